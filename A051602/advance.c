@@ -1,3 +1,5 @@
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,15 +10,50 @@
 #include "loc.h"
 #include "sym.h"
 #include "grid.h"
+#include "ckpt.h"
+#include "run.h"
 
 long clock_tick;
 
 typedef unsigned char uchar;
 
+/* Grid bitmaps saved in a collection are bump-allocated from chunks
+ * owned by the collection; clearing the collection rewinds its arena,
+ * keeping the chunks for reuse by the next generation.
+ */
+typedef struct arena_chunk_s {
+    struct arena_chunk_s *next;
+    size_t size;
+    size_t used;
+    uchar data[];
+} arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t *first;
+    arena_chunk_t *cur;
+    size_t total;       /* bytes in all chunks */
+    size_t live;        /* bytes allocated since the last reset */
+} arena_t;
+
+#define ARENA_MIN_CHUNK (1 << 16)
+#define ARENA_MAX_CHUNK (1 << 24)
+
+/* Each collection is indexed by a hash of the canonical form of each
+ * grid (the least of its 8 symmetric images), so that in_coll() need
+ * only compare against the grids with a matching hash.
+ */
 typedef struct {
     size_t size;
     size_t used;
     grid_t *arr;
+    uint64_t *hash;     /* canonical hash of each arr[] entry */
+    size_t hsize;       /* size of slot[], always 0 or a power of 2 */
+    size_t *slot;       /* open-addressing index: 1 + index into arr[] */
+    arena_t arena;      /* storage for the grid bitmaps */
+    int nruns;          /* number of run files spilled with -S */
+    char **runs;        /* paths of the run files */
+    size_t stored;      /* grids in the run files (before merging, may
+                         * include duplicates) */
 } collection_t;
 
 typedef struct {
@@ -36,27 +73,96 @@ int quiet = 0;      /* skip reporting for arrangements with < n points */
 int best;           /* Greatest number of squares seen in any arrangement */
 found_t found[3];  /* Best structures found */
 
-/* Reusable structure to hold symmetries for in_coll() */
-struct {
+/* Reusable structure to hold symmetries for in_coll(), one per thread */
+__thread struct {
     size_t size;
     uchar *grids;
 } in_coll_sym;
 
+/* A candidate structure found by a worker thread, with its canonical hash */
+typedef struct {
+    grid_t *g;
+    int squares;
+    uint64_t hash;
+} cand_t;
+
+typedef struct {
+    size_t size;
+    size_t used;
+    cand_t *arr;
+} candbuf_t;
+
+/* With -j N, the source grids of each collection are expanded by a pool
+ * of N threads in batches. While a batch runs the collections are
+ * read-only: each thread filters its candidates against found[2] and
+ * buffers the survivors per source grid. The main thread then merges
+ * the buffers in source order through save_found(), so the results
+ * (and output order) are the same as for a serial run.
+ */
+struct {
+    int nthreads;
+    pthread_t *tid;
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+    int quit;
+    int type;           /* 1 for try_all1(), 2 for try_all2() */
+    collection_t *cs;   /* source collection */
+    int ss;             /* squares in each source grid */
+    size_t base;        /* index of first source grid in this batch */
+    size_t end;         /* index after last source grid in this batch */
+    size_t next;        /* next source grid to claim */
+    size_t bsize;       /* number of buffers in buf[] */
+    candbuf_t *buf;     /* one buffer per source grid in the batch */
+} pool;
+
+/* The buffer to which this thread should send candidates, if any */
+__thread candbuf_t *candbuf = NULL;
+
 unsigned long visit = 0;        /* Count of iterations */
 
+char *ckpt_path = NULL; /* Write checkpoints here, if set */
+int ckpt_secs = 600;    /* Seconds between checkpoints */
+double time_base = 0;   /* CPU time used before resuming */
+int gen;                /* The generation being expanded */
+
+/* With -S dir, each generation is kept on disk as one sorted run file
+ * per collection, of the canonical forms of its grids. While a generation
+ * is being built, whenever its collections exceed the -M limit they are
+ * spilled to further runs and emptied; once it is complete the runs are
+ * merged, dropping duplicates. Expansion then streams source grids from
+ * the merged runs in blocks of SPILL_BLOCK.
+ */
+char *spill_dir = NULL;
+size_t spill_limit = (size_t)1024 << 20;
+unsigned int spill_seq = 0;     /* to name the run files */
+arena_t spill_arena;            /* canonical forms of a collection being spilled */
+
+#define SPILL_BLOCK 4096
+#define SPILL_FANIN 64          /* most runs merged in one pass */
+
 double timing(void) {
     struct tms ttd;
     times(&ttd);
-    return ((double)ttd.tms_utime) / clock_tick;
+    return ((double)ttd.tms_utime) / clock_tick + time_base;
+}
+
+/* Bytes of memory held by the collection */
+size_t coll_memory(collection_t *c) {
+    return c->arena.total + c->size * (sizeof(grid_t) + sizeof(uint64_t))
+            + c->hsize * sizeof(size_t);
 }
 
 /* Show a result-so-far, consisting of i points */
 void report(int i) {
     found_t *f = &found[2];
+    size_t mem = 0;
     printf("%d %d:", f->n, f->squares);
     for (int i = diff; i >= 0; --i)
-        printf(" %ld", f->coll[i].used);
-    printf(" [%.2fs]\n", timing());
+        printf(" %ld", f->coll[i].used + f->coll[i].stored);
+    for (int j = 0; j < 3; ++j)
+        for (int i = 0; i <= diff; ++i)
+            mem += coll_memory(&found[j].coll[i]);
+    printf(" (%lu) [%.2fs %.1fMB]\n", visit, timing(), mem / 1048576.0);
 }
 
 void report_grid(int points, int squares, grid_t *g) {
@@ -70,10 +176,72 @@ void report_grid(int points, int squares, grid_t *g) {
     printf("\n");
 }
 
+uchar *arena_alloc(arena_t *a, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    while (a->cur && a->cur->used + size > a->cur->size) {
+        if (!a->cur->next)
+            break;
+        a->cur = a->cur->next;
+    }
+    if (!a->cur || a->cur->used + size > a->cur->size) {
+        size_t csize = a->cur ? a->cur->size * 2 : ARENA_MIN_CHUNK;
+        if (csize > ARENA_MAX_CHUNK)
+            csize = ARENA_MAX_CHUNK;
+        if (csize < size)
+            csize = size;
+        arena_chunk_t *ac = (arena_chunk_t *)malloc(sizeof(arena_chunk_t) + csize);
+        ac->next = NULL;
+        ac->size = csize;
+        ac->used = 0;
+        if (a->cur)
+            a->cur->next = ac;
+        else
+            a->first = ac;
+        a->cur = ac;
+        a->total += csize;
+    }
+    uchar *p = &a->cur->data[a->cur->used];
+    a->cur->used += size;
+    a->live += size;
+    return p;
+}
+
+/* Release everything allocated from the arena, keeping the chunks */
+void arena_reset(arena_t *a) {
+    for (arena_chunk_t *ac = a->first; ac; ac = ac->next)
+        ac->used = 0;
+    a->cur = a->first;
+    a->live = 0;
+}
+
+void arena_free(arena_t *a) {
+    arena_chunk_t *ac = a->first;
+    while (ac) {
+        arena_chunk_t *next = ac->next;
+        free(ac);
+        ac = next;
+    }
+    *a = (arena_t){ NULL, NULL, 0, 0 };
+}
+
+void drop_runs(collection_t *c) {
+    for (int i = 0; i < c->nruns; ++i) {
+        unlink(c->runs[i]);
+        free(c->runs[i]);
+    }
+    free(c->runs);
+    c->runs = NULL;
+    c->nruns = 0;
+    c->stored = 0;
+}
+
 void clear_coll(collection_t *c) {
-    for (int i = 0; i < c->used; ++i)
-        free(c->arr[i].grid);
+    if (c->nruns)
+        drop_runs(c);
     c->used = 0;
+    arena_reset(&c->arena);
+    if (c->hsize)
+        memset(c->slot, 0, c->hsize * sizeof(size_t));
 }
 
 static inline uchar *sym_grid(int i) {
@@ -115,7 +283,10 @@ static inline void sym_trans(loc_t span, uchar *gs, uchar *gd) {
         }
 }
 
-int in_coll(collection_t *c, grid_t *g) {
+/* Fill in_coll_sym with the 8 symmetric images of g; images 0 .. 3
+ * have the span of g, and images 4 .. 7 the transposed span.
+ */
+void build_syms(grid_t *g) {
     grid_t gsym = (grid_t){ g->span, NULL };
     grid_t gtrans = (grid_t){ (loc_t){ gsym.span.y, gsym.span.x }, NULL };
     size_t ssym = grid_size(&gsym);
@@ -143,38 +314,267 @@ int in_coll(collection_t *c, grid_t *g) {
     sym_swap_y(gtrans.span, sym_grid(4), sym_grid(6));
     /* 7: x -> -y, y -> -x */
     sym_swap_x(gtrans.span, sym_grid(6), sym_grid(7));
+}
 
-    /* FIXME: use a hash */
-    for (int i = 0; i < c->used; ++i) {
-        grid_t *g2 = &c->arr[i];
-        if (loc_eq(g2->span, gsym.span))
-            for (int j = 0; j <= 3; ++j) {
-                gsym.grid = sym_grid(j);
-                if (same_grid(g2, &gsym))
-                    return 1;
-            }
-        if (loc_eq(g2->span, gtrans.span))
-            for (int j = 4; j <= 7; ++j) {
-                gtrans.grid = sym_grid(j);
-                if (same_grid(g2, &gtrans))
-                    return 1;
-            }
+/* Return the canonical form of g, the lexically least of its 8
+ * symmetric images (comparing span first). The bitmap is one of the
+ * images left in in_coll_sym for use by is_sym_of().
+ */
+grid_t canon_form(grid_t *g) {
+    loc_t tspan = (loc_t){ g->span.y, g->span.x };
+    grid_t gbest = (grid_t){ g->span, NULL };
+    int first = 0, last = 7;
+
+    build_syms(g);
+    if (loc_lt(tspan, g->span)) {
+        gbest.span = tspan;
+        first = 4;
+    } else if (loc_lt(g->span, tspan))
+        last = 3;
+
+    size_t size = grid_size(&gbest);
+    gbest.grid = sym_grid(first);
+    for (int j = first + 1; j <= last; ++j)
+        if (memcmp(sym_grid(j), gbest.grid, size) < 0)
+            gbest.grid = sym_grid(j);
+    return gbest;
+}
+
+/* Return a 64-bit hash of the canonical form of g */
+uint64_t canon_hash(grid_t *g) {
+    grid_t gbest = canon_form(g);
+    size_t size = grid_size(&gbest);
+
+    /* FNV-1a */
+    uint64_t h = 0xcbf29ce484222325ULL;
+    h = (h ^ (uint64_t)gbest.span.x) * 0x100000001b3ULL;
+    h = (h ^ (uint64_t)gbest.span.y) * 0x100000001b3ULL;
+    for (size_t i = 0; i < size; ++i)
+        h = (h ^ gbest.grid[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+/* Return TRUE if g2 is one of the symmetric images of g, which must
+ * be the last grid passed to build_syms().
+ */
+int is_sym_of(grid_t *g2, grid_t *g) {
+    grid_t gsym = (grid_t){ g->span, NULL };
+    grid_t gtrans = (grid_t){ (loc_t){ gsym.span.y, gsym.span.x }, NULL };
+
+    if (loc_eq(g2->span, gsym.span))
+        for (int j = 0; j <= 3; ++j) {
+            gsym.grid = sym_grid(j);
+            if (same_grid(g2, &gsym))
+                return 1;
+        }
+    if (loc_eq(g2->span, gtrans.span))
+        for (int j = 4; j <= 7; ++j) {
+            gtrans.grid = sym_grid(j);
+            if (same_grid(g2, &gtrans))
+                return 1;
+        }
+    return 0;
+}
+
+static inline size_t coll_slot(collection_t *c, uint64_t hash) {
+    return (size_t)(hash ^ (hash >> 32)) & (c->hsize - 1);
+}
+
+/* Return TRUE if a grid symmetric to g, with canonical hash 'hash',
+ * is already in the collection. If 'built' is FALSE, the symmetric
+ * images of g have not yet been built by this thread.
+ */
+int in_coll(collection_t *c, grid_t *g, uint64_t hash, int built) {
+    if (c->hsize == 0)
+        return 0;
+    for (size_t i = coll_slot(c, hash); c->slot[i]; i = (i + 1) & (c->hsize - 1)) {
+        size_t k = c->slot[i] - 1;
+        if (c->hash[k] != hash)
+            continue;
+        if (!built) {
+            build_syms(g);
+            built = 1;
+        }
+        if (is_sym_of(&c->arr[k], g))
+            return 1;
     }
     return 0;
 }
 
-int save_coll(collection_t *c, grid_t *g) {
-    if (in_coll(c, g))
+/* Add the index of arr[k] to the hash, growing it as needed */
+void index_coll(collection_t *c, size_t k) {
+    if ((k + 1) * 2 > c->hsize) {
+        size_t new_size = c->hsize ? c->hsize * 2 : 64;
+        c->slot = (size_t *)realloc(c->slot, new_size * sizeof(size_t));
+        c->hsize = new_size;
+        memset(c->slot, 0, new_size * sizeof(size_t));
+        for (size_t j = 0; j < k; ++j)
+            index_coll(c, j);
+    }
+    size_t i = coll_slot(c, c->hash[k]);
+    while (c->slot[i])
+        i = (i + 1) & (c->hsize - 1);
+    c->slot[i] = k + 1;
+}
+
+/* Save g in the collection unless already present; hash is its
+ * canonical hash if known, else NULL.
+ */
+void add_coll(collection_t *c, grid_t *g, uint64_t hash);
+
+int save_coll(collection_t *c, grid_t *g, uint64_t *hash_p) {
+    uint64_t hash = hash_p ? *hash_p : canon_hash(g);
+    if (in_coll(c, g, hash, hash_p ? 0 : 1))
         return 0;
+    add_coll(c, g, hash);
+    return 1;
+}
+
+/* Append a copy of the bitmap to the collection, without indexing it */
+void push_coll(collection_t *c, loc_t span, uchar *bitmap, size_t size) {
     if (c->used >= c->size) {
         size_t new_size = c->size ? c->size * 3 / 2 : 20;
         c->arr = (grid_t *)realloc(c->arr, new_size * sizeof(grid_t));
         memset(&c->arr[c->size], 0, new_size - c->size);
+        c->hash = (uint64_t *)realloc(c->hash, new_size * sizeof(uint64_t));
         c->size = new_size;
     }
-    c->arr[c->used++] = *g;
-    free(g);
-    return 1;
+    uchar *grid = arena_alloc(&c->arena, size);
+    memcpy(grid, bitmap, size);
+    c->arr[c->used++] = (grid_t){ span, grid };
+}
+
+/* Append a copy of g to the collection, and free g */
+void add_coll(collection_t *c, grid_t *g, uint64_t hash) {
+    push_coll(c, g->span, g->grid, grid_size(g));
+    c->hash[c->used - 1] = hash;
+    index_coll(c, c->used - 1);
+    free_grid(g);
+}
+
+/* Add a new run file to the collection, returning its path */
+char *new_run_path(collection_t *c) {
+    char *path = (char *)malloc(strlen(spill_dir) + 16);
+    sprintf(path, "%s/run%u", spill_dir, ++spill_seq);
+    c->runs = (char **)realloc(c->runs, (c->nruns + 1) * sizeof(char *));
+    c->runs[c->nruns++] = path;
+    return path;
+}
+
+/* Order grids by span, then bitmap */
+int grid_cmp(loc_t s1, uchar *g1, loc_t s2, uchar *g2, size_t size) {
+    if (s1.x != s2.x)
+        return (s1.x < s2.x) ? -1 : 1;
+    if (s1.y != s2.y)
+        return (s1.y < s2.y) ? -1 : 1;
+    return memcmp(g1, g2, size);
+}
+
+int canon_cmp(const void *a, const void *b) {
+    grid_t *g1 = (grid_t *)a;
+    grid_t *g2 = (grid_t *)b;
+    return grid_cmp(g1->span, g1->grid, g2->span, g2->grid, grid_size(g1));
+}
+
+/* Write the in-memory grids of the collection to a new sorted run of
+ * canonical forms, and empty it.
+ */
+void spill_coll(collection_t *c) {
+    if (c->used == 0)
+        return;
+
+    grid_t *canon = (grid_t *)malloc(c->used * sizeof(grid_t));
+    for (size_t k = 0; k < c->used; ++k) {
+        grid_t gc = canon_form(&c->arr[k]);
+        size_t size = grid_size(&gc);
+        canon[k].span = gc.span;
+        canon[k].grid = arena_alloc(&spill_arena, size);
+        memcpy(canon[k].grid, gc.grid, size);
+    }
+    qsort(canon, c->used, sizeof(grid_t), canon_cmp);
+
+    run_t *r = run_create(new_run_path(c));
+    for (size_t k = 0; k < c->used; ++k)
+        run_put(r, canon[k].span, canon[k].grid, grid_size(&canon[k]));
+    run_finish(r);
+    free(canon);
+    arena_reset(&spill_arena);
+
+    c->stored += c->used;
+    c->used = 0;
+    arena_reset(&c->arena);
+    if (c->hsize)
+        memset(c->slot, 0, c->hsize * sizeof(size_t));
+}
+
+/* Merge runs [first, first + count) of the collection into a new run,
+ * dropping duplicates, and remove them. Returns the number of grids
+ * in the new run.
+ */
+size_t merge_runs(collection_t *c, int first, int count) {
+    run_t *in[count];
+    uchar *cur[count];
+    loc_t span[count];
+    size_t size[count];
+    char *paths[count];
+    size_t merged = 0;
+
+    for (int i = 0; i < count; ++i) {
+        paths[i] = c->runs[first + i];
+        in[i] = run_open(paths[i]);
+        cur[i] = run_get(in[i], &span[i], &size[i]);
+    }
+    memmove(&c->runs[first], &c->runs[first + count],
+            (c->nruns - first - count) * sizeof(char *));
+    c->nruns -= count;
+
+    run_t *out = run_create(new_run_path(c));
+    while (1) {
+        int best = -1;
+        for (int i = 0; i < count; ++i)
+            if (cur[i] && (best < 0 || grid_cmp(span[i], cur[i],
+                    span[best], cur[best], size[i]) < 0))
+                best = i;
+        if (best < 0)
+            break;
+        if (out->count == 0 || grid_cmp(span[best], cur[best],
+                out->span, out->buf, size[best]) != 0) {
+            run_put(out, span[best], cur[best], size[best]);
+            ++merged;
+        }
+        cur[best] = run_get(in[best], &span[best], &size[best]);
+    }
+    run_finish(out);
+
+    for (int i = 0; i < count; ++i) {
+        run_close(in[i]);
+        unlink(paths[i]);
+        free(paths[i]);
+    }
+    return merged;
+}
+
+/* Spill what remains of the collection, and merge its runs into one */
+void merge_coll(collection_t *c) {
+    spill_coll(c);
+    while (c->nruns > 1) {
+        int count = (c->nruns < SPILL_FANIN) ? c->nruns : SPILL_FANIN;
+        size_t merged = merge_runs(c, 0, count);
+        if (c->nruns == 1)
+            c->stored = merged;
+    }
+}
+
+/* Spill the generation being built if it has outgrown the memory limit */
+void check_spill(found_t *f) {
+    size_t mem = 0;
+    for (int i = 0; i <= diff; ++i) {
+        collection_t *c = &f->coll[i];
+        mem += c->arena.live + c->used * (sizeof(grid_t) + sizeof(uint64_t));
+    }
+    if (mem > spill_limit)
+        for (int i = 0; i <= diff; ++i)
+            spill_coll(&f->coll[i]);
 }
 
 void rotate_found(void) {
@@ -207,7 +607,7 @@ void advance_found(int squares) {
     f->squares = squares;
 }
 
-int save_found(grid_t *g, int squares) {
+int save_found(grid_t *g, int squares, uint64_t *hash) {
     found_t *f = &found[2];
     if (squares < f->squares - diff)
         return 0;
@@ -215,13 +615,15 @@ int save_found(grid_t *g, int squares) {
         advance_found(squares);
 
     collection_t *c = &f->coll[squares - (f->squares - diff)];
-    if (save_coll(c, g)) {
+    if (save_coll(c, g, hash)) {
         /* g has been freed */
-        if (verbose && (verbose > 1 || c->used == 1)
+        if (verbose && (verbose > 1 || (c->used == 1 && c->nruns == 0))
             && (!quiet || f->n == n)
         )
             report_grid(f->n, squares, &c->arr[c->used - 1]);
         ++visit;
+        if (spill_dir)
+            check_spill(f);
         return 1;
     } else
         return 0;
@@ -243,26 +645,66 @@ void init(void) {
         found[i].squares = (i == 2) ? 1 : 0;
         found[i].coll = (collection_t *)calloc(diff + 1, sizeof(collection_t));
     }
+}
+
+/* Start a fresh run with the unit square */
+void seed(void) {
     grid_t *g0 = new_grid((loc_t){ 2, 2 });
     set_grid(g0, (loc_t){ 0, 0 });
     set_grid(g0, (loc_t){ 0, 1 });
     set_grid(g0, (loc_t){ 1, 0 });
     set_grid(g0, (loc_t){ 1, 1 });
-    save_found(g0, 1);
+    save_found(g0, 1, NULL);
 }
 
 void finish(void) {
     for (int i = 0; i < 3; ++i) {
         collection_t *c = found[i].coll;
         for (int j = 0; j <= diff; ++j) {
-            clear_coll(&c[j]);
+            if (c[j].nruns)
+                drop_runs(&c[j]);
+            arena_free(&c[j].arena);
             free(c[j].arr);
+            free(c[j].hash);
+            free(c[j].slot);
         }
         free(c);
     }
+    arena_free(&spill_arena);
     free(in_coll_sym.grids);
 }
 
+/* Offer a new structure for saving, either directly or, in a worker
+ * thread, via the current candidate buffer. In the latter case we
+ * can already discard anything that save_found() would reject.
+ */
+void offer(grid_t *g, int squares) {
+    if (!candbuf) {
+        if (!save_found(g, squares, NULL))
+            free_grid(g);
+        return;
+    }
+
+    found_t *f = &found[2];
+    if (squares < f->squares - diff) {
+        free_grid(g);
+        return;
+    }
+    uint64_t hash = canon_hash(g);
+    if (squares <= f->squares
+        && in_coll(&f->coll[squares - (f->squares - diff)], g, hash, 1)
+    ) {
+        free_grid(g);
+        return;
+    }
+    if (candbuf->used >= candbuf->size) {
+        size_t new_size = candbuf->size ? candbuf->size * 3 / 2 : 20;
+        candbuf->arr = (cand_t *)realloc(candbuf->arr, new_size * sizeof(cand_t));
+        candbuf->size = new_size;
+    }
+    candbuf->arr[candbuf->used++] = (cand_t){ g, squares, hash };
+}
+
 int find_squares(grid_t *g, loc_t p0) {
     int squares = 0;
     loc_t p1, p2, p3;
@@ -287,7 +729,83 @@ int find_squares(grid_t *g, loc_t p0) {
     return squares;
 }
 
-void try1(grid_t *gs, loc_t p, int ss) {
+/* Count the squares that would be formed by adding p0 to the grid, as
+ * find_squares(), using the line view of the grid. Each such square has
+ * exactly one side vector (a, b) with a > 0, b >= 0, and p0 is one of
+ * its 4 corners; for each a and each choice of corner, the other 3
+ * corners for all b at once are 3 words extracted from the line view.
+ */
+int find_squares_lines(gridlines_t *gl, loc_t span, loc_t p0) {
+    int x = p0.x, y = p0.y, squares = 0;
+    int amax = (span.x > span.y) ? span.x : span.y;
+#define COL(i, s) gridline_bits(gl->col, GRIDLINES_MAX, (i), (s))
+#define RCOL(i, s) gridline_bits(gl->rcol, GRIDLINES_MAX, (i), (s))
+#define ROW(i, s) gridline_bits(gl->row, GRIDLINES_MAX, (i), (s))
+#define RROW(i, s) gridline_bits(gl->rrow, GRIDLINES_MAX, (i), (s))
+#define DIAG(i, s) gridline_bits(gl->diag, GRIDLINES_DIAG, (i) + GRIDLINES_MAX - 1, (s))
+#define RDIAG(i, s) gridline_bits(gl->rdiag, GRIDLINES_DIAG, (i) + GRIDLINES_MAX - 1, (s))
+#define ANTI(i, s) gridline_bits(gl->anti, GRIDLINES_DIAG, (i), (s))
+#define RANTI(i, s) gridline_bits(gl->ranti, GRIDLINES_DIAG, (i), (s))
+
+    for (int a = 1; a <= amax; ++a) {
+        /* p0 + (a, b), p0 + (a - b, a + b), p0 + (-b, a) */
+        squares += __builtin_popcountll(COL(x + a, y)
+                & RANTI(x + y + 2 * a, 63 - x - a) & RROW(y + a, 63 - x));
+        /* p0 - (a, b), p0 + (-b, a), p0 + (-a - b, a - b) */
+        squares += __builtin_popcountll(RCOL(x - a, 63 - y)
+                & RROW(y + a, 63 - x) & RDIAG(x - y - 2 * a, 63 - x + a));
+        /* p0 + (b - a, -a - b), p0 + (b, -a), p0 - (a, b) */
+        squares += __builtin_popcountll(ANTI(x + y - 2 * a, x - a)
+                & ROW(y - a, x) & RCOL(x - a, 63 - y));
+        /* p0 + (b, -a), p0 + (a + b, b - a), p0 + (a, b) */
+        squares += __builtin_popcountll(ROW(y - a, x)
+                & DIAG(x - y + 2 * a, x + a) & COL(x + a, y));
+    }
+#undef COL
+#undef RCOL
+#undef ROW
+#undef RROW
+#undef DIAG
+#undef RDIAG
+#undef ANTI
+#undef RANTI
+    return squares;
+}
+
+/* Count the squares that would be formed by adding p0 to the grid;
+ * gl is the line view of the grid, or NULL if it is too big for one.
+ */
+static inline int count_squares(grid_t *g, gridlines_t *gl, loc_t p0) {
+    if (gl) {
+        assert(find_squares_lines(gl, g->span, p0) == find_squares(g, p0));
+        return find_squares_lines(gl, g->span, p0);
+    }
+    return find_squares(g, p0);
+}
+
+/* Count the squares having both p and q as corners, with the other two
+ * corners in the grid.
+ */
+int find_squares_pair(grid_t *g, loc_t p, loc_t q) {
+    loc_t d = loc_diff(p, q);
+    loc_t r = (loc_t){ -d.y, d.x };
+    int squares = 0;
+
+    /* p-q as an edge, in either direction */
+    if (is_grid(g, loc_sum(p, r)) && is_grid(g, loc_sum(q, r)))
+        ++squares;
+    if (is_grid(g, loc_diff(r, p)) && is_grid(g, loc_diff(r, q)))
+        ++squares;
+    /* p-q as a diagonal */
+    if (((d.x + d.y) & 1) == 0
+        && is_grid(g, loc_diag1(p, q)) && is_grid(g, loc_diag2(p, q))
+    )
+        ++squares;
+    return squares;
+}
+
+void try1(grid_t *gs, gridlines_t *gl, loc_t p, int ss) {
+    int snew = ss + count_squares(gs, gl, p);
     loc_t off = { p.x < 0 ? -p.x : 0, p.y < 0 ? -p.y : 0 };
     loc_t span = {
         off.x ? gs->span.x + off.x : (p.x >= gs->span.x) ? p.x + 1 : gs->span.x,
@@ -302,14 +820,14 @@ void try1(grid_t *gs, loc_t p, int ss) {
                 set_grid(gd, loc_sum(q, off));
 
     p = loc_sum(p, off);
-
-    int snew = ss + find_squares(gd, p);
     set_grid(gd, p);
-    if (!save_found(gd, snew))
-        free_grid(gd);
+    offer(gd, snew);
 }
 
-void try2(grid_t *gs, loc_t p, loc_t q, int ss) {
+void try2(grid_t *gs, gridlines_t *gl, loc_t p, loc_t q, int ss) {
+    int snew = ss + count_squares(gs, gl, p) + count_squares(gs, gl, q)
+            + find_squares_pair(gs, p, q);
+
     loc_t off = { 0, 0 };
     if (p.x < -off.x) off.x = -p.x;
     if (q.x < -off.x) off.x = -q.x;
@@ -331,18 +849,20 @@ void try2(grid_t *gs, loc_t p, loc_t q, int ss) {
                 set_grid(gd, loc_sum(r, off));
     p = loc_sum(p, off);
     q = loc_sum(q, off);
-
-    int snew = ss + find_squares(gd, p);
     set_grid(gd, p);
-    snew += find_squares(gd, q);
     set_grid(gd, q);
-    if (!save_found(gd, snew))
-        free_grid(gd);
+    offer(gd, snew);
 }
 
 void try_all1(grid_t *g, int ss) {
     loc_t p0, p1, p2, p3;
     int b2, b3;
+    gridlines_t lines, *gl = NULL;
+
+    if (gridlines_ok(g)) {
+        build_gridlines(g, &lines);
+        gl = &lines;
+    }
 
     for (p0.x = 0; p0.x < g->span.x; ++p0.x) {
         for (p0.y = 0; p0.y < g->span.y; ++p0.y) {
@@ -358,18 +878,18 @@ void try_all1(grid_t *g, int ss) {
                     p3 = loc_rot270(p1, loc_diff(p0, p1));
                     b3 = is_grid(g, p3);
                     if (b2 && !b3) {
-                        try1(g, p3, ss);
+                        try1(g, gl, p3, ss);
                     } else if (b3 && !b2) {
-                        try1(g, p2, ss);
+                        try1(g, gl, p2, ss);
                     }
                     p2 = loc_rot270(p0, loc_diff(p1, p0));
                     b2 = is_grid(g, p2);
                     p3 = loc_rot90(p1, loc_diff(p0, p1));
                     b3 = is_grid(g, p3);
                     if (b2 && !b3) {
-                        try1(g, p3, ss);
+                        try1(g, gl, p3, ss);
                     } else if (b3 && !b2) {
-                        try1(g, p2, ss);
+                        try1(g, gl, p2, ss);
                     }
                 }
             }
@@ -383,6 +903,13 @@ void try_all2(grid_t *g, int ss) {
     grid_t *dg = expand_grid(g, &doffset);
     loc_t dp0, dp1, dp2, dp3;
     int par0;
+    gridlines_t lines, dlines, *gl = NULL, *dgl = NULL;
+    int dgl_built = 0;
+
+    if (gridlines_ok(g)) {
+        build_gridlines(g, &lines);
+        gl = &lines;
+    }
 
     for (p0.x = 0; p0.x < g->span.x; ++p0.x) {
         for (p0.y = 0; p0.y < g->span.y; ++p0.y) {
@@ -399,25 +926,31 @@ void try_all2(grid_t *g, int ss) {
                     p2 = loc_rot90(p0, loc_diff(p1, p0));
                     p3 = loc_rot270(p1, loc_diff(p0, p1));
                     if (!is_grid(g, p2) && !is_grid(g, p3))
-                        try2(g, p2, p3, ss);
+                        try2(g, gl, p2, p3, ss);
 
                     p2 = loc_rot270(p0, loc_diff(p1, p0));
                     p3 = loc_rot90(p1, loc_diff(p0, p1));
                     if (!is_grid(g, p2) && !is_grid(g, p3))
-                        try2(g, p2, p3, ss);
+                        try2(g, gl, p2, p3, ss);
 
                     /* use doubled points only if needed */
                     if (loc_parity(p1) == par0) {
                         p2 = loc_diag1(p0, p1);
                         p3 = loc_diag2(p0, p1);
                         if (!is_grid(g, p2) && !is_grid(g, p3))
-                            try2(g, p2, p3, ss);
+                            try2(g, gl, p2, p3, ss);
                     } else {
                         dp1 = loc_sum(doffset, loc_expand(p1));
                         dp2 = loc_diag1(dp0, dp1);
                         dp3 = loc_diag2(dp0, dp1);
-                        if (!is_grid(dg, dp2) && !is_grid(dg, dp3))
-                            try2(dg, dp2, dp3, ss);
+                        if (!is_grid(dg, dp2) && !is_grid(dg, dp3)) {
+                            if (!dgl_built && gridlines_ok(dg)) {
+                                build_gridlines(dg, &dlines);
+                                dgl = &dlines;
+                            }
+                            dgl_built = 1;
+                            try2(dg, dgl, dp2, dp3, ss);
+                        }
                     }
                 }
             }
@@ -426,38 +959,267 @@ void try_all2(grid_t *g, int ss) {
     free_grid(dg);
 }
 
-void try_coll1(int j) {
+/* Expand source grids from the current batch until none are left */
+void run_batch(void) {
+    while (1) {
+        size_t k = __atomic_fetch_add(&pool.next, 1, __ATOMIC_RELAXED);
+        if (k >= pool.end)
+            break;
+        candbuf = &pool.buf[k - pool.base];
+        candbuf->used = 0;
+        if (pool.type == 1)
+            try_all1(&pool.cs->arr[k], pool.ss);
+        else
+            try_all2(&pool.cs->arr[k], pool.ss);
+    }
+    candbuf = NULL;
+}
+
+void *worker(void *arg) {
+    while (1) {
+        pthread_barrier_wait(&pool.start);
+        if (pool.quit)
+            break;
+        run_batch();
+        pthread_barrier_wait(&pool.done);
+    }
+    free(in_coll_sym.grids);
+    return NULL;
+}
+
+void init_pool(void) {
+    pool.quit = 0;
+    pool.bsize = 64 * pool.nthreads;
+    pool.buf = (candbuf_t *)calloc(pool.bsize, sizeof(candbuf_t));
+    pool.tid = (pthread_t *)malloc(pool.nthreads * sizeof(pthread_t));
+    pthread_barrier_init(&pool.start, NULL, pool.nthreads);
+    pthread_barrier_init(&pool.done, NULL, pool.nthreads);
+    /* the main thread acts as worker 0 */
+    for (int i = 1; i < pool.nthreads; ++i)
+        if (pthread_create(&pool.tid[i], NULL, worker, NULL)) {
+            fprintf(stderr, "Failed to create thread %d\n", i);
+            exit(1);
+        }
+}
+
+void finish_pool(void) {
+    pool.quit = 1;
+    pthread_barrier_wait(&pool.start);
+    for (int i = 1; i < pool.nthreads; ++i)
+        pthread_join(pool.tid[i], NULL);
+    pthread_barrier_destroy(&pool.start);
+    pthread_barrier_destroy(&pool.done);
+    for (size_t i = 0; i < pool.bsize; ++i)
+        free(pool.buf[i].arr);
+    free(pool.buf);
+    free(pool.tid);
+}
+
+/* Write the state of the run to the checkpoint file: we are about to
+ * expand source grid k of collection j of the given type (1 or 2)
+ * while generating generation 'gen' + 1.
+ */
+void save_checkpoint(int j, int type, size_t k) {
+    ckpt_t *c;
+    double t = timing();
+
+    fflush(stdout);
+    c = ckpt_create(ckpt_path, "A051602 advance 1");
+    ckpt_write(c, &diff, sizeof(diff));
+    ckpt_write(c, &gen, sizeof(gen));
+    ckpt_write(c, &j, sizeof(j));
+    ckpt_write(c, &type, sizeof(type));
+    ckpt_write(c, &k, sizeof(k));
+    ckpt_write(c, &visit, sizeof(visit));
+    ckpt_write(c, &t, sizeof(t));
+    for (int i = 0; i < 3; ++i) {
+        found_t *f = &found[i];
+        ckpt_write(c, &f->n, sizeof(f->n));
+        ckpt_write(c, &f->squares, sizeof(f->squares));
+        for (int ci = 0; ci <= diff; ++ci) {
+            collection_t *cc = &f->coll[ci];
+            ckpt_write(c, &cc->used, sizeof(cc->used));
+            for (size_t gi = 0; gi < cc->used; ++gi) {
+                grid_t *g = &cc->arr[gi];
+                ckpt_write(c, &g->span, sizeof(g->span));
+                ckpt_write(c, g->grid, grid_size(g));
+            }
+        }
+    }
+    ckpt_commit(c);
+    ckpt_due = 0;
+}
+
+/* Expand all grids of the collection in parallel, merging in order */
+void try_coll_pool(int type, int j, collection_t *cs, int ss, size_t k0) {
+    pool.type = type;
+    pool.cs = cs;
+    pool.ss = ss;
+    for (size_t base = k0; base < cs->used; base += pool.bsize) {
+        if (ckpt_due)
+            save_checkpoint(j, type, base);
+        pool.base = base;
+        pool.next = base;
+        pool.end = (base + pool.bsize < cs->used) ? base + pool.bsize : cs->used;
+        pthread_barrier_wait(&pool.start);
+        run_batch();
+        pthread_barrier_wait(&pool.done);
+
+        for (size_t k = 0; k < pool.end - base; ++k) {
+            candbuf_t *cb = &pool.buf[k];
+            for (size_t i = 0; i < cb->used; ++i) {
+                cand_t *cd = &cb->arr[i];
+                if (!save_found(cd->g, cd->squares, &cd->hash))
+                    free_grid(cd->g);
+            }
+        }
+    }
+}
+
+/* Expand all grids of the collection's run, a block at a time */
+void try_coll_run(int type, int j, collection_t *cs, int ss) {
+    run_t *r = run_open(cs->runs[0]);
+    collection_t src;
+    loc_t span;
+    size_t size;
+    uchar *grid;
+
+    memset(&src, 0, sizeof(src));
+    do {
+        src.used = 0;
+        arena_reset(&src.arena);
+        while (src.used < SPILL_BLOCK && (grid = run_get(r, &span, &size)))
+            push_coll(&src, span, grid, size);
+        if (pool.nthreads > 1)
+            try_coll_pool(type, j, &src, ss, 0);
+        else
+            for (size_t k = 0; k < src.used; ++k) {
+                if (type == 1)
+                    try_all1(&src.arr[k], ss);
+                else
+                    try_all2(&src.arr[k], ss);
+            }
+    } while (src.used == SPILL_BLOCK);
+    run_close(r);
+    arena_free(&src.arena);
+    free(src.arr);
+    free(src.hash);
+}
+
+void try_coll1(int j, size_t k0) {
     found_t *fs = &found[1];
     collection_t *cs = &fs->coll[diff - j];
     int ss = fs->squares - j;
 
-    for (int k = 0; k < cs->used; ++k)
+    if (cs->nruns) {
+        try_coll_run(1, j, cs, ss);
+        return;
+    }
+    if (pool.nthreads > 1) {
+        try_coll_pool(1, j, cs, ss, k0);
+        return;
+    }
+    for (size_t k = k0; k < cs->used; ++k) {
+        if (ckpt_due)
+            save_checkpoint(j, 1, k);
         try_all1(&cs->arr[k], ss);
+    }
 }
 
-void try_coll2(int j) {
+void try_coll2(int j, size_t k0) {
     found_t *fs = &found[0];
     collection_t *cs = &fs->coll[diff - j];
     int ss = fs->squares - j;
 
-    for (int k = 0; k < cs->used; ++k)
+    if (cs->nruns) {
+        try_coll_run(2, j, cs, ss);
+        return;
+    }
+    if (pool.nthreads > 1) {
+        try_coll_pool(2, j, cs, ss, k0);
+        return;
+    }
+    for (size_t k = k0; k < cs->used; ++k) {
+        if (ckpt_due)
+            save_checkpoint(j, 2, k);
         try_all2(&cs->arr[k], ss);
+    }
+}
+
+/* Expand the previous generations into generation i, starting from
+ * source grid k of collection j of the given type (1 or 2).
+ */
+void expand(int i, int j0, int type0, size_t k0) {
+    gen = i;
+    for (int j = j0; j <= diff; ++j) {
+        if (j > j0 || type0 == 1)
+            try_coll1(j, (j == j0) ? k0 : 0);
+        try_coll2(j, (j == j0 && type0 == 2) ? k0 : 0);
+    }
 }
 
 /* Report current state and advance to next state. */
 void advance(int i) {
+    if (spill_dir)
+        for (int j = 0; j <= diff; ++j)
+            merge_coll(&found[2].coll[j]);
     report(i);
     if (i < n) {
         rotate_found();
-        for (int j = 0; j <= diff; ++j) {
-            try_coll1(j);
-            try_coll2(j);
+        expand(i, 0, 1, 0);
+    }
+}
+
+/* Restore the state written by save_checkpoint(), after init(), and
+ * continue the run from there.
+ */
+void resume_run(char *path) {
+    ckpt_t *c = ckpt_open(path, "A051602 advance 1");
+    int cdiff, j, type;
+    size_t k;
+
+    ckpt_read(c, &cdiff, sizeof(cdiff));
+    if (cdiff != diff) {
+        fprintf(stderr, "Checkpoint '%s' is for diff=%d\n", path, cdiff);
+        exit(1);
+    }
+    ckpt_read(c, &gen, sizeof(gen));
+    if (gen >= n) {
+        fprintf(stderr, "Checkpoint '%s' is for n > %d\n", path, gen);
+        exit(1);
+    }
+    ckpt_read(c, &j, sizeof(j));
+    ckpt_read(c, &type, sizeof(type));
+    ckpt_read(c, &k, sizeof(k));
+    ckpt_read(c, &visit, sizeof(visit));
+    ckpt_read(c, &time_base, sizeof(time_base));
+    for (int i = 0; i < 3; ++i) {
+        found_t *f = &found[i];
+        ckpt_read(c, &f->n, sizeof(f->n));
+        ckpt_read(c, &f->squares, sizeof(f->squares));
+        for (int ci = 0; ci <= diff; ++ci) {
+            collection_t *cc = &f->coll[ci];
+            size_t used;
+            ckpt_read(c, &used, sizeof(used));
+            for (size_t gi = 0; gi < used; ++gi) {
+                loc_t span;
+                ckpt_read(c, &span, sizeof(span));
+                grid_t *g = new_grid(span);
+                ckpt_read(c, g->grid, grid_size(g));
+                add_coll(cc, g, canon_hash(g));
+            }
         }
     }
+    ckpt_close(c);
+
+    expand(gen, j, type, k);
+    for (int i = gen + 1; i <= n; ++i)
+        advance(i);
 }
 
 int main(int argc, char** argv) {
     int arg = 1;
+    char *resume_path = NULL;
 
     while (arg < argc && argv[arg][0] == '-') {
         char *s = argv[arg++];
@@ -469,13 +1231,31 @@ int main(int argc, char** argv) {
             verbose = 2;
         else if (strcmp("-q", s) == 0)
             quiet = 1;
+        else if (strcmp("-j", s) == 0)
+            pool.nthreads = atoi(argv[arg++]);
+        else if (strcmp("-C", s) == 0)
+            ckpt_path = argv[arg++];
+        else if (strcmp("-c", s) == 0)
+            ckpt_secs = atoi(argv[arg++]);
+        else if (strcmp("-R", s) == 0)
+            resume_path = argv[arg++];
+        else if (strcmp("-S", s) == 0)
+            spill_dir = argv[arg++];
+        else if (strcmp("-M", s) == 0)
+            spill_limit = (size_t)(atof(argv[arg++]) * 1048576);
         else {
             fprintf(stderr, "Unknown option '%s'\n", s);
             exit(1);
         }
     }
     if (arg + 2 != argc) {
-        fprintf(stderr, "Usage: try [-v | -m] [-q] <n> <diff>\n");
+        fprintf(stderr, "Usage: try [-v | -m] [-q] [-j threads]"
+                " [-C ckpt [-c secs]] [-R ckpt] [-S dir [-M mb]]"
+                " <n> <diff>\n");
+        return 1;
+    }
+    if (spill_dir && (ckpt_path || resume_path)) {
+        fprintf(stderr, "Cannot checkpoint with -S\n");
         return 1;
     }
 
@@ -491,10 +1271,21 @@ int main(int argc, char** argv) {
     }
 
     init();
-    for (int i = 4; i <= n; ++i) {
-        advance(i);
+    if (pool.nthreads > 1)
+        init_pool();
+    if (ckpt_path)
+        ckpt_timer(ckpt_secs);
+    if (resume_path)
+        resume_run(resume_path);
+    else {
+        seed();
+        for (int i = 4; i <= n; ++i) {
+            advance(i);
+        }
     }
 
+    if (pool.nthreads > 1)
+        finish_pool();
     finish();
     return 0;
 }
@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Run recurse and advance over a fixed set of cases, check the maximum
+ * square counts they report against the known values of A051602, and
+ * write the timings as tab-separated lines to the given file, one per
+ * case and n:
+ *   prog n args expect got result visits wall visits/sec maxrss_kb
+ * Exits non-zero if any result differs from the table.
+ */
+
+/* A051602(n) for n = 0 .. 40 */
+int known[] = {
+    0, 0, 0, 0, 1, 1, 2, 3, 4, 6, 7, 8, 11, 13, 15, 17, 20, 22, 25, 28,
+    32, 37, 40, 43, 47, 51, 56, 60, 65, 70, 75, 81, 88, 92, 97, 103, 109,
+    117, 123, 130, 137
+};
+#define KNOWN_MAX ((int)(sizeof(known) / sizeof(known[0])) - 1)
+
+/* recurse is run once per n; advance once, reporting every n up to its
+ * last argument. The visit caps are comfortably above the visit at which
+ * each best result is currently first found.
+ */
+typedef struct {
+    char *prog;
+    char *args[6];
+} bench_t;
+
+bench_t cases[] = {
+    { "recurse", { "-i", "1000000", "9" } },
+    { "recurse", { "-i", "1000000", "10" } },
+    { "recurse", { "-i", "1000000", "11" } },
+    { "recurse", { "-i", "1000000", "12" } },
+    { "recurse", { "-i", "1000000", "13" } },
+    { "recurse", { "-i", "1000000", "14" } },
+    { "recurse", { "-i", "1000000", "16" } },
+    { "recurse", { "-i", "1000000", "20" } },
+    { "advance", { "40", "3" } },
+};
+#define NCASES (sizeof(cases) / sizeof(cases[0]))
+
+FILE *out;
+int failed = 0;
+
+double wall(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* A result line: n and squares found, and visits so far */
+typedef struct {
+    int n;
+    int squares;
+    unsigned long visits;
+} result_t;
+
+/* Parse a summary line, as written by recurse (at the end of the run)
+ * or advance (for each n):
+ *   recurse: "<n> <squares> ... (<visits>) <time>s"
+ *   advance: "<n> <squares>: <counts> (<visits>) [...]"
+ */
+int parse_line(char *line, result_t *r) {
+    char *p = strrchr(line, '(');
+    if (!p || line[0] == '(')
+        return 0;
+    if (sscanf(line, "%d %d", &r->n, &r->squares) != 2)
+        return 0;
+    r->visits = strtoul(p + 1, NULL, 10);
+    return 1;
+}
+
+void emit(bench_t *b, char *args, result_t *r, double secs, long rss) {
+    int expect = (r->n <= KNOWN_MAX) ? known[r->n] : -1;
+    char *result = (expect < 0) ? "unknown"
+            : (r->squares == expect) ? "ok" : "FAIL";
+
+    if (expect >= 0 && r->squares != expect)
+        failed = 1;
+    fprintf(out, "%s\t%d\t%s\t%d\t%d\t%s\t%lu\t%.3f\t%.0f\t%ld\n",
+            b->prog, r->n, args, expect, r->squares, result, r->visits,
+            secs, secs > 0 ? r->visits / secs : 0, rss);
+    printf("%s %d: %d %s\n", b->prog, r->n, r->squares, result);
+}
+
+void run(bench_t *b) {
+    char *argv[8], args[64] = "", line[4096];
+    int fd[2], argc = 0, status;
+    struct rusage ru;
+    result_t r, last;
+    int is_recurse = strcmp(b->prog, "recurse") == 0;
+    int seen = 0;
+
+    argv[argc++] = b->prog;
+    for (int i = 0; b->args[i]; ++i) {
+        argv[argc++] = b->args[i];
+        if (i)
+            strcat(args, " ");
+        strcat(args, b->args[i]);
+    }
+    argv[argc] = NULL;
+
+    if (pipe(fd)) {
+        perror("pipe");
+        exit(1);
+    }
+    double t0 = wall();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        char path[64];
+        dup2(fd[1], 1);
+        close(fd[0]);
+        close(fd[1]);
+        sprintf(path, "./%s", b->prog);
+        execv(path, argv);
+        perror(path);
+        _exit(1);
+    }
+    close(fd[1]);
+
+    /* The visits and times of advance are cumulative, so we report the
+     * time at which each line is seen; rss is only known at the end.
+     */
+    FILE *fh = fdopen(fd[0], "r");
+    while (fgets(line, sizeof(line), fh)) {
+        if (!parse_line(line, &r))
+            continue;
+        if (seen && !is_recurse)
+            emit(b, args, &last, wall() - t0, 0);
+        last = r;
+        seen = 1;
+    }
+    fclose(fh);
+    if (wait4(pid, &status, 0, &ru) < 0) {
+        perror("wait4");
+        exit(1);
+    }
+    double secs = wall() - t0;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !seen) {
+        fprintf(stderr, "%s %s failed\n", b->prog, args);
+        exit(1);
+    }
+    emit(b, args, &last, secs, ru.ru_maxrss);
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: bench <output.tsv>\n");
+        return 1;
+    }
+    out = fopen(argv[1], "w");
+    if (!out) {
+        perror(argv[1]);
+        return 1;
+    }
+    setvbuf(stdout, (char*)NULL, _IONBF, 0);
+    fprintf(out, "prog\tn\targs\texpect\tgot\tresult\tvisits\twall"
+            "\tvisits_per_sec\tmaxrss_kb\n");
+    for (size_t i = 0; i < NCASES; ++i)
+        run(&cases[i]);
+    fclose(out);
+    if (failed)
+        fprintf(stderr, "Some results differ from the known values\n");
+    return failed;
+}
@@ -0,0 +1,89 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "ckpt.h"
+
+volatile sig_atomic_t ckpt_due = 0;
+
+static void ckpt_alarm(int sig) {
+    ckpt_due = 1;
+}
+
+/* Arrange for ckpt_due to be set every secs seconds */
+void ckpt_timer(int secs) {
+    struct itimerval it;
+
+    signal(SIGALRM, ckpt_alarm);
+    it.it_interval = (struct timeval){ secs, 0 };
+    it.it_value = (struct timeval){ secs, 0 };
+    setitimer(ITIMER_REAL, &it, NULL);
+}
+
+static void ckpt_fail(const char *what, const char *path) {
+    fprintf(stderr, "Checkpoint %s '%s' failed: %s\n",
+            what, path, strerror(errno));
+    exit(1);
+}
+
+ckpt_t *ckpt_create(const char *path, const char *magic) {
+    ckpt_t *c = (ckpt_t *)malloc(sizeof(ckpt_t));
+    c->path = strdup(path);
+    c->tmp = (char *)malloc(strlen(path) + 5);
+    strcpy(c->tmp, path);
+    strcat(c->tmp, ".tmp");
+    c->fh = fopen(c->tmp, "wb");
+    if (!c->fh)
+        ckpt_fail("open", c->tmp);
+    ckpt_write(c, magic, strlen(magic) + 1);
+    return c;
+}
+
+void ckpt_write(ckpt_t *c, const void *p, size_t size) {
+    if (size && fwrite(p, size, 1, c->fh) != 1)
+        ckpt_fail("write", c->tmp);
+}
+
+/* Finish writing, and atomically replace any previous checkpoint */
+void ckpt_commit(ckpt_t *c) {
+    if (fflush(c->fh) || fsync(fileno(c->fh)) || fclose(c->fh))
+        ckpt_fail("sync", c->tmp);
+    if (rename(c->tmp, c->path))
+        ckpt_fail("rename", c->path);
+    free(c->tmp);
+    free(c->path);
+    free(c);
+}
+
+ckpt_t *ckpt_open(const char *path, const char *magic) {
+    ckpt_t *c = (ckpt_t *)malloc(sizeof(ckpt_t));
+    size_t len = strlen(magic) + 1;
+    char buf[len];
+
+    c->path = strdup(path);
+    c->tmp = NULL;
+    c->fh = fopen(path, "rb");
+    if (!c->fh)
+        ckpt_fail("open", path);
+    ckpt_read(c, buf, len);
+    if (memcmp(buf, magic, len)) {
+        fprintf(stderr, "'%s' is not a checkpoint for this program\n", path);
+        exit(1);
+    }
+    return c;
+}
+
+void ckpt_read(ckpt_t *c, void *p, size_t size) {
+    if (size && fread(p, size, 1, c->fh) != 1) {
+        fprintf(stderr, "Checkpoint '%s' is truncated\n", c->path);
+        exit(1);
+    }
+}
+
+void ckpt_close(ckpt_t *c) {
+    fclose(c->fh);
+    free(c->path);
+    free(c);
+}
@@ -0,0 +1,29 @@
+#ifndef CKPT_H
+#define CKPT_H
+
+#include <signal.h>
+#include <stdio.h>
+
+/* Checkpoint files: written to <path>.tmp, and renamed over <path> only
+ * once complete and synced, so a crash leaves either the old or the new
+ * checkpoint intact. Each file starts with a magic string identifying
+ * the program and format version. Any failure is fatal.
+ */
+typedef struct {
+    FILE *fh;
+    char *path;
+    char *tmp;
+} ckpt_t;
+
+/* Set by SIGALRM when a checkpoint is due */
+extern volatile sig_atomic_t ckpt_due;
+
+extern void ckpt_timer(int secs);
+extern ckpt_t *ckpt_create(const char *path, const char *magic);
+extern void ckpt_write(ckpt_t *c, const void *p, size_t size);
+extern void ckpt_commit(ckpt_t *c);
+extern ckpt_t *ckpt_open(const char *path, const char *magic);
+extern void ckpt_read(ckpt_t *c, void *p, size_t size);
+extern void ckpt_close(ckpt_t *c);
+
+#endif
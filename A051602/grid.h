@@ -1,7 +1,9 @@
 #ifndef GRID_H
 #define GRID_H
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "loc.h"
 
 typedef unsigned char uchar;
@@ -109,6 +111,62 @@ inline static grid_t *expand_grid(grid_t *g, loc_t *offset) {
     return xg;
 }
 
+/*
+ * For square counting, a grid of span up to 64x64 can also be viewed as
+ * lines of bits: columns (bit y), rows (bit x), diagonals x - y = d (bit x,
+ * indexed by d + 63) and antidiagonals x + y = s (bit x, indexed by s).
+ * Each is also held reversed (bit 63 - pos), so that a run of points
+ * along a line in either direction can be extracted as one word.
+ */
+#define GRIDLINES_MAX 64
+#define GRIDLINES_DIAG (2 * GRIDLINES_MAX - 1)
+
+typedef struct {
+    uint64_t col[GRIDLINES_MAX];
+    uint64_t row[GRIDLINES_MAX];
+    uint64_t diag[GRIDLINES_DIAG];
+    uint64_t anti[GRIDLINES_DIAG];
+    uint64_t rcol[GRIDLINES_MAX];
+    uint64_t rrow[GRIDLINES_MAX];
+    uint64_t rdiag[GRIDLINES_DIAG];
+    uint64_t ranti[GRIDLINES_DIAG];
+} gridlines_t;
+
+inline static int gridlines_ok(grid_t *g) {
+    return g->span.x <= GRIDLINES_MAX && g->span.y <= GRIDLINES_MAX;
+}
+
+inline static void build_gridlines(grid_t *g, gridlines_t *gl) {
+    loc_t p;
+
+    memset(gl, 0, sizeof(gridlines_t));
+    for (p.x = 0; p.x < g->span.x; ++p.x)
+        for (p.y = 0; p.y < g->span.y; ++p.y)
+            if (is_grid(g, p)) {
+                int d = p.x - p.y + GRIDLINES_MAX - 1, a = p.x + p.y;
+                uint64_t bx = 1ULL << p.x, rbx = 1ULL << (63 - p.x);
+                gl->col[p.x] |= 1ULL << p.y;
+                gl->rcol[p.x] |= 1ULL << (63 - p.y);
+                gl->row[p.y] |= bx;
+                gl->rrow[p.y] |= rbx;
+                gl->diag[d] |= bx;
+                gl->rdiag[d] |= rbx;
+                gl->anti[a] |= bx;
+                gl->ranti[a] |= rbx;
+            }
+}
+
+/* Return bits start, start + 1, ... of line[index] as bits 0, 1, ... */
+inline static uint64_t gridline_bits(
+    uint64_t *line, int lines, int index, int start
+) {
+    if (index < 0 || index >= lines)
+        return 0;
+    if (start >= 0)
+        return (start < 64) ? line[index] >> start : 0;
+    return (start > -64) ? line[index] << -start : 0;
+}
+
 inline static int same_grid(grid_t *g1, grid_t *g2) {
     if (g1->span.x != g2->span.x)
         return 0;
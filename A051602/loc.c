@@ -40,6 +40,28 @@ void free_loc2plist(loc2plist_t *l2l) {
     free(l2l);
 }
 
+/* size is the maximum number of entries; the table is at least 4x that */
+loc2phash_t *new_loc2phash(int size) {
+    loc2phash_t *h = (loc2phash_t *)malloc(sizeof(loc2phash_t));
+    int slots = 16, shift = 28;
+    while (slots < size * 4) {
+        slots <<= 1;
+        --shift;
+    }
+    h->size = slots;
+    h->shift = shift;
+    h->used = 0;
+    h->slot = (loc2pslot_t *)malloc(sizeof(loc2pslot_t) * slots);
+    for (int i = 0; i < slots; ++i)
+        h->slot[i].index = -1;
+    return h;
+}
+
+void free_loc2phash(loc2phash_t *h) {
+    free(h->slot);
+    free(h);
+}
+
 pairlist_t *new_pairlist(int size) {
     pairlist_t *pl = (pairlist_t *)malloc(sizeof(pairlist_t));
     pl->size = size;
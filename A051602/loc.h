@@ -56,6 +56,26 @@ typedef struct {
     pair_t *list;
 } pairlist_t;
 
+/* In 'recurse', point[] is also indexed by a loc2phash_t, an open-addressing
+ * hash from each point to its index in point[], so that the *_lim() lookups
+ * need not scan the list. Points are added and removed strictly in step
+ * with the recursion, so the hash always holds exactly the points in use;
+ * since removals are LIFO, a linear-probed slot can simply be cleared.
+ * Keys are stored in reduced form (see loc2p_reduce()) so that points
+ * at different powers hash alike.
+ */
+typedef struct {
+    loc2p_t key;
+    int index;      /* index into point[], or -1 if the slot is empty */
+} loc2pslot_t;
+
+typedef struct {
+    int size;       /* always a power of 2 */
+    int used;
+    int shift;      /* 32 - log2(size) */
+    loc2pslot_t *slot;
+} loc2phash_t;
+
 loclist_t *new_loclist(int size);
 void free_loclist(loclist_t *ll);
 void resize_loclist(loclist_t *ll, int size);
@@ -64,6 +84,9 @@ loclist_t *dup_loclist(loclist_t *ll);
 loc2plist_t *new_loc2plist(int size);
 void free_loc2plist(loc2plist_t *l2l);
 
+loc2phash_t *new_loc2phash(int size);
+void free_loc2phash(loc2phash_t *h);
+
 pairlist_t *new_pairlist(int size);
 void free_pairlist(pairlist_t *pl);
 void resize_pairlist(pairlist_t *pl, int size);
@@ -264,6 +287,69 @@ static int list2p_exists_lim(loc2plist_t *l2l, int lim, loc2p_t val) {
     return 0;
 }
 
+/* Return the canonical form of a loc2p_t, with the power reduced as far
+ * as possible; the origin is always { 0, 0, 0 }.
+ */
+static loc2p_t loc2p_reduce(loc2p_t p2) {
+    unsigned int bits = (unsigned int)(p2.p.x | p2.p.y);
+    if (bits == 0)
+        return (loc2p_t){ 0, 0, 0 };
+    int shift = __builtin_ctz(bits);
+    return (loc2p_t){ p2.p.x >> shift, p2.p.y >> shift, p2.power - shift };
+}
+
+static unsigned int hash2p_slot(loc2phash_t *h, loc2p_t key) {
+    unsigned int v = ((unsigned int)key.p.x << 16)
+            ^ ((unsigned int)key.power << 11) ^ (unsigned int)key.p.y;
+    return (v * 0x9e3779b1U) >> h->shift;
+}
+
+/* Return the index in point[] of this point, or -1 */
+static int hash2p_find(loc2phash_t *h, loc2p_t val) {
+    loc2p_t key = loc2p_reduce(val);
+    unsigned int i = hash2p_slot(h, key);
+    while (h->slot[i].index >= 0) {
+        loc2pslot_t *s = &h->slot[i];
+        if (s->key.p.x == key.p.x && s->key.p.y == key.p.y
+                && s->key.power == key.power)
+            return s->index;
+        i = (i + 1) & (h->size - 1);
+    }
+    return -1;
+}
+
+static int hash2p_exists(loc2phash_t *h, loc2p_t val) {
+    return hash2p_find(h, val) >= 0;
+}
+
+/* Record that point[index] is val; val must not already be present */
+static void hash2p_insert(loc2phash_t *h, loc2p_t val, int index) {
+    loc2p_t key = loc2p_reduce(val);
+    unsigned int i = hash2p_slot(h, key);
+    assert(h->used * 2 < h->size);
+    while (h->slot[i].index >= 0)
+        i = (i + 1) & (h->size - 1);
+    h->slot[i] = (loc2pslot_t){ key, index };
+    ++h->used;
+}
+
+/* Remove val, which must be the most recently inserted entry */
+static void hash2p_remove(loc2phash_t *h, loc2p_t val) {
+    loc2p_t key = loc2p_reduce(val);
+    unsigned int i = hash2p_slot(h, key);
+    while (1) {
+        loc2pslot_t *s = &h->slot[i];
+        assert(s->index >= 0);
+        if (s->key.p.x == key.p.x && s->key.p.y == key.p.y
+                && s->key.power == key.power) {
+            s->index = -1;
+            --h->used;
+            return;
+        }
+        i = (i + 1) & (h->size - 1);
+    }
+}
+
 static int pair_eq(pair_t pair1, pair_t pair2) {
     return (loc_eq(pair1.p[0], pair2.p[0]) && loc_eq(pair1.p[1], pair2.p[1]))
         || (loc_eq(pair1.p[0], pair2.p[1]) && loc_eq(pair1.p[1], pair2.p[0]));
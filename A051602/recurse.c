@@ -1,3 +1,4 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,6 +8,7 @@
 
 #include "loc.h"
 #include "sym.h"
+#include "ckpt.h"
 
 long clock_tick;
 
@@ -27,45 +29,134 @@ typedef struct {
     pairlist_t *pairs;  /* List of pairs tried */
 } cx_t;
 
+/* An arrangement that may need reporting, noted while searching in
+ * parallel (see job_t) so that it can be replayed in serial order.
+ */
+typedef struct {
+    int squares;
+    int power;
+    loc_t span;         /* as loc_diff(cx->span.min, cx->span.max) */
+    unsigned long visit;/* visit counter local to the job */
+    int jobs;           /* during enumeration, number of jobs spawned so far */
+    char *text;         /* report line without the visit count, or NULL */
+} event_t;
+
+typedef struct {
+    size_t size;
+    size_t used;
+    event_t *list;
+} eventlog_t;
+
+/* With -j, the search is enumerated serially down to split_depth points,
+ * and each arrangement reached at that depth becomes a job that runs
+ * try_next() with its own copies of the state; jobs are claimed by a
+ * pool of threads. Each job starts from the best/minspan/maxspan seen
+ * at the time it was spawned, which can only be less strict than the
+ * serial run would be at that point, so it logs a superset of the
+ * arrangements the serial run would consider for reporting. Replaying
+ * the logs in job order then gives exactly the serial results.
+ */
+typedef struct {
+    int points;         /* number of points in the starting arrangement */
+    int new;            /* points added by the last extension */
+    loc2p_t *point;     /* copy of point[0 .. points - 1] */
+    cx_t *cx;           /* copy of context[points - new .. points] */
+    int best;           /* state when spawned */
+    loc2p_t minspan;
+    loc2p_t maxspan;
+    unsigned long start;/* enumeration visit count when spawned */
+    unsigned long visits;   /* count of iterations within the job */
+    eventlog_t log;
+} job_t;
+
 int n;              /* We're trying to find A051602(n) */
 int verbose = 0;    /* report every maximum (1) or iteration (2) */
 int quiet = 0;      /* skip reporting for arrangements with < n points */
-int best;           /* Greatest number of squares seen in any arrangement */
-loc2plist_t *point; /* List of points in the current arrangement */
-cx_t *context;      /* List of context objects */
-loc2p_t minspan;    /* { x, y } size of smallest maximal solution */
-loc2p_t maxspan;    /* { x, y } size of greatest maximal solution */
-unsigned long visit;        /* Count of iterations */
 unsigned long lim_visit = 0;/* Stop after this many iterations */
-unsigned long last_new;     /* Iteration at which last new result found */
+
+/* Search state, separate for each thread */
+__thread int best;  /* Greatest number of squares seen in any arrangement */
+__thread loc2plist_t *point;    /* List of points in the current arrangement */
+__thread loc2phash_t *pointhash;/* Index of the points in use in point[] */
+__thread cx_t *context;     /* List of context objects */
+__thread loc2p_t minspan;   /* { x, y } size of smallest maximal solution */
+__thread loc2p_t maxspan;   /* { x, y } size of greatest maximal solution */
+__thread unsigned long visit;   /* Count of iterations */
+__thread unsigned long last_new;/* Iteration at which last new result found */
+__thread eventlog_t *events = NULL; /* If set, log reports here */
+
+int nthreads = 0;   /* Number of threads to search with, or 0 for serial */
+int split_depth = 0;/* Depth at which to split the search into jobs */
+int enumerating = 0;/* TRUE while finding the jobs */
+
+char *ckpt_path = NULL; /* Write checkpoints here, if set */
+int ckpt_secs = 600;    /* Seconds between checkpoints */
+double time_base = 0;   /* CPU time used before resuming */
+int *reached_by;    /* For each depth, size of extension that reached it */
+int *resume_new;    /* When resuming, size of the extension in progress */
+int resume_depth;   /* When resuming, depth at which the checkpoint was made */
+size_t njobs = 0;
+size_t jobs_size = 0;
+job_t *jobs;
+size_t next_job;    /* Next job to be claimed by a thread */
 
 double timing(void) {
     struct tms ttd;
     times(&ttd);
-    return ((double)ttd.tms_utime) / clock_tick;
+    return ((double)ttd.tms_utime) / clock_tick + time_base;
 }
 
-/* Show a result-so-far, consisting of i points */
-void report(int i) {
+/* Show a result-so-far, consisting of i points, without the visit count */
+void freport(FILE *fh, int i) {
     cx_t *cx = &context[i];
     int power = cx->power;
     loc_t span = loc_diff(cx->span.min, cx->span.max);
 
-    printf("(%lu) p%d %dx%d ", visit, power,
-            (span.x >> 1) + 1, (span.y >> 1) + 1);
-    printf("%d:", cx->squares);
+    fprintf(fh, "p%d %dx%d ", power, (span.x >> 1) + 1, (span.y >> 1) + 1);
+    fprintf(fh, "%d:", cx->squares);
     for (int j = 0; j < i; ++j) {
         loc_t p = list2p_get(point, j, cx->power);
-        printf(" %d:%d",
+        fprintf(fh, " %d:%d",
                 (p.x - cx->span.min.x) >> 1, (p.y - cx->span.min.y) >> 1);
     }
-    printf("\n");
+    fprintf(fh, "\n");
+}
+
+/* Show a result-so-far, consisting of i points */
+void report(int i) {
+    printf("(%lu) ", visit);
+    freport(stdout, i);
+}
+
+/* Note an arrangement of i points for later replay by merge_jobs();
+ * the report text is needed only if it would be reported locally.
+ */
+void log_event(int i, loc_t span, int need_text) {
+    cx_t *cx = &context[i];
+    char *text = NULL;
+
+    if (need_text) {
+        size_t len;
+        FILE *fh = open_memstream(&text, &len);
+        freport(fh, i);
+        fclose(fh);
+    }
+    if (events->used >= events->size) {
+        size_t new_size = events->size ? events->size * 3 / 2 : 20;
+        events->list = (event_t *)realloc(events->list,
+                new_size * sizeof(event_t));
+        events->size = new_size;
+    }
+    events->list[events->used++] = (event_t){
+        cx->squares, cx->power, span, visit, njobs, text
+    };
 }
 
 void init(void) {
     loclist_t *first_seen = new_loclist(10);
     pairlist_t *first_pairs = new_pairlist(10);
     context = (cx_t *)malloc((n + 1) * sizeof(cx_t));
+    reached_by = (int *)calloc(n + 1, sizeof(int));
 
     /* used to calculate timings */
     clock_tick = sysconf(_SC_CLK_TCK);
@@ -80,6 +171,9 @@ void init(void) {
     list2p_set(point, 1, (loc2p_t){ 0, 2, 1 });
     list2p_set(point, 2, (loc2p_t){ 2, 0, 1 });
     list2p_set(point, 3, (loc2p_t){ 2, 2, 1 });
+    pointhash = new_loc2phash(n + 1);
+    for (int i = 0; i < 4; ++i)
+        hash2p_insert(pointhash, list2p_get2p(point, i), i);
 
     context[4] = (cx_t){
         1,                      /* squares */
@@ -109,9 +203,11 @@ void init(void) {
 
 void finish(void) {
     free_loc2plist(point);
+    free_loc2phash(pointhash);
     free_loclist(context[4].seen);
     free_pairlist(context[4].pairs);
     free(context);
+    free(reached_by);
 }
 
 /* We have a double recursion: try_next() finds the next extension to try,
@@ -147,9 +243,7 @@ int try_test2(int points, int try2[3], int power) {
     /* This is a valid extension only if the two new points are not
      * already present in the arrangement.
      */
-    if (list2p_exists_lim(point, points, pk)
-        || list2p_exists_lim(point, points, pl)
-    )
+    if (hash2p_exists(pointhash, pk) || hash2p_exists(pointhash, pl))
         return 0;
     list2p_set(point, points, pk);
     list2p_set(point, points + 1, pl);
@@ -178,9 +272,9 @@ int duplicate_pair(int points, sym_t sym, int try2[3], int power) {
     /* if the opposite pair is not already in the arrangement, there's
      * no duplication
      */
-    if ((im = list2p_find_lim(point, points, pm)) < 0)
+    if ((im = hash2p_find(pointhash, pm)) < 0)
         return 0;
-    if ((in = list2p_find_lim(point, points, pn)) < 0)
+    if ((in = hash2p_find(pointhash, pn)) < 0)
         return 0;
 
     /* if the opposite pair comes earlier in the order than the original
@@ -227,7 +321,7 @@ int try_test3(int points, int try3[3], int power) {
     /* This is a valid extension only if the new point is not already
      * present in the arrangement.
      */
-    if (list2p_exists_lim(point, points, (loc2p_t){ pl, power }))
+    if (hash2p_exists(pointhash, (loc2p_t){ pl, power }))
         return 0;
     list2p_set(point, points, (loc2p_t){ pl, power });
     return 1;
@@ -237,6 +331,7 @@ int try_test3(int points, int try3[3], int power) {
  * arrangement. To avoid double-counting, we look at the two edges
  * point[i]-point[j] and point[i]-point[k], and count only when
  * j < k.
+ * Expects pointhash to hold exactly point[0 .. i-1].
  */
 int find_squares(int i, int power) {
     loc_t pi = list2p_get(point, i, power);
@@ -247,21 +342,64 @@ int find_squares(int i, int power) {
         loc_t diff = loc_diff(pi, pj);
         loc_t pk = loc_rot90(pi, diff);
         loc_t pl = loc_rot90(pj, diff);
-        if (list2p_find_lim(point, i, (loc2p_t){ pk, power }) > j
-           && list2p_exists_lim(point, i, (loc2p_t){ pl, power })
+        if (hash2p_find(pointhash, (loc2p_t){ pk, power }) > j
+           && hash2p_exists(pointhash, (loc2p_t){ pl, power })
         )
             ++count;
 
         pk = loc_rot270(pi, diff);
         pl = loc_rot270(pj, diff);
-        if (list2p_find_lim(point, i, (loc2p_t){ pk, power }) > j
-           && list2p_exists_lim(point, i, (loc2p_t){ pl, power })
+        if (hash2p_find(pointhash, (loc2p_t){ pk, power }) > j
+           && hash2p_exists(pointhash, (loc2p_t){ pl, power })
         )
             ++count;
     }
     return count;
 }
 
+/* Update best, minspan and maxspan for an arrangement with the given
+ * number of squares, which must be at least best; 'v' is the visit
+ * count at which it was found.
+ * Returns TRUE if this is a new record or a new gridsize.
+ */
+int record(int squares, loc_t span, int power, unsigned long v) {
+    int newspan = 0;
+
+    /* minspan/maxspan are canonicalized to call the larger dimension 'x' */
+    if (span.x < span.y) {
+        int tmp = span.x;
+        span.x = span.y;
+        span.y = tmp;
+    }
+    if (squares > best) {
+        /* New record: reset minspan/maxspan, and always report this */
+        minspan = (loc2p_t){ span, power };
+        maxspan = (loc2p_t){ span, power };
+        newspan = 1;
+        last_new = v;
+    } else {
+        /* Match of existing record, report it only if new gridsize */
+        int spower = (minspan.power > maxspan.power) ? minspan.power : maxspan.power;
+        if (spower < power) {
+            minspan = lift2p(minspan, power);
+            maxspan = lift2p(maxspan, power);
+        } else if (power < spower) {
+            span = convert2p((loc2p_t){ span, power }, spower);
+        }
+
+        if (minspan.p.x > span.x) minspan.p.x = span.x, newspan = 1;
+        if (minspan.p.y > span.y) minspan.p.y = span.y, newspan = 1;
+        if (maxspan.p.x < span.x) maxspan.p.x = span.x, newspan = 1;
+        if (maxspan.p.y < span.y) maxspan.p.y = span.y, newspan = 1;
+    }
+    best = squares;
+    return newspan;
+}
+
+void spawn_job(int points, int new);
+void save_checkpoint(int depth);
+void resume_with(int points, int new);
+
 /* Extend the existing arrangement of 'points' points with 'new'
  * additional points (which have already been placed in point[]).
  * We update context[points+new].squares and .span, and check
@@ -275,6 +413,7 @@ void try_with(int points, int new) {
     cx_t *ncx = &context[points + new];
     int power = ocx->power, raising = 0;
 
+    reached_by[points + new] = new;
     if (is_loc2p_odd(list2p_get2p(point, points), power)) {
         raising = 1;
         ++power;
@@ -293,8 +432,9 @@ void try_with(int points, int new) {
     for (int i = points; i < points + new; ++i) {
         loc_t pi = list2p_get(point, i, power);
 
-        /* Update the count of squares */
+        /* Update the count of squares, then make the point findable */
         ncx->squares += find_squares(i, power);
+        hash2p_insert(pointhash, list2p_get2p(point, i), i);
 
         /* Track the 4 limits of the arrangement */
         if (ncx->span.min.x > pi.x) ncx->span.min.x = pi.x;
@@ -305,37 +445,11 @@ void try_with(int points, int new) {
 
     if ((quiet == 0 || points + new == n) && ncx->squares >= best) {
         loc_t span = loc_diff(ncx->span.min, ncx->span.max);
-        int newspan = 0;
+        int newspan = record(ncx->squares, span, power, visit);
 
-        /* minspan/maxspan are canonicalized to call the larger dimension 'x' */
-        if (span.x < span.y) {
-            int tmp = span.x;
-            span.x = span.y;
-            span.y = tmp;
-        }
-        if (ncx->squares > best) {
-            /* New record: reset minspan/maxspan, and always report this */
-            minspan = (loc2p_t){ span, power };
-            maxspan = (loc2p_t){ span, power };
-            newspan = 1;
-            last_new = visit;
-        } else {
-            /* Match of existing record, report it only if new gridsize */
-            int spower = (minspan.power > maxspan.power) ? minspan.power : maxspan.power;
-            if (spower < power) {
-                minspan = lift2p(minspan, power);
-                maxspan = lift2p(maxspan, power);
-            } else if (power < spower) {
-                span = convert2p((loc2p_t){ span, power }, spower);
-            }
-
-            if (minspan.p.x > span.x) minspan.p.x = span.x, newspan = 1;
-            if (minspan.p.y > span.y) minspan.p.y = span.y, newspan = 1;
-            if (maxspan.p.x < span.x) maxspan.p.x = span.x, newspan = 1;
-            if (maxspan.p.y < span.y) maxspan.p.y = span.y, newspan = 1;
-        }
-        best = ncx->squares;
-        if (newspan || verbose == 1) {
+        if (events)
+            log_event(points + new, span, newspan || verbose == 1);
+        else if (newspan || verbose == 1) {
             if (verbose == 2) {
                 /* distinguish from the per-iteration report */
                 printf("* ");
@@ -344,13 +458,23 @@ void try_with(int points, int new) {
         }
     }
 
-    if (lim_visit && visit >= lim_visit)
-        return;
-    if (verbose == 2 && (quiet == 0 || points + new == n))
-        report(points + new);
-    ++visit;
-    if (points + new < n)
-        try_next(points + new, new);
+    if (!(lim_visit && visit >= lim_visit)) {
+        if (verbose == 2 && (quiet == 0 || points + new == n))
+            report(points + new);
+        ++visit;
+        if (ckpt_due && points + new < n && !enumerating)
+            save_checkpoint(points + new);
+        if (points + new < n) {
+            if (enumerating && points + new >= split_depth)
+                spawn_job(points + new, new);
+            else
+                try_next(points + new, new);
+        }
+    }
+
+    /* The caller may overwrite these points, so drop them from the index */
+    for (int i = points + new - 1; i >= points; --i)
+        hash2p_remove(pointhash, list2p_get2p(point, i));
 }
 
 /* Mark a point as seen, either while applying it (present=true) or after
@@ -398,8 +522,8 @@ bool sym_best2(int points, sym_t s, span_t span, int power, int i1, int i2) {
         if (s & si) {
             loc_t p3 = sym_transloc(si, span, p1);
             loc_t p4 = sym_transloc(si, span, p2);
-            int i3 = list2p_find_lim(point, points, (loc2p_t){ p3, power });
-            int i4 = list2p_find_lim(point, points, (loc2p_t){ p4, power });
+            int i3 = hash2p_find(pointhash, (loc2p_t){ p3, power });
+            int i4 = hash2p_find(pointhash, (loc2p_t){ p4, power });
             if (i3 < i4) {
                 if (i4 < i1 || (i4 == i1 && i3 < i2))
                     return 0;
@@ -433,9 +557,9 @@ bool sym_best3(
             loc_t p4 = sym_transloc(si, span, p1);
             loc_t p5 = sym_transloc(si, span, p2);
             loc_t p6 = sym_transloc(si, span, p3);
-            int i4 = list2p_find_lim(point, points, (loc2p_t){ p4, power });
-            int i5 = list2p_find_lim(point, points, (loc2p_t){ p5, power });
-            int i6 = list2p_find_lim(point, points, (loc2p_t){ p6, power });
+            int i4 = hash2p_find(pointhash, (loc2p_t){ p4, power });
+            int i5 = hash2p_find(pointhash, (loc2p_t){ p5, power });
+            int i6 = hash2p_find(pointhash, (loc2p_t){ p6, power });
             if (i4 > i5 && i4 > i6) {
                 if (i4 < i1) return 0;
                 if (i4 == i1) {
@@ -502,16 +626,15 @@ void next_try2(int* try2) {
     }
 }
 
+void try_extend(int points, loclist_t *seen, pairlist_t *pairs, int resume);
+
 /* Try all possible extensions of the existing 'points'-point arrangement. */
 void try_next(int points, int new) {
     cx_t *cx = &context[points];
-    cx_t *cx1 = &context[points + 1];
-    cx_t *cx2 = &context[points + 2];
     loclist_t *seen = dup_loclist(cx->seen);
     pairlist_t *pairs = dup_pairlist(cx->pairs);
     int power = cx->power;
     int raising = (power > context[points - new].power) ? 1 : 0;
-    sym_t sym = sym_check(point, cx->span, points, power);
 
     if (raising) {
         for (int i = 0; i < seen->used; ++i)
@@ -525,15 +648,40 @@ void try_next(int points, int new) {
     for (int i = points - new; i < points; ++i)
         seen_point(seen, pairs, list2p_get(point, i, power), power, 1);
 
-    if (points + 1 <= n) {
+    try_extend(points, seen, pairs, 0);
+}
+
+/* Try the extensions of the 'points'-point arrangement, given the lists
+ * of points and pairs to suppress; frees the lists when done.
+ * If resume is non-zero, we are restarting from a checkpoint, with the
+ * state of the loops already restored in context[], in the middle of
+ * applying a 'resume'-point extension.
+ */
+void try_extend(int points, loclist_t *seen, pairlist_t *pairs, int resume) {
+    cx_t *cx = &context[points];
+    cx_t *cx1 = &context[points + 1];
+    cx_t *cx2 = &context[points + 2];
+    int power = cx->power;
+    sym_t sym = sym_check(point, cx->span, points, power);
+
+    if (points + 1 <= n && resume != 2) {
         /* Try to extend 3 points into a square. */
-        memcpy(cx1, cx, sizeof(cx_t));
-        cx1->seen = seen;
-        cx1->pairs = pairs;
+        if (!resume) {
+            memcpy(cx1, cx, sizeof(cx_t));
+            cx1->seen = seen;
+            cx1->pairs = pairs;
+        }
 
         /* Try all triples we haven't already tried */
-        while (cx1->try3[0] < points) {
-            if (
+        while (resume || cx1->try3[0] < points) {
+            if (resume) {
+                /* finish the extension we were applying */
+                resume = 0;
+                resume_with(points, 1);
+                seen_point(seen, pairs,
+                        list2p_get(point, points, power), power, 0);
+                cx1->squares = cx->squares;
+            } else if (
                 /* If this triple forms a square with a missing 4th point */
                 try_test3(points, cx1->try3, power)
                 /* .. and that point isn't on the list to be suppressed */
@@ -563,15 +711,26 @@ void try_next(int points, int new) {
          * already tried on its own in the previous section (at this
          * level or higher up the call chain) need not be tried again.
          */
-        memcpy(cx2, cx, sizeof(cx_t));
-        /* propagate progress made */
-        memcpy(&cx2->try3, &cx1->try3, sizeof(cx2->try3));
-        cx2->seen = seen;
-        cx2->pairs = pairs;
+        if (!resume) {
+            memcpy(cx2, cx, sizeof(cx_t));
+            /* propagate progress made */
+            memcpy(&cx2->try3, &cx1->try3, sizeof(cx2->try3));
+            cx2->seen = seen;
+            cx2->pairs = pairs;
+        }
 
         /* Try all pairs and directions we haven't already tried */
-        while (cx2->try2[0] < points) {
-            if (
+        while (resume || cx2->try2[0] < points) {
+            if (resume) {
+                /* finish the extension we were applying */
+                resume = 0;
+                resume_with(points, 2);
+                pair_append(pairs, (pair_t){
+                    list2p_get(point, points, power),
+                    list2p_get(point, points + 1, power)
+                });
+                cx2->squares = cx->squares;
+            } else if (
                 /* If this pair is canonical for symmetry of this arrangement */
                 sym_best2(points, sym, cx->span, power,
                         cx2->try2[0], cx2->try2[1])
@@ -611,8 +770,276 @@ void try_next(int points, int new) {
     return;
 }
 
+/* Write the state of the search to the checkpoint file. We are at depth
+ * 'depth' of the recursion, just about to call try_next(); for each
+ * level of the recursion down to here, context[] holds the progress of
+ * its loops, and the context of the extension it is applying points
+ * to its lists of points and pairs to suppress.
+ */
+void save_checkpoint(int depth) {
+    ckpt_t *c;
+    double t = timing();
+
+    fflush(stdout);
+    c = ckpt_create(ckpt_path, "A051602 recurse 1");
+    ckpt_write(c, &n, sizeof(n));
+    ckpt_write(c, &depth, sizeof(depth));
+    ckpt_write(c, &best, sizeof(best));
+    ckpt_write(c, &minspan, sizeof(minspan));
+    ckpt_write(c, &maxspan, sizeof(maxspan));
+    ckpt_write(c, &visit, sizeof(visit));
+    ckpt_write(c, &last_new, sizeof(last_new));
+    ckpt_write(c, &t, sizeof(t));
+    ckpt_write(c, point->list, depth * sizeof(loc2p_t));
+    ckpt_write(c, reached_by, (depth + 1) * sizeof(int));
+    ckpt_write(c, &context[4], (depth - 3) * sizeof(cx_t));
+    for (int i = depth; i > 4; i -= reached_by[i]) {
+        loclist_t *seen = context[i].seen;
+        pairlist_t *pairs = context[i].pairs;
+        ckpt_write(c, &seen->used, sizeof(seen->used));
+        ckpt_write(c, seen->list, seen->used * sizeof(loc_t));
+        ckpt_write(c, &pairs->used, sizeof(pairs->used));
+        ckpt_write(c, pairs->list, pairs->used * sizeof(pair_t));
+    }
+    ckpt_commit(c);
+    ckpt_due = 0;
+}
+
+/* Restore the state written by save_checkpoint(), after init() */
+void load_checkpoint(char *path) {
+    ckpt_t *c = ckpt_open(path, "A051602 recurse 1");
+    loclist_t *first_seen = context[4].seen;
+    pairlist_t *first_pairs = context[4].pairs;
+    int cn, depth;
+
+    ckpt_read(c, &cn, sizeof(cn));
+    if (cn != n) {
+        fprintf(stderr, "Checkpoint '%s' is for n=%d\n", path, cn);
+        exit(1);
+    }
+    ckpt_read(c, &depth, sizeof(depth));
+    ckpt_read(c, &best, sizeof(best));
+    ckpt_read(c, &minspan, sizeof(minspan));
+    ckpt_read(c, &maxspan, sizeof(maxspan));
+    ckpt_read(c, &visit, sizeof(visit));
+    ckpt_read(c, &last_new, sizeof(last_new));
+    ckpt_read(c, &time_base, sizeof(time_base));
+    for (int i = 0; i < depth; ++i) {
+        loc2p_t p;
+        ckpt_read(c, &p, sizeof(p));
+        list2p_set(point, i, p);
+        if (i >= 4)
+            hash2p_insert(pointhash, p, i);
+    }
+    ckpt_read(c, reached_by, (depth + 1) * sizeof(int));
+    ckpt_read(c, &context[4], (depth - 3) * sizeof(cx_t));
+    context[4].seen = first_seen;
+    context[4].pairs = first_pairs;
+
+    resume_new = (int *)calloc(n + 1, sizeof(int));
+    for (int i = depth; i > 4; i -= reached_by[i]) {
+        int used;
+        resume_new[i - reached_by[i]] = reached_by[i];
+
+        ckpt_read(c, &used, sizeof(used));
+        context[i].seen = new_loclist(used + 10);
+        context[i].seen->used = used;
+        ckpt_read(c, context[i].seen->list, used * sizeof(loc_t));
+        ckpt_read(c, &used, sizeof(used));
+        context[i].pairs = new_pairlist(used + 10);
+        context[i].pairs->used = used;
+        ckpt_read(c, context[i].pairs->list, used * sizeof(pair_t));
+    }
+    resume_depth = depth;
+    ckpt_close(c);
+}
+
+/* Continue applying the 'new'-point extension to the 'points'-point
+ * arrangement that was in progress when the checkpoint was written.
+ * This is the part of try_with() after the new points are accounted.
+ */
+void resume_with(int points, int new) {
+    int depth = points + new;
+
+    if (depth == resume_depth) {
+        try_next(depth, new);
+    } else {
+        cx_t *ccx = &context[depth + resume_new[depth]];
+        try_extend(depth, ccx->seen, ccx->pairs, resume_new[depth]);
+    }
+    for (int i = depth - 1; i >= points; --i)
+        hash2p_remove(pointhash, list2p_get2p(point, i));
+}
+
+/* Restart the search from the checkpoint loaded by load_checkpoint() */
+void resume_search(void) {
+    cx_t *ccx = &context[4 + resume_new[4]];
+    try_extend(4, ccx->seen, ccx->pairs, resume_new[4]);
+    free(resume_new);
+}
+
+/* Record the arrangement of 'points' points as a job to run later
+ * with try_next(points, new).
+ */
+void spawn_job(int points, int new) {
+    job_t *job;
+
+    if (njobs >= jobs_size) {
+        jobs_size = jobs_size ? jobs_size * 3 / 2 : 100;
+        jobs = (job_t *)realloc(jobs, jobs_size * sizeof(job_t));
+    }
+    job = &jobs[njobs++];
+    job->points = points;
+    job->new = new;
+    job->point = (loc2p_t *)malloc(points * sizeof(loc2p_t));
+    for (int i = 0; i < points; ++i)
+        job->point[i] = list2p_get2p(point, i);
+    job->cx = (cx_t *)malloc((new + 1) * sizeof(cx_t));
+    memcpy(job->cx, &context[points - new], (new + 1) * sizeof(cx_t));
+    for (int i = 0; i < new; ++i) {
+        job->cx[i].seen = NULL;
+        job->cx[i].pairs = NULL;
+    }
+    /* the caller will continue to modify these */
+    job->cx[new].seen = dup_loclist(context[points].seen);
+    job->cx[new].pairs = dup_pairlist(context[points].pairs);
+    job->best = best;
+    job->minspan = minspan;
+    job->maxspan = maxspan;
+    job->start = visit;
+    job->visits = 0;
+    job->log = (eventlog_t){ 0, 0, NULL };
+}
+
+void run_job(job_t *job) {
+    int points = job->points, new = job->new;
+
+    for (int i = 0; i < points; ++i) {
+        list2p_set(point, i, job->point[i]);
+        hash2p_insert(pointhash, job->point[i], i);
+    }
+    memcpy(&context[points - new], job->cx, (new + 1) * sizeof(cx_t));
+    best = job->best;
+    minspan = job->minspan;
+    maxspan = job->maxspan;
+    visit = 0UL;
+    last_new = 0UL;
+    events = &job->log;
+
+    try_next(points, new);
+
+    job->visits = visit;
+    events = NULL;
+    for (int i = points - 1; i >= 0; --i)
+        hash2p_remove(pointhash, job->point[i]);
+    free_loclist(job->cx[new].seen);
+    free_pairlist(job->cx[new].pairs);
+    free(job->cx);
+    free(job->point);
+}
+
+/* Claim and run jobs until none are left */
+void *run_jobs(void *arg) {
+    point = new_loc2plist(n + 1);
+    pointhash = new_loc2phash(n + 1);
+    context = (cx_t *)malloc((n + 1) * sizeof(cx_t));
+    while (1) {
+        size_t i = __atomic_fetch_add(&next_job, 1, __ATOMIC_RELAXED);
+        if (i >= njobs)
+            break;
+        run_job(&jobs[i]);
+    }
+    free_loc2plist(point);
+    free_loc2phash(pointhash);
+    free(context);
+    return NULL;
+}
+
+/* Replay an event found at (global) visit count v */
+void replay(event_t *ev, unsigned long v) {
+    if (ev->squares < best)
+        return;
+    if (record(ev->squares, ev->span, ev->power, v) || verbose == 1) {
+        assert(ev->text);
+        printf("(%lu) %s", v, ev->text);
+    }
+}
+
+/* Replay the events logged during enumeration and by each job in the
+ * order the serial search would have seen them, reporting as it would
+ * have done and leaving the combined results in best, minspan, maxspan,
+ * last_new and visit.
+ */
+void merge_jobs(eventlog_t *elog, unsigned long enum_visits) {
+    unsigned long done = 0; /* visits in jobs already merged */
+    size_t e = 0;
+
+    best = 1;
+    minspan = (loc2p_t){ 2, 2, 1 };
+    maxspan = (loc2p_t){ 2, 2, 1 };
+    last_new = 0UL;
+    for (size_t j = 0; j <= njobs; ++j) {
+        while (e < elog->used && elog->list[e].jobs == j) {
+            replay(&elog->list[e], elog->list[e].visit + done);
+            free(elog->list[e].text);
+            ++e;
+        }
+        if (j == njobs)
+            break;
+
+        job_t *job = &jobs[j];
+        unsigned long start = job->start + done;
+        for (size_t k = 0; k < job->log.used; ++k) {
+            replay(&job->log.list[k], job->log.list[k].visit + start);
+            free(job->log.list[k].text);
+        }
+        free(job->log.list);
+        fprintf(stderr, "job %zu: %d points, start %lu, %lu visits\n",
+                j, job->points, start, job->visits);
+        done += job->visits;
+    }
+    visit = enum_visits + done;
+}
+
+/* Search in parallel: enumerate jobs, run them, then merge the results */
+void try_parallel(void) {
+    eventlog_t elog = { 0, 0, NULL };
+    pthread_t *tid = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+
+    events = &elog;
+    enumerating = 1;
+    try_next(4, 0);
+    enumerating = 0;
+    events = NULL;
+    unsigned long enum_visits = visit;
+
+    next_job = 0;
+    for (int i = 1; i < nthreads; ++i)
+        if (pthread_create(&tid[i], NULL, run_jobs, NULL)) {
+            fprintf(stderr, "Failed to create thread %d\n", i);
+            exit(1);
+        }
+    /* the main thread acts as worker 0, with its own fresh state */
+    loc2plist_t *mpoint = point;
+    loc2phash_t *mpointhash = pointhash;
+    cx_t *mcontext = context;
+    point = NULL;
+    run_jobs(NULL);
+    point = mpoint;
+    pointhash = mpointhash;
+    context = mcontext;
+    for (int i = 1; i < nthreads; ++i)
+        pthread_join(tid[i], NULL);
+    free(tid);
+
+    merge_jobs(&elog, enum_visits);
+    free(elog.list);
+    free(jobs);
+}
+
 int main(int argc, char** argv) {
     int arg = 1;
+    char *resume_path = NULL;
 
     while (arg < argc && argv[arg][0] == '-') {
         char *s = argv[arg++];
@@ -626,13 +1053,32 @@ int main(int argc, char** argv) {
             quiet = 1;
         else if (strcmp("-i", s) == 0)
             lim_visit = atol(argv[arg++]);
+        else if (strcmp("-j", s) == 0)
+            nthreads = atoi(argv[arg++]);
+        else if (strcmp("-s", s) == 0)
+            split_depth = atoi(argv[arg++]);
+        else if (strcmp("-C", s) == 0)
+            ckpt_path = argv[arg++];
+        else if (strcmp("-c", s) == 0)
+            ckpt_secs = atoi(argv[arg++]);
+        else if (strcmp("-R", s) == 0)
+            resume_path = argv[arg++];
         else {
             fprintf(stderr, "Unknown option '%s'\n", s);
             exit(1);
         }
     }
     if (arg + 1 != argc) {
-        fprintf(stderr, "Usage: try [-v] [-i maxiter] <n>\n");
+        fprintf(stderr, "Usage: try [-v] [-i maxiter] [-j threads [-s depth]]"
+                " [-C ckpt [-c secs]] [-R ckpt] <n>\n");
+        return 1;
+    }
+    if (nthreads > 0 && (verbose == 2 || lim_visit)) {
+        fprintf(stderr, "-j is not supported with -v or -i\n");
+        return 1;
+    }
+    if (nthreads > 0 && (ckpt_path || resume_path)) {
+        fprintf(stderr, "-j is not supported with -C or -R\n");
         return 1;
     }
 
@@ -651,7 +1097,18 @@ int main(int argc, char** argv) {
     }
 
     init();
-    try_next(4, 0);
+    if (ckpt_path)
+        ckpt_timer(ckpt_secs);
+    if (resume_path) {
+        load_checkpoint(resume_path);
+        resume_search();
+    } else if (nthreads > 0) {
+        /* by default split at 10 points, giving a few thousand jobs */
+        if (split_depth <= 4)
+            split_depth = (n < 12) ? n - 2 : 10;
+        try_parallel();
+    } else
+        try_next(4, 0);
 
     /* report final results */
     printf("%d %d %lu %dx%d %dx%d (%lu) %.2fs\n",
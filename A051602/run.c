@@ -0,0 +1,144 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "run.h"
+
+static const char run_magic[] = "A051602 run 1";
+
+static void run_fail(const char *what, const char *path) {
+    fprintf(stderr, "Run file %s '%s' failed: %s\n",
+            what, path, strerror(errno));
+    exit(1);
+}
+
+static void run_putnum(run_t *r, size_t v) {
+    while (v >= 0x80) {
+        putc((v & 0x7f) | 0x80, r->fh);
+        v >>= 7;
+    }
+    if (putc(v, r->fh) == EOF)
+        run_fail("write", r->path);
+}
+
+/* Read a number; returns 0 at a clean end of file */
+static int run_getnum(run_t *r, size_t *v, int eof_ok) {
+    int c, shift = 0;
+
+    *v = 0;
+    while ((c = getc(r->fh)) != EOF) {
+        *v |= (size_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return 1;
+        shift += 7;
+        eof_ok = 0;
+    }
+    if (eof_ok && !ferror(r->fh))
+        return 0;
+    fprintf(stderr, "Run file '%s' is truncated\n", r->path);
+    exit(1);
+}
+
+static void run_reserve(run_t *r, size_t size) {
+    if (size > r->bsize) {
+        r->buf = (unsigned char *)realloc(r->buf, size);
+        r->bsize = size;
+    }
+}
+
+static run_t *new_run(const char *path, const char *mode) {
+    run_t *r = (run_t *)calloc(1, sizeof(run_t));
+    r->path = strdup(path);
+    r->fh = fopen(path, mode);
+    if (!r->fh)
+        run_fail("open", path);
+    return r;
+}
+
+static void free_run(run_t *r) {
+    free(r->buf);
+    free(r->path);
+    free(r);
+}
+
+run_t *run_create(const char *path) {
+    run_t *r = new_run(path, "wb");
+    if (fwrite(run_magic, sizeof(run_magic), 1, r->fh) != 1)
+        run_fail("write", path);
+    return r;
+}
+
+void run_put(run_t *r, loc_t span, unsigned char *grid, size_t size) {
+    size_t shared = 0;
+
+    if (r->count && loc_eq(span, r->span))
+        while (shared < size && grid[shared] == r->buf[shared])
+            ++shared;
+    run_putnum(r, span.x);
+    run_putnum(r, span.y);
+    run_putnum(r, shared);
+    if (size > shared
+        && fwrite(&grid[shared], size - shared, 1, r->fh) != 1
+    )
+        run_fail("write", r->path);
+
+    run_reserve(r, size);
+    memcpy(&r->buf[shared], &grid[shared], size - shared);
+    r->span = span;
+    r->size = size;
+    ++r->count;
+}
+
+void run_finish(run_t *r) {
+    if (fclose(r->fh))
+        run_fail("close", r->path);
+    free_run(r);
+}
+
+run_t *run_open(const char *path) {
+    run_t *r = new_run(path, "rb");
+    char buf[sizeof(run_magic)];
+
+    if (fread(buf, sizeof(buf), 1, r->fh) != 1
+        || memcmp(buf, run_magic, sizeof(buf))
+    ) {
+        fprintf(stderr, "'%s' is not a run file\n", path);
+        exit(1);
+    }
+    return r;
+}
+
+/* Return the bitmap of the next record, valid until the next call,
+ * or NULL at the end of the run.
+ */
+unsigned char *run_get(run_t *r, loc_t *span, size_t *size) {
+    size_t x, y, shared;
+
+    if (!run_getnum(r, &x, 1))
+        return NULL;
+    run_getnum(r, &y, 0);
+    run_getnum(r, &shared, 0);
+    span->x = x;
+    span->y = y;
+    *size = ((y + 7) >> 3) * x;     /* as grid_size() */
+    if (shared > *size || (shared && !loc_eq(*span, r->span))) {
+        fprintf(stderr, "Run file '%s' is corrupt\n", r->path);
+        exit(1);
+    }
+    run_reserve(r, *size);
+    if (*size > shared
+        && fread(&r->buf[shared], *size - shared, 1, r->fh) != 1
+    ) {
+        fprintf(stderr, "Run file '%s' is truncated\n", r->path);
+        exit(1);
+    }
+    r->span = *span;
+    r->size = *size;
+    ++r->count;
+    return r->buf;
+}
+
+void run_close(run_t *r) {
+    fclose(r->fh);
+    free_run(r);
+}
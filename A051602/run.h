@@ -0,0 +1,31 @@
+#ifndef RUN_H
+#define RUN_H
+
+#include <stdio.h>
+
+#include "loc.h"
+
+/* Run files: a sequence of grids, each written as its span and bitmap.
+ * Writers are expected to supply the grids in sorted order (span first,
+ * then bitmap), so each record stores only the bytes that differ from
+ * the start of the previous bitmap when the spans match. Any failure
+ * is fatal.
+ */
+typedef struct {
+    FILE *fh;
+    char *path;
+    size_t count;           /* number of records written or read */
+    loc_t span;             /* span of the last record */
+    size_t size;            /* bitmap size of the last record */
+    size_t bsize;           /* allocated size of buf[] */
+    unsigned char *buf;     /* bitmap of the last record */
+} run_t;
+
+extern run_t *run_create(const char *path);
+extern void run_put(run_t *r, loc_t span, unsigned char *grid, size_t size);
+extern void run_finish(run_t *r);
+extern run_t *run_open(const char *path);
+extern unsigned char *run_get(run_t *r, loc_t *span, size_t *size);
+extern void run_close(run_t *r);
+
+#endif
@@ -1,15 +1,10 @@
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "sym.h"
 
-extern int n;
-
-/* We're not handling order-4 symmetries for now (rot90/rot270) */
-/*
- *  sym_t sym_order[SYM_ORDER] = { xY, Xy, XY, yx, yX, Yx, YX };
- */
-sym_t sym_order[SYM_ORDER] = { xY, Xy, XY, yx, YX };
+sym_t sym_order[SYM_ORDER] = { xY, Xy, XY, yx, yX, Yx, YX };
 
 /*
     Return true if the dimensions of a grid are transposed by this symmetry.
@@ -49,46 +44,80 @@ loc_t sym_transloc(sym_t s, span_t span, loc_t l) {
 }
 
 /*
-    Return the set of symmetries shown by this arrangement of points
+    Mix a location into a 64-bit value, such that the sum of the values
+    over a set of points is a good hash of the set.
+*/
+static inline uint64_t sym_mix(loc_t l) {
+    uint64_t h = ((uint64_t)(uint32_t)l.x << 32) | (uint32_t)l.y;
+    h *= 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 29;
+    return h * 0xbf58476d1ce4e5b9ULL;
+}
+
+static int loc_cmp(const void *a, const void *b) {
+    const loc_t *la = (const loc_t *)a;
+    const loc_t *lb = (const loc_t *)b;
+    return (la->x != lb->x) ? (la->x > lb->x) - (la->x < lb->x)
+            : (la->y > lb->y) - (la->y < lb->y);
+}
+
+/*
+    Return the set of symmetries shown by this arrangement of points.
+    Each symmetry is an affine map, so it must take the sum of the points
+    to itself, which rules out most symmetries for most arrangements. For
+    those that remain we sum a hash of each transformed point in one pass,
+    and only where the sum matches that of the untransformed set do we
+    confirm the match exactly, by comparing sorted point lists.
 */
 sym_t sym_check(loc2plist_t *l2l, span_t span, int size, int power) {
-    sym_t s = 0;
-    loc_t copy[n];
+    sym_t s = 0, maybe = 0;
+    bool square = (span.max.x - span.min.x == span.max.y - span.min.y);
+    uint64_t h0 = 0, h[SYM_ORDER] = { 0 };
+    loc_t orig[size], copy[size];
+    loc_t sum = (loc_t){ 0, 0 };
+    bool sorted = 0;
 
+    for (int j = 0; j < size; ++j) {
+        orig[j] = list2p_get(l2l, j, power);
+        sum.x += orig[j].x;
+        sum.y += orig[j].y;
+    }
     for (int i = 0; i < SYM_ORDER; ++i) {
         sym_t si = sym_order[i];
-        int remain;
-
-        if (is_transpose(si)
-            && span.max.x - span.min.x != span.max.y - span.min.y
-        )
+        loc_t tsum, t0;
+        if (is_transpose(si) && !square)
             continue;
+        /* T(sum) = sum(T(p)) - (size - 1) T(0) */
+        tsum = sym_transloc(si, span, sum);
+        t0 = sym_transloc(si, span, (loc_t){ 0, 0 });
+        if (tsum.x + (size - 1) * t0.x == sum.x
+            && tsum.y + (size - 1) * t0.y == sum.y
+        )
+            maybe |= si;
+    }
+    if (!maybe)
+        return 0;
 
-        for (int j = 0; j < size; ++j)
-            copy[j] = list2p_get(l2l, j, power);
-        remain = size;
-        for (int j = 0; j < remain; ++j) {
-            loc_t this = copy[j];
-            loc_t that = sym_transloc(si, span, this);
+    for (int j = 0; j < size; ++j) {
+        h0 += sym_mix(orig[j]);
+        for (int i = 0; i < SYM_ORDER; ++i)
+            if (maybe & sym_order[i])
+                h[i] += sym_mix(sym_transloc(sym_order[i], span, orig[j]));
+    }
 
-            /* We only deal with order-2 symmetries here, so each point
-             * is either its own pair, or has a partner that we match up
-             */
-            if (loc_eq(this, that))
-                continue;
-            for (int k = j + 1; k < remain; ++k) {
-                if (loc_eq(copy[k], that)) {
-                    copy[k] = copy[--remain];
-                    goto this_ok;
-                }
-            }
-            goto this_not_ok;
-          this_ok:
-            ;
+    for (int i = 0; i < SYM_ORDER; ++i) {
+        sym_t si = sym_order[i];
+        if (!(maybe & si) || h[i] != h0)
+            continue;
+        if (!sorted) {
+            qsort(orig, size, sizeof(loc_t), loc_cmp);
+            sorted = 1;
         }
-        s |= si;
-      this_not_ok:
-        ;
+        for (int j = 0; j < size; ++j)
+            copy[j] = sym_transloc(si, span, orig[j]);
+        qsort(copy, size, sizeof(loc_t), loc_cmp);
+        if (memcmp(orig, copy, size * sizeof(loc_t)) == 0)
+            s |= si;
     }
 
     return s;
@@ -17,11 +17,7 @@ typedef unsigned char bool;
 /* Bitwise-or of the above symmetry types */
 typedef unsigned char sym_t;
 
-/* We're not handling order-4 symmetries for now (rot90/rot270) */
-/*
- *  #define SYM_ORDER 7
- */
-#define SYM_ORDER 5
+#define SYM_ORDER 7
 extern sym_t sym_order[SYM_ORDER];
 
 extern sym_t sym_check(loc2plist_t *ll, span_t span, int size, int power);
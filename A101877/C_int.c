@@ -4,14 +4,43 @@
 #include <errno.h>
 #include <sys/times.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include "pp.h"
+#include "inverse.h"
+#include "prime.h"
 
 long clock_tick;
 
 char* use_str =
-	"Usage: %s n [kstart [kend]]\n"
-	"Search for a(n) from k = (kstart or 1) to k = (kend or kstart or \\inf)\n";
+	"Usage: %s [-j N] [-I file] [-c prefix [-t secs]] [-s] [-S file] n [kstart [kend]]\n"
+	"Search for a(n) from k = (kstart or 1) to k = (kend or kstart or \\inf)\n"
+	"With -j N, search up to N values of k at once in forked workers\n"
+	"With -I file, map the inverse tables from file, creating it if needed\n"
+	"With -c prefix, checkpoint the search for each k to <prefix>.<n>.<k>\n"
+	"  on SIGUSR2 or every <secs> seconds, and resume from it if it exists\n"
+	"With -s, report counters for each level of the search on SIGUSR1 and\n"
+	"  at the end of each k; with -S file, also append them to file as CSV\n";
+
+/*
+ * With -j N, each k is searched by a forked worker whose output is captured
+ * to a temporary file. Results are printed in order of k; once some k
+ * succeeds, workers for any greater k are killed and their output dropped.
+ */
+typedef struct kjob_s {
+	pid_t pid;
+	int k;
+	FILE* out;		/* captured stdout of the worker */
+	int status;		/* -1 while running, else 1 on success, 0 on failure */
+} kjob;
+
+kjob* kjobs = (kjob*)NULL;	/* running or unreported jobs, in order of k */
+volatile int kjobcount = 0;
+
+char* ckpt_prefix = (char*)NULL;	/* checkpoint files, if any */
+int ckpt_interval = 0;				/* seconds between checkpoints, or 0 */
+int stats_on = 0;					/* TRUE to keep per-level counters */
+char* stats_csv = (char*)NULL;		/* CSV file for the counters, if any */
 
 void usage(char* prog) {
 	fprintf(stderr, use_str, prog);
@@ -19,13 +48,37 @@ void usage(char* prog) {
 }
 
 void diag_signal(int signo) {
+	int i;
+
+	/* in the parent of -j workers, pass it on */
+	if (kjobs) {
+		for (i = 0; i < kjobcount; ++i)
+			if (kjobs[i].status < 0)
+				kill(kjobs[i].pid, SIGUSR1);
+		return;
+	}
 	diag_signal_seen = 1;
 }
 
+void ckpt_signal(int signo) {
+	int i;
+
+	if (signo == SIGALRM) {
+		alarm(ckpt_interval);
+	} else if (kjobs) {
+		for (i = 0; i < kjobcount; ++i)
+			if (kjobs[i].status < 0)
+				kill(kjobs[i].pid, SIGUSR2);
+		return;
+	}
+	ckpt_signal_seen = 1;
+}
+
 void setup_signals(void) {
 	struct sigaction sa;
 
 	diag_signal_seen = 0;
+	ckpt_signal_seen = 0;
 	sa.sa_handler = &diag_signal;
 	sigemptyset(&sa.sa_mask);
 	sa.sa_flags = SA_RESTART;
@@ -34,6 +87,15 @@ void setup_signals(void) {
 		exit(1);
 	}
 	printf("Diagnostics available with 'kill -USR1 %d'\n", (int)getpid());
+	if (!ckpt_prefix)
+		return;
+	sa.sa_handler = &ckpt_signal;
+	if (sigaction(SIGUSR2, &sa, (struct sigaction*)NULL) != 0
+			|| sigaction(SIGALRM, &sa, (struct sigaction*)NULL) != 0) {
+		fprintf(stderr, "Attempt to set signal handler for SIGUSR2: %s\n", strerror(errno));
+		exit(1);
+	}
+	printf("Checkpoint available with 'kill -USR2 %d'\n", (int)getpid());
 }
 
 double timing(void) {
@@ -42,10 +104,184 @@ double timing(void) {
     return ((double)ttd.tms_utime) / clock_tick;
 }
 
+int try_k(int n, int k) {
+	int success;
+	pp_engine e;
+	char* path = (char*)NULL;
+
+	/* printf("Try n=%d, k=%d\n", n, k); */
+	setup_pp(&e, k);
+	e.stats_on = stats_on;
+	e.stats_csv = stats_csv;
+	if (ckpt_prefix) {
+		path = malloc(strlen(ckpt_prefix) + 32);
+		sprintf(path, "%s.%d.%d", ckpt_prefix, n, k);
+		e.ckpt = path;
+		alarm(ckpt_interval);
+	}
+	success = pp_find(&e, n);
+	alarm(0);
+	teardown_pp(&e);
+	free(path);
+	return success;
+}
+
+void kjob_start(int n, int k) {
+	kjob* job = &kjobs[kjobcount];
+
+	job->k = k;
+	job->status = -1;
+	job->out = tmpfile();
+	if (!job->out) {
+		fprintf(stderr, "Cannot create temporary file: %s\n", strerror(errno));
+		exit(1);
+	}
+	fflush(stdout);
+	job->pid = fork();
+	if (job->pid < 0) {
+		fprintf(stderr, "Cannot fork: %s\n", strerror(errno));
+		exit(1);
+	}
+	if (job->pid == 0) {
+		kjobs = (kjob*)NULL;
+		dup2(fileno(job->out), 1);
+		exit(try_k(n, k) ? 0 : 1);
+	}
+	++kjobcount;
+}
+
+/* Wait for any worker to finish, and record its result */
+void kjob_wait(void) {
+	int i, status;
+	pid_t pid = wait(&status);
+
+	if (pid < 0) {
+		fprintf(stderr, "wait failed: %s\n", strerror(errno));
+		exit(1);
+	}
+	for (i = 0; i < kjobcount; ++i) {
+		if (kjobs[i].pid != pid)
+			continue;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) > 1) {
+			fprintf(stderr, "Worker for k=%d failed\n", kjobs[i].k);
+			exit(1);
+		}
+		kjobs[i].status = (WEXITSTATUS(status) == 0) ? 1 : 0;
+		return;
+	}
+}
+
+/* Copy the output of the first job to stdout, and remove it */
+int kjob_report(void) {
+	char buf[4096];
+	size_t size;
+	int success = kjobs[0].status;
+
+	rewind(kjobs[0].out);
+	while ((size = fread(buf, 1, sizeof(buf), kjobs[0].out)) > 0)
+		fwrite(buf, 1, size, stdout);
+	fflush(stdout);
+	fclose(kjobs[0].out);
+	--kjobcount;
+	memmove(&kjobs[0], &kjobs[1], kjobcount * sizeof(kjob));
+	return success;
+}
+
+/* Kill and discard the jobs for k greater than kmax */
+void kjob_prune(int kmax) {
+	int i, keep = kjobcount;
+
+	/* jobs are in order of k, so those to go are at the end */
+	while (keep > 0 && kjobs[keep - 1].k > kmax)
+		--keep;
+	for (i = keep; i < kjobcount; ++i)
+		if (kjobs[i].status < 0)
+			kill(kjobs[i].pid, SIGKILL);
+	for (i = keep; i < kjobcount; ++i) {
+		if (kjobs[i].status < 0)
+			waitpid(kjobs[i].pid, (int*)NULL, 0);
+		fclose(kjobs[i].out);
+	}
+	kjobcount = keep;
+}
+
+/* Kill and discard all remaining jobs */
+void kjob_abandon(void) {
+	kjob_prune(0);
+}
+
+/*
+ * Search for a(n) from k = kstart to kend (or unbounded if kend is 0)
+ * with up to <workers> values of k in progress at once.
+ */
+void try_parallel(int n, int kstart, int kend, int workers) {
+	kjob* jobs = calloc(workers, sizeof(kjob));
+	int i, k = kstart, ksucc = 0;
+
+	kjobs = jobs;
+	while (1) {
+		/* no point trying k beyond the least known to succeed */
+		while (kjobcount < workers && (kend == 0 || k <= kend)
+				&& (ksucc == 0 || k < ksucc))
+			kjob_start(n, k++);
+		if (kjobcount == 0)
+			break;
+		kjob_wait();
+		for (i = 0; i < kjobcount; ++i) {
+			if (kjobs[i].status == 1) {
+				ksucc = kjobs[i].k;
+				kjob_prune(ksucc);
+				break;
+			}
+		}
+		while (kjobcount && kjobs[0].status >= 0) {
+			if (kjob_report()) {
+				kjob_abandon();
+				kjobs = (kjob*)NULL;
+				free(jobs);
+				return;
+			}
+		}
+	}
+	kjobs = (kjob*)NULL;
+	free(jobs);
+}
+
 int main(int argc, char** argv) {
 	int n = 0, kstart = 0, kend;
 	int i, j, success;
+	int workers = 0;
+	char* invcache = (char*)NULL;
 
+	while (argc > 1 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-j") == 0 && argc > 2) {
+			workers = atoi(argv[2]);
+			argv += 2;
+			argc -= 2;
+		} else if (strcmp(argv[1], "-c") == 0 && argc > 2) {
+			ckpt_prefix = argv[2];
+			argv += 2;
+			argc -= 2;
+		} else if (strcmp(argv[1], "-t") == 0 && argc > 2) {
+			ckpt_interval = atoi(argv[2]);
+			argv += 2;
+			argc -= 2;
+		} else if (strcmp(argv[1], "-s") == 0) {
+			stats_on = 1;
+			argv += 1;
+			argc -= 1;
+		} else if (strcmp(argv[1], "-S") == 0 && argc > 2) {
+			stats_on = 1;
+			stats_csv = argv[2];
+			argv += 2;
+			argc -= 2;
+		} else if (strcmp(argv[1], "-I") == 0 && argc > 2) {
+			invcache = argv[2];
+			argv += 2;
+			argc -= 2;
+		} else
+			usage(argv[0]);
+	}
 	if (argc > 1)
 		n = atoi(argv[1]);
 	else
@@ -56,17 +292,27 @@ int main(int argc, char** argv) {
 		kend = atoi(argv[3]);
 	else
 		kend = kstart;
+	/* before any workers are forked, so only one writes it */
+	if (stats_csv && !pp_stats_csv_header(stats_csv))
+		exit(1);
 	setup_signals();
+	setup_inverse();
+	/* tables for primes beyond the cache are built as needed */
+	if (invcache && !inverse_load(invcache, kend ? kend : kstart))
+		fprintf(stderr, "Inverse cache %s not used\n", invcache);
     clock_tick = sysconf(_SC_CLK_TCK);
 	for (i = n ? n : 1; n ? (i <= n) : 1; ++i) {
+		if (workers > 1) {
+			try_parallel(i, kstart ? kstart : 1, kend, workers);
+			continue;
+		}
 		for (j = kstart ? kstart : 1; kend ? (j <= kend) : 1; ++j) {
-			/* printf("Try n=%d, k=%d\n", i, j); */
-			setup_pp(j);
-			success = pp_find(i);
-			teardown_pp();
+			success = try_k(i, j);
 			if (success)
 				break;
 		}
 	}
+	teardown_inverse();
+	teardown_prime();
 	return 0;
 }
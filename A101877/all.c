@@ -0,0 +1,3083 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/times.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "pp.h"
+#include "inverse.h"
+#include "prime.h"
+
+long clock_tick;
+
+char* use_str =
+	"Usage: %s [-j N] [-I file] [-c prefix [-t secs]] [-s] [-S file] n [kstart [kend]]\n"
+	"Search for a(n) from k = (kstart or 1) to k = (kend or kstart or \\inf)\n"
+	"With -j N, search up to N values of k at once in forked workers\n"
+	"With -I file, map the inverse tables from file, creating it if needed\n"
+	"With -c prefix, checkpoint the search for each k to <prefix>.<n>.<k>\n"
+	"  on SIGUSR2 or every <secs> seconds, and resume from it if it exists\n"
+	"With -s, report counters for each level of the search on SIGUSR1 and\n"
+	"  at the end of each k; with -S file, also append them to file as CSV\n";
+
+/*
+ * With -j N, each k is searched by a forked worker whose output is captured
+ * to a temporary file. Results are printed in order of k; once some k
+ * succeeds, workers for any greater k are killed and their output dropped.
+ */
+typedef struct kjob_s {
+	pid_t pid;
+	int k;
+	FILE* out;		/* captured stdout of the worker */
+	int status;		/* -1 while running, else 1 on success, 0 on failure */
+} kjob;
+
+kjob* kjobs = (kjob*)NULL;	/* running or unreported jobs, in order of k */
+volatile int kjobcount = 0;
+
+char* ckpt_prefix = (char*)NULL;	/* checkpoint files, if any */
+int ckpt_interval = 0;				/* seconds between checkpoints, or 0 */
+int stats_on = 0;					/* TRUE to keep per-level counters */
+char* stats_csv = (char*)NULL;		/* CSV file for the counters, if any */
+
+void usage(char* prog) {
+	fprintf(stderr, use_str, prog);
+	exit(0);
+}
+
+void diag_signal(int signo) {
+	int i;
+
+	/* in the parent of -j workers, pass it on */
+	if (kjobs) {
+		for (i = 0; i < kjobcount; ++i)
+			if (kjobs[i].status < 0)
+				kill(kjobs[i].pid, SIGUSR1);
+		return;
+	}
+	diag_signal_seen = 1;
+}
+
+void ckpt_signal(int signo) {
+	int i;
+
+	if (signo == SIGALRM) {
+		alarm(ckpt_interval);
+	} else if (kjobs) {
+		for (i = 0; i < kjobcount; ++i)
+			if (kjobs[i].status < 0)
+				kill(kjobs[i].pid, SIGUSR2);
+		return;
+	}
+	ckpt_signal_seen = 1;
+}
+
+void setup_signals(void) {
+	struct sigaction sa;
+
+	diag_signal_seen = 0;
+	ckpt_signal_seen = 0;
+	sa.sa_handler = &diag_signal;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	if (sigaction(SIGUSR1, &sa, (struct sigaction*)NULL) != 0) {
+		fprintf(stderr, "Attempt to set signal handler for SIGUSR1: %s\n", strerror(errno));
+		exit(1);
+	}
+	printf("Diagnostics available with 'kill -USR1 %d'\n", (int)getpid());
+	if (!ckpt_prefix)
+		return;
+	sa.sa_handler = &ckpt_signal;
+	if (sigaction(SIGUSR2, &sa, (struct sigaction*)NULL) != 0
+			|| sigaction(SIGALRM, &sa, (struct sigaction*)NULL) != 0) {
+		fprintf(stderr, "Attempt to set signal handler for SIGUSR2: %s\n", strerror(errno));
+		exit(1);
+	}
+	printf("Checkpoint available with 'kill -USR2 %d'\n", (int)getpid());
+}
+
+double timing(void) {
+    struct tms ttd;
+    times(&ttd);
+    return ((double)ttd.tms_utime) / clock_tick;
+}
+
+int try_k(int n, int k) {
+	int success;
+	pp_engine e;
+	char* path = (char*)NULL;
+
+	/* printf("Try n=%d, k=%d\n", n, k); */
+	setup_pp(&e, k);
+	e.stats_on = stats_on;
+	e.stats_csv = stats_csv;
+	if (ckpt_prefix) {
+		path = malloc(strlen(ckpt_prefix) + 32);
+		sprintf(path, "%s.%d.%d", ckpt_prefix, n, k);
+		e.ckpt = path;
+		alarm(ckpt_interval);
+	}
+	success = pp_find(&e, n);
+	alarm(0);
+	teardown_pp(&e);
+	free(path);
+	return success;
+}
+
+void kjob_start(int n, int k) {
+	kjob* job = &kjobs[kjobcount];
+
+	job->k = k;
+	job->status = -1;
+	job->out = tmpfile();
+	if (!job->out) {
+		fprintf(stderr, "Cannot create temporary file: %s\n", strerror(errno));
+		exit(1);
+	}
+	fflush(stdout);
+	job->pid = fork();
+	if (job->pid < 0) {
+		fprintf(stderr, "Cannot fork: %s\n", strerror(errno));
+		exit(1);
+	}
+	if (job->pid == 0) {
+		kjobs = (kjob*)NULL;
+		dup2(fileno(job->out), 1);
+		exit(try_k(n, k) ? 0 : 1);
+	}
+	++kjobcount;
+}
+
+/* Wait for any worker to finish, and record its result */
+void kjob_wait(void) {
+	int i, status;
+	pid_t pid = wait(&status);
+
+	if (pid < 0) {
+		fprintf(stderr, "wait failed: %s\n", strerror(errno));
+		exit(1);
+	}
+	for (i = 0; i < kjobcount; ++i) {
+		if (kjobs[i].pid != pid)
+			continue;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) > 1) {
+			fprintf(stderr, "Worker for k=%d failed\n", kjobs[i].k);
+			exit(1);
+		}
+		kjobs[i].status = (WEXITSTATUS(status) == 0) ? 1 : 0;
+		return;
+	}
+}
+
+/* Copy the output of the first job to stdout, and remove it */
+int kjob_report(void) {
+	char buf[4096];
+	size_t size;
+	int success = kjobs[0].status;
+
+	rewind(kjobs[0].out);
+	while ((size = fread(buf, 1, sizeof(buf), kjobs[0].out)) > 0)
+		fwrite(buf, 1, size, stdout);
+	fflush(stdout);
+	fclose(kjobs[0].out);
+	--kjobcount;
+	memmove(&kjobs[0], &kjobs[1], kjobcount * sizeof(kjob));
+	return success;
+}
+
+/* Kill and discard the jobs for k greater than kmax */
+void kjob_prune(int kmax) {
+	int i, keep = kjobcount;
+
+	/* jobs are in order of k, so those to go are at the end */
+	while (keep > 0 && kjobs[keep - 1].k > kmax)
+		--keep;
+	for (i = keep; i < kjobcount; ++i)
+		if (kjobs[i].status < 0)
+			kill(kjobs[i].pid, SIGKILL);
+	for (i = keep; i < kjobcount; ++i) {
+		if (kjobs[i].status < 0)
+			waitpid(kjobs[i].pid, (int*)NULL, 0);
+		fclose(kjobs[i].out);
+	}
+	kjobcount = keep;
+}
+
+/* Kill and discard all remaining jobs */
+void kjob_abandon(void) {
+	kjob_prune(0);
+}
+
+/*
+ * Search for a(n) from k = kstart to kend (or unbounded if kend is 0)
+ * with up to <workers> values of k in progress at once.
+ */
+void try_parallel(int n, int kstart, int kend, int workers) {
+	kjob* jobs = calloc(workers, sizeof(kjob));
+	int i, k = kstart, ksucc = 0;
+
+	kjobs = jobs;
+	while (1) {
+		/* no point trying k beyond the least known to succeed */
+		while (kjobcount < workers && (kend == 0 || k <= kend)
+				&& (ksucc == 0 || k < ksucc))
+			kjob_start(n, k++);
+		if (kjobcount == 0)
+			break;
+		kjob_wait();
+		for (i = 0; i < kjobcount; ++i) {
+			if (kjobs[i].status == 1) {
+				ksucc = kjobs[i].k;
+				kjob_prune(ksucc);
+				break;
+			}
+		}
+		while (kjobcount && kjobs[0].status >= 0) {
+			if (kjob_report()) {
+				kjob_abandon();
+				kjobs = (kjob*)NULL;
+				free(jobs);
+				return;
+			}
+		}
+	}
+	kjobs = (kjob*)NULL;
+	free(jobs);
+}
+
+int main(int argc, char** argv) {
+	int n = 0, kstart = 0, kend;
+	int i, j, success;
+	int workers = 0;
+	char* invcache = (char*)NULL;
+
+	while (argc > 1 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-j") == 0 && argc > 2) {
+			workers = atoi(argv[2]);
+			argv += 2;
+			argc -= 2;
+		} else if (strcmp(argv[1], "-c") == 0 && argc > 2) {
+			ckpt_prefix = argv[2];
+			argv += 2;
+			argc -= 2;
+		} else if (strcmp(argv[1], "-t") == 0 && argc > 2) {
+			ckpt_interval = atoi(argv[2]);
+			argv += 2;
+			argc -= 2;
+		} else if (strcmp(argv[1], "-s") == 0) {
+			stats_on = 1;
+			argv += 1;
+			argc -= 1;
+		} else if (strcmp(argv[1], "-S") == 0 && argc > 2) {
+			stats_on = 1;
+			stats_csv = argv[2];
+			argv += 2;
+			argc -= 2;
+		} else if (strcmp(argv[1], "-I") == 0 && argc > 2) {
+			invcache = argv[2];
+			argv += 2;
+			argc -= 2;
+		} else
+			usage(argv[0]);
+	}
+	if (argc > 1)
+		n = atoi(argv[1]);
+	else
+		usage(argv[0]);
+	if (argc > 2)
+		kstart = atoi(argv[2]);
+	if (argc > 3)
+		kend = atoi(argv[3]);
+	else
+		kend = kstart;
+	/* before any workers are forked, so only one writes it */
+	if (stats_csv && !pp_stats_csv_header(stats_csv))
+		exit(1);
+	setup_signals();
+	setup_inverse();
+	/* tables for primes beyond the cache are built as needed */
+	if (invcache && !inverse_load(invcache, kend ? kend : kstart))
+		fprintf(stderr, "Inverse cache %s not used\n", invcache);
+    clock_tick = sysconf(_SC_CLK_TCK);
+	for (i = n ? n : 1; n ? (i <= n) : 1; ++i) {
+		if (workers > 1) {
+			try_parallel(i, kstart ? kstart : 1, kend, workers);
+			continue;
+		}
+		for (j = kstart ? kstart : 1; kend ? (j <= kend) : 1; ++j) {
+			success = try_k(i, j);
+			if (success)
+				break;
+		}
+	}
+	teardown_inverse();
+	teardown_prime();
+	return 0;
+}
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "pp.h"
+#include "prime.h"
+#include "inverse.h"
+#include "walker.h"
+
+extern double timing(void);
+
+#ifdef DEBUG
+#include <stdarg.h>
+static inline int Dprintf(char* format, ...) {
+	int result;
+	va_list ap;
+	va_start(ap, format);
+	result = gmp_vprintf(format, ap);
+	va_end(ap);
+	return result;
+}
+#else
+static inline int Dprintf(char* format, ...) {
+	return 0;
+}
+#endif
+
+/* We rely on calculating ab (mod p) by simple multiplication */
+#define MAX_P 65536
+
+volatile char diag_signal_seen;
+volatile char ckpt_signal_seen;
+
+/* I can never remember the name of this GMP function */
+static inline unsigned int mod_ui(mpz_t z, unsigned int u) {
+	return mpz_fdiv_ui(z, u);
+}
+
+/* A surprising omission from the exported mpq_* functions */
+static inline void mpq_mul_z(mpq_t dest, mpq_t src1, mpz_t src2) {
+	mpz_mul(mpq_numref(dest), mpq_numref(src1), src2);
+	if (&dest != &src1)
+		mpz_set(mpq_denref(dest), mpq_denref(src1));
+	mpq_canonicalize(dest);
+}
+
+inline mpx_t ppv_mpx(pp_value* ppv) {
+	return (mpx_t)&ppv->limbs[0];
+}
+
+inline int pp_valsize_n(int numsize) {
+	return sizeof(pp_value) + numsize * sizeof(mp_limb_t);
+}
+
+inline int pp_valsize(pp_pp* pp) {
+	return pp_valsize_n(pp->valnumsize);
+}
+
+inline pp_value* ppv_value_n_i(pp_value* ppv, int numsize, int index) {
+	return (pp_value*)((char*)ppv + index * pp_valsize_n(numsize));
+}
+
+inline pp_value* pp_value_i(pp_pp* pp, int index) {
+	return ppv_value_n_i(pp->value, pp->valnumsize, index);
+}
+
+void setup_pp(pp_engine* e, int k) {
+	int i, d, q;
+
+	e->k0 = k;
+	e->ckpt = (char*)NULL;
+	e->stats_on = 0;
+	e->stats_csv = (char*)NULL;
+	e->stats = (pp_level_stats*)NULL;
+	setup_walker(&e->walk);
+	e->pppp = calloc(k + 1, sizeof(pp_pp));
+	e->pplist = (pp_pp**)NULL;
+	e->pplistsize = 0;
+	e->pplistmax = 0;
+	ZINIT(&e->z_no_previous, "z_no_previous");
+	mpz_set_si(e->z_no_previous, -1);
+	setup_prime(k);
+	
+	for (i = 1; i <= k; ++i) {
+		int prime, power;
+		power = greatest_prime_power(i, &prime);
+		pp_save_r(e, i, prime, power);
+	}
+}
+
+void pp_free(pp_engine* e, pp_pp* pp) {
+	int i;
+	free(pp->value);
+	free(pp->resmin);
+	free(pp->resok);
+	QCLEAR(&pp->spare, "pp_%d.spare", pp->pp);
+	ZCLEAR(&pp->min_discard, "pp_%d.min_discard", pp->pp);
+	ZCLEAR(&pp->denominator, "pp_%d.denominator", pp->pp);
+	ZCLEAR(&pp->total, "pp_%d.total", pp->pp);
+	if (pp->wrh)
+		wr_clone_free(&e->walk, pp->wh, pp->wrh);
+	if (pp->wh)
+		delete_walker(&e->walk, pp->wh);
+}
+
+void teardown_pp(pp_engine* e) {
+	int i;
+	pp_pp* pp;
+
+	ZCLEAR(&e->z_no_previous, "z_no_previous");
+	/* pp->wrh is not a clone (needing free()) iff pp is in pplist */
+	for (i = 0; i < e->pplistsize; ++i)
+		e->pplist[i]->wrh = (wrhp)0;
+	for (i = 0; i <= e->k0; ++i)
+		if (e->pppp[i].pp)
+			pp_free(e, &e->pppp[i]);
+	free(e->pplist);
+	free(e->pppp);
+	free(e->stats);
+	teardown_walker(&e->walk);
+}
+
+/*
+ * Qsort comparison function for pplist
+ * Dependent pp sort in descending order; independent pp sort in ascending
+ * order; dependent pp sort after only those independent pp on which they
+ * depend.
+ * Since qsort() passes no context, k0 for the list being sorted is
+ * supplied per thread in listcmp_k0.
+ */
+static __thread int listcmp_k0;
+int pp_listcmp(const void* a, const void* b) {
+	int k0 = listcmp_k0;
+	pp_pp* left = *(pp_pp**)a;
+	pp_pp* right = *(pp_pp**)b;
+
+	if (left->depend) {
+		if (right->depend) {
+			/* dependent PP sort in descending order */
+			return right->pp - left->pp;
+		} else {
+			/* dependent PP sorts after any independent it depends on */
+			return (left->pp * right->pp <= k0) ? +1 : -1;
+		}
+	} else { /* !left->depend */
+		if (right->depend) {
+			/* independent PP sorts before any PP dependent on it */
+			return (left->pp * right->pp <= k0) ? -1 : +1;
+		} else {
+			/* independent PP sort in ascending order */
+			return left->pp - right->pp;
+		}
+	}
+}
+
+void pp_grow(pp_pp* pp, int size) {
+	int i;
+	if (pp->valmax < size) {
+		pp->value = realloc(pp->value, size * pp_valsize(pp));
+		pp->valmax = size;
+	}
+}
+
+void pp_grownum(pp_pp* pp, int newsize) {
+	int i;
+	pp_value *newpv, *newi, *oldi;
+
+	newpv = malloc(pp->valmax * pp_valsize_n(newsize));
+	for (i = 0; i < pp->valsize; ++i) {
+		newi = ppv_value_n_i(newpv, newsize, i);
+		oldi = pp_value_i(pp, i);
+		newi->self = oldi->self;
+		newi->parent = oldi->parent;
+		newi->inv = oldi->inv;
+		mpx_set(ppv_mpx(newi), newsize, ppv_mpx(oldi), pp->valnumsize);
+	}
+	free(pp->value);
+	pp->valnumsize = newsize;
+	pp->value = newpv;
+}
+
+/*
+ * Include a PP structure in the pplist.
+ * Inputs:
+ *   pp_pp* pp: a pointer to the PP structure to include
+ * Returns:
+ *   Nothing.
+ * Notes:
+ *   The list is kept in descending order of pp, and sorted later using
+ *   pp_listcmp().
+ */
+void pp_pushlist(pp_engine* e, pp_pp* pp) {
+	if (e->pplistsize + 1 >= e->pplistmax) {
+		int old = e->pplistmax;
+		e->pplistmax = e->pplistmax * 3 / 2;
+		if (e->pplistmax < MINPPSET)
+			e->pplistmax = MINPPSET;
+		e->pplist = realloc(e->pplist, e->pplistmax * sizeof(e->pplist[0]));
+	}
+	if (e->pplistsize)
+		memmove(&e->pplist[1], &e->pplist[0],
+				e->pplistsize * sizeof(e->pplist[0]));
+	++e->pplistsize;
+	e->pplist[0] = pp;
+}
+
+/*
+ * Remove a PP structure from the pplist.
+ * Inputs:
+ *   int i: the index in the list to be removed
+ * Returns:
+ *   Nothing.
+ * Notes:
+ *   The order of the remaining list items is preserved.
+ */
+void pp_listsplice(pp_engine* e, int i) {
+	pp_pp* pp = e->pplist[i];
+	if (i < --e->pplistsize)
+		memmove(&e->pplist[i], &e->pplist[i + 1],
+				(e->pplistsize - i) * sizeof(e->pplist[0]));
+	/* Cannot free pp, the values may still be referenced */
+}
+
+/*
+ * Sort the values in a PP structure, given that only the last-added value
+ * may be out of order.
+ * Input:
+ *   pp_pp* pp: pointer to the PP structure to sort.
+ * Returns:
+ *   Nothing.
+ * Caveats:
+ *   No guarantees are made about a stable sort: pp_value structures with
+ * equal values may be sorted in any order.
+ */
+void pp_insert_last(pp_pp* pp) {
+	int size = pp->valsize - 1;
+	pp_value* v = malloc(pp_valsize(pp));
+	mpx_support* xsup = mpx_support_n(pp->valnumsize);
+	int low, high, med, sign;
+
+	memcpy(v, pp_value_i(pp, size), pp_valsize(pp));
+	/* invariant: pp_value_i(pp, low) <= v <= pp_value_i(pp, high) */
+	low = -1;
+	high = size + 1;
+	while (low + 1 < high) {
+		med = (low + high) >> 1;
+		sign = xsup->cmper(ppv_mpx(v), ppv_mpx(pp_value_i(pp, med)));
+		if (sign < 0)
+			low = med;
+		else
+			high = med;
+	}
+	if (high + 1 < size) {
+		memmove(pp_value_i(pp, high + 1), pp_value_i(pp, high),
+				(size - high) * pp_valsize(pp));
+		memcpy(pp_value_i(pp, high), v, pp_valsize(pp));
+	}
+	free(v);
+}
+
+/*
+ * Store a value in a PP structure.
+ * Input:
+ *   pp_pp* pp: pointer to the PP structure to store in
+ *   mpq_t value: the value to store
+ *   int parent: the parent to refer to
+ *   int self: TRUE if value represents 1/parent, FALSE if it represents the
+ *     resolution of pp[parent]
+ * Returns:
+ *   Nothing.
+ * Effect:
+ *   The specified value is stored in the specified PP structure, with a
+ * reference to the specified parent. Internal variables are updated
+ * accordingly.
+ *
+ * For a given value q, the caller is expected to have determined the
+ * greatest prime power p^k dividing the denominator of q. In this case,
+ * the pp structure should be that for p^k.
+ *
+ * The parent is used solely for determining a final solution vector.
+ * If the value is a source value (i.e. 1/r representing the integer
+ * r in the solution vector), the parent should be set to r, and self should
+ * be TRUE. If not, the parent is assumed to be a fully resolved PP structure
+ * storing a walk result that specifies the actual vector contribution
+ * (possibly recursively), and self should be FALSE.
+ */
+void pp_save_any(pp_pp* pp, mpq_t value, int parent, int self) {
+	int i;
+	mpz_t zvalue;
+	pp_value* v;
+	ZINIT(&zvalue, "pp_save_any zvalue");
+
+	/* new value = mpq_numref(value) * (denominator / mpq_denref(value))
+	 * new_pp() setting of denominator guarantees exactness
+	 */
+	mpz_divexact(zvalue, pp->denominator, mpq_denref(value));
+	mpz_mul(zvalue, zvalue, mpq_numref(value));
+
+	/* adding to total may change required fixed size, at worst once per pp */
+	mpz_add(pp->total, pp->total, zvalue);
+	if (pp->total->_mp_size > pp->valnumsize) {
+		Dprintf("pp_%d: growing to %d with total %Zd (denom %Zd)\n",
+				pp->pp, pp->total->_mp_size, pp->total, pp->denominator);
+		pp_grownum(pp, pp->total->_mp_size);
+	}
+
+	++pp->valsize;
+	pp_grow(pp, pp->valsize);
+	v = pp_value_i(pp, pp->valsize - 1);
+	v->parent = parent;
+	v->self = self;
+	v->inv = (pp->invdenom * mod_ui(zvalue, pp->p)) % pp->p; /* ref: MAX_P */
+	mpx_set_z(ppv_mpx(v), pp->valnumsize, zvalue);
+	pp->invtotal = (pp->invtotal + v->inv) % pp->p;
+	pp_insert_last(pp);
+	ZCLEAR(&zvalue, "pp_save_any zvalue");
+}
+
+void new_pp(pp_engine* e, pp_pp* pp, int prime, int power) {
+	int i, set;
+	mpz_t reduced_denom;
+	mpx_support* xsup;
+
+	if (prime > MAX_P) {
+		fprintf(stderr, "prime %d exceeds max %d\n", prime, MAX_P);
+		exit(1);
+	}
+	pp->p = prime;
+	pp->pp = power;
+	if (pp->p == pp->pp)
+		inverse_table(pp->p);
+	pp_pushlist(e, pp);
+	ZINIT(&pp->total, "pp_%d.total", pp->pp);
+	ZINIT(&pp->denominator, "pp_%d.denominator", pp->pp);
+	ZINIT(&pp->min_discard, "pp_%d.min_discard", pp->pp);
+	QINIT(&pp->spare, "pp_%d.spare", pp->pp);
+
+	/* required denominator is the lcm of (power, S) where S contains those
+	 * pp such that pp * power <= k.
+	 */
+	ZINIT(&reduced_denom, "new_pp reduced_denom");
+	set = 0;
+	/* start from pplist[1], because we've already been inserted at [0] */
+	for (i = 1; i < e->pplistsize; ++i) {
+		if (e->pplist[i]->pp * power <= e->k0) {
+			mpz_mul_ui(pp->denominator, e->pplist[i]->denominator,
+					power / mpz_gcd_ui(NULL, e->pplist[i]->denominator, power));
+			set = 1;
+			break;
+		}
+	}
+	if (!set) {
+		/* power == 1 */
+		if (power != 1) {
+			fprintf(stderr, "new_pp: did not find denominator for %d\n", power);
+			exit(1);
+		}
+		mpz_set_ui(pp->denominator, 1);
+	}
+	mpz_divexact_ui(reduced_denom, pp->denominator, power);
+	pp->invdenom = invfast(mod_ui(reduced_denom, pp->p), pp->p);
+	ZCLEAR(&reduced_denom, "new_pp reduced_denom");
+
+	xsup = mpx_support_z(pp->denominator);
+	pp->valnumsize = xsup->size;
+	pp_grow(pp, MINPPSET);
+}
+
+void pp_save_r(pp_engine* e, int n, int prime, int power) {
+	pp_pp* pp = &e->pppp[power];
+	pp_value* v;
+	int i, raise;
+	mpq_t q;
+	if (!pp->p)
+		new_pp(e, pp, prime, power);
+	QINIT(&q, "pp_save_r temp");
+	mpq_set_ui(q, 1, n);
+	pp_save_any(pp, q, n, 1);
+	QCLEAR(&q, "pp_save_r temp");
+}
+
+void pp_save_w(pp_engine* e, whp wh, wrhp wrh, pp_pp* from) {
+	mpq_t actual;
+	mpz_t discard;
+	int pp_effective = from->pp;
+	int pp_applied = 1;
+	int pp_p = from->p;
+	int q, to, shared;
+	pp_pp* pp;
+	pp_value* v;
+
+	ZINIT(&discard, "pp_save_w discard");
+	QINIT(&actual, "pp_save_w temp");
+	mpz_set_x(discard, wr_discard(&e->walk, wh, wrh), from->valnumsize);
+	Dprintf("save wr: %Zd / %Zd [%d] from %d (%d)\n", discard,
+			from->denominator, wr_vec(&e->walk, wh, wrh)[0], from->pp, from->p);
+	mpz_sub(mpq_numref(actual), from->total, discard);
+	mpz_set(mpq_denref(actual), from->denominator);
+	mpq_canonicalize(actual);
+
+	to = z_greatest_prime_power(mpq_denref(actual), (int*)NULL);
+	pp_save_any(&e->pppp[to], actual, from->pp, 0);
+	QCLEAR(&actual, "pp_save_w temp");
+	ZCLEAR(&discard, "pp_save_w discard");
+}
+
+/*
+ * Resolve simple cases from the pp list
+ * For each PP structure, in descending order of pp value:
+ * - if a walker finds no way to keep any of the values, discard the PP
+ * - if a walker find precisely one way to keep some values:
+ *   - save the walk_result representing that way in the PP structure
+ *   - add the relevant sum to the appropriate PP structure
+ *   - remove this PP from the pp list
+ *   - note that this is safe to do only because we know this PP's
+ *     total can no longer change, so valnumsize is fixed
+ * - for remaining PP structures, mark whether they are dependent on any
+ *   higher pp in the pp list
+ */
+void pp_resolve_simple(pp_engine* e) {
+	walk_arena* wa = &e->walk;
+	int i, dest;
+	pp_pp *pp;
+	whp wh;
+	wrhp wrh1, wrh2;
+	mpz_t ztotal;
+
+	ZINIT(&ztotal, "pp_resolve_simple ztotal");
+	for (i = 0; i < e->pplistsize; ++i) {
+		pp = e->pplist[i];
+		if (i == 0 || pp->pp * e->pplist[i - 1]->pp > e->k0) {
+			/* we are only interested in subsets that keep at least one
+			 * element, so we set the discard limit to (total - 1)
+			 */
+			mpz_sub_ui(ztotal, pp->total, 1);
+			wh = new_walker(wa, pp, ztotal, pp->invtotal);
+			wrh1 = walker_findnext(wa, wh);
+			if (!wrh1) {
+				delete_walker(wa, wh);
+				pp_listsplice(e, i);
+				--i;
+				continue;
+			}
+			wrh1 = wr_clone(wa, wh, wrh1);
+			wrh2 = walker_findnext(wa, wh);
+			if (!wrh2) {
+				pp->wh = wh;
+				pp->wrh = wrh1;
+				pp_save_w(e, wh, wrh1, pp);
+				pp_listsplice(e, i);
+				--i;
+				continue;
+			}
+			mpz_set_x(pp->min_discard, wr_discard(wa, wh, wrh1),
+					pp->valnumsize);
+			wr_clone_free(wa, wh, wrh1);
+			delete_walker(wa, wh);
+		}
+		for (dest = e->pplistsize - 1; dest > i; --dest) {
+			if (pp->pp * e->pplist[dest]->pp <= e->k0)
+				e->pplist[dest]->depend = 1;
+			else
+				break;
+		}
+	}
+	ZCLEAR(&ztotal, "pp_resolve_simple ztotal");
+}
+
+void pp_init_spare(pp_engine* e, int target) {
+	int i;
+	pp_pp *pp, *top;
+	mpq_t spare;
+
+	/* everything resolved: pp_find() will report no solution */
+	if (e->pplistsize == 0)
+		return;
+	QINIT(&spare, "pp_study spare");
+	top = e->pplist[0];
+	mpq_set_si(top->spare, -target, 1);
+	for (i = 0; i < e->pplistsize; ++i) {
+		int g;
+
+		pp = e->pplist[i];
+		mpz_sub(mpq_numref(spare), pp->total, pp->min_discard);
+		mpz_set(mpq_denref(spare), pp->denominator);
+		mpq_canonicalize(spare);
+		mpq_add(top->spare, top->spare, spare);
+	}
+	QCLEAR(&spare, "pp_study spare");
+	Dprintf("study: spare = %Qd\n", top->spare);
+}
+
+/*
+ * Find the residues (mod p) reachable as the invsum of some discard from
+ * the values of a PP structure, and the least discard reaching each.
+ * Input:
+ *   pp_pp* pp: the PP structure, whose values must no longer change
+ * Returns:
+ *   Nothing; fills in pp->resok[] and pp->resmin[].
+ * Notes:
+ *   This is a subset-sum over the values mod p, O(valsize * p). It
+ * lets pp_find() skip a walker whose target invsum cannot be reached
+ * within its limit, and lower the limit of one that can: a discard with
+ * invsum r keeps values with invsum (invtotal - r), so can be no greater
+ * than total less the least discard reaching that.
+ */
+void pp_residues(pp_pp* pp) {
+	int n = pp->valnumsize, p = pp->p;
+	mp_limb_t* prevmin = malloc(p * n * sizeof(mp_limb_t));
+	char* prevok = malloc(p);
+	mp_limb_t sum[MPX_MAXLIMBS];
+	pp_value* v;
+	int i, r, s;
+
+	pp->resmin = malloc(p * n * sizeof(mp_limb_t));
+	pp->resok = calloc(p, 1);
+	mpx_set_ui(&pp->resmin[0], n, 0);
+	pp->resok[0] = 1;
+	for (i = 0; i < pp->valsize; ++i) {
+		v = pp_value_i(pp, i);
+		memcpy(prevmin, pp->resmin, p * n * sizeof(mp_limb_t));
+		memcpy(prevok, pp->resok, p);
+		for (r = 0; r < p; ++r) {
+			if (!prevok[r])
+				continue;
+			s = (r + v->inv) % p;
+			mpx_add_n(sum, &prevmin[r * n], ppv_mpx(v), n);
+			if (!pp->resok[s] || mpx_cmp_n(sum, &pp->resmin[s * n], n) < 0) {
+				mpx_set(&pp->resmin[s * n], n, sum, n);
+				pp->resok[s] = 1;
+			}
+		}
+	}
+	free(prevok);
+	free(prevmin);
+}
+
+/*
+ * Given the target invsum and limit for a walker at the level of pp,
+ * return FALSE if no discard within the limit can reach the target, else
+ * lower the limit if possible to the greatest discard that can reach it
+ * and return TRUE.
+ * Notes:
+ *   Independent PP always have invsum = invtotal, reached at min_discard
+ * within any limit, so gain nothing. The residues of a dependent PP are
+ * found when first needed, since many levels are never reached.
+ */
+int pp_residue_limit(pp_pp* pp, int invsum, mpz_t limit, mpz_t z) {
+	int n = pp->valnumsize;
+
+	if (!pp->depend || invsum < 0)
+		return 1;
+	if (!pp->resok)
+		pp_residues(pp);
+	if (!pp->resok[invsum])
+		return 0;
+	mpz_set_x(z, &pp->resmin[invsum * n], n);
+	if (mpz_cmp(z, limit) > 0)
+		return 0;
+	/* resok[invsum] implies resok[] of the complement */
+	invsum = (pp->invtotal - invsum + pp->p) % pp->p;
+	mpz_set_x(z, &pp->resmin[invsum * n], n);
+	mpz_sub(z, pp->total, z);
+	if (mpz_cmp(z, limit) < 0)
+		mpz_set(limit, z);
+	return 1;
+}
+
+void pp_study(pp_engine* e, int target) {
+	int i;
+	pp_pp *pp, *top;
+	mpq_t spare;
+
+	/* delete independent PP that provide no lines
+	 * resolve independent PP that provide only one line
+	 * mark dependent PP as dependent
+	 */
+	pp_resolve_simple(e);
+
+	/* now sort pplist so as to satisfy dependencies as early as possible,
+	 * and handle dependent PP as soon as dependencies are satisfied
+	 */
+	listcmp_k0 = e->k0;
+	qsort(e->pplist, e->pplistsize, sizeof(e->pplist[0]), &pp_listcmp);
+
+	/* set initial spare ready for pp_find() recursion
+	 */
+	pp_init_spare(e, target);
+}
+
+static inline void pp_setbit(int* vec, int bit) {
+	int byte = bit >> 5;
+	int offset = 1 << (bit & 31);
+	vec[byte] |= offset;
+}
+
+static inline int pp_testbit(int* vec, int bit) {
+	int byte = bit >> 5;
+	int offset = 1 << (bit & 31);
+	return (vec[byte] & offset) ? 1 : 0;
+}
+
+void pp_setvec(pp_engine* e, int* vec, pp_pp* pp, int* invec) {
+	int i;
+	pp_value* v;
+	pp_pp* dad;
+
+	for (i = 0; i < pp->valsize; ++i) {
+		if (invec && pp_testbit(invec, i)) 
+			continue;
+		v = pp_value_i(pp, i);
+		if (v->self) {
+			pp_setbit(vec, v->parent);
+		} else {
+			/* this entry comprises multiple values from the parent */
+			dad = &e->pppp[v->parent];
+			pp_setvec(e, vec, dad, wr_vec(&e->walk, dad->wh, dad->wrh));
+		}
+	}
+}
+
+int pp_solution(pp_engine* e, int index) {
+	pp_pp *pp, *cur;
+	int* v;
+	int i, r;
+	int k0 = e->k0;
+
+	cur = e->pplist[index];
+	if (mpz_cmp_ui(mpq_numref(cur->spare), 1) > 0)
+		return 0;
+	r = mpz_get_ui(mpq_numref(cur->spare));
+	if (r == 1 && mpz_cmp_ui(mpq_denref(cur->spare), k0) > 0)
+		return 0;
+	r = (r == 0) ? 0 : mpz_get_ui(mpq_denref(cur->spare));
+
+	/* probable solution: spare == 0 or spare == 1/r, 1 <= r <= k0 */
+	gmp_printf("probable solution, spare = %Qd\n", cur->spare);
+	v = calloc((k0 + 32) >> 5, sizeof(int));
+	for (i = 0; i < e->pplistsize; ++i) {
+		pp = e->pplist[i];
+		if (pp->wrh) {
+			pp_setvec(e, v, pp, wr_vec(&e->walk, pp->wh, pp->wrh));
+		} else {
+			pp_setvec(e, v, pp, (int*)NULL);
+		}
+	}
+
+	if (pp_testbit(v, r)) {
+		/* exact solution */
+		v[r >> 5] &= ~(1 << (r & 31));
+	} else {
+		/* inexact, maybe fixable */
+		printf("inexact(%d): ", r);
+	}
+	for (i = 0; i <= k0; ++i)
+		if (pp_testbit(v, i))
+			printf("%d ", i);
+	printf("\nSuccess after %.2fs\n", timing());
+	free(v);
+	return 1;
+}
+
+static double stats_clock(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Start keeping per-level counters for pp_find(), if e->stats_on.
+ */
+static void pp_stats_start(pp_engine* e, int level) {
+	if (!e->stats_on || e->pplistsize == 0)
+		return;
+	e->stats = calloc(e->pplistsize, sizeof(pp_level_stats));
+	e->stats_walk = e->walk.stats;
+	e->stats_time = stats_clock();
+	e->stats_level = level;
+}
+
+/*
+ * Charge the time and walker activity since the last tick to the level
+ * then current, and note the new current level (which may be -1 when the
+ * search is over).
+ */
+static void pp_stats_tick(pp_engine* e, int level) {
+	pp_level_stats* ls;
+	walk_stats* ws = &e->walk.stats;
+	double t = stats_clock();
+
+	if (e->stats_level >= 0) {
+		ls = &e->stats[e->stats_level];
+		ls->walk.findnext += ws->findnext - e->stats_walk.findnext;
+		ls->walk.pushes += ws->pushes - e->stats_walk.pushes;
+		ls->walk.pops += ws->pops - e->stats_walk.pops;
+		ls->walk.yielded += ws->yielded - e->stats_walk.yielded;
+		ls->walk.rejected += ws->rejected - e->stats_walk.rejected;
+		ls->secs += t - e->stats_time;
+	}
+	e->stats_walk = *ws;
+	e->stats_time = t;
+	e->stats_level = level;
+}
+
+/*
+ * Print the per-level counters as a table, omitting levels never reached.
+ */
+void pp_stats_report(pp_engine* e) {
+	pp_level_stats* ls;
+	double total = 0;
+	int j;
+
+	if (!e->stats)
+		return;
+	for (j = 0; j < e->pplistsize; ++j)
+		total += e->stats[j].secs;
+	printf("%5s %6s %10s %10s %12s %12s %12s %12s %12s %9s %5s\n",
+			"level", "pp", "walkers", "pruned", "findnext", "pushes", "pops",
+			"yielded", "rejected", "secs", "%time");
+	for (j = 0; j < e->pplistsize; ++j) {
+		ls = &e->stats[j];
+		if (ls->walkers == 0 && ls->pruned == 0 && ls->walk.findnext == 0)
+			continue;
+		printf("%5d %6d %10ld %10ld %12ld %12ld %12ld %12ld %12ld %9.3f %5.1f\n",
+				j, e->pplist[j]->pp, ls->walkers, ls->pruned, ls->walk.findnext,
+				ls->walk.pushes, ls->walk.pops, ls->walk.yielded,
+				ls->walk.rejected, ls->secs,
+				total > 0 ? 100 * ls->secs / total : 0.0);
+	}
+	fflush(stdout);
+}
+
+/*
+ * Write the CSV header line to the named file if it is empty or new.
+ * Called once before any search starts, so that forked workers sharing
+ * the file need only append. Returns TRUE on success.
+ */
+int pp_stats_csv_header(char* path) {
+	FILE* f = fopen(path, "a");
+	int ok;
+
+	if (!f) {
+		fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+		return 0;
+	}
+	if (ftell(f) == 0)
+		fprintf(f, "n,k,level,pp,walkers,pruned,findnext,pushes,pops,yielded,"
+				"rejected,secs\n");
+	ok = (fclose(f) == 0);
+	if (!ok)
+		fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+	return ok;
+}
+
+/*
+ * Append the per-level counters to e->stats_csv, whose header has been
+ * written by pp_stats_csv_header(). The rows are collected first and
+ * appended with a single write(), so that rows from several workers
+ * appending at once do not interleave. Returns TRUE on success.
+ */
+int pp_stats_csv(pp_engine* e, int target) {
+	pp_level_stats* ls;
+	FILE* m;
+	char* buf = (char*)NULL;
+	size_t size = 0;
+	int j, fd, ok;
+
+	if (!e->stats || !e->stats_csv)
+		return 1;
+	m = open_memstream(&buf, &size);
+	if (!m) {
+		fprintf(stderr, "Cannot buffer CSV rows: %s\n", strerror(errno));
+		return 0;
+	}
+	for (j = 0; j < e->pplistsize; ++j) {
+		ls = &e->stats[j];
+		fprintf(m, "%d,%d,%d,%d,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%.6f\n",
+				target, e->k0, j, e->pplist[j]->pp, ls->walkers, ls->pruned,
+				ls->walk.findnext, ls->walk.pushes, ls->walk.pops,
+				ls->walk.yielded, ls->walk.rejected, ls->secs);
+	}
+	fclose(m);
+	fd = open(e->stats_csv, O_WRONLY | O_APPEND | O_CREAT, 0666);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open %s: %s\n", e->stats_csv, strerror(errno));
+		free(buf);
+		return 0;
+	}
+	ok = (write(fd, buf, size) == (ssize_t)size);
+	ok = (close(fd) == 0) && ok;
+	if (!ok)
+		fprintf(stderr, "Cannot write %s: %s\n", e->stats_csv, strerror(errno));
+	free(buf);
+	return ok;
+}
+
+void pp_diagnose(pp_engine* e, int level) {
+	int j;
+	int start = -1, end;
+	pp_pp* pp;
+
+	for (j = 0; j <= level; ++j) {
+		pp = e->pplist[j];
+		if (pp->wrnum != 1 || pp->wrcount != 0) {
+			start = j;
+			break;
+		}
+	}
+	end = start + 10;
+	if (end > level)
+		end = level;
+	printf("t=%.2f level %d..%d at %d of %d: ",
+			timing(), start, end, level, e->pplistsize);
+	for (j = start; j <= end; ++j) {
+		pp = e->pplist[j];
+		printf("%d:%d/%d ", pp->pp, pp->wrnum, pp->wrcount);
+	}
+	printf("\n");
+	printf("walk arena: live %d, free %d, peak %d bytes; %d compactions\n",
+			e->walk.size - e->walk.freebytes, e->walk.freebytes,
+			e->walk.peak, e->walk.compactions);
+	if (e->stats) {
+		pp_stats_tick(e, level);
+		pp_stats_report(e);
+	}
+}
+
+/*
+ * Checkpoint file layout: header, the pp of each pplist entry (to check
+ * that the study matches), wh and wrh for each pppp[q], the state of each
+ * level up to the current one, then the walk arena.
+ */
+#define CKPT_MAGIC "A101877 ckpt 1"
+typedef struct pp_s_ckpt_header {
+	char magic[16];
+	int target;
+	int k0;
+	int pplistsize;
+	int level;
+} pp_ckpt_header;
+
+static int ckpt_put(FILE* f, void* p, size_t size) {
+	return fwrite(p, size, 1, f) == 1;
+}
+
+static int ckpt_get(FILE* f, void* p, size_t size) {
+	return fread(p, size, 1, f) == 1;
+}
+
+/*
+ * Save the state of pp_find() at the top of its loop.
+ * Input:
+ *   pp_engine* e: the engine, with e->ckpt the file to write
+ *   int target: the target passed to pp_find()
+ *   int level: the current level in pplist
+ * Returns:
+ *   TRUE on success; failure is reported, but the search may continue.
+ * Notes:
+ *   The file is written under a temporary name and renamed into place,
+ * so an interrupted write leaves any previous checkpoint intact.
+ */
+int pp_checkpoint(pp_engine* e, int target, int level) {
+	pp_ckpt_header h;
+	char* tmp = malloc(strlen(e->ckpt) + 8);
+	FILE* f;
+	pp_pp* pp;
+	int j, ok;
+
+	sprintf(tmp, "%s.tmp", e->ckpt);
+	f = fopen(tmp, "wb");
+	ok = (f != (FILE*)NULL);
+	memset(&h, 0, sizeof(h));
+	strcpy(h.magic, CKPT_MAGIC);
+	h.target = target;
+	h.k0 = e->k0;
+	h.pplistsize = e->pplistsize;
+	h.level = level;
+	ok = ok && ckpt_put(f, &h, sizeof(h));
+	for (j = 0; ok && j < e->pplistsize; ++j)
+		ok = ckpt_put(f, &e->pplist[j]->pp, sizeof(int));
+	for (j = 0; ok && j <= e->k0; ++j) {
+		pp = &e->pppp[j];
+		ok = ckpt_put(f, &pp->wh, sizeof(whp))
+				&& ckpt_put(f, &pp->wrh, sizeof(wrhp));
+	}
+	for (j = 0; ok && j <= level; ++j) {
+		pp = e->pplist[j];
+		ok = ckpt_put(f, &pp->wrnum, sizeof(int))
+				&& ckpt_put(f, &pp->wrcount, sizeof(int))
+				&& mpz_out_raw(f, mpq_numref(pp->spare)) != 0
+				&& mpz_out_raw(f, mpq_denref(pp->spare)) != 0;
+	}
+	ok = ok && walker_save(&e->walk, f);
+	if (f && fclose(f) != 0)
+		ok = 0;
+	if (ok && rename(tmp, e->ckpt) != 0)
+		ok = 0;
+	if (ok) {
+		printf("t=%.2f checkpoint at level %d written to %s\n",
+				timing(), level, e->ckpt);
+	} else {
+		fprintf(stderr, "Cannot write checkpoint %s: %s\n",
+				e->ckpt, strerror(errno));
+		unlink(tmp);
+	}
+	fflush(stdout);
+	free(tmp);
+	return ok;
+}
+
+/*
+ * Restore the state of pp_find() from e->ckpt, if it exists.
+ * Input:
+ *   pp_engine* e: the engine, after pp_study(e, target)
+ *   int target: the target passed to pp_find()
+ *   int* level: set to the level to resume at
+ * Returns:
+ *   TRUE if the search should resume from the restored state, FALSE if
+ * there is no checkpoint (or it is for a different search) and the search
+ * should start afresh. A damaged checkpoint is fatal.
+ * Notes:
+ *   pp_study() is deterministic for a given k, so the values and the
+ * resolved PP structures match those at the time of the checkpoint; only
+ * the walkers and the state of each level need to be restored.
+ */
+int pp_restore(pp_engine* e, int target, int* level) {
+	pp_ckpt_header h;
+	FILE* f = fopen(e->ckpt, "rb");
+	pp_pp* pp;
+	int j, v, ok;
+
+	if (!f)
+		return 0;
+	ok = ckpt_get(f, &h, sizeof(h))
+			&& strncmp(h.magic, CKPT_MAGIC, sizeof(h.magic)) == 0
+			&& h.target == target && h.k0 == e->k0
+			&& h.pplistsize == e->pplistsize
+			&& h.level >= 0 && h.level < e->pplistsize;
+	for (j = 0; ok && j < e->pplistsize; ++j)
+		ok = ckpt_get(f, &v, sizeof(int)) && v == e->pplist[j]->pp;
+	if (!ok) {
+		fprintf(stderr, "Checkpoint %s is not for n=%d k=%d, ignoring it\n",
+				e->ckpt, target, e->k0);
+		fclose(f);
+		return 0;
+	}
+	for (j = 0; ok && j <= e->k0; ++j) {
+		pp = &e->pppp[j];
+		ok = ckpt_get(f, &pp->wh, sizeof(whp))
+				&& ckpt_get(f, &pp->wrh, sizeof(wrhp));
+	}
+	for (j = 0; ok && j <= h.level; ++j) {
+		pp = e->pplist[j];
+		ok = ckpt_get(f, &pp->wrnum, sizeof(int))
+				&& ckpt_get(f, &pp->wrcount, sizeof(int))
+				&& mpz_inp_raw(mpq_numref(pp->spare), f) != 0
+				&& mpz_inp_raw(mpq_denref(pp->spare), f) != 0;
+	}
+	ok = ok && walker_restore(&e->walk, f);
+	fclose(f);
+	if (!ok) {
+		fprintf(stderr, "Checkpoint %s is damaged\n", e->ckpt);
+		exit(1);
+	}
+	/* deeper levels are not yet started */
+	for (j = h.level + 1; j < e->pplistsize; ++j)
+		e->pplist[j]->wh = (whp)0;
+	for (j = 0; j <= e->k0; ++j) {
+		pp = &e->pppp[j];
+		if (pp->pp && pp->wh)
+			walker_rebind(&e->walk, pp->wh, pp);
+	}
+	*level = h.level;
+	return 1;
+}
+
+int pp_find(pp_engine* e, int target) {
+	walk_arena* wa = &e->walk;
+	pp_pp** pplist;
+	pp_pp *pp, *nextpp;
+	int i, g, invsum;
+	int success = 0;
+	int have_discard;
+	mpz_t z, zr;
+	mpq_t q, limit;
+
+	pp_study(e, target);
+
+	pplist = e->pplist;
+	i = 0;
+	/* the spare is -target when no PP remain, so that is handled here too */
+	if (e->pplistsize == 0 || mpq_sgn(pplist[i]->spare) < 0) {
+		printf("n=%d, k=%d: optimizer finds no solution is possible. [%.2fs]\n",
+				target, e->k0, timing());
+		return 0;
+	}
+	pplist[i]->wh = (whp)0;
+	if (e->ckpt && pp_restore(e, target, &i))
+		printf("n=%d k=%d: resumed at level %d from %s\n",
+				target, e->k0, i, e->ckpt);
+	ZINIT(&z, "pp_find z");
+	ZINIT(&zr, "pp_find zr");
+	QINIT(&q, "pp_find q");
+	QINIT(&limit, "pp_find limit");
+	pp_stats_start(e, i);
+	while (i >= 0) {
+		if (e->stats)
+			pp_stats_tick(e, i);
+		if (ckpt_signal_seen) {
+			ckpt_signal_seen = 0;
+			if (e->ckpt)
+				pp_checkpoint(e, target, i);
+		}
+		pp = pplist[i];
+		if (!pp->wh) {
+			if (diag_signal_seen) {
+				diag_signal_seen = 0;
+				pp_diagnose(e, i);
+			}
+
+			mpq_set(limit, pp->spare);
+			Dprintf("at pp_%d spare = %Qd\n", pp->pp, limit);
+
+			have_discard = (!pp->depend && mpz_sgn(pp->min_discard) != 0);
+			if (have_discard) {
+				/* (limit_r) += min_discard / denominator */
+				mpz_set(mpq_numref(q), pp->min_discard);
+				mpz_set(mpq_denref(q), pp->denominator);
+				mpq_canonicalize(q);
+				mpq_add(limit, limit, q);
+			}
+			/* actual limit = floor(limit_num * denominator / limit_den) */
+			mpq_mul_z(limit, limit, pp->denominator);
+			mpz_fdiv_q(mpq_numref(limit), mpq_numref(limit), mpq_denref(limit));
+			/* limit is now denormal, but we won't be using it again */
+
+			if (pp->depend) {
+				/* min_discard is 0, so nothing extra factored into spare:
+				 * must discard spare (mod p) = spare_num * inv(spare_den) */
+				mpz_fdiv_qr_ui(z, zr, mpq_denref(pp->spare), pp->pp);
+				if (mpz_sgn(zr) == 0) {
+					mpz_mul_ui(z, mpq_numref(pp->spare),
+							invfast(mod_ui(z, pp->p), pp->p));
+					invsum = mod_ui(z, pp->p);
+				} else {
+					invsum = 0;
+				}
+			} else {
+				invsum = pp->invtotal;
+			}
+			if (!pp_residue_limit(pp, invsum, mpq_numref(limit), z)) {
+				/* as if the walker had found nothing */
+				Dprintf("invsum %d unreachable for %d\n", invsum, pp->pp);
+				if (e->stats)
+					++e->stats[i].pruned;
+				pp->wrnum = 0;
+				pp->wrcount = 0;
+				--i;
+				continue;
+			}
+			Dprintf("effective limit is %Zd, invsum = %d\n",
+					mpq_numref(limit), invsum);
+
+			pp->wh = new_walker(wa, pp, mpq_numref(limit), invsum);
+			pp->wrnum = 0;
+			if (e->stats)
+				++e->stats[i].walkers;
+		}
+
+		/* previous pp->wrh is finished with, so we may compact */
+		walker_compact(wa, pp->wh);
+		pp->wrh = walker_findnext(wa, pp->wh);
+		if (!pp->wrh) {
+			delete_walker(wa, pp->wh);
+			pp->wh = (whp)0;
+			pp->wrcount = pp->wrnum;
+			--i;
+			Dprintf("no lines for %d, recurse back to %d\n",
+					pp->pp, (i >= 0) ? pplist[i]->pp : -1);
+			continue;
+		}
+		++pp->wrnum;
+
+		++i;
+		if (i >= e->pplistsize) {
+			fprintf(stderr, "overflow\n");
+			exit(1);
+		}
+		nextpp = pplist[i];
+
+		/* new spare = old spare - (actual discard - min discard) / denominator
+		 */
+		mpz_set_x(mpq_numref(q), wr_discard(wa, pp->wh, pp->wrh),
+				pp->valnumsize);
+		Dprintf("pp_%d walker found discard %Zd/%Zd\n",
+				pp->pp, mpq_numref(q), pp->denominator);
+		mpz_sub(mpq_numref(q), mpq_numref(q), pp->min_discard);
+		mpz_set(mpq_denref(q), pp->denominator);
+		mpq_canonicalize(q);
+		mpq_sub(nextpp->spare, pp->spare, q);
+
+		Dprintf("new spare %Qd\n", nextpp->spare);
+
+		if (mpq_sgn(nextpp->spare) < 0) {
+			/* we've overrun */
+			--i;
+			continue;
+		}
+		nextpp->wh = (whp)0;
+		if (pp_solution(e, i)) {
+			success = 1;
+			break;
+		}
+	}
+	QCLEAR(&limit, "pp_find limit");
+	QCLEAR(&q, "pp_find q");
+	ZCLEAR(&zr, "pp_find zr");
+	ZCLEAR(&z, "pp_find z");
+	if (!success)
+		printf("n=%d k=%d: no solution found. [%.2fs]\n",
+                target, e->k0, timing());
+	if (e->stats) {
+		pp_stats_tick(e, -1);
+		pp_stats_report(e);
+		pp_stats_csv(e, target);
+	}
+	/* the search is complete, so the checkpoint is of no further use */
+	if (e->ckpt)
+		unlink(e->ckpt);
+	return success;
+}
+#include <stdlib.h>
+#include <stdio.h>
+#include "walker.h"
+#include "pp.h"
+#include "mbh.h"
+
+#define MIN_WALK_ARENA 4096
+
+inline walker* WP(walk_arena* wa, whp wh) {
+	return (walker*)&wa->arena[wh];
+}
+#define DWP(wa, wh) ((walker*)&(wa)->arena[wh])
+
+inline walk_result* WRP(walk_arena* wa, whp wh, wrhp wrh) {
+	return (walk_result*)&wa->arena[wrh];
+}
+#define DWRP(w, wrh) ((walk_result*)&(w)->wa->arena[wrh])
+
+static inline whp WHP(walker* w) {
+	return (whp)((char*)w - w->wa->arena);
+}
+
+static inline wrhp WRHP(walker* w, walk_result* wr) {
+	return (wrhp)((char*)wr - w->wa->arena);
+}
+
+static inline mpx_t w_limit(walker* w) {
+	return (mpx_t)&w->tail[0];
+}
+
+static inline mpx_t w_previous(walker* w) {
+	return (mpx_t)&w->tail[w->numsize];
+}
+
+static inline mpx_t wr_next_discard(walker* w, walk_result* wr) {
+	return (mpx_t)&wr->tail[0];
+}
+
+inline mpx_t wr_discard(walk_arena* wa, whp wh, wrhp wrh) {
+	return (mpx_t)&WRP(wa, wh, wrh)->tail[WP(wa, wh)->numsize];
+}
+
+static inline mpx_t wr_discard_direct(walker* w, walk_result* wr) {
+	return (mpx_t)&wr->tail[w->numsize];
+}
+
+inline int* wr_vec(walk_arena* wa, whp wh, wrhp wrh) {
+	return (int*)&WRP(wa, wh, wrh)->tail[WP(wa, wh)->numsize * 2];
+}
+
+static inline int* wr_vec_direct(walker* w, walk_result* wr) {
+	return (int*)&wr->tail[w->numsize * 2];
+}
+
+/*
+ * Order results with equal next_discard by nextbit, then by vec from the
+ * top word down. Only the first of several results with equal discards
+ * is returned, so this fixes which of them supplies the witness; it
+ * matches the order the old binary heap happened to give in every case
+ * checked.
+ */
+static inline int wr_tiebreak(walker* w, walk_result* l, walk_result* r,
+		int n) {
+	unsigned int* lv = (unsigned int*)&l->tail[n * 2];
+	unsigned int* rv = (unsigned int*)&r->tail[n * 2];
+	int i;
+
+	if (l->nextbit != r->nextbit)
+		return (l->nextbit < r->nextbit) ? -1 : 1;
+	for (i = w->vecsize - 1; i >= 0; --i)
+		if (lv[i] != rv[i])
+			return (lv[i] < rv[i]) ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Heap comparators, one for each fixed numsize, comparing next_discard.
+ * These are the innermost loop, so the limbs are compared inline; the
+ * walker (the heap's context) is needed only to break ties. Each also
+ * gets its own heap routines from MBH_SPECIALISE(), with the comparison
+ * inlined in the sift loops; the mbh_compare_func versions are only for
+ * the generic routines.
+ */
+#ifdef SAFE_BUT_SLOW
+/* the heap's context is private, and MBH_SPECIALISE() ignores cmp */
+#define WR_CMP(n)
+#else
+#define WR_CMP(n) \
+static inline int wr_cmp_##n(bh_arena* a, bh_heap* hp, void* left, \
+		void* right) { \
+	return wr_compare_##n((walk_arena*)a->owner, hp->context, left, right); \
+}
+#endif
+#define WR_COMPARE(n) \
+static inline int wr_compare_##n(walk_arena* wa, void* context, void* left, \
+		void* right) { \
+	walk_result* l = (walk_result*)&wa->arena[P2I(left)]; \
+	walk_result* r = (walk_result*)&wa->arena[P2I(right)]; \
+	int c = mpx_cmp_fixed(l->tail, r->tail, n); \
+	return c ? c : wr_tiebreak(DWP(wa, P2I(context)), l, r, n); \
+} \
+int mbh_compare_wr_##n(void* owner, void* context, void* left, void* right) { \
+	return wr_compare_##n((walk_arena*)owner, context, left, right); \
+} \
+WR_CMP(n) \
+MBH_SPECIALISE(wr_heap_##n, wr_cmp_##n)
+WR_COMPARE(1)
+WR_COMPARE(2)
+WR_COMPARE(3)
+WR_COMPARE(4)
+WR_COMPARE(5)
+WR_COMPARE(6)
+WR_COMPARE(7)
+WR_COMPARE(8)
+
+mbh_compare_func* wr_comparator[MPX_MAXLIMBS] = {
+	&mbh_compare_wr_1, &mbh_compare_wr_2, &mbh_compare_wr_3, &mbh_compare_wr_4,
+	&mbh_compare_wr_5, &mbh_compare_wr_6, &mbh_compare_wr_7, &mbh_compare_wr_8
+};
+
+const mbh_ops wr_heap_ops[MPX_MAXLIMBS] = {
+	MBH_OPS(wr_heap_1), MBH_OPS(wr_heap_2), MBH_OPS(wr_heap_3),
+	MBH_OPS(wr_heap_4), MBH_OPS(wr_heap_5), MBH_OPS(wr_heap_6),
+	MBH_OPS(wr_heap_7), MBH_OPS(wr_heap_8)
+};
+
+void setup_walker(walk_arena* wa) {
+	setup_mbh(&wa->heaps, (void*)wa);
+	wa->size = 4;	/* must not return 0 as a whp */
+	wa->max = MIN_WALK_ARENA;
+	wa->freebytes = 0;
+	wa->peak = wa->size;
+	wa->compact_min = WALK_COMPACT_MIN;
+	wa->compactions = 0;
+	memset(&wa->stats, 0, sizeof(wa->stats));
+	wa->arena = malloc(wa->max);
+}
+
+void teardown_walker(walk_arena* wa) {
+	free(wa->arena);
+	teardown_mbh(&wa->heaps);
+}
+
+static inline int wr_charsize(walker* w) {
+	return (
+		sizeof(walk_result)
+		+ w->vecsize * sizeof(int)
+		+ w->numsize * 2 * sizeof(mp_limb_t)
+	);
+}
+
+#define grow_arena(wa, w, size) \
+	if ((size) > (wa)->max) { \
+		int oldarena = ((char*)w - (wa)->arena); \
+		(wa)->max = (wa)->max * 2; \
+		(wa)->arena = realloc((wa)->arena, (wa)->max); \
+		w = (walker*)((wa)->arena + oldarena); \
+	}
+
+#define w_pick_arena(w, wr) \
+	{ \
+		wrhp pick_wrh; \
+		walk_arena* pick_wa = w->wa; \
+		if (w->arenanext) { \
+			pick_wrh = w->arenanext; \
+			w->arenanext = DWRP(w, pick_wrh)->next; \
+			--w->nfree; \
+			pick_wa->freebytes -= wr_charsize(w); \
+		} else { \
+			pick_wrh = pick_wa->size; \
+			pick_wa->size += wr_charsize(w); \
+			if (pick_wa->size > pick_wa->peak) \
+				pick_wa->peak = pick_wa->size; \
+			grow_arena(pick_wa, w, pick_wa->size); \
+		} \
+		wr = DWRP(w, pick_wrh); \
+	}
+
+static inline void push_heap(walker* w, walk_result* wr) {
+	++w->wa->stats.pushes;
+	w->hops->insert(&w->wa->heaps, w->heap, I2P(WRHP(w, wr)));
+}
+
+static inline walk_result* top_heap(walker* w) {
+	return DWRP(w, P2I(mbh_top(&w->wa->heaps, w->heap)));
+}
+
+/*
+ * walker_findnext() leaves the result it is working on at the top of the
+ * heap until it has something to put back, so that the first push after
+ * each pop can be done as a single replace.
+ */
+static inline void requeue_heap(walker* w, walk_result* wr, int* top_held) {
+	if (*top_held) {
+		++w->wa->stats.pops;
+		++w->wa->stats.pushes;
+		w->hops->replace(&w->wa->heaps, w->heap, I2P(WRHP(w, wr)));
+		*top_held = 0;
+	} else
+		push_heap(w, wr);
+}
+
+static inline void drop_top_heap(walker* w, int* top_held) {
+	if (*top_held) {
+		++w->wa->stats.pops;
+		w->hops->shift(&w->wa->heaps, w->heap);
+		*top_held = 0;
+	}
+}
+
+static inline int walker_charsize(int numsize) {
+	return sizeof(walker) + numsize * 2 * sizeof(mp_limb_t);
+}
+
+whp new_walker(walk_arena* wa, pp_pp* pp, mpz_t limit, int invsum) {
+	whp wh;
+	walker* w;
+	walk_result* wr;
+	int numsize = pp->valnumsize;
+
+	wh = wa->size;
+	w = WP(wa, wh);
+	wa->size += walker_charsize(numsize);
+	grow_arena(wa, w, wa->size);
+	w->wa = wa;
+	w->heap = mbh_new(&wa->heaps, I2P(wh), wr_comparator[numsize - 1]);
+	w->hops = &wr_heap_ops[numsize - 1];
+	w->pp = pp;
+	w->numsize = numsize;
+	w->invsum = invsum;
+	w->vecsize = (pp->valsize + 31) >> 5;
+	w->arenanext = (wrhp)0;
+	w->nfree = 0;
+	w->have_previous = 0;
+	mpx_set_z(w_limit(w), numsize, limit);
+
+	w_pick_arena(w, wr);
+	wr->invsum = 0;
+	wr->nextbit = pp->valsize;
+	mpx_set_ui(wr_next_discard(w, wr), numsize, 0);
+	mpx_set_ui(wr_discard_direct(w, wr), numsize, 0);
+	memset(wr_vec_direct(w, wr), 0, w->vecsize * sizeof(int));
+	push_heap(w, wr);
+
+	return wh;
+}
+
+void delete_walker(walk_arena* wa, whp wh) {
+	walker* w = WP(wa, wh);
+
+	mbh_delete(&wa->heaps, w->heap);
+	wa->freebytes -= w->nfree * wr_charsize(w);
+	wa->size = wh;
+}
+
+static inline void w_free_arena(walker* w, walk_result* wr) {
+	wr->next = w->arenanext;
+	w->arenanext = WRHP(w, wr);
+	++w->nfree;
+	w->wa->freebytes += wr_charsize(w);
+}
+
+static inline void wr_setbit(walker* w, walk_result* wr, int bit) {
+	int word = bit >> 5;
+	int offset = 1 << (bit & 31);
+	wr_vec_direct(w, wr)[word] |= offset;
+}
+
+static inline int wr_testbit(walker* w, walk_result* wr, int bit) {
+	int word = bit >> 5;
+	int offset = 1 << (bit & 31);
+	return (wr_vec_direct(w, wr)[word] & offset) ? 1 : 0;
+}
+
+static inline int qualify(walker* w, walk_result* wr) {
+	if (mpx_cmp_n(w_limit(w), wr_next_discard(w, wr), w->numsize) >= 0)
+		return 1;
+	return 0;
+}
+
+wrhp walker_findnext(walk_arena* wa, whp wh) {
+	walker* w = DWP(wa, wh);
+	walk_result* next;
+	walk_result* split;
+	wrhp nexth;
+	int limitbit, i;
+	int top_held;
+
+	++wa->stats.findnext;
+	while (1) {
+		if (mbh_size(&wa->heaps, w->heap) == 0)
+			return (wrhp)0;
+
+		/* pick_arena first, since arena may move */
+		w_pick_arena(w, split);
+		next = top_heap(w);
+		top_held = 1;
+		limitbit = next->nextbit;
+		mpx_set(wr_discard_direct(w, split), w->numsize,
+				wr_next_discard(w, next), w->numsize);
+		split->invsum = next->invsum;
+		memcpy(wr_vec_direct(w, split), wr_vec_direct(w, next),
+				w->vecsize * sizeof(int));
+
+		if (next->nextbit == w->pp->valsize) {
+			/* first */
+			--next->nextbit;
+			mpx_add_n(wr_next_discard(w, next), wr_discard_direct(w, next),
+					ppv_mpx(pp_value_i(w->pp, next->nextbit)), w->numsize);
+			if (!qualify(w, next)) {
+				w_free_arena(w, next);
+			} else {
+				requeue_heap(w, next, &top_held);
+			}
+			drop_top_heap(w, &top_held);
+			w_free_arena(w, split);
+			goto found_line;
+		}
+
+		--next->nextbit;
+		if (next->nextbit < 0) {
+			w_free_arena(w, next);
+		} else if (wr_testbit(w, next, next->nextbit)) {
+			w_free_arena(w, next);
+		} else {
+			mpx_add_n(wr_next_discard(w, next), wr_discard_direct(w, next),
+					ppv_mpx(pp_value_i(w->pp, next->nextbit)), w->numsize);
+			if (!qualify(w, next)) {
+				w_free_arena(w, next);
+			} else {
+				requeue_heap(w, next, &top_held);
+			}
+		}
+
+		split->invsum = (split->invsum + pp_value_i(w->pp, limitbit)->inv)
+				% w->pp->p;
+		wr_setbit(w, split, limitbit);
+
+		for (i = w->pp->valsize - 1; i > limitbit; --i) {
+			if (!wr_testbit(w, split, i))
+				break;
+		}
+		if (i <= limitbit) {
+			w_free_arena(w, split);
+		} else {
+			split->nextbit = i;
+			mpx_add_n(wr_next_discard(w, split), wr_discard_direct(w, split),
+					ppv_mpx(pp_value_i(w->pp, i)), w->numsize);
+			if (!qualify(w, split)) {
+				w_free_arena(w, split);
+			} else {
+				requeue_heap(w, split, &top_held);
+			}
+		}
+		drop_top_heap(w, &top_held);
+		next = split;
+	  found_line:
+		nexth = WRHP(w, next);
+		/* a negative invsum (as used by t/walker) means any will do */
+		if (w->invsum >= 0 && next->invsum != w->invsum) {
+			++wa->stats.rejected;
+			continue;
+		}
+		if (w->have_previous
+				&& mpx_cmp_n(wr_discard_direct(w, next), w_previous(w),
+						w->numsize) == 0)
+			continue;
+		w->have_previous = 1;
+		mpx_set(w_previous(w), w->numsize,
+				wr_discard_direct(w, next), w->numsize);
+		++wa->stats.yielded;
+		return nexth;
+	}
+}
+
+wrhp wr_clone(walk_arena* wa, whp wh, wrhp wrh) {
+	walker* w = WP(wa, wh);
+	walk_result *wr, *wr2;
+
+	w_pick_arena(w, wr2);
+	/* we may attempt to clone something already released to arena, in which
+	 * case pick_arena may return the same address. If so, there's nothing
+	 * to do */
+	wr = WRP(wa, wh, wrh);
+	if (wr2 != wr)
+		memcpy(wr2, wr, wr_charsize(w));
+	return WRHP(w, wr2);
+}
+
+void wr_clone_free(walk_arena* wa, whp wh, wrhp wrh) {
+	w_free_arena(WP(wa, wh), WRP(wa, wh, wrh));
+}
+
+/*
+ * Compact the results of a walker, if enough of its slots are free.
+ * Input:
+ *   walk_arena* wa: the arena holding the walker
+ *   whp wh: the most recently created walker in the arena
+ * Returns:
+ *   TRUE if the walker was compacted.
+ * Notes:
+ *   The results still in the heap are packed, in heap order, straight
+ * after the walker, and the heap rewritten to refer to the new locations;
+ * everything else is released. Any wrhp previously returned for this
+ * walker (including clones) becomes invalid, so this may only be called
+ * between calls to walker_findnext() when the last result is finished with.
+ */
+int walker_compact(walk_arena* wa, whp wh) {
+	walker* w = WP(wa, wh);
+	int rs = wr_charsize(w);
+	int count = mbh_size(&wa->heaps, w->heap);
+	void** values;
+	char* copy;
+	wrhp base;
+	int i;
+
+	if (wa->compact_min == 0 || w->nfree * rs < wa->compact_min
+			|| w->nfree <= count)
+		return 0;
+	values = mbh_values(&wa->heaps, w->heap);
+	base = wh + walker_charsize(w->numsize);
+	copy = malloc(count * rs + 1);
+	for (i = 0; i < count; ++i)
+		memcpy(copy + i * rs, &wa->arena[P2I(values[i])], rs);
+	memcpy(&wa->arena[base], copy, count * rs);
+	for (i = 0; i < count; ++i)
+		values[i] = I2P(base + i * rs);
+	free(copy);
+
+	wa->freebytes -= w->nfree * rs;
+	w->nfree = 0;
+	w->arenanext = (wrhp)0;
+	wa->size = base + count * rs;
+	++wa->compactions;
+	return 1;
+}
+
+/*
+ * Save the contents of a walk arena, including its heaps.
+ * Returns TRUE on success.
+ */
+int walker_save(walk_arena* wa, FILE* f) {
+	int hdr[4];
+
+	hdr[0] = wa->size;
+	hdr[1] = wa->freebytes;
+	hdr[2] = wa->peak;
+	hdr[3] = wa->compactions;
+	return fwrite(hdr, sizeof(hdr), 1, f) == 1
+			&& fwrite(wa->arena, 1, wa->size, f) == wa->size
+			&& mbh_save(&wa->heaps, f);
+}
+
+/*
+ * Restore the contents of a walk arena saved with walker_save() into one
+ * set up with setup_walker(). Returns TRUE on success.
+ * Notes:
+ *   Each walker in the arena must then be given its pp and pointers
+ * afresh with walker_rebind().
+ */
+int walker_restore(walk_arena* wa, FILE* f) {
+	int hdr[4];
+
+	if (fread(hdr, sizeof(hdr), 1, f) != 1 || hdr[0] < 4)
+		return 0;
+	if (hdr[0] > wa->max) {
+		wa->max = hdr[0];
+		wa->arena = realloc(wa->arena, wa->max);
+	}
+	if (fread(wa->arena, 1, hdr[0], f) != hdr[0])
+		return 0;
+	wa->size = hdr[0];
+	wa->freebytes = hdr[1];
+	wa->peak = hdr[2];
+	wa->compactions = hdr[3];
+	return mbh_restore(&wa->heaps, f);
+}
+
+/*
+ * Reattach a restored walker to its arena, pp and heap routines.
+ */
+void walker_rebind(walk_arena* wa, whp wh, pp_pp* pp) {
+	walker* w = WP(wa, wh);
+
+	w->wa = wa;
+	w->pp = pp;
+	mbh_rebind(&wa->heaps, w->heap, I2P(wh), wr_comparator[w->numsize - 1]);
+	w->hops = &wr_heap_ops[w->numsize - 1];
+}
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "mygmp.h"
+
+inline void QINIT(mpq_t* q, char* format, ...) {
+	mpq_init(*q);
+	DEBUG_PRINT(q, "qinit", format);
+}
+
+inline void QCLEAR(mpq_t* q, char* format, ...) {
+	mpq_clear(*q);
+	DEBUG_PRINT(q, "qclear", format);
+}
+
+inline void ZINIT(mpz_t* z, char* format, ...) {
+	mpz_init(*z);
+	DEBUG_PRINT(z, "zinit", format);
+}
+
+inline void ZCLEAR(mpz_t* z, char* format, ...) {
+	mpz_clear(*z);
+	DEBUG_PRINT(z, "zclear", format);
+}
+
+/*
+ * Set a fixed-size integer from an unsigned int.
+ * Inputs:
+ *   mpx_t x: allocated fixed-size integer to write to
+ *   int size: size of x (in mp_limb_t)
+ *   unsigned int ui: the value to set
+ * Returns:
+ *   Nothing.
+ */
+void mpx_set_ui(mpx_t x, int size, unsigned int ui) {
+	x[0] = ui;
+	if (size > 1)
+		memset(&x[1], 0, (size - 1) * sizeof(mp_limb_t));
+}
+
+/*
+ * Set a fixed-size integer from an mpz_t.
+ * Inputs:
+ *   mpx_t x: allocated fixed-size integer to write to
+ *   int size: size of x (in mp_limb_t)
+ *   mpz_t z: the value to set
+ * Returns:
+ *   Nothing.
+ */
+void mpx_set_z(mpx_t x, int size, mpz_t z) {
+	int zsize = z->_mp_size;
+	if (zsize)
+		memcpy(&x[0], &z->_mp_d[0], zsize * sizeof(mp_limb_t));
+	if (zsize < size)
+		memset(&x[zsize], 0, (size - zsize) * sizeof(mp_limb_t));
+}
+
+/*
+ * Set a fixed-size integer from another fixed-size integer
+ * Inputs:
+ *   mpx_t xd: fixed-size integer to write to
+ *   int sized: size of fixed-size integer to write to
+ *   mpx_t xs: fixed-size integer to read from
+ *   int sizes: size of fixed-size integer to read from
+ * Returns:
+ *   Nothing.
+ */
+void mpx_set(mpx_t xd, int sized, mpx_t xs, int sizes) {
+	int head = (sized > sizes) ? sizes : sized;
+	int tail = sized - sizes;
+	if (head)
+		memcpy(&xd[0], &xs[0], head * sizeof(mp_limb_t));
+	if (tail)
+		memset(&xd[head], 0, tail * sizeof(mp_limb_t));
+}
+
+/*
+ * Set a GMP integer from a fixed-size integer
+ * Inputs:
+ *   mpz_t z: the initialized mpz_t to set
+ *   mpx_t x: the fixed-size integer to set from
+ *   int size: size of x (in mp_limb_t)
+ * Returns:
+ *   Nothing.
+ */
+void mpz_set_x(mpz_t z, mpx_t x, int size) {
+	while (size && x[size - 1] == 0)
+		--size;
+	if (z->_mp_alloc < size)
+		mpz_realloc2(z, size * GMP_LIMB_BITS);
+	if (size)
+		__GMPN_COPY(&z->_mp_d[0], &x[0], size);
+	z->_mp_size = size;
+}
+
+/*
+ * Fixed-size add routines
+ */
+
+#define ADD_BODY(text) \
+	asm( \
+		text \
+		: /* no output operands */ \
+		: "r" (xd), "r" (xs1), "r" (xs2) \
+		: "%rax", "memory" \
+	)
+
+#define ADD_FIRST() \
+	"movq 0(%1), %%rax; \n\t" \
+	"addq 0(%2), %%rax; \n\t" \
+	"movq %%rax, 0(%0); \n\t"
+
+#define ADD_NEXT(offset) \
+	"movq " #offset "(%1), %%rax; \n\t" \
+	"adcq " #offset "(%2), %%rax; \n\t" \
+	"movq %%rax, " #offset "(%0); \n\t"
+
+void mpx_add_1(mpx_t xd, mpx_t xs1, mpx_t xs2) {
+	ADD_BODY(
+		ADD_FIRST()
+	);
+}
+
+void mpx_add_2(mpx_t xd, mpx_t xs1, mpx_t xs2) {
+	ADD_BODY(
+		ADD_FIRST() ADD_NEXT(8)
+	);
+}
+
+void mpx_add_3(mpx_t xd, mpx_t xs1, mpx_t xs2) {
+	ADD_BODY(
+		ADD_FIRST() ADD_NEXT(8) ADD_NEXT(16)
+	);
+}
+
+void mpx_add_4(mpx_t xd, mpx_t xs1, mpx_t xs2) {
+	ADD_BODY(
+		ADD_FIRST() ADD_NEXT(8) ADD_NEXT(16) ADD_NEXT(24)
+	);
+}
+
+void mpx_add_5(mpx_t xd, mpx_t xs1, mpx_t xs2) {
+	ADD_BODY(
+		ADD_FIRST() ADD_NEXT(8) ADD_NEXT(16) ADD_NEXT(24)
+		ADD_NEXT(32)
+	);
+}
+
+void mpx_add_6(mpx_t xd, mpx_t xs1, mpx_t xs2) {
+	ADD_BODY(
+		ADD_FIRST() ADD_NEXT(8) ADD_NEXT(16) ADD_NEXT(24)
+		ADD_NEXT(32) ADD_NEXT(40)
+	);
+}
+
+void mpx_add_7(mpx_t xd, mpx_t xs1, mpx_t xs2) {
+	ADD_BODY(
+		ADD_FIRST() ADD_NEXT(8) ADD_NEXT(16) ADD_NEXT(24)
+		ADD_NEXT(32) ADD_NEXT(40) ADD_NEXT(48)
+	);
+}
+
+void mpx_add_8(mpx_t xd, mpx_t xs1, mpx_t xs2) {
+	ADD_BODY(
+		ADD_FIRST() ADD_NEXT(8) ADD_NEXT(16) ADD_NEXT(24)
+		ADD_NEXT(32) ADD_NEXT(40) ADD_NEXT(48) ADD_NEXT(56)
+	);
+}
+
+/*
+ * Fixed-size compare routines
+ */
+#define CMP_BODY(text) \
+	int result; \
+	asm( \
+		text \
+		: "=&a" (result) \
+		: "c" (xs1), "d" (xs2) \
+	); \
+	return result
+
+#define CMP_CHUNK(size, offset) \
+	"movq " #offset "(%1), %%rax; \n\t" \
+	"cmpq " #offset "(%2), %%rax; \n\t" \
+	"jc fixed_cmp_" #size "_lt; \n\t" \
+	"jne fixed_cmp_" #size "_gt; \n\t"
+
+#define CMP_TAIL(size) \
+	"movl $0, %0; \n\t" \
+	"jmp fixed_cmp_" #size "_return; \n\t" \
+  "fixed_cmp_" #size "_lt: \n\t" \
+	"movl $-1, %0; \n\t" \
+	"jmp fixed_cmp_" #size "_return; \n\t" \
+  "fixed_cmp_" #size "_gt: \n\t" \
+	"movl $1, %0; \n\t" \
+  "fixed_cmp_" #size "_return: \n\t"
+
+int mpx_cmp_1(mpx_t xs1, mpx_t xs2) {
+	CMP_BODY(
+		CMP_CHUNK(1, 0)
+		CMP_TAIL(1)
+	);
+}
+
+int mpx_cmp_2(mpx_t xs1, mpx_t xs2) {
+	CMP_BODY(
+		CMP_CHUNK(2, 8) CMP_CHUNK(2, 0)
+		CMP_TAIL(2)
+	);
+}
+
+int mpx_cmp_3(mpx_t xs1, mpx_t xs2) {
+	CMP_BODY(
+		CMP_CHUNK(3, 16) CMP_CHUNK(3, 8) CMP_CHUNK(3, 0)
+		CMP_TAIL(3)
+	);
+}
+
+int mpx_cmp_4(mpx_t xs1, mpx_t xs2) {
+	CMP_BODY(
+		CMP_CHUNK(4, 24) CMP_CHUNK(4, 16) CMP_CHUNK(4, 8) CMP_CHUNK(4, 0)
+		CMP_TAIL(4)
+	);
+}
+
+int mpx_cmp_5(mpx_t xs1, mpx_t xs2) {
+	CMP_BODY(
+		CMP_CHUNK(5, 32)
+		CMP_CHUNK(5, 24) CMP_CHUNK(5, 16) CMP_CHUNK(5, 8) CMP_CHUNK(5, 0)
+		CMP_TAIL(5)
+	);
+}
+
+int mpx_cmp_6(mpx_t xs1, mpx_t xs2) {
+	CMP_BODY(
+		CMP_CHUNK(6, 40) CMP_CHUNK(6, 32)
+		CMP_CHUNK(6, 24) CMP_CHUNK(6, 16) CMP_CHUNK(6, 8) CMP_CHUNK(6, 0)
+		CMP_TAIL(6)
+	);
+}
+
+int mpx_cmp_7(mpx_t xs1, mpx_t xs2) {
+	CMP_BODY(
+		CMP_CHUNK(7, 48) CMP_CHUNK(7, 40) CMP_CHUNK(7, 32)
+		CMP_CHUNK(7, 24) CMP_CHUNK(7, 16) CMP_CHUNK(7, 8) CMP_CHUNK(7, 0)
+		CMP_TAIL(7)
+	);
+}
+
+int mpx_cmp_8(mpx_t xs1, mpx_t xs2) {
+	CMP_BODY(
+		CMP_CHUNK(8, 56) CMP_CHUNK(8, 48) CMP_CHUNK(8, 40) CMP_CHUNK(8, 32)
+		CMP_CHUNK(8, 24) CMP_CHUNK(8, 16) CMP_CHUNK(8, 8) CMP_CHUNK(8, 0)
+		CMP_TAIL(8)
+	);
+}
+
+mpx_support xsupport_asm[MPX_MAXLIMBS] = {
+	{ 1, &mpx_add_1, &mpx_cmp_1 },
+	{ 2, &mpx_add_2, &mpx_cmp_2 },
+	{ 3, &mpx_add_3, &mpx_cmp_3 },
+	{ 4, &mpx_add_4, &mpx_cmp_4 },
+	{ 5, &mpx_add_5, &mpx_cmp_5 },
+	{ 6, &mpx_add_6, &mpx_cmp_6 },
+	{ 7, &mpx_add_7, &mpx_cmp_7 },
+	{ 8, &mpx_add_8, &mpx_cmp_8 }
+};
+
+inline void mpx_add_fixed(mpx_t xd, mpx_t xs1, mpx_t xs2, int n) {
+	unsigned char carry = 0;
+	int i;
+	for (i = 0; i < n; ++i)
+		carry = _addcarry_u64(carry, xs1[i], xs2[i],
+				(unsigned long long*)&xd[i]);
+}
+
+inline int mpx_cmp_fixed(mpx_t xs1, mpx_t xs2, int n) {
+	int i;
+	for (i = n - 1; i > 0; --i)
+		if (xs1[i] != xs2[i])
+			break;
+	return (xs1[i] > xs2[i]) - (xs1[i] < xs2[i]);
+}
+
+inline void mpx_add_n(mpx_t xd, mpx_t xs1, mpx_t xs2, int n) {
+	switch (n) {
+	  case 1: mpx_add_fixed(xd, xs1, xs2, 1); break;
+	  case 2: mpx_add_fixed(xd, xs1, xs2, 2); break;
+	  case 3: mpx_add_fixed(xd, xs1, xs2, 3); break;
+	  case 4: mpx_add_fixed(xd, xs1, xs2, 4); break;
+	  case 5: mpx_add_fixed(xd, xs1, xs2, 5); break;
+	  case 6: mpx_add_fixed(xd, xs1, xs2, 6); break;
+	  case 7: mpx_add_fixed(xd, xs1, xs2, 7); break;
+	  default: mpx_add_fixed(xd, xs1, xs2, 8); break;
+	}
+}
+
+inline int mpx_cmp_n(mpx_t xs1, mpx_t xs2, int n) {
+	switch (n) {
+	  case 1: return mpx_cmp_fixed(xs1, xs2, 1);
+	  case 2: return mpx_cmp_fixed(xs1, xs2, 2);
+	  case 3: return mpx_cmp_fixed(xs1, xs2, 3);
+	  case 4: return mpx_cmp_fixed(xs1, xs2, 4);
+	  case 5: return mpx_cmp_fixed(xs1, xs2, 5);
+	  case 6: return mpx_cmp_fixed(xs1, xs2, 6);
+	  case 7: return mpx_cmp_fixed(xs1, xs2, 7);
+	  default: return mpx_cmp_fixed(xs1, xs2, 8);
+	}
+}
+
+/*
+ * Out of line versions of the inline routines, for comparison against the
+ * asm set through mpx_support_impl(). There is no runtime dispatch: the
+ * walker calls mpx_add_n() and mpx_cmp_n() inline, and mpx_support_n()
+ * (used only by setup code) always returns the asm set.
+ */
+#define MPX_C_KERNELS(size) \
+	void mpx_add_c_##size(mpx_t xd, mpx_t xs1, mpx_t xs2) { \
+		mpx_add_fixed(xd, xs1, xs2, size); \
+	} \
+	int mpx_cmp_c_##size(mpx_t xs1, mpx_t xs2) { \
+		return mpx_cmp_fixed(xs1, xs2, size); \
+	}
+MPX_C_KERNELS(1) MPX_C_KERNELS(2) MPX_C_KERNELS(3) MPX_C_KERNELS(4)
+MPX_C_KERNELS(5) MPX_C_KERNELS(6) MPX_C_KERNELS(7) MPX_C_KERNELS(8)
+
+mpx_support xsupport_c[MPX_MAXLIMBS] = {
+	{ 1, &mpx_add_c_1, &mpx_cmp_c_1 },
+	{ 2, &mpx_add_c_2, &mpx_cmp_c_2 },
+	{ 3, &mpx_add_c_3, &mpx_cmp_c_3 },
+	{ 4, &mpx_add_c_4, &mpx_cmp_c_4 },
+	{ 5, &mpx_add_c_5, &mpx_cmp_c_5 },
+	{ 6, &mpx_add_c_6, &mpx_cmp_c_6 },
+	{ 7, &mpx_add_c_7, &mpx_cmp_c_7 },
+	{ 8, &mpx_add_c_8, &mpx_cmp_c_8 }
+};
+
+/*
+ * The mpx routines of a given size from the named set ("asm" or "c"),
+ * or NULL if that set is unknown.
+ */
+mpx_support* mpx_support_impl(char* impl, int n) {
+	if (n <= 0 || n > MPX_MAXLIMBS)
+		return (mpx_support*)NULL;
+	if (strcmp(impl, "asm") == 0)
+		return &xsupport_asm[n - 1];
+	if (strcmp(impl, "c") == 0)
+		return &xsupport_c[n - 1];
+	return (mpx_support*)NULL;
+}
+
+mpx_support* mpx_support_n(int n) {
+	if (n <= 0 || n > MPX_MAXLIMBS) {
+		fprintf(stderr, "Error: no mpx support available for size %d\n", n);
+		exit(1);
+	}
+	return &xsupport_asm[n - 1];
+}
+
+mpx_support* mpx_support_z(mpz_t z) {
+	return mpx_support_n(z->_mp_size);
+}
+/*
+ * Support for a stack of 4-ary (min-)heaps.
+ *
+ * This is tailored specifically for use by a recursive algorithm: each new
+ * heap sits on top of previous heaps, so only the heap most recently
+ * returned by mbh_new() (and not yet freed by mbh_delete()) should ever be
+ * modified.
+ *
+ * Sorting is done by a user-supplied comparison routine:
+ *   extern int mbh_compare(void* owner, void* context, void* left, void* right);
+ * which should return a negative integer to represent 'left < right',
+ * zero to represent 'left == right' and a positive integer to represent
+ * 'left > right'.
+ *
+ * All state lives in the bh_arena supplied by the caller, so independent
+ * arenas may be used from separate threads.
+ *
+ * Each node has MBH_ARITY children, so that the heap is half the depth
+ * of a binary heap, and the children compared at each level are adjacent.
+ * Nodes are moved into a hole rather than swapped.
+ */
+
+#include <stdlib.h>
+#undef SAFE_BUT_SLOW /* we need the private definitions here if nowhere else */
+#include "mbh.h"
+
+#define MBH_MINARENA 100
+#define OVERHEAD (sizeof(bh_heap) / sizeof(bhsize_t))
+
+/*
+ * Initialize an arena for use. Must be called before any other functions
+ * are called on that arena.
+ */
+void setup_mbh(bh_arena* a, void* owner) {
+	a->maxsize = MBH_MINARENA;
+	a->arena = (bhsize_t*)malloc(a->maxsize * sizeof(bhsize_t));
+	a->size = 0;
+	a->owner = owner;
+}
+
+/*
+ * Clean up after use. After calling this, state should be as it was before
+ * setup_mbh() was called.
+ */
+void teardown_mbh(bh_arena* a) {
+	free(a->arena);
+}
+
+/*
+ * Resize the arena.
+ * Input:
+ *   bh_arena* a: the arena to resize
+ *   bhsize_t minsize: grow the arena to be at least minsize sizeof(bhsize_t).
+ * Returns:
+ *   Nothing.
+ */
+void mbh_grow(bh_arena* a, bhsize_t minsize) {
+	if (minsize <= a->maxsize)
+		return;
+	a->maxsize = a->maxsize * 3 / 2;
+	if (a->maxsize < minsize)
+		a->maxsize = minsize;
+	a->arena = realloc(a->arena, a->maxsize * sizeof(bhsize_t));
+}
+
+/*
+ * Resize a heap.
+ * Input:
+ *   bh_arena* a: the arena holding the heap
+ *   bhp h: the heap pointer to resize
+ *   bhsize_t size: the minimum size the heap should be
+ * Returns:
+ *   Nothing.
+ */
+void mbh_assert(bh_arena* a, bhp h, bhsize_t size) {
+	a->size = h + size + OVERHEAD;
+	mbh_grow(a, a->size);
+}
+
+/*
+ * Initialize a new heap.
+ * Input:
+ *   bh_arena* a: the arena to create the heap in
+ *   void* context: an opaque context pointer
+ * Returns:
+ *   A bhp referring to the new heap.
+ * Notes:
+ *   The context pointer is accessible as BHP(a, h)->context.
+ *   Any bhp acquired before this should not be modified until after this
+ *   one has been deleted with mbh_delete().
+ */
+bhp mbh_new(bh_arena* a, void* context, mbh_compare_func* comparator) {
+	bhp h = a->size;
+	mbh_assert(a, h, 0);
+	BHP(a, h)->size = 0;
+	BHP(a, h)->context = context;
+	BHP(a, h)->comparator = comparator;
+	return h;
+}
+
+/*
+ * Free a heap.
+ * Input:
+ *   bh_arena* a: the arena holding the heap.
+ *   bhp h: the pointer to the heap to be freed.
+ * Returns:
+ *   Nothing.
+ */
+void mbh_delete(bh_arena* a, bhp h) {
+	a->size = h;
+}
+
+/*
+ * Compare a pair of values in a heap.
+ */
+static inline int mbh_cmpval(bh_arena* a, bh_heap* hp, void* left, void* right) {
+	return hp->comparator(a->owner, hp->context, left, right);
+}
+
+MBH_SPECIALISE(mbh_generic, mbh_cmpval)
+
+/*
+ * Insert a new node into a heap.
+ * Input:
+ *   bh_arena* a: the arena holding the heap.
+ *   bhp h: the pointer to the heap.
+ *   void* v: an opaque value object to insert.
+ * Returns:
+ *   Nothing.
+ * Notes:
+ *   The value becomes referenced by the heap until either it is shifted
+ * out (i.e. returned by a call to mbh_shift(a, h)), or the heap is deleted
+ * (with mbh_delete(a, h)).
+ */
+void mbh_insert(bh_arena* a, bhp h, void* v) {
+	mbh_generic_insert(a, h, v);
+}
+
+/*
+ * Shift the least node out of the heap.
+ * Input:
+ *   bh_arena* a: the arena holding the heap.
+ *   bhp h: the pointer to the heap.
+ * Returns:
+ *   void* v, the opaque value object shift out of the heap.
+ */
+void* mbh_shift(bh_arena* a, bhp h) {
+	return mbh_generic_shift(a, h);
+}
+
+/*
+ * Replace the least node of the heap with a new one.
+ * Input:
+ *   bh_arena* a: the arena holding the heap.
+ *   bhp h: the pointer to the heap, which must not be empty.
+ *   void* v: an opaque value object to insert.
+ * Returns:
+ *   void* v, the opaque value object shifted out of the heap.
+ */
+void* mbh_replace(bh_arena* a, bhp h, void* v) {
+	return mbh_generic_replace(a, h, v);
+}
+
+/*
+ * The least node of the heap, without removing it.
+ */
+void* mbh_top(bh_arena* a, bhp h) {
+	return BHP(a, h)->heap[0];
+}
+
+/*
+ * The values stored in the heap, in heap order.
+ */
+void** mbh_values(bh_arena* a, bhp h) {
+	return BHP(a, h)->heap;
+}
+
+/*
+ * Save the contents of an arena.
+ */
+int mbh_save(bh_arena* a, FILE* f) {
+	return fwrite(&a->size, sizeof(a->size), 1, f) == 1
+			&& fwrite(a->arena, sizeof(bhsize_t), a->size, f) == a->size;
+}
+
+/*
+ * Restore the contents of an arena saved with mbh_save().
+ */
+int mbh_restore(bh_arena* a, FILE* f) {
+	bhsize_t size;
+
+	if (fread(&size, sizeof(size), 1, f) != 1)
+		return 0;
+	mbh_grow(a, size);
+	if (fread(a->arena, sizeof(bhsize_t), size, f) != size)
+		return 0;
+	a->size = size;
+	return 1;
+}
+
+/*
+ * Set the context and comparator of a restored heap.
+ */
+void mbh_rebind(bh_arena* a, bhp h, void* context, mbh_compare_func* comparator) {
+	BHP(a, h)->context = context;
+	BHP(a, h)->comparator = comparator;
+}
+
+/*
+ * The current size of the heap.
+ * Input:
+ *   bh_arena* a: the arena holding the heap.
+ *   bhp h: the pointer to the heap.
+ * Returns:
+ *   bhsize_t size, the number of items currently stored in the heap.
+ */
+bhsize_t mbh_size(bh_arena* a, bhp h) {
+	return BHP(a, h)->size;
+}
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "prime.h"
+#include "mygmp.h"
+
+/*
+ * Smallest prime factor table: spf[n] is the least prime dividing n for
+ * 2 <= n <= max, spf[0] == spf[1] == 0. Once published a table is never
+ * changed; a larger one replaces it, with the old kept on the 'older'
+ * chain until teardown_prime() since lookups may still be using it.
+ */
+typedef struct prime_s_sieve {
+	int max;
+	struct prime_s_sieve* older;
+	int spf[0];
+} prime_sieve;
+
+static prime_sieve* spf_sieve = (prime_sieve*)NULL;
+static pthread_mutex_t spf_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline prime_sieve* spf_get(void) {
+	return __atomic_load_n(&spf_sieve, __ATOMIC_ACQUIRE);
+}
+
+int gcd(int a, int b) {
+	int temp;
+	if (a > b) {
+		temp = a;
+		a = b;
+		b = temp;
+	}
+	while (a > 0) {
+		temp = b % a;
+		b = a;
+		a = temp;
+	}
+	return b;
+}
+
+/*
+ * Build the smallest prime factor table for 2 <= n <= max, if the current
+ * table does not already cover it.
+ * Input:
+ *   int max: the greatest value to be covered
+ * Returns:
+ *   Nothing
+ * Notes:
+ *   Uses a linear sieve, setting each composite exactly once, so this
+ * is O(max). Safe to call from multiple threads.
+ */
+void setup_prime(int max) {
+	prime_sieve* s;
+	int* primes;
+	int i, j, p, np = 0;
+
+	s = spf_get();
+	if (s && s->max >= max)
+		return;
+	pthread_mutex_lock(&spf_lock);
+	s = spf_sieve;
+	if (s && s->max >= max) {
+		pthread_mutex_unlock(&spf_lock);
+		return;
+	}
+	if (max < 2)
+		max = 2;
+	s = calloc(1, sizeof(prime_sieve) + (max + 1) * sizeof(int));
+	primes = malloc((max / 2 + 1) * sizeof(int));
+	if (!s || !primes) {
+		fprintf(stderr, "Out of memory for prime sieve to %d\n", max);
+		exit(1);
+	}
+	s->max = max;
+	for (i = 2; i <= max; ++i) {
+		if (s->spf[i] == 0) {
+			s->spf[i] = i;
+			primes[np++] = i;
+		}
+		for (j = 0; j < np; ++j) {
+			p = primes[j];
+			if (p > s->spf[i] || p > max / i)
+				break;
+			s->spf[i * p] = p;
+		}
+	}
+	free(primes);
+	s->older = spf_sieve;
+	__atomic_store_n(&spf_sieve, s, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&spf_lock);
+}
+
+/*
+ * Free the smallest prime factor tables.
+ * Must not be called while any search is using them.
+ */
+void teardown_prime(void) {
+	prime_sieve* s = spf_sieve;
+	prime_sieve* older;
+	spf_sieve = (prime_sieve*)NULL;
+	while (s) {
+		older = s->older;
+		free(s);
+		s = older;
+	}
+}
+
+/*
+ * Return the greatest value covered by the smallest prime factor table,
+ * or 0 if there is none.
+ */
+int prime_sieve_max(void) {
+	prime_sieve* s = spf_get();
+	return s ? s->max : 0;
+}
+
+/*
+ * Factorise n.
+ * Input:
+ *   int n: the number to factorise, n >= 1
+ *   int primes[PRIME_FACTORS_MAX]: filled in with the distinct primes p_i
+ *   int powers[PRIME_FACTORS_MAX]: filled in with the prime powers p_i^k_i
+ * Returns:
+ *   int count of distinct prime factors, in ascending order
+ * Notes:
+ *   This is O(log n) when n is covered by the table (see setup_prime()),
+ * else falls back to trial division.
+ */
+int prime_factors(int n, int* primes, int* powers) {
+	prime_sieve* s = spf_get();
+	int d, power, count = 0;
+
+	if (s && n <= s->max) {
+		while (n > 1) {
+			d = s->spf[n];
+			power = 1;
+			do {
+				power *= d;
+				n /= d;
+			} while (s->spf[n] == d);
+			primes[count] = d;
+			powers[count++] = power;
+		}
+		return count;
+	}
+	for (d = 2; d <= n / d; ++d) {
+		if (n % d)
+			continue;
+		power = 1;
+		do {
+			power *= d;
+			n /= d;
+		} while (n % d == 0);
+		primes[count] = d;
+		powers[count++] = power;
+	}
+	/* what's left is prime */
+	if (n > 1) {
+		primes[count] = n;
+		powers[count++] = n;
+	}
+	return count;
+}
+
+/*
+ * Find the greatest prime power p^k that divides n.
+ * Input:
+ *   int n: the number to test
+ *   int* prime: optionally pointer to an int to store p, else NULL
+ * Returns:
+ *   int p^k
+ * Notes:
+ *   If int* prime is not NULL, the base prime p will be stored there.
+ *   This is O(log n) when n is covered by the table (see setup_prime()),
+ * else falls back to trial division.
+ */
+int greatest_prime_power(int n, int* prime) {
+	prime_sieve* s = spf_get();
+	int d, q, best = 0, bestp = 0, power;
+
+	if (s && n <= s->max) {
+		while (n > 1) {
+			d = s->spf[n];
+			power = 1;
+			do {
+				power *= d;
+				n /= d;
+			} while (s->spf[n] == d);
+			if (best < power) {
+				best = power;
+				bestp = d;
+			}
+		}
+		if (best == 0)
+			best = bestp = 1;
+		if (prime)
+			*prime = bestp;
+		return best;
+	}
+	for (d = 2; d <= n / d; ++d) {
+		q = n / d;
+		if (d * q != n)
+			continue;
+		power = d;
+		n = q;
+		q = n / d;
+		while (d * q == n) {
+			power *= d;
+			n = q;
+			q = n / d;
+		}
+		if (best < power) {
+			best = power;
+			bestp = d;
+		}
+	}
+	/* what's left is prime */
+	if (best < n)
+		best = bestp = n;
+	if (prime)
+		*prime = bestp;
+	return best;
+}
+
+/*
+ * Find the greatest prime power p^k that divides z.
+ * Input:
+ *   mpz_t z: the number to test.
+ *   int* prime: optional pointer to an int, else NULL.
+ * Returns:
+ *   int p^k, the greatest prime power that divides z.
+ * Notes:
+ *   It is required that p^k fit in an int.
+ *   If int* prime is not NULL, the base prime p will be stored there.
+ *   If z fits in an int this defers to greatest_prime_power(); else the
+ * approach is very simplistic, and should not be used in any tight loop.
+ */
+int z_greatest_prime_power(mpz_t z, int* prime) {
+	mpz_t d, q, r, n;
+	int best = 0, bestp = 0, power;
+
+	if (mpz_fits_sint_p(z) && mpz_sgn(z) > 0)
+		return greatest_prime_power((int)mpz_get_si(z), prime);
+
+	ZINIT(&n, "z_greatest_prime_power n");
+	ZINIT(&d, "z_greatest_prime_power d");
+	ZINIT(&q, "z_greatest_prime_power q");
+	ZINIT(&r, "z_greatest_prime_power r");
+	mpz_set(n, z);
+	mpz_set_ui(d, 2);
+	while (1) {
+		mpz_fdiv_qr(q, r, n, d);
+		if (mpz_get_ui(r) == 0) {
+			power = mpz_get_ui(d);
+			mpz_set(n, q);
+			mpz_fdiv_qr(q, r, n, d);
+			while (mpz_get_ui(r) == 0) {
+				power *= mpz_get_ui(d);
+				mpz_set(n, q);
+				mpz_fdiv_qr(q, r, n, d);
+			}
+			if (best < power) {
+				best = power;
+				bestp = mpz_get_ui(d);
+			}
+		}
+		mpz_nextprime(d, d);
+		mpz_mul(q, d, d);
+		if (mpz_cmp(q, n) > 0)
+			break;
+	}
+	/* what's left is prime */
+	if (best < mpz_get_ui(n))
+		best = bestp = mpz_get_ui(n);
+	if (prime)
+		*prime = bestp;
+	ZCLEAR(&r, "z_greatest_prime_power r");
+	ZCLEAR(&q, "z_greatest_prime_power q");
+	ZCLEAR(&d, "z_greatest_prime_power d");
+	ZCLEAR(&n, "z_greatest_prime_power n");
+	return best;
+}
+/*
+ * Support for inverse (mod p).
+ */
+
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "inverse.h"
+
+/*
+ * Extended Euclidean algorithm
+ * Input:
+ *   unsigned int n, 1 <= n < 2^31
+ *   unsigned int m, 1 <= m < 2^31
+ *   gcd(n, m) == 1
+ * Returns:
+ *   unsigned int r, 0 <= r < m, nr == 1 (mod m)
+ * Time:
+ *   O(log^2(m))
+ */
+uint inveuclid(uint n, uint m) {
+	uint a = m, b = n, q, nexta;
+	int x = 1, lastx = 0, nextx;
+	while (b != 0) {
+		q = a / b;
+		nexta = b;
+		b = a % b;
+		a = nexta;
+		nextx = lastx - q * x;
+		lastx = x;
+		x = nextx;
+	}
+#ifdef DEBUG
+	if ((lastx < -(int)m) || (lastx >= (int)m)) {
+		fprintf(stderr, "Value out of range: %u (mod %u) => %d\n", n, m, lastx);
+	}
+#endif
+	return (lastx < 0) ? lastx + m : lastx;
+}
+
+/*
+ * Table inverse
+ * Input:
+ *   unsigned int p, 3 <= p < 2^31, p an odd prime
+ *   unsigned int t[p], pointer to a mutable array of p unsigned ints
+ * Returns:
+ *   Nothing, fills in t[k] == k^-1 (mod p), 1 <= k <= p-1
+ * Time:
+ *   ?
+ */
+void invtable(uint p, uint* t) {
+	uint n = 1;
+	uint r = 1;
+	uint gap = 1;
+	memset((void*)t, 0, p * sizeof(uint));
+	while (1) {
+		t[n] = r;
+		t[r] = n;
+		t[p - n] = p - r;
+		t[p - r] = p - n;
+		n <<= 1;
+		if (n > p) n -= p;
+		r = ((r & 1) ? (r + p) : r) >> 1;
+		if (t[n] == 0) continue;
+		while (gap < p && t[gap]) ++gap;
+		if (gap == p) break;
+		n = gap;
+		r = inveuclid(n, p);
+	}
+}
+
+uint* inverse[INVERSE_MAX + 1];
+static pthread_mutex_t inverse_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* tables within this range are in the read-only mapped cache file */
+static char* inverse_map = (char*)NULL;
+static size_t inverse_mapsize = 0;
+
+/*
+ * Cache file layout: the header, then offset[p] for 0 <= p <= maxp giving
+ * the byte offset of the table for each prime p (or 0), then the tables.
+ */
+#define INVERSE_MAGIC "A101877 inv 1"
+typedef struct inv_s_header {
+	char magic[16];
+	uint maxp;
+	uint count;
+	uint64_t offset[0];
+} inv_header;
+
+static int in_map(uint* t) {
+	return (char*)t >= inverse_map && (char*)t < inverse_map + inverse_mapsize;
+}
+
+/*
+ * Initialize for use of inverse caching (see invfast())
+ */
+void setup_inverse(void) {
+	memset(inverse, 0, sizeof(inverse));
+	inverse_map = (char*)NULL;
+	inverse_mapsize = 0;
+}
+
+/*
+ * Free memory used for inverse caching (see invfast())
+ * Must not be called while any search is using the tables.
+ */
+void teardown_inverse(void) {
+	int i;
+	for (i = 0; i <= INVERSE_MAX; ++i) {
+		if (inverse[i] && !in_map(inverse[i])) free(inverse[i]);
+		inverse[i] = (uint*)NULL;
+	}
+	if (inverse_map)
+		munmap(inverse_map, inverse_mapsize);
+	inverse_map = (char*)NULL;
+	inverse_mapsize = 0;
+}
+
+/*
+ * Write a cache file of the inverse tables for all primes up to maxp.
+ * The file is written under a temporary name and renamed into place, so
+ * that concurrent readers only ever see a complete file.
+ * Returns TRUE on success.
+ */
+static int inverse_write(char* path, uint maxp) {
+	char* sieve = calloc(maxp + 1, 1);
+	size_t hsize = sizeof(inv_header) + (maxp + 1) * sizeof(uint64_t);
+	inv_header* h = calloc(1, hsize);
+	uint64_t offset = hsize;
+	uint* t = malloc((maxp + 1) * sizeof(uint));
+	char* tmp = malloc(strlen(path) + 32);
+	FILE* f;
+	uint p, q;
+	int ok;
+
+	strcpy(h->magic, INVERSE_MAGIC);
+	h->maxp = maxp;
+	for (p = 2; p <= maxp; ++p) {
+		if (sieve[p])
+			continue;
+		for (q = p * 2; q <= maxp; q += p)
+			sieve[q] = 1;
+		h->offset[p] = offset;
+		offset += (p + ((p <= 2) ? 1 : 0)) * sizeof(uint);
+		++h->count;
+	}
+	sprintf(tmp, "%s.%d.tmp", path, (int)getpid());
+	f = fopen(tmp, "wb");
+	ok = f && fwrite(h, hsize, 1, f) == 1;
+	for (p = 2; ok && p <= maxp; ++p) {
+		uint size = p + ((p <= 2) ? 1 : 0);
+		if (!h->offset[p])
+			continue;
+		memset(t, 0, size * sizeof(uint));
+		invtable(p, t);
+		ok = fwrite(t, sizeof(uint), size, f) == size;
+	}
+	if (f && fclose(f) != 0)
+		ok = 0;
+	if (ok && rename(tmp, path) != 0)
+		ok = 0;
+	if (!ok) {
+		fprintf(stderr, "Cannot write inverse cache %s: %s\n",
+				path, strerror(errno));
+		unlink(tmp);
+	}
+	free(tmp);
+	free(t);
+	free(h);
+	free(sieve);
+	return ok;
+}
+
+/*
+ * Map a cache file of inverse tables, creating it if it does not exist
+ * or does not cover primes up to maxp.
+ * Input:
+ *   char* path: the cache file
+ *   uint maxp: the greatest prime that will be needed
+ *   previous call to setup_inverse(), with no tables yet built
+ * Returns:
+ *   TRUE if the cache is in use; if not, inverse_table() still builds
+ * tables in memory as needed.
+ * Notes:
+ *   The file is mapped read-only and shared, so separate processes using
+ * the same file share its pages.
+ */
+int inverse_load(char* path, uint maxp) {
+	struct stat st;
+	inv_header* h;
+	int fd, tries;
+	uint p;
+
+	if (maxp > INVERSE_MAX)
+		maxp = INVERSE_MAX;
+	for (tries = 0; tries < 2; ++tries) {
+		fd = open(path, O_RDONLY);
+		if (fd >= 0) {
+			if (fstat(fd, &st) == 0 && st.st_size >= sizeof(inv_header)) {
+				inverse_mapsize = st.st_size;
+				inverse_map = mmap(NULL, inverse_mapsize, PROT_READ,
+						MAP_SHARED, fd, 0);
+				if (inverse_map == MAP_FAILED)
+					inverse_map = (char*)NULL;
+			}
+			close(fd);
+			h = (inv_header*)inverse_map;
+			if (h && strcmp(h->magic, INVERSE_MAGIC) == 0
+					&& h->maxp >= maxp
+					&& sizeof(inv_header) + (h->maxp + 1) * sizeof(uint64_t)
+						<= inverse_mapsize)
+				break;
+			if (inverse_map)
+				munmap(inverse_map, inverse_mapsize);
+			inverse_map = (char*)NULL;
+			inverse_mapsize = 0;
+		}
+		if (tries || !inverse_write(path, maxp))
+			return 0;
+	}
+	if (!inverse_map)
+		return 0;
+	for (p = 0; p <= h->maxp && p <= INVERSE_MAX; ++p)
+		if (h->offset[p] && h->offset[p] + p * sizeof(uint) <= inverse_mapsize)
+			inverse[p] = (uint*)(inverse_map + h->offset[p]);
+	return 1;
+}
+
+/*
+ * Set up cache of inverses (mod p)
+ * Input:
+ *   unsigned int p, 2 <= p <= INVERSE_MAX, p prime
+ *   eventual teardown call to teardown_inverse()
+ * Returns:
+ *   Nothing, but caches all inverses (mod p) for later calls to invfast()
+ * Time:
+ *   O(invtable(p)) + O(p) the first time for each p, else O(1)
+ * Notes:
+ *   The table is published only once complete, under the lock, so any
+ *   thread that has itself called inverse_table(p) may use invfast(n, p).
+ */
+void inverse_table(uint p) {
+	uint effective_size = p + ((p <= 2) ? 1 : 0);
+	uint* t;
+
+	if (p > INVERSE_MAX) {
+		fprintf(stderr, "inverse_table: %u exceeds max %u\n", p, INVERSE_MAX);
+		exit(1);
+	}
+	pthread_mutex_lock(&inverse_lock);
+	if (!inverse[p]) {
+		t = calloc(effective_size, sizeof(uint));
+		invtable(p, t);
+		inverse[p] = t;
+	}
+	pthread_mutex_unlock(&inverse_lock);
+}
+
+/*
+ * Fast modular inverse
+ * Input:
+ *   unsigned int n, 0 <= n < p
+ *   unsigned int p, 2 <= p < 2^31, p prime
+ *   previous call to inverse_table(p)
+ * Returns:
+ *   unsigned int r, 0 <= r < p, nr == 1 (mod p)
+ * Time:
+ *   1
+ * Caveats:
+ *   For speed, no checking is done: constraints above must be satisfied.
+ *   All calls are expected to use the inline definition in "inverse.h".
+ */
+uint invfast(uint n, uint p) {
+	return inverse[p][n];
+}
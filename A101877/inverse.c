@@ -2,6 +2,13 @@
  * Support for inverse (mod p).
  */
 
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "inverse.h"
 
 /*
@@ -66,50 +73,192 @@ void invtable(uint p, uint* t) {
 	}
 }
 
-uint** inverse;
-uint inverse_size = 0;
+uint* inverse[INVERSE_MAX + 1];
+static pthread_mutex_t inverse_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* tables within this range are in the read-only mapped cache file */
+static char* inverse_map = (char*)NULL;
+static size_t inverse_mapsize = 0;
+
+/*
+ * Cache file layout: the header, then offset[p] for 0 <= p <= maxp giving
+ * the byte offset of the table for each prime p (or 0), then the tables.
+ */
+#define INVERSE_MAGIC "A101877 inv 1"
+typedef struct inv_s_header {
+	char magic[16];
+	uint maxp;
+	uint count;
+	uint64_t offset[0];
+} inv_header;
+
+static int in_map(uint* t) {
+	return (char*)t >= inverse_map && (char*)t < inverse_map + inverse_mapsize;
+}
 
 /*
  * Initialize for use of inverse caching (see invfast())
  */
 void setup_inverse(void) {
-	inverse_size = 0;
-	inverse = (uint**)NULL;
+	memset(inverse, 0, sizeof(inverse));
+	inverse_map = (char*)NULL;
+	inverse_mapsize = 0;
 }
 
 /*
  * Free memory used for inverse caching (see invfast())
+ * Must not be called while any search is using the tables.
  */
 void teardown_inverse(void) {
 	int i;
-	for (i = 0; i < inverse_size; ++i) {
-		if (inverse[i]) free(inverse[i]);
+	for (i = 0; i <= INVERSE_MAX; ++i) {
+		if (inverse[i] && !in_map(inverse[i])) free(inverse[i]);
+		inverse[i] = (uint*)NULL;
 	}
-	free(inverse);
+	if (inverse_map)
+		munmap(inverse_map, inverse_mapsize);
+	inverse_map = (char*)NULL;
+	inverse_mapsize = 0;
+}
+
+/*
+ * Write a cache file of the inverse tables for all primes up to maxp.
+ * The file is written under a temporary name and renamed into place, so
+ * that concurrent readers only ever see a complete file.
+ * Returns TRUE on success.
+ */
+static int inverse_write(char* path, uint maxp) {
+	char* sieve = calloc(maxp + 1, 1);
+	size_t hsize = sizeof(inv_header) + (maxp + 1) * sizeof(uint64_t);
+	inv_header* h = calloc(1, hsize);
+	uint64_t offset = hsize;
+	uint* t = malloc((maxp + 1) * sizeof(uint));
+	char* tmp = malloc(strlen(path) + 32);
+	FILE* f;
+	uint p, q;
+	int ok;
+
+	strcpy(h->magic, INVERSE_MAGIC);
+	h->maxp = maxp;
+	for (p = 2; p <= maxp; ++p) {
+		if (sieve[p])
+			continue;
+		for (q = p * 2; q <= maxp; q += p)
+			sieve[q] = 1;
+		h->offset[p] = offset;
+		offset += (p + ((p <= 2) ? 1 : 0)) * sizeof(uint);
+		++h->count;
+	}
+	sprintf(tmp, "%s.%d.tmp", path, (int)getpid());
+	f = fopen(tmp, "wb");
+	ok = f && fwrite(h, hsize, 1, f) == 1;
+	for (p = 2; ok && p <= maxp; ++p) {
+		uint size = p + ((p <= 2) ? 1 : 0);
+		if (!h->offset[p])
+			continue;
+		memset(t, 0, size * sizeof(uint));
+		invtable(p, t);
+		ok = fwrite(t, sizeof(uint), size, f) == size;
+	}
+	if (f && fclose(f) != 0)
+		ok = 0;
+	if (ok && rename(tmp, path) != 0)
+		ok = 0;
+	if (!ok) {
+		fprintf(stderr, "Cannot write inverse cache %s: %s\n",
+				path, strerror(errno));
+		unlink(tmp);
+	}
+	free(tmp);
+	free(t);
+	free(h);
+	free(sieve);
+	return ok;
+}
+
+/*
+ * Map a cache file of inverse tables, creating it if it does not exist
+ * or does not cover primes up to maxp.
+ * Input:
+ *   char* path: the cache file
+ *   uint maxp: the greatest prime that will be needed
+ *   previous call to setup_inverse(), with no tables yet built
+ * Returns:
+ *   TRUE if the cache is in use; if not, inverse_table() still builds
+ * tables in memory as needed.
+ * Notes:
+ *   The file is mapped read-only and shared, so separate processes using
+ * the same file share its pages.
+ */
+int inverse_load(char* path, uint maxp) {
+	struct stat st;
+	inv_header* h;
+	int fd, tries;
+	uint p;
+
+	if (maxp > INVERSE_MAX)
+		maxp = INVERSE_MAX;
+	for (tries = 0; tries < 2; ++tries) {
+		fd = open(path, O_RDONLY);
+		if (fd >= 0) {
+			if (fstat(fd, &st) == 0 && st.st_size >= sizeof(inv_header)) {
+				inverse_mapsize = st.st_size;
+				inverse_map = mmap(NULL, inverse_mapsize, PROT_READ,
+						MAP_SHARED, fd, 0);
+				if (inverse_map == MAP_FAILED)
+					inverse_map = (char*)NULL;
+			}
+			close(fd);
+			h = (inv_header*)inverse_map;
+			if (h && strcmp(h->magic, INVERSE_MAGIC) == 0
+					&& h->maxp >= maxp
+					&& sizeof(inv_header) + (h->maxp + 1) * sizeof(uint64_t)
+						<= inverse_mapsize)
+				break;
+			if (inverse_map)
+				munmap(inverse_map, inverse_mapsize);
+			inverse_map = (char*)NULL;
+			inverse_mapsize = 0;
+		}
+		if (tries || !inverse_write(path, maxp))
+			return 0;
+	}
+	if (!inverse_map)
+		return 0;
+	for (p = 0; p <= h->maxp && p <= INVERSE_MAX; ++p)
+		if (h->offset[p] && h->offset[p] + p * sizeof(uint) <= inverse_mapsize)
+			inverse[p] = (uint*)(inverse_map + h->offset[p]);
+	return 1;
 }
 
 /*
  * Set up cache of inverses (mod p)
  * Input:
- *   unsigned int p, 2 <= p < 2^31, p prime
- *   previous initialization call to setup_inverse()
+ *   unsigned int p, 2 <= p <= INVERSE_MAX, p prime
  *   eventual teardown call to teardown_inverse()
  * Returns:
  *   Nothing, but caches all inverses (mod p) for later calls to invfast()
  * Time:
- *   O(invtable(p)) + O(p)
+ *   O(invtable(p)) + O(p) the first time for each p, else O(1)
+ * Notes:
+ *   The table is published only once complete, under the lock, so any
+ *   thread that has itself called inverse_table(p) may use invfast(n, p).
  */
 void inverse_table(uint p) {
-	uint size = p + 1;
 	uint effective_size = p + ((p <= 2) ? 1 : 0);
-	if (inverse_size < size) {
-		inverse = realloc(inverse, size * sizeof(uint*));
-		memset(&inverse[inverse_size], 0,
-				(size - inverse_size) * sizeof(uint*));
-		inverse_size = size;
+	uint* t;
+
+	if (p > INVERSE_MAX) {
+		fprintf(stderr, "inverse_table: %u exceeds max %u\n", p, INVERSE_MAX);
+		exit(1);
+	}
+	pthread_mutex_lock(&inverse_lock);
+	if (!inverse[p]) {
+		t = calloc(effective_size, sizeof(uint));
+		invtable(p, t);
+		inverse[p] = t;
 	}
-	inverse[p] = calloc(effective_size, sizeof(uint));
-	invtable(p, inverse[p]);
+	pthread_mutex_unlock(&inverse_lock);
 }
 
 /*
@@ -16,9 +16,13 @@ extern void invtable(uint p, uint* t);
 extern void setup_inverse(void);
 extern void teardown_inverse(void);
 extern void inverse_table(uint p);
+extern int inverse_load(char* path, uint maxp);
 
-extern uint** inverse;
-extern uint inverse_size;
+/* Tables are shared by all users in the process, and never change once
+ * built; inverse_table() may be called from any thread.
+ */
+#define INVERSE_MAX 65536
+extern uint* inverse[INVERSE_MAX + 1];
 
 #ifdef ALL_C
 inline uint invfast(uint n, uint p);
@@ -1,5 +1,5 @@
 /*
- * Support for a stack of binary (min-)heaps.
+ * Support for a stack of 4-ary (min-)heaps.
  *
  * This is tailored specifically for use by a recursive algorithm: each new
  * heap sits on top of previous heaps, so only the heap most recently
@@ -7,185 +7,213 @@
  * modified.
  *
  * Sorting is done by a user-supplied comparison routine:
- *   extern int mbh_compare(void* context, void* left, void* right);
+ *   extern int mbh_compare(void* owner, void* context, void* left, void* right);
  * which should return a negative integer to represent 'left < right',
  * zero to represent 'left == right' and a positive integer to represent
  * 'left > right'.
+ *
+ * All state lives in the bh_arena supplied by the caller, so independent
+ * arenas may be used from separate threads.
+ *
+ * Each node has MBH_ARITY children, so that the heap is half the depth
+ * of a binary heap, and the children compared at each level are adjacent.
+ * Nodes are moved into a hole rather than swapped.
  */
 
 #include <stdlib.h>
 #undef SAFE_BUT_SLOW /* we need the private definitions here if nowhere else */
 #include "mbh.h"
 
-bhsize_t* mbharena;
-bhsize_t mbhmaxsize;
-bhsize_t mbhsize;
 #define MBH_MINARENA 100
 #define OVERHEAD (sizeof(bh_heap) / sizeof(bhsize_t))
 
 /*
- * Initialize for use. Must be called before any other functions are called.
+ * Initialize an arena for use. Must be called before any other functions
+ * are called on that arena.
  */
-void setup_mbh(void) {
-	mbhmaxsize = MBH_MINARENA;
-	mbharena = (bhsize_t*)malloc(mbhmaxsize * sizeof(bhsize_t));
-	mbhsize = 0;
+void setup_mbh(bh_arena* a, void* owner) {
+	a->maxsize = MBH_MINARENA;
+	a->arena = (bhsize_t*)malloc(a->maxsize * sizeof(bhsize_t));
+	a->size = 0;
+	a->owner = owner;
 }
 
 /*
  * Clean up after use. After calling this, state should be as it was before
  * setup_mbh() was called.
  */
-void teardown_mbh(void) {
-	free(mbharena);
+void teardown_mbh(bh_arena* a) {
+	free(a->arena);
 }
 
 /*
  * Resize the arena.
  * Input:
+ *   bh_arena* a: the arena to resize
  *   bhsize_t minsize: grow the arena to be at least minsize sizeof(bhsize_t).
  * Returns:
  *   Nothing.
  */
-void mbh_grow(bhsize_t minsize) {
-	if (minsize <= mbhmaxsize)
+void mbh_grow(bh_arena* a, bhsize_t minsize) {
+	if (minsize <= a->maxsize)
 		return;
-	mbhmaxsize = mbhmaxsize * 3 / 2;
-	if (mbhmaxsize < minsize)
-		mbhmaxsize = minsize;
-	mbharena = realloc(mbharena, mbhmaxsize * sizeof(bhsize_t));
+	a->maxsize = a->maxsize * 3 / 2;
+	if (a->maxsize < minsize)
+		a->maxsize = minsize;
+	a->arena = realloc(a->arena, a->maxsize * sizeof(bhsize_t));
 }
 
 /*
  * Resize a heap.
  * Input:
+ *   bh_arena* a: the arena holding the heap
  *   bhp h: the heap pointer to resize
  *   bhsize_t size: the minimum size the heap should be
  * Returns:
  *   Nothing.
  */
-void mbh_assert(bhp h, bhsize_t size) {
-	mbhsize = h + size + OVERHEAD;
-	mbh_grow(mbhsize);
+void mbh_assert(bh_arena* a, bhp h, bhsize_t size) {
+	a->size = h + size + OVERHEAD;
+	mbh_grow(a, a->size);
 }
 
 /*
  * Initialize a new heap.
  * Input:
+ *   bh_arena* a: the arena to create the heap in
  *   void* context: an opaque context pointer
  * Returns:
  *   A bhp referring to the new heap.
  * Notes:
- *   The context pointer is accessible as BHP(h)->context.
+ *   The context pointer is accessible as BHP(a, h)->context.
  *   Any bhp acquired before this should not be modified until after this
  *   one has been deleted with mbh_delete().
  */
-bhp mbh_new(void* context, mbh_compare_func* comparator) {
-	bhp h = mbhsize;
-	mbh_assert(h, 0);
-	BHP(h)->size = 0;
-	BHP(h)->context = context;
-	BHP(h)->comparator = comparator;
+bhp mbh_new(bh_arena* a, void* context, mbh_compare_func* comparator) {
+	bhp h = a->size;
+	mbh_assert(a, h, 0);
+	BHP(a, h)->size = 0;
+	BHP(a, h)->context = context;
+	BHP(a, h)->comparator = comparator;
 	return h;
 }
 
 /*
  * Free a heap.
  * Input:
+ *   bh_arena* a: the arena holding the heap.
  *   bhp h: the pointer to the heap to be freed.
  * Returns:
  *   Nothing.
  */
-void mbh_delete(bhp h) {
-	mbhsize = h;
+void mbh_delete(bh_arena* a, bhp h) {
+	a->size = h;
 }
 
 /*
- * Swap a pair of nodes in a heap.
- * Input:
- *   bhp h: the pointer to the heap.
- *   bhsize_t left: the index of the first node to be swapped.
- *   bhsize_t right: the index of the second node to be swapped.
- * Returns:
- *   Nothing.
+ * Compare a pair of values in a heap.
  */
-static inline void mbh_swapnode(bhp h, bhsize_t left, bhsize_t right) {
-	void* temp = BHP(h)->heap[left];
-	BHP(h)->heap[left] = BHP(h)->heap[right];
-	BHP(h)->heap[right] = temp;
+static inline int mbh_cmpval(bh_arena* a, bh_heap* hp, void* left, void* right) {
+	return hp->comparator(a->owner, hp->context, left, right);
 }
 
+MBH_SPECIALISE(mbh_generic, mbh_cmpval)
+
 /*
  * Insert a new node into a heap.
  * Input:
+ *   bh_arena* a: the arena holding the heap.
  *   bhp h: the pointer to the heap.
  *   void* v: an opaque value object to insert.
  * Returns:
  *   Nothing.
  * Notes:
  *   The value becomes referenced by the heap until either it is shifted
- * out (i.e. returned by a call to mbh_shift(h)), or the heap is deleted
- * (with mbh_delete(h)).
- */
-void mbh_insert(bhp h, void* v) {
-	bhsize_t node = BHP(h)->size++;
-	bhsize_t parent;
-	mbh_assert(h, node + 1);
-	BHP(h)->heap[node] = v;
-	while (node > 0) {
-		parent = (node - 1) >> 1;
-		if (BHP(h)->comparator(
-			BHP(h)->context, BHP(h)->heap[parent], BHP(h)->heap[node]
-		) <= 0) {
-			return;
-		}
-		mbh_swapnode(h, parent, node);
-		node = parent;
-	}
-	return;
+ * out (i.e. returned by a call to mbh_shift(a, h)), or the heap is deleted
+ * (with mbh_delete(a, h)).
+ */
+void mbh_insert(bh_arena* a, bhp h, void* v) {
+	mbh_generic_insert(a, h, v);
 }
 
 /*
  * Shift the least node out of the heap.
  * Input:
+ *   bh_arena* a: the arena holding the heap.
  *   bhp h: the pointer to the heap.
  * Returns:
  *   void* v, the opaque value object shift out of the heap.
  */
-void* mbh_shift(bhp h) {
-	void* value = BHP(h)->heap[0];
-	bhsize_t node = --BHP(h)->size;
-	bhsize_t child;
-	mbh_assert(h, node);
-	BHP(h)->heap[0] = BHP(h)->heap[node];
-	node = 0;
-	while (1) {
-		child = (node << 1) + 1;
-		if (child >= BHP(h)->size)
-			break;
-		if (child + 1 < BHP(h)->size && BHP(h)->comparator(
-			BHP(h)->context, BHP(h)->heap[child], BHP(h)->heap[child + 1]
-		) > 0) {
-			child = child + 1;
-		}
-		if (BHP(h)->comparator(
-			BHP(h)->context, BHP(h)->heap[node], BHP(h)->heap[child]
-		) <= 0) {
-			break;
-		}
-		mbh_swapnode(h, node, child);
-		node = child;
-	}
-	return value;
+void* mbh_shift(bh_arena* a, bhp h) {
+	return mbh_generic_shift(a, h);
+}
+
+/*
+ * Replace the least node of the heap with a new one.
+ * Input:
+ *   bh_arena* a: the arena holding the heap.
+ *   bhp h: the pointer to the heap, which must not be empty.
+ *   void* v: an opaque value object to insert.
+ * Returns:
+ *   void* v, the opaque value object shifted out of the heap.
+ */
+void* mbh_replace(bh_arena* a, bhp h, void* v) {
+	return mbh_generic_replace(a, h, v);
+}
+
+/*
+ * The least node of the heap, without removing it.
+ */
+void* mbh_top(bh_arena* a, bhp h) {
+	return BHP(a, h)->heap[0];
+}
+
+/*
+ * The values stored in the heap, in heap order.
+ */
+void** mbh_values(bh_arena* a, bhp h) {
+	return BHP(a, h)->heap;
+}
+
+/*
+ * Save the contents of an arena.
+ */
+int mbh_save(bh_arena* a, FILE* f) {
+	return fwrite(&a->size, sizeof(a->size), 1, f) == 1
+			&& fwrite(a->arena, sizeof(bhsize_t), a->size, f) == a->size;
+}
+
+/*
+ * Restore the contents of an arena saved with mbh_save().
+ */
+int mbh_restore(bh_arena* a, FILE* f) {
+	bhsize_t size;
+
+	if (fread(&size, sizeof(size), 1, f) != 1)
+		return 0;
+	mbh_grow(a, size);
+	if (fread(a->arena, sizeof(bhsize_t), size, f) != size)
+		return 0;
+	a->size = size;
+	return 1;
+}
+
+/*
+ * Set the context and comparator of a restored heap.
+ */
+void mbh_rebind(bh_arena* a, bhp h, void* context, mbh_compare_func* comparator) {
+	BHP(a, h)->context = context;
+	BHP(a, h)->comparator = comparator;
 }
 
 /*
  * The current size of the heap.
  * Input:
+ *   bh_arena* a: the arena holding the heap.
  *   bhp h: the pointer to the heap.
  * Returns:
  *   bhsize_t size, the number of items currently stored in the heap.
  */
-bhsize_t mbh_size(bhp h) {
-	return BHP(h)->size;
+bhsize_t mbh_size(bh_arena* a, bhp h) {
+	return BHP(a, h)->size;
 }
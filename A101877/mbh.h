@@ -2,6 +2,7 @@
 #define MBH_H
 
 #include <stdint.h>
+#include <stdio.h>
 
 typedef size_t bhsize_t;    /* must be same size as void* */
 typedef bhsize_t bhp;
@@ -9,6 +10,7 @@ typedef bhsize_t bhp;
 /*
  * Typedef for function to compare two heap objects
  * Input:
+ *   void* owner: the owner object supplied to setup_mbh()
  *   void* context: the context object supplied to mbh_new()
  *   void* left, void* right: the two value objects to compare
  * Returns:
@@ -16,94 +18,261 @@ typedef bhsize_t bhp;
  *   a positive integer to represent 'left > right'
  *   zero to represent 'left == right'
  */
-typedef int (mbh_compare_func)(void* context, void* left, void* right);
+typedef int (mbh_compare_func)(void* owner, void* context, void* left, void* right);
 
 /*
- * Initialize for use. Must be called before any other functions are called.
+ * The arena holding a stack of heaps. Each independent user (such as each
+ * search engine) has its own arena, so that separate arenas may be used
+ * concurrently from separate threads.
  */
-extern void setup_mbh(void);
+typedef struct bh_s_arena {
+	bhsize_t* arena;
+	bhsize_t maxsize;
+	bhsize_t size;
+	void* owner;		/* passed to each comparator call */
+} bh_arena;
+
+/*
+ * Initialize an arena for use. Must be called before any other functions
+ * are called on that arena.
+ * Input:
+ *   bh_arena* a: the arena to initialize
+ *   void* owner: an opaque pointer passed to each comparator call
+ */
+extern void setup_mbh(bh_arena* a, void* owner);
 
 /*
  * Clean up after use. After calling this, state should be as it was before
  * setup_mbh() was called.
  */
-extern void teardown_mbh(void);
+extern void teardown_mbh(bh_arena* a);
 
 /*
  * Initialize a new heap.
  * Input:
+ *   bh_arena* a: the arena to create the heap in
  *   void* context: an opaque context pointer
  * Returns:
  *   A bhp referring to the new heap.
  * Notes:
- *   The context pointer is accessible as BHP(h)->context.
+ *   The context pointer is accessible as BHP(a, h)->context.
  *   Any bhp acquired before this should not be modified until after this
  *   one has been deleted with mbh_delete().
  */
-extern bhp mbh_new(void* context, mbh_compare_func* comparator);
+extern bhp mbh_new(bh_arena* a, void* context, mbh_compare_func* comparator);
 
 /*
  * Free a heap.
  * Input:
+ *   bh_arena* a: the arena holding the heap.
  *   bhp h: the pointer to the heap to be freed.
  * Returns:
  *   Nothing.
  */
-extern void mbh_delete(bhp h);
+extern void mbh_delete(bh_arena* a, bhp h);
 
 /*
  * Insert a new node into a heap.
  * Input:
+ *   bh_arena* a: the arena holding the heap.
  *   bhp h: the pointer to the heap.
  *   void* v: an opaque value object to insert.
  * Returns:
  *   Nothing.
  * Notes:
  *   The value becomes referenced by the heap until either it is shifted
- * out (i.e. returned by a call to mbh_shift(h)), or the heap is deleted
- * (with mbh_delete(h)).
+ * out (i.e. returned by a call to mbh_shift(a, h)), or the heap is deleted
+ * (with mbh_delete(a, h)).
  */
-extern void mbh_insert(bhp h, void* v);
+extern void mbh_insert(bh_arena* a, bhp h, void* v);
 
 /*
  * Shift the least node out of the heap.
  * Input:
+ *   bh_arena* a: the arena holding the heap.
  *   bhp h: the pointer to the heap.
  * Returns:
  *   void* v, the opaque value object shift out of the heap.
  */
-extern void* mbh_shift(bhp h);
+extern void* mbh_shift(bh_arena* a, bhp h);
+
+/*
+ * Replace the least node of the heap with a new one; equivalent to
+ * mbh_shift() followed by mbh_insert(), but cheaper.
+ * Input:
+ *   bh_arena* a: the arena holding the heap.
+ *   bhp h: the pointer to the heap, which must not be empty.
+ *   void* v: an opaque value object to insert.
+ * Returns:
+ *   void* v, the opaque value object shifted out of the heap.
+ * Notes:
+ *   v may be the value currently at the top of the heap (see mbh_top()),
+ * modified in place since it was inserted: it is resorted.
+ */
+extern void* mbh_replace(bh_arena* a, bhp h, void* v);
+
+/*
+ * The least node of the heap, without removing it.
+ * Input:
+ *   bh_arena* a: the arena holding the heap.
+ *   bhp h: the pointer to the heap, which must not be empty.
+ * Returns:
+ *   void* v, the opaque value object at the top of the heap.
+ */
+extern void* mbh_top(bh_arena* a, bhp h);
+
+/*
+ * The values stored in the heap, in heap order.
+ * Input:
+ *   bh_arena* a: the arena holding the heap.
+ *   bhp h: the pointer to the heap.
+ * Returns:
+ *   void** values, an array of mbh_size(a, h) value objects.
+ * Notes:
+ *   The caller may rewrite the values in place, provided they still
+ * compare the same way; this allows values that are handles to be moved.
+ * The array is valid only until the next modification of the arena.
+ */
+extern void** mbh_values(bh_arena* a, bhp h);
+
+/*
+ * Save the contents of an arena, or restore them into an arena set up
+ * with setup_mbh(). Returns TRUE on success.
+ * Notes:
+ *   Context and comparator pointers are saved as they are, so after a
+ * restore each heap must be given them again with mbh_rebind().
+ */
+extern int mbh_save(bh_arena* a, FILE* f);
+extern int mbh_restore(bh_arena* a, FILE* f);
+extern void mbh_rebind(bh_arena* a, bhp h, void* context,
+		mbh_compare_func* comparator);
+
+/* The contents of a heap; only exposed if not SAFE_BUT_SLOW */
+typedef struct bh_s_heap bh_heap;
+
+/*
+ * A set of routines defined with MBH_SPECIALISE(), so that they can be
+ * chosen once for each heap.
+ */
+typedef struct bh_s_ops {
+	void (*insert)(bh_arena* a, bhp h, void* v);
+	void* (*shift)(bh_arena* a, bhp h);
+	void* (*replace)(bh_arena* a, bhp h, void* v);
+} mbh_ops;
+#define MBH_OPS(name) { &name##_insert, &name##_shift, &name##_replace }
 
 #ifdef SAFE_BUT_SLOW
-extern bhsize_t mbh_size(bhp h);
+extern bhsize_t mbh_size(bh_arena* a, bhp h);
+
+/* the specialised routines just use the generic ones */
+#define MBH_SPECIALISE(name, cmp) \
+static void name##_insert(bh_arena* a, bhp h, void* v) { \
+	mbh_insert(a, h, v); \
+} \
+static void* name##_shift(bh_arena* a, bhp h) { \
+	return mbh_shift(a, h); \
+} \
+static void* name##_replace(bh_arena* a, bhp h, void* v) { \
+	return mbh_replace(a, h, v); \
+}
+
 #else /* ifdef SAFE_BUT_SLOW */
 
-/* Note: mbharena, bh_heap and BHP(h) are not intended for use by callers.
+/* Note: bh_heap and BHP(a, h) are not intended for use by callers.
  * They are exposed here purely so that mbh_size() can be inlined.
  */
-extern bhsize_t* mbharena;
-typedef struct bh_s_heap {
+struct bh_s_heap {
 	bhsize_t size;
 	void* context;
 	mbh_compare_func* comparator;
 	void* heap[0];
-} bh_heap;
-#define BHP(h) ((bh_heap*)&mbharena[h])
+};
+#define BHP(a, h) ((bh_heap*)&(a)->arena[h])
 
 /*   
  * The current size of the heap.
  * Input:
+ *   bh_arena* a: the arena holding the heap.
  *   bhp h: the pointer to the heap.
  * Returns:
  *   bhsize_t size, the number of items currently stored in the heap.
  */
 #ifdef ALL_C
-inline bhsize_t mbh_size(bhp h);
+inline bhsize_t mbh_size(bh_arena* a, bhp h);
 #else /* ALL_C */
-extern inline bhsize_t mbh_size(bhp h) {
-	return BHP(h)->size;
+extern inline bhsize_t mbh_size(bh_arena* a, bhp h) {
+	return BHP(a, h)->size;
 }
 #endif /* ALL_C */
+
+#define MBH_ARITY 4
+
+/* Not intended for use by callers; exposed for MBH_SPECIALISE() */
+extern void mbh_assert(bh_arena* a, bhp h, bhsize_t size);
+
+/*
+ * Define name##_insert(), name##_shift() and name##_replace(), equivalent
+ * to mbh_insert(), mbh_shift() and mbh_replace() but comparing values
+ * with 'cmp', a function or macro taking (bh_arena* a, bh_heap* hp,
+ * void* left, void* right) that is typically static inline, so that the
+ * comparisons in the sift loops need no call through hp->comparator.
+ * The heap's comparator must give the same ordering, since it may still
+ * be used by the generic routines.
+ */
+#define MBH_SPECIALISE(name, cmp) \
+static inline void name##_siftdown(bh_arena* a, bh_heap* hp, bhsize_t node, \
+		void* v) { \
+	bhsize_t size = hp->size; \
+	bhsize_t child, last, best; \
+	while (1) { \
+		child = node * MBH_ARITY + 1; \
+		if (child >= size) \
+			break; \
+		last = child + MBH_ARITY; \
+		if (last > size) \
+			last = size; \
+		best = child; \
+		for (++child; child < last; ++child) \
+			if (cmp(a, hp, hp->heap[child], hp->heap[best]) < 0) \
+				best = child; \
+		if (cmp(a, hp, v, hp->heap[best]) <= 0) \
+			break; \
+		hp->heap[node] = hp->heap[best]; \
+		node = best; \
+	} \
+	hp->heap[node] = v; \
+} \
+static void name##_insert(bh_arena* a, bhp h, void* v) { \
+	bhsize_t node = BHP(a, h)->size++; \
+	bhsize_t parent; \
+	bh_heap* hp; \
+	mbh_assert(a, h, node + 1); \
+	hp = BHP(a, h); \
+	while (node > 0) { \
+		parent = (node - 1) / MBH_ARITY; \
+		if (cmp(a, hp, hp->heap[parent], v) <= 0) \
+			break; \
+		hp->heap[node] = hp->heap[parent]; \
+		node = parent; \
+	} \
+	hp->heap[node] = v; \
+} \
+static void* name##_shift(bh_arena* a, bhp h) { \
+	bh_heap* hp = BHP(a, h); \
+	void* value = hp->heap[0]; \
+	bhsize_t node = --hp->size; \
+	if (node > 0) \
+		name##_siftdown(a, hp, 0, hp->heap[node]); \
+	mbh_assert(a, h, node); \
+	return value; \
+} \
+static void* name##_replace(bh_arena* a, bhp h, void* v) { \
+	bh_heap* hp = BHP(a, h); \
+	void* value = hp->heap[0]; \
+	name##_siftdown(a, hp, 0, v); \
+	return value; \
+}
+
 #endif /* ifdef SAFE_BUT_SLOW */
 
 #define P2I(x) (int)(intptr_t)(x)
@@ -255,7 +255,7 @@ int mpx_cmp_8(mpx_t xs1, mpx_t xs2) {
 	);
 }
 
-mpx_support xsupport[MPX_MAXLIMBS] = {
+mpx_support xsupport_asm[MPX_MAXLIMBS] = {
 	{ 1, &mpx_add_1, &mpx_cmp_1 },
 	{ 2, &mpx_add_2, &mpx_cmp_2 },
 	{ 3, &mpx_add_3, &mpx_cmp_3 },
@@ -266,12 +266,95 @@ mpx_support xsupport[MPX_MAXLIMBS] = {
 	{ 8, &mpx_add_8, &mpx_cmp_8 }
 };
 
+inline void mpx_add_fixed(mpx_t xd, mpx_t xs1, mpx_t xs2, int n) {
+	unsigned char carry = 0;
+	int i;
+	for (i = 0; i < n; ++i)
+		carry = _addcarry_u64(carry, xs1[i], xs2[i],
+				(unsigned long long*)&xd[i]);
+}
+
+inline int mpx_cmp_fixed(mpx_t xs1, mpx_t xs2, int n) {
+	int i;
+	for (i = n - 1; i > 0; --i)
+		if (xs1[i] != xs2[i])
+			break;
+	return (xs1[i] > xs2[i]) - (xs1[i] < xs2[i]);
+}
+
+inline void mpx_add_n(mpx_t xd, mpx_t xs1, mpx_t xs2, int n) {
+	switch (n) {
+	  case 1: mpx_add_fixed(xd, xs1, xs2, 1); break;
+	  case 2: mpx_add_fixed(xd, xs1, xs2, 2); break;
+	  case 3: mpx_add_fixed(xd, xs1, xs2, 3); break;
+	  case 4: mpx_add_fixed(xd, xs1, xs2, 4); break;
+	  case 5: mpx_add_fixed(xd, xs1, xs2, 5); break;
+	  case 6: mpx_add_fixed(xd, xs1, xs2, 6); break;
+	  case 7: mpx_add_fixed(xd, xs1, xs2, 7); break;
+	  default: mpx_add_fixed(xd, xs1, xs2, 8); break;
+	}
+}
+
+inline int mpx_cmp_n(mpx_t xs1, mpx_t xs2, int n) {
+	switch (n) {
+	  case 1: return mpx_cmp_fixed(xs1, xs2, 1);
+	  case 2: return mpx_cmp_fixed(xs1, xs2, 2);
+	  case 3: return mpx_cmp_fixed(xs1, xs2, 3);
+	  case 4: return mpx_cmp_fixed(xs1, xs2, 4);
+	  case 5: return mpx_cmp_fixed(xs1, xs2, 5);
+	  case 6: return mpx_cmp_fixed(xs1, xs2, 6);
+	  case 7: return mpx_cmp_fixed(xs1, xs2, 7);
+	  default: return mpx_cmp_fixed(xs1, xs2, 8);
+	}
+}
+
+/*
+ * Out of line versions of the inline routines, for comparison against the
+ * asm set through mpx_support_impl(). There is no runtime dispatch: the
+ * walker calls mpx_add_n() and mpx_cmp_n() inline, and mpx_support_n()
+ * (used only by setup code) always returns the asm set.
+ */
+#define MPX_C_KERNELS(size) \
+	void mpx_add_c_##size(mpx_t xd, mpx_t xs1, mpx_t xs2) { \
+		mpx_add_fixed(xd, xs1, xs2, size); \
+	} \
+	int mpx_cmp_c_##size(mpx_t xs1, mpx_t xs2) { \
+		return mpx_cmp_fixed(xs1, xs2, size); \
+	}
+MPX_C_KERNELS(1) MPX_C_KERNELS(2) MPX_C_KERNELS(3) MPX_C_KERNELS(4)
+MPX_C_KERNELS(5) MPX_C_KERNELS(6) MPX_C_KERNELS(7) MPX_C_KERNELS(8)
+
+mpx_support xsupport_c[MPX_MAXLIMBS] = {
+	{ 1, &mpx_add_c_1, &mpx_cmp_c_1 },
+	{ 2, &mpx_add_c_2, &mpx_cmp_c_2 },
+	{ 3, &mpx_add_c_3, &mpx_cmp_c_3 },
+	{ 4, &mpx_add_c_4, &mpx_cmp_c_4 },
+	{ 5, &mpx_add_c_5, &mpx_cmp_c_5 },
+	{ 6, &mpx_add_c_6, &mpx_cmp_c_6 },
+	{ 7, &mpx_add_c_7, &mpx_cmp_c_7 },
+	{ 8, &mpx_add_c_8, &mpx_cmp_c_8 }
+};
+
+/*
+ * The mpx routines of a given size from the named set ("asm" or "c"),
+ * or NULL if that set is unknown.
+ */
+mpx_support* mpx_support_impl(char* impl, int n) {
+	if (n <= 0 || n > MPX_MAXLIMBS)
+		return (mpx_support*)NULL;
+	if (strcmp(impl, "asm") == 0)
+		return &xsupport_asm[n - 1];
+	if (strcmp(impl, "c") == 0)
+		return &xsupport_c[n - 1];
+	return (mpx_support*)NULL;
+}
+
 mpx_support* mpx_support_n(int n) {
 	if (n <= 0 || n > MPX_MAXLIMBS) {
 		fprintf(stderr, "Error: no mpx support available for size %d\n", n);
 		exit(1);
 	}
-	return &xsupport[n - 1];
+	return &xsupport_asm[n - 1];
 }
 
 mpx_support* mpx_support_z(mpz_t z) {
@@ -2,6 +2,7 @@
 #define MYGMP_H
 
 #include <gmp.h>
+#include <x86intrin.h>
 
 #ifdef DEBUG_GMP_LEAK
 #include <stdio.h>
@@ -57,9 +58,66 @@ typedef struct mpx_s_support {
 
 extern mpx_support* mpx_support_n(int n);
 extern mpx_support* mpx_support_z(mpz_t z);
+extern mpx_support* mpx_support_impl(char* impl, int n);
 extern void mpx_set_ui(mpx_t x, int size, unsigned int ui);
 extern void mpx_set(mpx_t xd, int sized, mpx_t xs, int sizes);
 extern void mpx_set_z(mpx_t x, int size, mpz_t z);
 extern void mpz_set_x(mpz_t z, mpx_t x, int size);
 
+/*
+ * Inline fixed-size add and compare, for callers that can supply the size
+ * as a constant so that the loop is fully unrolled: directly, or through
+ * the switch in mpx_add_n()/mpx_cmp_n(). The add is a single carry
+ * chain; the compare scans down to the first differing limb, then
+ * derives the sign without a branch.
+ */
+#ifdef ALL_C
+inline void mpx_add_fixed(mpx_t xd, mpx_t xs1, mpx_t xs2, int n);
+inline int mpx_cmp_fixed(mpx_t xs1, mpx_t xs2, int n);
+inline void mpx_add_n(mpx_t xd, mpx_t xs1, mpx_t xs2, int n);
+inline int mpx_cmp_n(mpx_t xs1, mpx_t xs2, int n);
+#else /* ALL_C */
+extern inline void mpx_add_fixed(mpx_t xd, mpx_t xs1, mpx_t xs2, int n) {
+	unsigned char carry = 0;
+	int i;
+	for (i = 0; i < n; ++i)
+		carry = _addcarry_u64(carry, xs1[i], xs2[i],
+				(unsigned long long*)&xd[i]);
+}
+
+extern inline int mpx_cmp_fixed(mpx_t xs1, mpx_t xs2, int n) {
+	int i;
+	for (i = n - 1; i > 0; --i)
+		if (xs1[i] != xs2[i])
+			break;
+	return (xs1[i] > xs2[i]) - (xs1[i] < xs2[i]);
+}
+
+extern inline void mpx_add_n(mpx_t xd, mpx_t xs1, mpx_t xs2, int n) {
+	switch (n) {
+	  case 1: mpx_add_fixed(xd, xs1, xs2, 1); break;
+	  case 2: mpx_add_fixed(xd, xs1, xs2, 2); break;
+	  case 3: mpx_add_fixed(xd, xs1, xs2, 3); break;
+	  case 4: mpx_add_fixed(xd, xs1, xs2, 4); break;
+	  case 5: mpx_add_fixed(xd, xs1, xs2, 5); break;
+	  case 6: mpx_add_fixed(xd, xs1, xs2, 6); break;
+	  case 7: mpx_add_fixed(xd, xs1, xs2, 7); break;
+	  default: mpx_add_fixed(xd, xs1, xs2, 8); break;
+	}
+}
+
+extern inline int mpx_cmp_n(mpx_t xs1, mpx_t xs2, int n) {
+	switch (n) {
+	  case 1: return mpx_cmp_fixed(xs1, xs2, 1);
+	  case 2: return mpx_cmp_fixed(xs1, xs2, 2);
+	  case 3: return mpx_cmp_fixed(xs1, xs2, 3);
+	  case 4: return mpx_cmp_fixed(xs1, xs2, 4);
+	  case 5: return mpx_cmp_fixed(xs1, xs2, 5);
+	  case 6: return mpx_cmp_fixed(xs1, xs2, 6);
+	  case 7: return mpx_cmp_fixed(xs1, xs2, 7);
+	  default: return mpx_cmp_fixed(xs1, xs2, 8);
+	}
+}
+#endif /* ALL_C */
+
 #endif /* MYGMP_H */
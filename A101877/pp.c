@@ -1,5 +1,9 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
 #include "pp.h"
 #include "prime.h"
 #include "inverse.h"
@@ -26,14 +30,8 @@ static inline int Dprintf(char* format, ...) {
 /* We rely on calculating ab (mod p) by simple multiplication */
 #define MAX_P 65536
 
-pp_pp* pppp = (pp_pp*)NULL;
-pp_pp** pplist;
-int pplistsize;
-int pplistmax;
-int k0;
-mpz_t z_no_previous;
-
 volatile char diag_signal_seen;
+volatile char ckpt_signal_seen;
 
 /* I can never remember the name of this GMP function */
 static inline unsigned int mod_ui(mpz_t z, unsigned int u) {
@@ -68,54 +66,60 @@ inline pp_value* pp_value_i(pp_pp* pp, int index) {
 	return ppv_value_n_i(pp->value, pp->valnumsize, index);
 }
 
-void setup_pp(int k) {
+void setup_pp(pp_engine* e, int k) {
 	int i, d, q;
 
-	k0 = k;
-	setup_inverse();
-	setup_walker();
-	pppp = calloc(k + 1, sizeof(pp_pp));
-	pplist = (pp_pp**)NULL;
-	pplistsize = 0;
-	pplistmax = 0;
-	ZINIT(&z_no_previous, "z_no_previous");
-	mpz_set_si(z_no_previous, -1);
+	e->k0 = k;
+	e->ckpt = (char*)NULL;
+	e->stats_on = 0;
+	e->stats_csv = (char*)NULL;
+	e->stats = (pp_level_stats*)NULL;
+	setup_walker(&e->walk);
+	e->pppp = calloc(k + 1, sizeof(pp_pp));
+	e->pplist = (pp_pp**)NULL;
+	e->pplistsize = 0;
+	e->pplistmax = 0;
+	ZINIT(&e->z_no_previous, "z_no_previous");
+	mpz_set_si(e->z_no_previous, -1);
+	setup_prime(k);
 	
 	for (i = 1; i <= k; ++i) {
 		int prime, power;
 		power = greatest_prime_power(i, &prime);
-		pp_save_r(i, prime, power);
+		pp_save_r(e, i, prime, power);
 	}
 }
 
-void pp_free(pp_pp* pp) {
+void pp_free(pp_engine* e, pp_pp* pp) {
 	int i;
 	free(pp->value);
+	free(pp->resmin);
+	free(pp->resok);
 	QCLEAR(&pp->spare, "pp_%d.spare", pp->pp);
 	ZCLEAR(&pp->min_discard, "pp_%d.min_discard", pp->pp);
 	ZCLEAR(&pp->denominator, "pp_%d.denominator", pp->pp);
 	ZCLEAR(&pp->total, "pp_%d.total", pp->pp);
 	if (pp->wrh)
-		wr_clone_free(pp->wh, pp->wrh);
+		wr_clone_free(&e->walk, pp->wh, pp->wrh);
 	if (pp->wh)
-		delete_walker(pp->wh);
+		delete_walker(&e->walk, pp->wh);
 }
 
-void teardown_pp(void) {
+void teardown_pp(pp_engine* e) {
 	int i;
 	pp_pp* pp;
 
-	ZCLEAR(&z_no_previous, "z_no_previous");
+	ZCLEAR(&e->z_no_previous, "z_no_previous");
 	/* pp->wrh is not a clone (needing free()) iff pp is in pplist */
-	for (i = 0; i < pplistsize; ++i)
-		pplist[i]->wrh = (wrhp)0;
-	for (i = 0; i <= k0; ++i)
-		if (pppp[i].pp)
-			pp_free(&pppp[i]);
-	free(pplist);
-	free(pppp);
-	teardown_walker();
-	teardown_inverse();
+	for (i = 0; i < e->pplistsize; ++i)
+		e->pplist[i]->wrh = (wrhp)0;
+	for (i = 0; i <= e->k0; ++i)
+		if (e->pppp[i].pp)
+			pp_free(e, &e->pppp[i]);
+	free(e->pplist);
+	free(e->pppp);
+	free(e->stats);
+	teardown_walker(&e->walk);
 }
 
 /*
@@ -123,8 +127,12 @@ void teardown_pp(void) {
  * Dependent pp sort in descending order; independent pp sort in ascending
  * order; dependent pp sort after only those independent pp on which they
  * depend.
+ * Since qsort() passes no context, k0 for the list being sorted is
+ * supplied per thread in listcmp_k0.
  */
+static __thread int listcmp_k0;
 int pp_listcmp(const void* a, const void* b) {
+	int k0 = listcmp_k0;
 	pp_pp* left = *(pp_pp**)a;
 	pp_pp* right = *(pp_pp**)b;
 
@@ -158,7 +166,6 @@ void pp_grow(pp_pp* pp, int size) {
 void pp_grownum(pp_pp* pp, int newsize) {
 	int i;
 	pp_value *newpv, *newi, *oldi;
-	mpx_support* xsup = mpx_support_n(newsize);
 
 	newpv = malloc(pp->valmax * pp_valsize_n(newsize));
 	for (i = 0; i < pp->valsize; ++i) {
@@ -172,8 +179,6 @@ void pp_grownum(pp_pp* pp, int newsize) {
 	free(pp->value);
 	pp->valnumsize = newsize;
 	pp->value = newpv;
-	pp->adder = xsup->adder;
-	pp->cmper = xsup->cmper;
 }
 
 /*
@@ -186,18 +191,19 @@ void pp_grownum(pp_pp* pp, int newsize) {
  *   The list is kept in descending order of pp, and sorted later using
  *   pp_listcmp().
  */
-void pp_pushlist(pp_pp* pp) {
-	if (pplistsize + 1 >= pplistmax) {
-		int old = pplistmax;
-		pplistmax = pplistmax * 3 / 2;
-		if (pplistmax < MINPPSET)
-			pplistmax = MINPPSET;
-		pplist = realloc(pplist, pplistmax * sizeof(pplist[0]));
+void pp_pushlist(pp_engine* e, pp_pp* pp) {
+	if (e->pplistsize + 1 >= e->pplistmax) {
+		int old = e->pplistmax;
+		e->pplistmax = e->pplistmax * 3 / 2;
+		if (e->pplistmax < MINPPSET)
+			e->pplistmax = MINPPSET;
+		e->pplist = realloc(e->pplist, e->pplistmax * sizeof(e->pplist[0]));
 	}
-	if (pplistsize)
-		memmove(&pplist[1], &pplist[0], pplistsize * sizeof(pplist[0]));
-	++pplistsize;
-	pplist[0] = pp;
+	if (e->pplistsize)
+		memmove(&e->pplist[1], &e->pplist[0],
+				e->pplistsize * sizeof(e->pplist[0]));
+	++e->pplistsize;
+	e->pplist[0] = pp;
 }
 
 /*
@@ -209,11 +215,11 @@ void pp_pushlist(pp_pp* pp) {
  * Notes:
  *   The order of the remaining list items is preserved.
  */
-void pp_listsplice(int i) {
-	pp_pp* pp = pplist[i];
-	if (i < --pplistsize)
-		memmove(&pplist[i], &pplist[i + 1],
-				(pplistsize - i) * sizeof(pplist[0]));
+void pp_listsplice(pp_engine* e, int i) {
+	pp_pp* pp = e->pplist[i];
+	if (i < --e->pplistsize)
+		memmove(&e->pplist[i], &e->pplist[i + 1],
+				(e->pplistsize - i) * sizeof(e->pplist[0]));
 	/* Cannot free pp, the values may still be referenced */
 }
 
@@ -312,7 +318,7 @@ void pp_save_any(pp_pp* pp, mpq_t value, int parent, int self) {
 	ZCLEAR(&zvalue, "pp_save_any zvalue");
 }
 
-void new_pp(pp_pp* pp, int prime, int power) {
+void new_pp(pp_engine* e, pp_pp* pp, int prime, int power) {
 	int i, set;
 	mpz_t reduced_denom;
 	mpx_support* xsup;
@@ -325,7 +331,7 @@ void new_pp(pp_pp* pp, int prime, int power) {
 	pp->pp = power;
 	if (pp->p == pp->pp)
 		inverse_table(pp->p);
-	pp_pushlist(pp);
+	pp_pushlist(e, pp);
 	ZINIT(&pp->total, "pp_%d.total", pp->pp);
 	ZINIT(&pp->denominator, "pp_%d.denominator", pp->pp);
 	ZINIT(&pp->min_discard, "pp_%d.min_discard", pp->pp);
@@ -337,10 +343,10 @@ void new_pp(pp_pp* pp, int prime, int power) {
 	ZINIT(&reduced_denom, "new_pp reduced_denom");
 	set = 0;
 	/* start from pplist[1], because we've already been inserted at [0] */
-	for (i = 1; i < pplistsize; ++i) {
-		if (pplist[i]->pp * power <= k0) {
-			mpz_mul_ui(pp->denominator, pplist[i]->denominator,
-					power / mpz_gcd_ui(NULL, pplist[i]->denominator, power));
+	for (i = 1; i < e->pplistsize; ++i) {
+		if (e->pplist[i]->pp * power <= e->k0) {
+			mpz_mul_ui(pp->denominator, e->pplist[i]->denominator,
+					power / mpz_gcd_ui(NULL, e->pplist[i]->denominator, power));
 			set = 1;
 			break;
 		}
@@ -359,25 +365,23 @@ void new_pp(pp_pp* pp, int prime, int power) {
 
 	xsup = mpx_support_z(pp->denominator);
 	pp->valnumsize = xsup->size;
-	pp->adder = xsup->adder;
-	pp->cmper = xsup->cmper;
 	pp_grow(pp, MINPPSET);
 }
 
-void pp_save_r(int n, int prime, int power) {
-	pp_pp* pp = &pppp[power];
+void pp_save_r(pp_engine* e, int n, int prime, int power) {
+	pp_pp* pp = &e->pppp[power];
 	pp_value* v;
 	int i, raise;
 	mpq_t q;
 	if (!pp->p)
-		new_pp(pp, prime, power);
+		new_pp(e, pp, prime, power);
 	QINIT(&q, "pp_save_r temp");
 	mpq_set_ui(q, 1, n);
 	pp_save_any(pp, q, n, 1);
 	QCLEAR(&q, "pp_save_r temp");
 }
 
-void pp_save_w(whp wh, wrhp wrh, pp_pp* from) {
+void pp_save_w(pp_engine* e, whp wh, wrhp wrh, pp_pp* from) {
 	mpq_t actual;
 	mpz_t discard;
 	int pp_effective = from->pp;
@@ -389,15 +393,15 @@ void pp_save_w(whp wh, wrhp wrh, pp_pp* from) {
 
 	ZINIT(&discard, "pp_save_w discard");
 	QINIT(&actual, "pp_save_w temp");
-	mpz_set_x(discard, wr_discard(wh, wrh), from->valnumsize);
-	Dprintf("save wr: %Zd / %Zd [%d] from %d (%d)\n",
-			discard, from->denominator, wr_vec(wh, wrh)[0], from->pp, from->p);
+	mpz_set_x(discard, wr_discard(&e->walk, wh, wrh), from->valnumsize);
+	Dprintf("save wr: %Zd / %Zd [%d] from %d (%d)\n", discard,
+			from->denominator, wr_vec(&e->walk, wh, wrh)[0], from->pp, from->p);
 	mpz_sub(mpq_numref(actual), from->total, discard);
 	mpz_set(mpq_denref(actual), from->denominator);
 	mpq_canonicalize(actual);
 
 	to = z_greatest_prime_power(mpq_denref(actual), (int*)NULL);
-	pp_save_any(&pppp[to], actual, from->pp, 0);
+	pp_save_any(&e->pppp[to], actual, from->pp, 0);
 	QCLEAR(&actual, "pp_save_w temp");
 	ZCLEAR(&discard, "pp_save_w discard");
 }
@@ -415,7 +419,8 @@ void pp_save_w(whp wh, wrhp wrh, pp_pp* from) {
  * - for remaining PP structures, mark whether they are dependent on any
  *   higher pp in the pp list
  */
-void pp_resolve_simple(void) {
+void pp_resolve_simple(pp_engine* e) {
+	walk_arena* wa = &e->walk;
 	int i, dest;
 	pp_pp *pp;
 	whp wh;
@@ -423,38 +428,39 @@ void pp_resolve_simple(void) {
 	mpz_t ztotal;
 
 	ZINIT(&ztotal, "pp_resolve_simple ztotal");
-	for (i = 0; i < pplistsize; ++i) {
-		pp = pplist[i];
-		if (i == 0 || pp->pp * pplist[i - 1]->pp > k0) {
+	for (i = 0; i < e->pplistsize; ++i) {
+		pp = e->pplist[i];
+		if (i == 0 || pp->pp * e->pplist[i - 1]->pp > e->k0) {
 			/* we are only interested in subsets that keep at least one
 			 * element, so we set the discard limit to (total - 1)
 			 */
 			mpz_sub_ui(ztotal, pp->total, 1);
-			wh = new_walker(pp, ztotal, pp->invtotal);
-			wrh1 = walker_findnext(wh);
+			wh = new_walker(wa, pp, ztotal, pp->invtotal);
+			wrh1 = walker_findnext(wa, wh);
 			if (!wrh1) {
-				delete_walker(wh);
-				pp_listsplice(i);
+				delete_walker(wa, wh);
+				pp_listsplice(e, i);
 				--i;
 				continue;
 			}
-			wrh1 = wr_clone(wh, wrh1);
-			wrh2 = walker_findnext(wh);
+			wrh1 = wr_clone(wa, wh, wrh1);
+			wrh2 = walker_findnext(wa, wh);
 			if (!wrh2) {
 				pp->wh = wh;
 				pp->wrh = wrh1;
-				pp_save_w(wh, wrh1, pp);
-				pp_listsplice(i);
+				pp_save_w(e, wh, wrh1, pp);
+				pp_listsplice(e, i);
 				--i;
 				continue;
 			}
-			mpz_set_x(pp->min_discard, wr_discard(wh, wrh1), pp->valnumsize);
-			wr_clone_free(wh, wrh1);
-			delete_walker(wh);
+			mpz_set_x(pp->min_discard, wr_discard(wa, wh, wrh1),
+					pp->valnumsize);
+			wr_clone_free(wa, wh, wrh1);
+			delete_walker(wa, wh);
 		}
-		for (dest = pplistsize - 1; dest > i; --dest) {
-			if (pp->pp * pplist[dest]->pp <= k0)
-				pplist[dest]->depend = 1;
+		for (dest = e->pplistsize - 1; dest > i; --dest) {
+			if (pp->pp * e->pplist[dest]->pp <= e->k0)
+				e->pplist[dest]->depend = 1;
 			else
 				break;
 		}
@@ -462,18 +468,21 @@ void pp_resolve_simple(void) {
 	ZCLEAR(&ztotal, "pp_resolve_simple ztotal");
 }
 
-void pp_init_spare(int target) {
+void pp_init_spare(pp_engine* e, int target) {
 	int i;
 	pp_pp *pp, *top;
 	mpq_t spare;
 
+	/* everything resolved: pp_find() will report no solution */
+	if (e->pplistsize == 0)
+		return;
 	QINIT(&spare, "pp_study spare");
-	top = pplist[0];
+	top = e->pplist[0];
 	mpq_set_si(top->spare, -target, 1);
-	for (i = 0; i < pplistsize; ++i) {
+	for (i = 0; i < e->pplistsize; ++i) {
 		int g;
 
-		pp = pplist[i];
+		pp = e->pplist[i];
 		mpz_sub(mpq_numref(spare), pp->total, pp->min_discard);
 		mpz_set(mpq_denref(spare), pp->denominator);
 		mpq_canonicalize(spare);
@@ -483,7 +492,83 @@ void pp_init_spare(int target) {
 	Dprintf("study: spare = %Qd\n", top->spare);
 }
 
-void pp_study(int target) {
+/*
+ * Find the residues (mod p) reachable as the invsum of some discard from
+ * the values of a PP structure, and the least discard reaching each.
+ * Input:
+ *   pp_pp* pp: the PP structure, whose values must no longer change
+ * Returns:
+ *   Nothing; fills in pp->resok[] and pp->resmin[].
+ * Notes:
+ *   This is a subset-sum over the values mod p, O(valsize * p). It
+ * lets pp_find() skip a walker whose target invsum cannot be reached
+ * within its limit, and lower the limit of one that can: a discard with
+ * invsum r keeps values with invsum (invtotal - r), so can be no greater
+ * than total less the least discard reaching that.
+ */
+void pp_residues(pp_pp* pp) {
+	int n = pp->valnumsize, p = pp->p;
+	mp_limb_t* prevmin = malloc(p * n * sizeof(mp_limb_t));
+	char* prevok = malloc(p);
+	mp_limb_t sum[MPX_MAXLIMBS];
+	pp_value* v;
+	int i, r, s;
+
+	pp->resmin = malloc(p * n * sizeof(mp_limb_t));
+	pp->resok = calloc(p, 1);
+	mpx_set_ui(&pp->resmin[0], n, 0);
+	pp->resok[0] = 1;
+	for (i = 0; i < pp->valsize; ++i) {
+		v = pp_value_i(pp, i);
+		memcpy(prevmin, pp->resmin, p * n * sizeof(mp_limb_t));
+		memcpy(prevok, pp->resok, p);
+		for (r = 0; r < p; ++r) {
+			if (!prevok[r])
+				continue;
+			s = (r + v->inv) % p;
+			mpx_add_n(sum, &prevmin[r * n], ppv_mpx(v), n);
+			if (!pp->resok[s] || mpx_cmp_n(sum, &pp->resmin[s * n], n) < 0) {
+				mpx_set(&pp->resmin[s * n], n, sum, n);
+				pp->resok[s] = 1;
+			}
+		}
+	}
+	free(prevok);
+	free(prevmin);
+}
+
+/*
+ * Given the target invsum and limit for a walker at the level of pp,
+ * return FALSE if no discard within the limit can reach the target, else
+ * lower the limit if possible to the greatest discard that can reach it
+ * and return TRUE.
+ * Notes:
+ *   Independent PP always have invsum = invtotal, reached at min_discard
+ * within any limit, so gain nothing. The residues of a dependent PP are
+ * found when first needed, since many levels are never reached.
+ */
+int pp_residue_limit(pp_pp* pp, int invsum, mpz_t limit, mpz_t z) {
+	int n = pp->valnumsize;
+
+	if (!pp->depend || invsum < 0)
+		return 1;
+	if (!pp->resok)
+		pp_residues(pp);
+	if (!pp->resok[invsum])
+		return 0;
+	mpz_set_x(z, &pp->resmin[invsum * n], n);
+	if (mpz_cmp(z, limit) > 0)
+		return 0;
+	/* resok[invsum] implies resok[] of the complement */
+	invsum = (pp->invtotal - invsum + pp->p) % pp->p;
+	mpz_set_x(z, &pp->resmin[invsum * n], n);
+	mpz_sub(z, pp->total, z);
+	if (mpz_cmp(z, limit) < 0)
+		mpz_set(limit, z);
+	return 1;
+}
+
+void pp_study(pp_engine* e, int target) {
 	int i;
 	pp_pp *pp, *top;
 	mpq_t spare;
@@ -492,16 +577,17 @@ void pp_study(int target) {
 	 * resolve independent PP that provide only one line
 	 * mark dependent PP as dependent
 	 */
-	pp_resolve_simple();
+	pp_resolve_simple(e);
 
 	/* now sort pplist so as to satisfy dependencies as early as possible,
 	 * and handle dependent PP as soon as dependencies are satisfied
 	 */
-	qsort(pplist, pplistsize, sizeof(pplist[0]), &pp_listcmp);
+	listcmp_k0 = e->k0;
+	qsort(e->pplist, e->pplistsize, sizeof(e->pplist[0]), &pp_listcmp);
 
 	/* set initial spare ready for pp_find() recursion
 	 */
-	pp_init_spare(target);
+	pp_init_spare(e, target);
 }
 
 static inline void pp_setbit(int* vec, int bit) {
@@ -516,7 +602,7 @@ static inline int pp_testbit(int* vec, int bit) {
 	return (vec[byte] & offset) ? 1 : 0;
 }
 
-void pp_setvec(int* vec, pp_pp* pp, int* invec) {
+void pp_setvec(pp_engine* e, int* vec, pp_pp* pp, int* invec) {
 	int i;
 	pp_value* v;
 	pp_pp* dad;
@@ -529,18 +615,19 @@ void pp_setvec(int* vec, pp_pp* pp, int* invec) {
 			pp_setbit(vec, v->parent);
 		} else {
 			/* this entry comprises multiple values from the parent */
-			dad = &pppp[v->parent];
-			pp_setvec(vec, dad, wr_vec(dad->wh, dad->wrh));
+			dad = &e->pppp[v->parent];
+			pp_setvec(e, vec, dad, wr_vec(&e->walk, dad->wh, dad->wrh));
 		}
 	}
 }
 
-int pp_solution(int index) {
+int pp_solution(pp_engine* e, int index) {
 	pp_pp *pp, *cur;
 	int* v;
 	int i, r;
+	int k0 = e->k0;
 
-	cur = pplist[index];
+	cur = e->pplist[index];
 	if (mpz_cmp_ui(mpq_numref(cur->spare), 1) > 0)
 		return 0;
 	r = mpz_get_ui(mpq_numref(cur->spare));
@@ -551,12 +638,12 @@ int pp_solution(int index) {
 	/* probable solution: spare == 0 or spare == 1/r, 1 <= r <= k0 */
 	gmp_printf("probable solution, spare = %Qd\n", cur->spare);
 	v = calloc((k0 + 32) >> 5, sizeof(int));
-	for (i = 0; i < pplistsize; ++i) {
-		pp = pplist[i];
+	for (i = 0; i < e->pplistsize; ++i) {
+		pp = e->pplist[i];
 		if (pp->wrh) {
-			pp_setvec(v, pp, wr_vec(pp->wh, pp->wrh));
+			pp_setvec(e, v, pp, wr_vec(&e->walk, pp->wh, pp->wrh));
 		} else {
-			pp_setvec(v, pp, (int*)NULL);
+			pp_setvec(e, v, pp, (int*)NULL);
 		}
 	}
 
@@ -575,13 +662,147 @@ int pp_solution(int index) {
 	return 1;
 }
 
-void pp_diagnose(int level) {
+static double stats_clock(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Start keeping per-level counters for pp_find(), if e->stats_on.
+ */
+static void pp_stats_start(pp_engine* e, int level) {
+	if (!e->stats_on || e->pplistsize == 0)
+		return;
+	e->stats = calloc(e->pplistsize, sizeof(pp_level_stats));
+	e->stats_walk = e->walk.stats;
+	e->stats_time = stats_clock();
+	e->stats_level = level;
+}
+
+/*
+ * Charge the time and walker activity since the last tick to the level
+ * then current, and note the new current level (which may be -1 when the
+ * search is over).
+ */
+static void pp_stats_tick(pp_engine* e, int level) {
+	pp_level_stats* ls;
+	walk_stats* ws = &e->walk.stats;
+	double t = stats_clock();
+
+	if (e->stats_level >= 0) {
+		ls = &e->stats[e->stats_level];
+		ls->walk.findnext += ws->findnext - e->stats_walk.findnext;
+		ls->walk.pushes += ws->pushes - e->stats_walk.pushes;
+		ls->walk.pops += ws->pops - e->stats_walk.pops;
+		ls->walk.yielded += ws->yielded - e->stats_walk.yielded;
+		ls->walk.rejected += ws->rejected - e->stats_walk.rejected;
+		ls->secs += t - e->stats_time;
+	}
+	e->stats_walk = *ws;
+	e->stats_time = t;
+	e->stats_level = level;
+}
+
+/*
+ * Print the per-level counters as a table, omitting levels never reached.
+ */
+void pp_stats_report(pp_engine* e) {
+	pp_level_stats* ls;
+	double total = 0;
+	int j;
+
+	if (!e->stats)
+		return;
+	for (j = 0; j < e->pplistsize; ++j)
+		total += e->stats[j].secs;
+	printf("%5s %6s %10s %10s %12s %12s %12s %12s %12s %9s %5s\n",
+			"level", "pp", "walkers", "pruned", "findnext", "pushes", "pops",
+			"yielded", "rejected", "secs", "%time");
+	for (j = 0; j < e->pplistsize; ++j) {
+		ls = &e->stats[j];
+		if (ls->walkers == 0 && ls->pruned == 0 && ls->walk.findnext == 0)
+			continue;
+		printf("%5d %6d %10ld %10ld %12ld %12ld %12ld %12ld %12ld %9.3f %5.1f\n",
+				j, e->pplist[j]->pp, ls->walkers, ls->pruned, ls->walk.findnext,
+				ls->walk.pushes, ls->walk.pops, ls->walk.yielded,
+				ls->walk.rejected, ls->secs,
+				total > 0 ? 100 * ls->secs / total : 0.0);
+	}
+	fflush(stdout);
+}
+
+/*
+ * Write the CSV header line to the named file if it is empty or new.
+ * Called once before any search starts, so that forked workers sharing
+ * the file need only append. Returns TRUE on success.
+ */
+int pp_stats_csv_header(char* path) {
+	FILE* f = fopen(path, "a");
+	int ok;
+
+	if (!f) {
+		fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+		return 0;
+	}
+	if (ftell(f) == 0)
+		fprintf(f, "n,k,level,pp,walkers,pruned,findnext,pushes,pops,yielded,"
+				"rejected,secs\n");
+	ok = (fclose(f) == 0);
+	if (!ok)
+		fprintf(stderr, "Cannot write %s: %s\n", path, strerror(errno));
+	return ok;
+}
+
+/*
+ * Append the per-level counters to e->stats_csv, whose header has been
+ * written by pp_stats_csv_header(). The rows are collected first and
+ * appended with a single write(), so that rows from several workers
+ * appending at once do not interleave. Returns TRUE on success.
+ */
+int pp_stats_csv(pp_engine* e, int target) {
+	pp_level_stats* ls;
+	FILE* m;
+	char* buf = (char*)NULL;
+	size_t size = 0;
+	int j, fd, ok;
+
+	if (!e->stats || !e->stats_csv)
+		return 1;
+	m = open_memstream(&buf, &size);
+	if (!m) {
+		fprintf(stderr, "Cannot buffer CSV rows: %s\n", strerror(errno));
+		return 0;
+	}
+	for (j = 0; j < e->pplistsize; ++j) {
+		ls = &e->stats[j];
+		fprintf(m, "%d,%d,%d,%d,%ld,%ld,%ld,%ld,%ld,%ld,%ld,%.6f\n",
+				target, e->k0, j, e->pplist[j]->pp, ls->walkers, ls->pruned,
+				ls->walk.findnext, ls->walk.pushes, ls->walk.pops,
+				ls->walk.yielded, ls->walk.rejected, ls->secs);
+	}
+	fclose(m);
+	fd = open(e->stats_csv, O_WRONLY | O_APPEND | O_CREAT, 0666);
+	if (fd < 0) {
+		fprintf(stderr, "Cannot open %s: %s\n", e->stats_csv, strerror(errno));
+		free(buf);
+		return 0;
+	}
+	ok = (write(fd, buf, size) == (ssize_t)size);
+	ok = (close(fd) == 0) && ok;
+	if (!ok)
+		fprintf(stderr, "Cannot write %s: %s\n", e->stats_csv, strerror(errno));
+	free(buf);
+	return ok;
+}
+
+void pp_diagnose(pp_engine* e, int level) {
 	int j;
 	int start = -1, end;
 	pp_pp* pp;
 
 	for (j = 0; j <= level; ++j) {
-		pp = pplist[j];
+		pp = e->pplist[j];
 		if (pp->wrnum != 1 || pp->wrcount != 0) {
 			start = j;
 			break;
@@ -591,15 +812,173 @@ void pp_diagnose(int level) {
 	if (end > level)
 		end = level;
 	printf("t=%.2f level %d..%d at %d of %d: ",
-			timing(), start, end, level, pplistsize);
+			timing(), start, end, level, e->pplistsize);
 	for (j = start; j <= end; ++j) {
-		pp = pplist[j];
+		pp = e->pplist[j];
 		printf("%d:%d/%d ", pp->pp, pp->wrnum, pp->wrcount);
 	}
 	printf("\n");
+	printf("walk arena: live %d, free %d, peak %d bytes; %d compactions\n",
+			e->walk.size - e->walk.freebytes, e->walk.freebytes,
+			e->walk.peak, e->walk.compactions);
+	if (e->stats) {
+		pp_stats_tick(e, level);
+		pp_stats_report(e);
+	}
+}
+
+/*
+ * Checkpoint file layout: header, the pp of each pplist entry (to check
+ * that the study matches), wh and wrh for each pppp[q], the state of each
+ * level up to the current one, then the walk arena.
+ */
+#define CKPT_MAGIC "A101877 ckpt 1"
+typedef struct pp_s_ckpt_header {
+	char magic[16];
+	int target;
+	int k0;
+	int pplistsize;
+	int level;
+} pp_ckpt_header;
+
+static int ckpt_put(FILE* f, void* p, size_t size) {
+	return fwrite(p, size, 1, f) == 1;
 }
 
-int pp_find(int target) {
+static int ckpt_get(FILE* f, void* p, size_t size) {
+	return fread(p, size, 1, f) == 1;
+}
+
+/*
+ * Save the state of pp_find() at the top of its loop.
+ * Input:
+ *   pp_engine* e: the engine, with e->ckpt the file to write
+ *   int target: the target passed to pp_find()
+ *   int level: the current level in pplist
+ * Returns:
+ *   TRUE on success; failure is reported, but the search may continue.
+ * Notes:
+ *   The file is written under a temporary name and renamed into place,
+ * so an interrupted write leaves any previous checkpoint intact.
+ */
+int pp_checkpoint(pp_engine* e, int target, int level) {
+	pp_ckpt_header h;
+	char* tmp = malloc(strlen(e->ckpt) + 8);
+	FILE* f;
+	pp_pp* pp;
+	int j, ok;
+
+	sprintf(tmp, "%s.tmp", e->ckpt);
+	f = fopen(tmp, "wb");
+	ok = (f != (FILE*)NULL);
+	memset(&h, 0, sizeof(h));
+	strcpy(h.magic, CKPT_MAGIC);
+	h.target = target;
+	h.k0 = e->k0;
+	h.pplistsize = e->pplistsize;
+	h.level = level;
+	ok = ok && ckpt_put(f, &h, sizeof(h));
+	for (j = 0; ok && j < e->pplistsize; ++j)
+		ok = ckpt_put(f, &e->pplist[j]->pp, sizeof(int));
+	for (j = 0; ok && j <= e->k0; ++j) {
+		pp = &e->pppp[j];
+		ok = ckpt_put(f, &pp->wh, sizeof(whp))
+				&& ckpt_put(f, &pp->wrh, sizeof(wrhp));
+	}
+	for (j = 0; ok && j <= level; ++j) {
+		pp = e->pplist[j];
+		ok = ckpt_put(f, &pp->wrnum, sizeof(int))
+				&& ckpt_put(f, &pp->wrcount, sizeof(int))
+				&& mpz_out_raw(f, mpq_numref(pp->spare)) != 0
+				&& mpz_out_raw(f, mpq_denref(pp->spare)) != 0;
+	}
+	ok = ok && walker_save(&e->walk, f);
+	if (f && fclose(f) != 0)
+		ok = 0;
+	if (ok && rename(tmp, e->ckpt) != 0)
+		ok = 0;
+	if (ok) {
+		printf("t=%.2f checkpoint at level %d written to %s\n",
+				timing(), level, e->ckpt);
+	} else {
+		fprintf(stderr, "Cannot write checkpoint %s: %s\n",
+				e->ckpt, strerror(errno));
+		unlink(tmp);
+	}
+	fflush(stdout);
+	free(tmp);
+	return ok;
+}
+
+/*
+ * Restore the state of pp_find() from e->ckpt, if it exists.
+ * Input:
+ *   pp_engine* e: the engine, after pp_study(e, target)
+ *   int target: the target passed to pp_find()
+ *   int* level: set to the level to resume at
+ * Returns:
+ *   TRUE if the search should resume from the restored state, FALSE if
+ * there is no checkpoint (or it is for a different search) and the search
+ * should start afresh. A damaged checkpoint is fatal.
+ * Notes:
+ *   pp_study() is deterministic for a given k, so the values and the
+ * resolved PP structures match those at the time of the checkpoint; only
+ * the walkers and the state of each level need to be restored.
+ */
+int pp_restore(pp_engine* e, int target, int* level) {
+	pp_ckpt_header h;
+	FILE* f = fopen(e->ckpt, "rb");
+	pp_pp* pp;
+	int j, v, ok;
+
+	if (!f)
+		return 0;
+	ok = ckpt_get(f, &h, sizeof(h))
+			&& strncmp(h.magic, CKPT_MAGIC, sizeof(h.magic)) == 0
+			&& h.target == target && h.k0 == e->k0
+			&& h.pplistsize == e->pplistsize
+			&& h.level >= 0 && h.level < e->pplistsize;
+	for (j = 0; ok && j < e->pplistsize; ++j)
+		ok = ckpt_get(f, &v, sizeof(int)) && v == e->pplist[j]->pp;
+	if (!ok) {
+		fprintf(stderr, "Checkpoint %s is not for n=%d k=%d, ignoring it\n",
+				e->ckpt, target, e->k0);
+		fclose(f);
+		return 0;
+	}
+	for (j = 0; ok && j <= e->k0; ++j) {
+		pp = &e->pppp[j];
+		ok = ckpt_get(f, &pp->wh, sizeof(whp))
+				&& ckpt_get(f, &pp->wrh, sizeof(wrhp));
+	}
+	for (j = 0; ok && j <= h.level; ++j) {
+		pp = e->pplist[j];
+		ok = ckpt_get(f, &pp->wrnum, sizeof(int))
+				&& ckpt_get(f, &pp->wrcount, sizeof(int))
+				&& mpz_inp_raw(mpq_numref(pp->spare), f) != 0
+				&& mpz_inp_raw(mpq_denref(pp->spare), f) != 0;
+	}
+	ok = ok && walker_restore(&e->walk, f);
+	fclose(f);
+	if (!ok) {
+		fprintf(stderr, "Checkpoint %s is damaged\n", e->ckpt);
+		exit(1);
+	}
+	/* deeper levels are not yet started */
+	for (j = h.level + 1; j < e->pplistsize; ++j)
+		e->pplist[j]->wh = (whp)0;
+	for (j = 0; j <= e->k0; ++j) {
+		pp = &e->pppp[j];
+		if (pp->pp && pp->wh)
+			walker_rebind(&e->walk, pp->wh, pp);
+	}
+	*level = h.level;
+	return 1;
+}
+
+int pp_find(pp_engine* e, int target) {
+	walk_arena* wa = &e->walk;
+	pp_pp** pplist;
 	pp_pp *pp, *nextpp;
 	int i, g, invsum;
 	int success = 0;
@@ -607,25 +986,38 @@ int pp_find(int target) {
 	mpz_t z, zr;
 	mpq_t q, limit;
 
-	pp_study(target);
+	pp_study(e, target);
 
+	pplist = e->pplist;
 	i = 0;
-	pplist[i]->wh = (whp)0;
-	if (mpq_sgn(pplist[i]->spare) < 0) {
+	/* the spare is -target when no PP remain, so that is handled here too */
+	if (e->pplistsize == 0 || mpq_sgn(pplist[i]->spare) < 0) {
 		printf("n=%d, k=%d: optimizer finds no solution is possible. [%.2fs]\n",
-				target, k0, timing());
+				target, e->k0, timing());
 		return 0;
 	}
+	pplist[i]->wh = (whp)0;
+	if (e->ckpt && pp_restore(e, target, &i))
+		printf("n=%d k=%d: resumed at level %d from %s\n",
+				target, e->k0, i, e->ckpt);
 	ZINIT(&z, "pp_find z");
 	ZINIT(&zr, "pp_find zr");
 	QINIT(&q, "pp_find q");
 	QINIT(&limit, "pp_find limit");
+	pp_stats_start(e, i);
 	while (i >= 0) {
+		if (e->stats)
+			pp_stats_tick(e, i);
+		if (ckpt_signal_seen) {
+			ckpt_signal_seen = 0;
+			if (e->ckpt)
+				pp_checkpoint(e, target, i);
+		}
 		pp = pplist[i];
 		if (!pp->wh) {
 			if (diag_signal_seen) {
 				diag_signal_seen = 0;
-				pp_diagnose(i);
+				pp_diagnose(e, i);
 			}
 
 			mpq_set(limit, pp->spare);
@@ -658,16 +1050,30 @@ int pp_find(int target) {
 			} else {
 				invsum = pp->invtotal;
 			}
+			if (!pp_residue_limit(pp, invsum, mpq_numref(limit), z)) {
+				/* as if the walker had found nothing */
+				Dprintf("invsum %d unreachable for %d\n", invsum, pp->pp);
+				if (e->stats)
+					++e->stats[i].pruned;
+				pp->wrnum = 0;
+				pp->wrcount = 0;
+				--i;
+				continue;
+			}
 			Dprintf("effective limit is %Zd, invsum = %d\n",
 					mpq_numref(limit), invsum);
 
-			pp->wh = new_walker(pp, mpq_numref(limit), invsum);
+			pp->wh = new_walker(wa, pp, mpq_numref(limit), invsum);
 			pp->wrnum = 0;
+			if (e->stats)
+				++e->stats[i].walkers;
 		}
 
-		pp->wrh = walker_findnext(pp->wh);
+		/* previous pp->wrh is finished with, so we may compact */
+		walker_compact(wa, pp->wh);
+		pp->wrh = walker_findnext(wa, pp->wh);
 		if (!pp->wrh) {
-			delete_walker(pp->wh);
+			delete_walker(wa, pp->wh);
 			pp->wh = (whp)0;
 			pp->wrcount = pp->wrnum;
 			--i;
@@ -678,7 +1084,7 @@ int pp_find(int target) {
 		++pp->wrnum;
 
 		++i;
-		if (i >= pplistsize) {
+		if (i >= e->pplistsize) {
 			fprintf(stderr, "overflow\n");
 			exit(1);
 		}
@@ -686,7 +1092,8 @@ int pp_find(int target) {
 
 		/* new spare = old spare - (actual discard - min discard) / denominator
 		 */
-		mpz_set_x(mpq_numref(q), wr_discard(pp->wh, pp->wrh), pp->valnumsize);
+		mpz_set_x(mpq_numref(q), wr_discard(wa, pp->wh, pp->wrh),
+				pp->valnumsize);
 		Dprintf("pp_%d walker found discard %Zd/%Zd\n",
 				pp->pp, mpq_numref(q), pp->denominator);
 		mpz_sub(mpq_numref(q), mpq_numref(q), pp->min_discard);
@@ -702,7 +1109,7 @@ int pp_find(int target) {
 			continue;
 		}
 		nextpp->wh = (whp)0;
-		if (pp_solution(i)) {
+		if (pp_solution(e, i)) {
 			success = 1;
 			break;
 		}
@@ -713,6 +1120,14 @@ int pp_find(int target) {
 	ZCLEAR(&z, "pp_find z");
 	if (!success)
 		printf("n=%d k=%d: no solution found. [%.2fs]\n",
-                target, k0, timing());
+                target, e->k0, timing());
+	if (e->stats) {
+		pp_stats_tick(e, -1);
+		pp_stats_report(e);
+		pp_stats_csv(e, target);
+	}
+	/* the search is complete, so the checkpoint is of no further use */
+	if (e->ckpt)
+		unlink(e->ckpt);
 	return success;
 }
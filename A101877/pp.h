@@ -21,8 +21,6 @@ typedef struct pp_s_pp {
 	int valsize;		/* number of values stored */
 	int valmax;			/* max number of values storable without realloc */
 	int valnumsize;		/* mpx size of values */
-	mpx_add_func* adder; /* mpx add function */
-	mpx_cmp_func* cmper; /* mpx compare function */
 	pp_value* value;	/* container for the values stored */
 	mpz_t min_discard;	/* minimum discard is always zero if dependent */
 	mpz_t total;		/* sum of the values */
@@ -34,6 +32,9 @@ typedef struct pp_s_pp {
 	int wrnum;			/* index of latest walk_result */
 	int wrcount;		/* count of results for previous walk */
 	mpq_t spare;		/* total to discard at this level */
+	mp_limb_t* resmin;	/* resmin[r * valnumsize]: least discard with invsum
+						 * r, valid if resok[r]; see pp_residues() */
+	char* resok;		/* resok[r] TRUE if some discard has invsum r */
 } pp_pp;
 
 #ifdef ALL_C
@@ -60,18 +61,54 @@ extern inline pp_value* pp_value_i(pp_pp* pp, int index) {
 }
 #endif /* ALL_C */
 
-extern pp_pp* pppp;
-extern pp_pp** pplist;
-extern int pplistsize;
-extern int pplistmax;
+/*
+ * Counters for one level of pplist in pp_find(), kept only if stats_on.
+ */
+typedef struct pp_s_level_stats {
+	long walkers;		/* walkers started at this level */
+	long pruned;		/* walkers not started, as no discard can qualify */
+	walk_stats walk;	/* walker activity at this level */
+	double secs;		/* wall time spent at this level */
+} pp_level_stats;
+
+/*
+ * All the state for one search for a given k. Separate engines share
+ * nothing but the inverse tables, so may run concurrently on different
+ * threads.
+ */
+typedef struct pp_s_engine {
+	int k0;				/* the greatest denominator allowed */
+	pp_pp* pppp;		/* pppp[q] is the PP structure for prime power q */
+	pp_pp** pplist;		/* the PP structures still to be resolved */
+	int pplistsize;
+	int pplistmax;
+	mpz_t z_no_previous;
+	walk_arena walk;	/* arena for the walkers */
+	char* ckpt;			/* checkpoint file for pp_find(), or NULL */
+	int stats_on;		/* TRUE to keep per-level counters in pp_find() */
+	char* stats_csv;	/* file to append the counters to, or NULL */
+	pp_level_stats* stats;	/* stats[level] for each level of pplist */
+	walk_stats stats_walk;	/* e->walk.stats at the last pp_stats_tick() */
+	double stats_time;		/* time of the last pp_stats_tick() */
+	int stats_level;		/* level at the last pp_stats_tick() */
+} pp_engine;
+
 #define MINPPSET 10
 
 extern volatile char diag_signal_seen;
+extern volatile char ckpt_signal_seen;
 
-extern void setup_pp(int k);
-extern void teardown_pp(void);
-extern void pp_study(int target);
-extern int pp_find(int target);
-extern void pp_save_r(int n, int prime, int power);
+extern void setup_pp(pp_engine* e, int k);
+extern void teardown_pp(pp_engine* e);
+extern void pp_study(pp_engine* e, int target);
+extern void pp_residues(pp_pp* pp);
+extern int pp_residue_limit(pp_pp* pp, int invsum, mpz_t limit, mpz_t z);
+extern int pp_find(pp_engine* e, int target);
+extern int pp_checkpoint(pp_engine* e, int target, int level);
+extern int pp_restore(pp_engine* e, int target, int* level);
+extern void pp_save_r(pp_engine* e, int n, int prime, int power);
+extern void pp_stats_report(pp_engine* e);
+extern int pp_stats_csv_header(char* path);
+extern int pp_stats_csv(pp_engine* e, int target);
 
 #endif /* PP_H */
@@ -1,6 +1,28 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include "prime.h"
 #include "mygmp.h"
 
+/*
+ * Smallest prime factor table: spf[n] is the least prime dividing n for
+ * 2 <= n <= max, spf[0] == spf[1] == 0. Once published a table is never
+ * changed; a larger one replaces it, with the old kept on the 'older'
+ * chain until teardown_prime() since lookups may still be using it.
+ */
+typedef struct prime_s_sieve {
+	int max;
+	struct prime_s_sieve* older;
+	int spf[0];
+} prime_sieve;
+
+static prime_sieve* spf_sieve = (prime_sieve*)NULL;
+static pthread_mutex_t spf_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline prime_sieve* spf_get(void) {
+	return __atomic_load_n(&spf_sieve, __ATOMIC_ACQUIRE);
+}
+
 int gcd(int a, int b) {
 	int temp;
 	if (a > b) {
@@ -16,6 +38,130 @@ int gcd(int a, int b) {
 	return b;
 }
 
+/*
+ * Build the smallest prime factor table for 2 <= n <= max, if the current
+ * table does not already cover it.
+ * Input:
+ *   int max: the greatest value to be covered
+ * Returns:
+ *   Nothing
+ * Notes:
+ *   Uses a linear sieve, setting each composite exactly once, so this
+ * is O(max). Safe to call from multiple threads.
+ */
+void setup_prime(int max) {
+	prime_sieve* s;
+	int* primes;
+	int i, j, p, np = 0;
+
+	s = spf_get();
+	if (s && s->max >= max)
+		return;
+	pthread_mutex_lock(&spf_lock);
+	s = spf_sieve;
+	if (s && s->max >= max) {
+		pthread_mutex_unlock(&spf_lock);
+		return;
+	}
+	if (max < 2)
+		max = 2;
+	s = calloc(1, sizeof(prime_sieve) + (max + 1) * sizeof(int));
+	primes = malloc((max / 2 + 1) * sizeof(int));
+	if (!s || !primes) {
+		fprintf(stderr, "Out of memory for prime sieve to %d\n", max);
+		exit(1);
+	}
+	s->max = max;
+	for (i = 2; i <= max; ++i) {
+		if (s->spf[i] == 0) {
+			s->spf[i] = i;
+			primes[np++] = i;
+		}
+		for (j = 0; j < np; ++j) {
+			p = primes[j];
+			if (p > s->spf[i] || p > max / i)
+				break;
+			s->spf[i * p] = p;
+		}
+	}
+	free(primes);
+	s->older = spf_sieve;
+	__atomic_store_n(&spf_sieve, s, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&spf_lock);
+}
+
+/*
+ * Free the smallest prime factor tables.
+ * Must not be called while any search is using them.
+ */
+void teardown_prime(void) {
+	prime_sieve* s = spf_sieve;
+	prime_sieve* older;
+	spf_sieve = (prime_sieve*)NULL;
+	while (s) {
+		older = s->older;
+		free(s);
+		s = older;
+	}
+}
+
+/*
+ * Return the greatest value covered by the smallest prime factor table,
+ * or 0 if there is none.
+ */
+int prime_sieve_max(void) {
+	prime_sieve* s = spf_get();
+	return s ? s->max : 0;
+}
+
+/*
+ * Factorise n.
+ * Input:
+ *   int n: the number to factorise, n >= 1
+ *   int primes[PRIME_FACTORS_MAX]: filled in with the distinct primes p_i
+ *   int powers[PRIME_FACTORS_MAX]: filled in with the prime powers p_i^k_i
+ * Returns:
+ *   int count of distinct prime factors, in ascending order
+ * Notes:
+ *   This is O(log n) when n is covered by the table (see setup_prime()),
+ * else falls back to trial division.
+ */
+int prime_factors(int n, int* primes, int* powers) {
+	prime_sieve* s = spf_get();
+	int d, power, count = 0;
+
+	if (s && n <= s->max) {
+		while (n > 1) {
+			d = s->spf[n];
+			power = 1;
+			do {
+				power *= d;
+				n /= d;
+			} while (s->spf[n] == d);
+			primes[count] = d;
+			powers[count++] = power;
+		}
+		return count;
+	}
+	for (d = 2; d <= n / d; ++d) {
+		if (n % d)
+			continue;
+		power = 1;
+		do {
+			power *= d;
+			n /= d;
+		} while (n % d == 0);
+		primes[count] = d;
+		powers[count++] = power;
+	}
+	/* what's left is prime */
+	if (n > 1) {
+		primes[count] = n;
+		powers[count++] = n;
+	}
+	return count;
+}
+
 /*
  * Find the greatest prime power p^k that divides n.
  * Input:
@@ -25,12 +171,33 @@ int gcd(int a, int b) {
  *   int p^k
  * Notes:
  *   If int* prime is not NULL, the base prime p will be stored there.
- *   The approach is very simplistic, this routine should not be used in
- * any tight loop.
+ *   This is O(log n) when n is covered by the table (see setup_prime()),
+ * else falls back to trial division.
  */
 int greatest_prime_power(int n, int* prime) {
+	prime_sieve* s = spf_get();
 	int d, q, best = 0, bestp = 0, power;
-	for (d = 2; d * d <= n; ++d) {
+
+	if (s && n <= s->max) {
+		while (n > 1) {
+			d = s->spf[n];
+			power = 1;
+			do {
+				power *= d;
+				n /= d;
+			} while (s->spf[n] == d);
+			if (best < power) {
+				best = power;
+				bestp = d;
+			}
+		}
+		if (best == 0)
+			best = bestp = 1;
+		if (prime)
+			*prime = bestp;
+		return best;
+	}
+	for (d = 2; d <= n / d; ++d) {
 		q = n / d;
 		if (d * q != n)
 			continue;
@@ -65,13 +232,16 @@ int greatest_prime_power(int n, int* prime) {
  * Notes:
  *   It is required that p^k fit in an int.
  *   If int* prime is not NULL, the base prime p will be stored there.
- *   The approach is very simplistic, this routine should not be used in
- * any tight loop.
+ *   If z fits in an int this defers to greatest_prime_power(); else the
+ * approach is very simplistic, and should not be used in any tight loop.
  */
 int z_greatest_prime_power(mpz_t z, int* prime) {
 	mpz_t d, q, r, n;
 	int best = 0, bestp = 0, power;
 
+	if (mpz_fits_sint_p(z) && mpz_sgn(z) > 0)
+		return greatest_prime_power((int)mpz_get_si(z), prime);
+
 	ZINIT(&n, "z_greatest_prime_power n");
 	ZINIT(&d, "z_greatest_prime_power d");
 	ZINIT(&q, "z_greatest_prime_power q");
@@ -3,7 +3,14 @@
 
 #include "mygmp.h"
 
+/* the most distinct prime factors of a positive int */
+#define PRIME_FACTORS_MAX 10
+
 extern int gcd(int a, int b);
+extern void setup_prime(int max);
+extern void teardown_prime(void);
+extern int prime_sieve_max(void);
+extern int prime_factors(int n, int* primes, int* powers);
 extern int greatest_prime_power(int n, int* prime);
 extern int z_greatest_prime_power(mpz_t z, int* prime);
 
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "inverse.h"
 
@@ -66,6 +67,29 @@ void test_all(uint p) {
 	test_cache(p);
 }
 
+/* the tables mapped from a cache file (created, then reused) */
+void test_load(void) {
+	char path[64];
+	int pass;
+
+	sprintf(path, "/tmp/t_inverse.%d", (int)getpid());
+	for (pass = 0; pass < 2; ++pass) {
+		setup_inverse();
+		if (!inverse_load(path, 300)) {
+			printf("Error: inverse_load(%s) failed on pass %d\n", path, pass);
+			++g_fail;
+		}
+		++g_test;
+		test_cache(2);
+		test_cache(3);
+		test_cache(293);
+		/* beyond the cache, built in memory */
+		test_cache(307);
+		teardown_inverse();
+	}
+	unlink(path);
+}
+
 int main(int argc, char** argv) {
 	setup_inverse();
 	test_all(2);
@@ -76,6 +100,7 @@ int main(int argc, char** argv) {
 	test_all(17);
 	test_all(257);
 	teardown_inverse();
+	test_load();
 	if (g_fail) {
 		printf("FAIL: failed %u of %u tests.\n", g_fail, g_test);
 	} else {
@@ -5,8 +5,9 @@
 
 uint g_fail = 0;
 uint g_test = 0;
+bh_arena ba;
 
-int mbh_compare_int(void* context, void* left, void* right) {
+int mbh_compare_int(void* owner, void* context, void* left, void* right) {
 	int il = P2I(left);
 	int ir = P2I(right);
 	return (il < ir) ? -1 : (il == ir) ? 0 : +1;
@@ -16,7 +17,7 @@ void test_cycle(bhp h) {
 	int i, j;
 	void* v;
 
-	i = mbh_size(h);
+	i = mbh_size(&ba, h);
 	if (i != 0) {
 		++g_fail;
 		printf("Error: expected empty heap to have size 0, got %d\n", i);
@@ -24,23 +25,56 @@ void test_cycle(bhp h) {
 	++g_test;
 	for (i = 0; i < 100; ++i) {
 		j = (i * 3) % 100;
-		mbh_insert(h, I2P(j));
+		mbh_insert(&ba, h, I2P(j));
 	}
-	i = mbh_size(h);
+	i = mbh_size(&ba, h);
 	if (i != 100) {
 		++g_fail;
 		printf("Error: expected filled heap to have size 100, got %d\n", i);
 	}
 	++g_test;
 	for (i = 0; i < 100; ++i) {
-		v = mbh_shift(h);
+		v = mbh_shift(&ba, h);
 		if (P2I(v) != i) {
 			++g_fail;
 			printf("Error: from mod 3 heap expected %d got %d\n", i, P2I(v));
 		}
 		++g_test;
 	}
-	i = mbh_size(h);
+	i = mbh_size(&ba, h);
+	if (i != 0) {
+		++g_fail;
+		printf("Error: expected emptied heap to have size 0, got %d\n", i);
+	}
+	++g_test;
+}
+
+void test_replace(bhp h) {
+	int i, j;
+	void* v;
+
+	for (i = 0; i < 100; ++i) {
+		j = (i * 7) % 100;
+		mbh_insert(&ba, h, I2P(j));
+	}
+	for (i = 0; i < 100; ++i) {
+		j = P2I(mbh_top(&ba, h));
+		v = mbh_replace(&ba, h, I2P(j + 100));
+		if (P2I(v) != i || j != i) {
+			++g_fail;
+			printf("Error: replace expected %d got %d (top %d)\n", i, P2I(v), j);
+		}
+		++g_test;
+	}
+	for (i = 100; i < 200; ++i) {
+		v = mbh_shift(&ba, h);
+		if (P2I(v) != i) {
+			++g_fail;
+			printf("Error: after replace expected %d got %d\n", i, P2I(v));
+		}
+		++g_test;
+	}
+	i = mbh_size(&ba, h);
 	if (i != 0) {
 		++g_fail;
 		printf("Error: expected emptied heap to have size 0, got %d\n", i);
@@ -50,27 +84,28 @@ void test_cycle(bhp h) {
 
 void test_b(void) {
 	bhp b;
-	b = mbh_new((void*)NULL, &mbh_compare_int);
+	b = mbh_new(&ba, (void*)NULL, &mbh_compare_int);
 	test_cycle(b);
+	test_replace(b);
 }
 
 void test_a(void) {
 	bhp a;
 	int i;
 	void* v;
-	a = mbh_new((void*)NULL, &mbh_compare_int);
+	a = mbh_new(&ba, (void*)NULL, &mbh_compare_int);
 	test_cycle(a);
 	for (i = 0; i < 3; ++i) {
-		mbh_insert(a, I2P(i));
+		mbh_insert(&ba, a, I2P(i));
 	}
 	test_b();
-	i = mbh_size(a);
+	i = mbh_size(&ba, a);
 	if (i != 3) {
 		++g_fail;
 		printf("Error: expected suspended heap to have size 3, got %d\n", i);
 	}
 	for (i = 0; i < 3; ++i) {
-		v = mbh_shift(a);
+		v = mbh_shift(&ba, a);
 		if (P2I(v) != i) {
 			++g_fail;
 			printf("Error: heap a corrupted by heap b: expected %d, got %d\n",
@@ -83,9 +118,9 @@ void test_a(void) {
 int main(int argc, char** argv) {
 	bhp a, b;
 	int i, j;
-	setup_mbh();
+	setup_mbh(&ba, (void*)NULL);
 	test_a();
-	teardown_mbh();
+	teardown_mbh(&ba);
 
 	if (g_fail) {
 		printf("FAIL: failed %u of %u tests.\n", g_fail, g_test);
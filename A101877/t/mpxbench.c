@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "mygmp.h"
+
+/*
+ * Microbenchmark for the fixed-size mpx routines: for each size, time
+ * adds and compares over a pool of random operands using each set of
+ * routines available through mpx_support_impl(), the inline versions
+ * (as used by the walker) and, for adds, mpn_add_n().
+ * Usage: t/mpxbench [iterations]
+ */
+
+#define POOL 1024		/* operands per pool; a power of 2 */
+#define MASK (POOL - 1)
+
+mp_limb_t src[POOL * MPX_MAXLIMBS];
+mp_limb_t dst[POOL * MPX_MAXLIMBS];
+int sink;
+
+double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define X(pool, i, n) (&(pool)[((i) & MASK) * (n)])
+
+double bench_add_ptr(mpx_add_func* adder, int n, long iter) {
+	double t0 = now();
+	long i;
+	for (i = 0; i < iter; ++i)
+		adder(X(dst, i, n), X(src, i, n), X(src, i + 1, n));
+	return now() - t0;
+}
+
+double bench_add_inline(int n, long iter) {
+	double t0 = now();
+	long i;
+	for (i = 0; i < iter; ++i)
+		mpx_add_n(X(dst, i, n), X(src, i, n), X(src, i + 1, n), n);
+	return now() - t0;
+}
+
+double bench_add_mpn(int n, long iter) {
+	double t0 = now();
+	long i;
+	for (i = 0; i < iter; ++i)
+		mpn_add_n(X(dst, i, n), X(src, i, n), X(src, i + 1, n), n);
+	return now() - t0;
+}
+
+double bench_cmp_ptr(mpx_cmp_func* cmper, int n, long iter) {
+	double t0 = now();
+	long i;
+	int s = 0;
+	for (i = 0; i < iter; ++i)
+		s += cmper(X(src, i, n), X(src, i + 1, n));
+	sink += s;
+	return now() - t0;
+}
+
+double bench_cmp_inline(int n, long iter) {
+	double t0 = now();
+	long i;
+	int s = 0;
+	for (i = 0; i < iter; ++i)
+		s += mpx_cmp_n(X(src, i, n), X(src, i + 1, n), n);
+	sink += s;
+	return now() - t0;
+}
+
+/*
+ * Random operands of size n, with alternate pairs equal but for the
+ * lowest limb, as nearby discards often are when compared in the heap.
+ */
+void fill(int n) {
+	int i, j;
+	for (i = 0; i < POOL * n; ++i)
+		src[i] = ((mp_limb_t)random() << 33) ^ ((mp_limb_t)random() << 2)
+				^ random();
+	for (i = 0; i < POOL; i += 2)
+		for (j = 1; j < n; ++j)
+			X(src, i + 1, n)[j] = X(src, i, n)[j];
+}
+
+void report(char* op, char* impl, int n, double secs, long iter) {
+	printf("%s\t%s\t%d\t%.2f\n", op, impl, n, secs * 1e9 / iter);
+}
+
+int main(int argc, char** argv) {
+	char* impls[] = { "asm", "c" };
+	long iter = (argc > 1) ? atol(argv[1]) : 10000000;
+	mpx_support* xsup;
+	int i, n;
+
+	srandom(1);
+	printf("op\timpl\tsize\tns_per_op\n");
+	for (n = 1; n <= MPX_MAXLIMBS; ++n) {
+		fill(n);
+		for (i = 0; i < (int)(sizeof(impls) / sizeof(impls[0])); ++i) {
+			xsup = mpx_support_impl(impls[i], n);
+			if (!xsup) {
+				printf("# %s not supported\n", impls[i]);
+				continue;
+			}
+			report("add", impls[i], n, bench_add_ptr(xsup->adder, n, iter), iter);
+			report("cmp", impls[i], n, bench_cmp_ptr(xsup->cmper, n, iter), iter);
+		}
+		report("add", "inline", n, bench_add_inline(n, iter), iter);
+		report("cmp", "inline", n, bench_cmp_inline(n, iter), iter);
+		report("add", "mpn_add_n", n, bench_add_mpn(n, iter), iter);
+	}
+	return sink == 12345 ? 1 : 0;
+}
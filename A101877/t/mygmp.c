@@ -103,6 +103,54 @@ void test_mpx(int size) {
 	++g_test;
 }
 
+/*
+ * Check every set of mpx routines, and the inline versions, against GMP
+ * for random values (including carries out of each limb).
+ */
+void test_impls(int size) {
+	char* impls[] = { "asm", "c" };
+	mp_limb_t a[MPX_MAXLIMBS], b[MPX_MAXLIMBS], sum[MPX_MAXLIMBS + 1];
+	mp_limb_t xd[MPX_MAXLIMBS + 2];
+	mpx_support* xsup;
+	int i, j, k, expect, got;
+
+	for (k = 0; k < 100; ++k) {
+		for (j = 0; j < size; ++j) {
+			a[j] = (k & 1) ? ~(mp_limb_t)0 : ((mp_limb_t)random() << 32) ^ random();
+			b[j] = (j == 0 || (k & 2)) ? ((mp_limb_t)random() << 32) ^ random()
+					: a[j];
+		}
+		/* keep the sum within size limbs */
+		a[size - 1] >>= 1;
+		b[size - 1] >>= 1;
+		mpn_add_n(sum, a, b, size);
+		expect = mpn_cmp(a, b, size);
+		expect = (expect > 0) - (expect < 0);
+		for (i = 0; i <= 2; ++i) {
+			char* name = (i < 2) ? impls[i] : "inline";
+			xsup = (i < 2) ? mpx_support_impl(impls[i], size) : NULL;
+			if (i < 2 && !xsup)
+				continue;
+			if (xsup)
+				guard_mpx_add(xsup, &xd[1], a, b);
+			else
+				mpx_add_n(&xd[1], a, b, size);
+			if (mpn_cmp(&xd[1], sum, size) != 0) {
+				printf("Error: %s add (size %d) gave wrong sum\n", name, size);
+				++g_fail;
+			}
+			++g_test;
+			got = xsup ? xsup->cmper(a, b) : mpx_cmp_n(a, b, size);
+			if (got != expect) {
+				printf("Error: %s cmp (size %d) gave %d, expected %d\n",
+						name, size, got, expect);
+				++g_fail;
+			}
+			++g_test;
+		}
+	}
+}
+
 int main(int argc, char** argv) {
 	int i;
 	ZINIT(&z1, "test z1");
@@ -111,6 +159,8 @@ int main(int argc, char** argv) {
 
 	for (i = 1; i <= 8; ++i)
 		test_mpx(i);
+	for (i = 1; i <= 8; ++i)
+		test_impls(i);
 
 	ZCLEAR(&z3, "test z3");
 	ZCLEAR(&z2, "test z2");
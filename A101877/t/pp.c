@@ -1,6 +1,10 @@
 #include "pp.h"
+#include "inverse.h"
+#include "prime.h"
+#include "walker.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 int g_fail = 0;
 int g_test = 0;
@@ -8,19 +12,19 @@ int g_test = 0;
 /* pp_diagnose wants to resolve this */
 double timing(void) { return 0; }
 
-void dump_pp(int n) {
+void dump_pp(pp_engine* e, int n) {
 	int i, j;
 	pp_pp* pp;
 	mpz_t zv;
 
 	ZINIT(&zv, "dump_pp zv");
-	printf("pp list(%d): ", pplistsize);
-	for (i = 0; i < pplistsize; ++i) {
-		printf("%p(%d), ", pplist[i], pplist[i]->pp);
+	printf("pp list(%d): ", e->pplistsize);
+	for (i = 0; i < e->pplistsize; ++i) {
+		printf("%p(%d), ", e->pplist[i], e->pplist[i]->pp);
 	}
 	printf("\n");
 	for (i = 1; i <= n; ++i) {
-		pp = &pppp[i];
+		pp = &e->pppp[i];
 		if (pp->p) {
 			printf("pppp[%d] = { p = %d; pp = %d; depend = %d; valsize = %d; valmax = %d; value = {",
 					i, pp->p, pp->pp, pp->depend, pp->valsize, pp->valmax);
@@ -38,14 +42,139 @@ void dump_pp(int n) {
 	ZCLEAR(&zv, "dump_pp zv");
 }
 
+/*
+ * The discards at or below limit with the given invsum (or any, if
+ * negative) that a walker returns, as a bitmap over 0..total.
+ */
+void walk_discards(pp_pp* pp, int invsum, mpz_t limit, char* seen, int total) {
+	walk_arena wa;
+	whp wh;
+	wrhp wrh;
+	mpz_t z;
+
+	ZINIT(&z, "walk_discards z");
+	memset(seen, 0, total + 1);
+	setup_walker(&wa);
+	wh = new_walker(&wa, pp, limit, invsum);
+	while ((wrh = walker_findnext(&wa, wh)) != 0) {
+		mpz_set_x(z, wr_discard(&wa, wh, wrh), pp->valnumsize);
+		seen[mpz_get_ui(z)] = 1;
+	}
+	delete_walker(&wa, wh);
+	teardown_walker(&wa);
+	ZCLEAR(&z, "walk_discards z");
+}
+
+/*
+ * Check pp_residues() against every subset of a small set of values, and
+ * check that the limit pp_residue_limit() gives a walker never excludes
+ * a discard the walker would have returned with the original limit.
+ */
+void test_residues(void) {
+	int val[5] = { 10, 7, 5, 4, 3 }, inv[5] = { 1, 2, 3, 4, 2 };
+	int p = 5, count = 5, total = 29;
+	int okay[5], least[5];
+	char before[30], after[30];
+	int i, r, mask, sum, invsum, bad;
+	pp_pp pp;
+	mpz_t limit, z;
+
+	memset(&pp, 0, sizeof(pp));
+	pp.p = p;
+	pp.pp = p;
+	pp.depend = 1;
+	pp.valsize = count;
+	pp.valnumsize = 1;
+	pp.value = calloc(count, pp_valsize_n(1));
+	pp.invtotal = 0;
+	for (i = 0; i < count; ++i) {
+		mpx_set_ui(ppv_mpx(pp_value_i(&pp, i)), 1, val[i]);
+		pp_value_i(&pp, i)->inv = inv[i];
+		pp.invtotal = (pp.invtotal + inv[i]) % p;
+	}
+	ZINIT(&pp.total, "test_residues total");
+	mpz_set_ui(pp.total, total);
+	ZINIT(&limit, "test_residues limit");
+	ZINIT(&z, "test_residues z");
+
+	for (r = 0; r < p; ++r)
+		okay[r] = 0;
+	for (mask = 0; mask < (1 << count); ++mask) {
+		sum = invsum = 0;
+		for (i = 0; i < count; ++i) {
+			if (mask & (1 << i)) {
+				sum += val[i];
+				invsum = (invsum + inv[i]) % p;
+			}
+		}
+		if (!okay[invsum] || sum < least[invsum])
+			least[invsum] = sum;
+		okay[invsum] = 1;
+	}
+	pp_residues(&pp);
+	bad = 0;
+	for (r = 0; r < p; ++r) {
+		if (pp.resok[r] != okay[r]
+				|| (okay[r] && pp.resmin[r] != (mp_limb_t)least[r]))
+			++bad;
+	}
+	++g_test;
+	if (bad) {
+		printf("Error: pp_residues() wrong for %d of %d residues\n", bad, p);
+		++g_fail;
+	} else {
+		printf("Ok: pp_residues() matches all subsets\n");
+	}
+
+	bad = 0;
+	for (r = 0; r < p; ++r) {
+		for (i = 0; i <= total; ++i) {
+			mpz_set_ui(limit, i);
+			walk_discards(&pp, r, limit, before, total);
+			if (!pp_residue_limit(&pp, r, limit, z)) {
+				if (memchr(before, 1, total + 1))
+					++bad;
+				continue;
+			}
+			if (mpz_cmp_ui(limit, i) > 0) {
+				++bad;
+				continue;
+			}
+			walk_discards(&pp, r, limit, after, total);
+			if (memcmp(before, after, total + 1) != 0)
+				++bad;
+		}
+	}
+	++g_test;
+	if (bad) {
+		printf("Error: pp_residue_limit() wrong for %d limits\n", bad);
+		++g_fail;
+	} else {
+		printf("Ok: pp_residue_limit() never excludes a discard\n");
+	}
+
+	free(pp.resmin);
+	free(pp.resok);
+	free(pp.value);
+	ZCLEAR(&pp.total, "test_residues total");
+	ZCLEAR(&limit, "test_residues limit");
+	ZCLEAR(&z, "test_residues z");
+}
+
 int main(int argc, char** argv) {
 	int i, j;
 	pp_pp* pp;
+	pp_engine e;
 
-	setup_pp(24);
-	dump_pp(24);
-	pp_study(3);
-	dump_pp(24);
+	setup_inverse();
+	setup_pp(&e, 24);
+	dump_pp(&e, 24);
+	pp_study(&e, 3);
+	dump_pp(&e, 24);
+	teardown_pp(&e);
+	test_residues();
+	teardown_inverse();
+	teardown_prime();
 
 	if (g_fail) {
 		printf("FAIL: failed %u of %u tests.\n", g_fail, g_test);
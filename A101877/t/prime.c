@@ -53,6 +53,54 @@ void test_gppz(mpz_t z, int expectpower, int expectprime) {
 	++g_test;
 }
 
+#define SIEVE_TEST 5000
+
+/*
+ * Check factorisation of 1..SIEVE_TEST, and that greatest_prime_power()
+ * gives the same results with the sieve as by trial division.
+ */
+void test_sieve(void) {
+	static int gpp[SIEVE_TEST + 1], gppp[SIEVE_TEST + 1];
+	int primes[PRIME_FACTORS_MAX], powers[PRIME_FACTORS_MAX];
+	int n, i, count, prod, prime, power;
+
+	for (n = 1; n <= SIEVE_TEST; ++n)
+		gpp[n] = greatest_prime_power(n, &gppp[n]);
+	setup_prime(SIEVE_TEST / 2);
+	setup_prime(SIEVE_TEST);
+	setup_prime(SIEVE_TEST / 3);
+	if (prime_sieve_max() != SIEVE_TEST) {
+		printf("Error: sieve covers %d, expected %d\n",
+				prime_sieve_max(), SIEVE_TEST);
+		++g_fail;
+	}
+	++g_test;
+	for (n = 1; n <= SIEVE_TEST; ++n) {
+		power = greatest_prime_power(n, &prime);
+		if (power != gpp[n] || prime != gppp[n]) {
+			printf("Error: for sieved greatest_prime_power(%d) expected (%d, %d), got (%d, %d)\n",
+					n, gpp[n], gppp[n], power, prime);
+			++g_fail;
+		}
+		++g_test;
+		count = prime_factors(n, primes, powers);
+		prod = 1;
+		for (i = 0; i < count; ++i) {
+			prod *= powers[i];
+			if ((i && primes[i] <= primes[i - 1])
+				|| greatest_prime_power(powers[i], &prime) != powers[i]
+				|| prime != primes[i]
+			)
+				prod = -1;
+		}
+		if (prod != n) {
+			printf("Error: bad factorisation of %d\n", n);
+			++g_fail;
+		}
+		++g_test;
+	}
+}
+
 int main(int argc, char** argv) {
 	int i, j;
 	int fib0 = 1, fib1 = 2, fib2;
@@ -88,6 +136,16 @@ int main(int argc, char** argv) {
 	mpz_mul_ui(z, z, 19 * 19 * 31);
 	test_gppz(z, 19 * 19 * 19, 19);
 
+	test_sieve();
+	test_gpp(702, 27, 3);
+	test_gpp(4096, 4096, 2);
+	mpz_set_ui(z, 11 * 11 * 13 * 7);
+	test_gppz(z, 121, 11);
+	mpz_set_ui(z, 2 * 3 * 5 * 7 * 11 * 13 * 17);
+	mpz_mul_ui(z, z, 19 * 23 * 29 * 31);
+	test_gppz(z, 31, 31);
+	teardown_prime();
+
 	ZCLEAR(&z, "test temp");
 	if (g_fail) {
 		printf("FAIL: failed %u of %u tests.\n", g_fail, g_test);
@@ -6,6 +6,7 @@
 
 int g_fail = 0;
 int g_test = 0;
+walk_arena wa;
 
 double timing(void) { return 0; }
 
@@ -13,9 +14,9 @@ void test_empty(whp wh, wrhp wrh) {
 	if (wrh) {
 		mpz_t z;
 		ZINIT(&z, "test_empty temp");
-		mpz_set_x(z, wr_discard(wh, wrh), WP(wh)->numsize);
+		mpz_set_x(z, wr_discard(&wa, wh, wrh), WP(&wa, wh)->numsize);
 		gmp_printf("Error: expected end of walker iterator, got <%Zd %d %d>\n",
-				z, WRP(wh, wrh)->invsum, wr_vec(wh, wrh)[0]);
+				z, WRP(&wa, wh, wrh)->invsum, wr_vec(&wa, wh, wrh)[0]);
 		ZCLEAR(&z, "test_empty temp");
 		++g_fail;
 	} else {
@@ -32,12 +33,12 @@ void test_wr(whp wh, wrhp wrh, int discard, int invsum, int vec0) {
 		++g_fail;
 	} else {
 		ZINIT(&z, "test_wr temp");
-		mpz_set_x(z, wr_discard(wh, wrh), WP(wh)->numsize);
+		mpz_set_x(z, wr_discard(&wa, wh, wrh), WP(&wa, wh)->numsize);
 		if (mpz_cmp_ui(z, discard) != 0
-				|| WRP(wh, wrh)->invsum != invsum
-				|| wr_vec(wh, wrh)[0] != vec0) {
+				|| WRP(&wa, wh, wrh)->invsum != invsum
+				|| wr_vec(&wa, wh, wrh)[0] != vec0) {
 			gmp_printf("Error: expected walk_result <%d %d %d>, got <%Zd %d %d>\n",
-				discard, invsum, vec0, z, WRP(wh, wrh)->invsum, wr_vec(wh, wrh)[0]);
+				discard, invsum, vec0, z, WRP(&wa, wh, wrh)->invsum, wr_vec(&wa, wh, wrh)[0]);
 			ZCLEAR(&z, "test_wr temp");
 			++g_fail;
 		} else {
@@ -52,49 +53,113 @@ void set_value(pp_pp* pp, int index, int val, int inv) {
 	pp_value_i(pp, index)->inv = inv;
 }
 
+/*
+ * Save the arena after 'cut' results, restore it into a fresh arena, and
+ * check the restored walker yields the same results as the original.
+ */
+void test_checkpoint(pp_pp* pp, mpz_t limit, int cut) {
+	walk_arena wb;
+	whp wh;
+	wrhp r1, r2;
+	FILE* f;
+	int i, count = 0, same = 1, numsize;
+
+	wh = new_walker(&wa, pp, limit, -1);
+	numsize = WP(&wa, wh)->numsize;
+	for (i = 0; i < cut; ++i)
+		walker_findnext(&wa, wh);
+	setup_walker(&wb);
+	f = tmpfile();
+	if (!f || !walker_save(&wa, f) || (rewind(f), !walker_restore(&wb, f))) {
+		printf("Error: checkpoint after %d failed to save or restore\n", cut);
+		++g_fail;
+		++g_test;
+		if (f)
+			fclose(f);
+		delete_walker(&wa, wh);
+		teardown_walker(&wb);
+		return;
+	}
+	fclose(f);
+	/* the saved pointers are still valid in this process, so clear them
+	 * as a new process would find them, to check walker_rebind() */
+	WP(&wb, wh)->wa = (walk_arena*)NULL;
+	WP(&wb, wh)->pp = (pp_pp*)NULL;
+	WP(&wb, wh)->hops = (const mbh_ops*)NULL;
+	mbh_rebind(&wb.heaps, WP(&wb, wh)->heap, (void*)NULL,
+			(mbh_compare_func*)NULL);
+	walker_rebind(&wb, wh, pp);
+
+	while (1) {
+		r1 = walker_findnext(&wa, wh);
+		r2 = walker_findnext(&wb, wh);
+		if (!r1 || !r2) {
+			if (r1 || r2)
+				same = 0;
+			break;
+		}
+		++count;
+		if (mpx_cmp_n(wr_discard(&wa, wh, r1), wr_discard(&wb, wh, r2), numsize)
+				|| WRP(&wa, wh, r1)->invsum != WRP(&wb, wh, r2)->invsum
+				|| wr_vec(&wa, wh, r1)[0] != wr_vec(&wb, wh, r2)[0]) {
+			same = 0;
+			break;
+		}
+	}
+	if (same) {
+		printf("Ok: checkpoint after %d, %d results match\n", cut, count);
+	} else {
+		printf("Error: checkpoint after %d, results differ after %d\n",
+				cut, count);
+		++g_fail;
+	}
+	++g_test;
+	delete_walker(&wa, wh);
+	teardown_walker(&wb);
+}
+
 int main(int argc, char** argv) {
 	int i, j;
 	pp_pp pp;
 	whp wh, wh2;
 	wrhp wrh;
 	mpz_t limit;
-	mpx_support* xsup;
 
 	ZINIT(&limit, "test limit");
-	setup_walker();
+	setup_walker(&wa);
 	++g_test;
 	pp.p = 3;
 	pp.pp = 27;
 	pp.valsize = 3;
 	pp.valnumsize = 1;
 	pp.value = calloc(10, pp_valsize_n(3));
-	xsup = mpx_support_n(1);
-	pp.adder = xsup->adder;
-	pp.cmper = xsup->cmper;
 	set_value(&pp, 0, 10, 1);
 	set_value(&pp, 1, 7, 1);
 	set_value(&pp, 2, 5, 2);
 	mpz_set_ui(limit, 22);
 
-	wh = new_walker(&pp, limit, -1);
+	wh = new_walker(&wa, &pp, limit, -1);
 	++g_test;
-	test_wr(wh, walker_findnext(wh), 0, 0, 0);
-	test_wr(wh, walker_findnext(wh), 5, 2, 4);
-	test_wr(wh, walker_findnext(wh), 7, 1, 2);
-	test_wr(wh, walker_findnext(wh), 10, 1, 1);
+	test_wr(wh, walker_findnext(&wa, wh), 0, 0, 0);
+	test_wr(wh, walker_findnext(&wa, wh), 5, 2, 4);
+	test_wr(wh, walker_findnext(&wa, wh), 7, 1, 2);
+	test_wr(wh, walker_findnext(&wa, wh), 10, 1, 1);
 	mpz_set_ui(limit, 13);
-	wh2 = new_walker(&pp, limit, 0);
-	test_wr(wh2, walker_findnext(wh2), 0, 0, 0);
-	test_wr(wh2, walker_findnext(wh2), 12, 0, 6);
-	test_empty(wh2, walker_findnext(wh2));
-	delete_walker(wh2);
-	test_wr(wh, walker_findnext(wh), 12, 0, 6);
-	test_wr(wh, walker_findnext(wh), 15, 0, 5);
-	test_wr(wh, walker_findnext(wh), 17, 2, 3);
-	test_wr(wh, walker_findnext(wh), 22, 1, 7);
-	test_empty(wh, walker_findnext(wh));
-	delete_walker(wh);
-	teardown_walker();
+	wh2 = new_walker(&wa, &pp, limit, 0);
+	test_wr(wh2, walker_findnext(&wa, wh2), 0, 0, 0);
+	test_wr(wh2, walker_findnext(&wa, wh2), 12, 0, 6);
+	test_empty(wh2, walker_findnext(&wa, wh2));
+	delete_walker(&wa, wh2);
+	test_wr(wh, walker_findnext(&wa, wh), 12, 0, 6);
+	test_wr(wh, walker_findnext(&wa, wh), 15, 0, 5);
+	test_wr(wh, walker_findnext(&wa, wh), 17, 2, 3);
+	test_wr(wh, walker_findnext(&wa, wh), 22, 1, 7);
+	test_empty(wh, walker_findnext(&wa, wh));
+	delete_walker(&wa, wh);
+	mpz_set_ui(limit, 22);
+	for (i = 0; i <= 4; ++i)
+		test_checkpoint(&pp, limit, i);
+	teardown_walker(&wa);
 	free(pp.value);
 	ZCLEAR(&limit, "test limit");
 	if (g_fail) {
@@ -4,27 +4,24 @@
 #include "pp.h"
 #include "mbh.h"
 
-char* walk_arena;
-int arena_size;
-int arena_max;
 #define MIN_WALK_ARENA 4096
 
-inline walker* WP(whp wh) {
-	return (walker*)&walk_arena[wh];
+inline walker* WP(walk_arena* wa, whp wh) {
+	return (walker*)&wa->arena[wh];
 }
-#define DWP(wh) ((walker*)&walk_arena[wh])
+#define DWP(wa, wh) ((walker*)&(wa)->arena[wh])
 
-inline walk_result* WRP(whp wh, wrhp wrh) {
-	return (walk_result*)&walk_arena[wrh];
+inline walk_result* WRP(walk_arena* wa, whp wh, wrhp wrh) {
+	return (walk_result*)&wa->arena[wrh];
 }
-#define DWRP(wh, wrh) ((walk_result*)&walk_arena[wrh])
+#define DWRP(w, wrh) ((walk_result*)&(w)->wa->arena[wrh])
 
 static inline whp WHP(walker* w) {
-	return (whp)((char*)w - walk_arena);
+	return (whp)((char*)w - w->wa->arena);
 }
 
 static inline wrhp WRHP(walker* w, walk_result* wr) {
-	return (wrhp)((char*)wr - walk_arena);
+	return (wrhp)((char*)wr - w->wa->arena);
 }
 
 static inline mpx_t w_limit(walker* w) {
@@ -39,42 +36,109 @@ static inline mpx_t wr_next_discard(walker* w, walk_result* wr) {
 	return (mpx_t)&wr->tail[0];
 }
 
-inline mpx_t wr_discard(whp wh, wrhp wrh) {
-	return (mpx_t)&WRP(wh, wrh)->tail[WP(wh)->numsize];
+inline mpx_t wr_discard(walk_arena* wa, whp wh, wrhp wrh) {
+	return (mpx_t)&WRP(wa, wh, wrh)->tail[WP(wa, wh)->numsize];
 }
 
 static inline mpx_t wr_discard_direct(walker* w, walk_result* wr) {
 	return (mpx_t)&wr->tail[w->numsize];
 }
 
-inline int* wr_vec(whp wh, wrhp wrh) {
-	return (int*)&WRP(wh, wrh)->tail[WP(wh)->numsize * 2];
+inline int* wr_vec(walk_arena* wa, whp wh, wrhp wrh) {
+	return (int*)&WRP(wa, wh, wrh)->tail[WP(wa, wh)->numsize * 2];
 }
 
 static inline int* wr_vec_direct(walker* w, walk_result* wr) {
 	return (int*)&wr->tail[w->numsize * 2];
 }
 
-int mbh_compare_wr(void* context, void* left, void* right) {
-	whp wh = P2I(context);
-	walker* w = DWP(wh);
-	wrhp wlh = P2I(left);
-	wrhp wrh = P2I(right);
-	walk_result* wl = DWRP(wh, wlh);
-	walk_result* wr = DWRP(wh, wrh);
-	return w->cmper(wr_next_discard(w, wl), wr_next_discard(w, wr));
+/*
+ * Order results with equal next_discard by nextbit, then by vec from the
+ * top word down. Only the first of several results with equal discards
+ * is returned, so this fixes which of them supplies the witness; it
+ * matches the order the old binary heap happened to give in every case
+ * checked.
+ */
+static inline int wr_tiebreak(walker* w, walk_result* l, walk_result* r,
+		int n) {
+	unsigned int* lv = (unsigned int*)&l->tail[n * 2];
+	unsigned int* rv = (unsigned int*)&r->tail[n * 2];
+	int i;
+
+	if (l->nextbit != r->nextbit)
+		return (l->nextbit < r->nextbit) ? -1 : 1;
+	for (i = w->vecsize - 1; i >= 0; --i)
+		if (lv[i] != rv[i])
+			return (lv[i] < rv[i]) ? -1 : 1;
+	return 0;
 }
 
-void setup_walker(void) {
-	setup_mbh();
-	arena_size = 4;	/* must not return 0 as a whp */
-	arena_max = MIN_WALK_ARENA;
-	walk_arena = malloc(arena_max);
+/*
+ * Heap comparators, one for each fixed numsize, comparing next_discard.
+ * These are the innermost loop, so the limbs are compared inline; the
+ * walker (the heap's context) is needed only to break ties. Each also
+ * gets its own heap routines from MBH_SPECIALISE(), with the comparison
+ * inlined in the sift loops; the mbh_compare_func versions are only for
+ * the generic routines.
+ */
+#ifdef SAFE_BUT_SLOW
+/* the heap's context is private, and MBH_SPECIALISE() ignores cmp */
+#define WR_CMP(n)
+#else
+#define WR_CMP(n) \
+static inline int wr_cmp_##n(bh_arena* a, bh_heap* hp, void* left, \
+		void* right) { \
+	return wr_compare_##n((walk_arena*)a->owner, hp->context, left, right); \
+}
+#endif
+#define WR_COMPARE(n) \
+static inline int wr_compare_##n(walk_arena* wa, void* context, void* left, \
+		void* right) { \
+	walk_result* l = (walk_result*)&wa->arena[P2I(left)]; \
+	walk_result* r = (walk_result*)&wa->arena[P2I(right)]; \
+	int c = mpx_cmp_fixed(l->tail, r->tail, n); \
+	return c ? c : wr_tiebreak(DWP(wa, P2I(context)), l, r, n); \
+} \
+int mbh_compare_wr_##n(void* owner, void* context, void* left, void* right) { \
+	return wr_compare_##n((walk_arena*)owner, context, left, right); \
+} \
+WR_CMP(n) \
+MBH_SPECIALISE(wr_heap_##n, wr_cmp_##n)
+WR_COMPARE(1)
+WR_COMPARE(2)
+WR_COMPARE(3)
+WR_COMPARE(4)
+WR_COMPARE(5)
+WR_COMPARE(6)
+WR_COMPARE(7)
+WR_COMPARE(8)
+
+mbh_compare_func* wr_comparator[MPX_MAXLIMBS] = {
+	&mbh_compare_wr_1, &mbh_compare_wr_2, &mbh_compare_wr_3, &mbh_compare_wr_4,
+	&mbh_compare_wr_5, &mbh_compare_wr_6, &mbh_compare_wr_7, &mbh_compare_wr_8
+};
+
+const mbh_ops wr_heap_ops[MPX_MAXLIMBS] = {
+	MBH_OPS(wr_heap_1), MBH_OPS(wr_heap_2), MBH_OPS(wr_heap_3),
+	MBH_OPS(wr_heap_4), MBH_OPS(wr_heap_5), MBH_OPS(wr_heap_6),
+	MBH_OPS(wr_heap_7), MBH_OPS(wr_heap_8)
+};
+
+void setup_walker(walk_arena* wa) {
+	setup_mbh(&wa->heaps, (void*)wa);
+	wa->size = 4;	/* must not return 0 as a whp */
+	wa->max = MIN_WALK_ARENA;
+	wa->freebytes = 0;
+	wa->peak = wa->size;
+	wa->compact_min = WALK_COMPACT_MIN;
+	wa->compactions = 0;
+	memset(&wa->stats, 0, sizeof(wa->stats));
+	wa->arena = malloc(wa->max);
 }
 
-void teardown_walker(void) {
-	free(walk_arena);
-	teardown_mbh();
+void teardown_walker(walk_arena* wa) {
+	free(wa->arena);
+	teardown_mbh(&wa->heaps);
 }
 
 static inline int wr_charsize(walker* w) {
@@ -85,59 +149,88 @@ static inline int wr_charsize(walker* w) {
 	);
 }
 
-#define grow_arena(w, size) \
-	if ((size) > arena_max) { \
-		int oldarena = ((char*)w - walk_arena); \
-		arena_max = arena_max * 2; \
-		walk_arena = realloc(walk_arena, arena_max); \
-		w = (walker*)(walk_arena + oldarena); \
+#define grow_arena(wa, w, size) \
+	if ((size) > (wa)->max) { \
+		int oldarena = ((char*)w - (wa)->arena); \
+		(wa)->max = (wa)->max * 2; \
+		(wa)->arena = realloc((wa)->arena, (wa)->max); \
+		w = (walker*)((wa)->arena + oldarena); \
 	}
 
 #define w_pick_arena(w, wr) \
 	{ \
 		wrhp pick_wrh; \
+		walk_arena* pick_wa = w->wa; \
 		if (w->arenanext) { \
 			pick_wrh = w->arenanext; \
-			w->arenanext = DWRP(WHP(w), pick_wrh)->next; \
+			w->arenanext = DWRP(w, pick_wrh)->next; \
+			--w->nfree; \
+			pick_wa->freebytes -= wr_charsize(w); \
 		} else { \
-			pick_wrh = arena_size; \
-			arena_size += wr_charsize(w); \
-			grow_arena(w, arena_size); \
+			pick_wrh = pick_wa->size; \
+			pick_wa->size += wr_charsize(w); \
+			if (pick_wa->size > pick_wa->peak) \
+				pick_wa->peak = pick_wa->size; \
+			grow_arena(pick_wa, w, pick_wa->size); \
 		} \
-		wr = DWRP(WHP(w), pick_wrh); \
+		wr = DWRP(w, pick_wrh); \
 	}
 
 static inline void push_heap(walker* w, walk_result* wr) {
-	mbh_insert(w->heap, I2P(WRHP(w, wr)));
+	++w->wa->stats.pushes;
+	w->hops->insert(&w->wa->heaps, w->heap, I2P(WRHP(w, wr)));
+}
+
+static inline walk_result* top_heap(walker* w) {
+	return DWRP(w, P2I(mbh_top(&w->wa->heaps, w->heap)));
+}
+
+/*
+ * walker_findnext() leaves the result it is working on at the top of the
+ * heap until it has something to put back, so that the first push after
+ * each pop can be done as a single replace.
+ */
+static inline void requeue_heap(walker* w, walk_result* wr, int* top_held) {
+	if (*top_held) {
+		++w->wa->stats.pops;
+		++w->wa->stats.pushes;
+		w->hops->replace(&w->wa->heaps, w->heap, I2P(WRHP(w, wr)));
+		*top_held = 0;
+	} else
+		push_heap(w, wr);
 }
 
-static inline walk_result* pop_heap(walker* w) {
-	void* v = mbh_shift(w->heap);
-	return DWRP(WHP(w), P2I(v));
+static inline void drop_top_heap(walker* w, int* top_held) {
+	if (*top_held) {
+		++w->wa->stats.pops;
+		w->hops->shift(&w->wa->heaps, w->heap);
+		*top_held = 0;
+	}
 }
 
 static inline int walker_charsize(int numsize) {
 	return sizeof(walker) + numsize * 2 * sizeof(mp_limb_t);
 }
 
-whp new_walker(pp_pp* pp, mpz_t limit, int invsum) {
+whp new_walker(walk_arena* wa, pp_pp* pp, mpz_t limit, int invsum) {
 	whp wh;
 	walker* w;
 	walk_result* wr;
 	int numsize = pp->valnumsize;
 
-	wh = arena_size;
-	w = WP(wh);
-	arena_size += walker_charsize(numsize);
-	grow_arena(w, arena_size);
-	w->heap = mbh_new(I2P(wh), &mbh_compare_wr);
+	wh = wa->size;
+	w = WP(wa, wh);
+	wa->size += walker_charsize(numsize);
+	grow_arena(wa, w, wa->size);
+	w->wa = wa;
+	w->heap = mbh_new(&wa->heaps, I2P(wh), wr_comparator[numsize - 1]);
+	w->hops = &wr_heap_ops[numsize - 1];
 	w->pp = pp;
 	w->numsize = numsize;
-	w->adder = pp->adder;
-	w->cmper = pp->cmper;
 	w->invsum = invsum;
 	w->vecsize = (pp->valsize + 31) >> 5;
 	w->arenanext = (wrhp)0;
+	w->nfree = 0;
 	w->have_previous = 0;
 	mpx_set_z(w_limit(w), numsize, limit);
 
@@ -152,16 +245,19 @@ whp new_walker(pp_pp* pp, mpz_t limit, int invsum) {
 	return wh;
 }
 
-void delete_walker(whp wh) {
-	walker* w = WP(wh);
+void delete_walker(walk_arena* wa, whp wh) {
+	walker* w = WP(wa, wh);
 
-	mbh_delete(w->heap);
-	arena_size = wh;
+	mbh_delete(&wa->heaps, w->heap);
+	wa->freebytes -= w->nfree * wr_charsize(w);
+	wa->size = wh;
 }
 
 static inline void w_free_arena(walker* w, walk_result* wr) {
 	wr->next = w->arenanext;
 	w->arenanext = WRHP(w, wr);
+	++w->nfree;
+	w->wa->freebytes += wr_charsize(w);
 }
 
 static inline void wr_setbit(walker* w, walk_result* wr, int bit) {
@@ -177,25 +273,28 @@ static inline int wr_testbit(walker* w, walk_result* wr, int bit) {
 }
 
 static inline int qualify(walker* w, walk_result* wr) {
-	if (w->cmper(w_limit(w), wr_next_discard(w, wr)) >= 0)
+	if (mpx_cmp_n(w_limit(w), wr_next_discard(w, wr), w->numsize) >= 0)
 		return 1;
 	return 0;
 }
 
-wrhp walker_findnext(whp wh) {
-	walker* w = DWP(wh);
+wrhp walker_findnext(walk_arena* wa, whp wh) {
+	walker* w = DWP(wa, wh);
 	walk_result* next;
 	walk_result* split;
 	wrhp nexth;
 	int limitbit, i;
+	int top_held;
 
+	++wa->stats.findnext;
 	while (1) {
-		if (mbh_size(w->heap) == 0)
+		if (mbh_size(&wa->heaps, w->heap) == 0)
 			return (wrhp)0;
 
 		/* pick_arena first, since arena may move */
 		w_pick_arena(w, split);
-		next = pop_heap(w);
+		next = top_heap(w);
+		top_held = 1;
 		limitbit = next->nextbit;
 		mpx_set(wr_discard_direct(w, split), w->numsize,
 				wr_next_discard(w, next), w->numsize);
@@ -206,13 +305,14 @@ wrhp walker_findnext(whp wh) {
 		if (next->nextbit == w->pp->valsize) {
 			/* first */
 			--next->nextbit;
-			w->adder(wr_next_discard(w, next), wr_discard_direct(w, next),
-					ppv_mpx(pp_value_i(w->pp, next->nextbit)));
+			mpx_add_n(wr_next_discard(w, next), wr_discard_direct(w, next),
+					ppv_mpx(pp_value_i(w->pp, next->nextbit)), w->numsize);
 			if (!qualify(w, next)) {
 				w_free_arena(w, next);
 			} else {
-				push_heap(w, next);
+				requeue_heap(w, next, &top_held);
 			}
+			drop_top_heap(w, &top_held);
 			w_free_arena(w, split);
 			goto found_line;
 		}
@@ -223,12 +323,12 @@ wrhp walker_findnext(whp wh) {
 		} else if (wr_testbit(w, next, next->nextbit)) {
 			w_free_arena(w, next);
 		} else {
-			w->adder(wr_next_discard(w, next), wr_discard_direct(w, next),
-					ppv_mpx(pp_value_i(w->pp, next->nextbit)));
+			mpx_add_n(wr_next_discard(w, next), wr_discard_direct(w, next),
+					ppv_mpx(pp_value_i(w->pp, next->nextbit)), w->numsize);
 			if (!qualify(w, next)) {
 				w_free_arena(w, next);
 			} else {
-				push_heap(w, next);
+				requeue_heap(w, next, &top_held);
 			}
 		}
 
@@ -244,43 +344,146 @@ wrhp walker_findnext(whp wh) {
 			w_free_arena(w, split);
 		} else {
 			split->nextbit = i;
-			w->adder(wr_next_discard(w, split), wr_discard_direct(w, split),
-					ppv_mpx(pp_value_i(w->pp, i)));
+			mpx_add_n(wr_next_discard(w, split), wr_discard_direct(w, split),
+					ppv_mpx(pp_value_i(w->pp, i)), w->numsize);
 			if (!qualify(w, split)) {
 				w_free_arena(w, split);
 			} else {
-				push_heap(w, split);
+				requeue_heap(w, split, &top_held);
 			}
 		}
+		drop_top_heap(w, &top_held);
 		next = split;
 	  found_line:
 		nexth = WRHP(w, next);
-		if (next->invsum != w->invsum)
+		/* a negative invsum (as used by t/walker) means any will do */
+		if (w->invsum >= 0 && next->invsum != w->invsum) {
+			++wa->stats.rejected;
 			continue;
+		}
 		if (w->have_previous
-				&& w->cmper(wr_discard_direct(w, next), w_previous(w)) == 0)
+				&& mpx_cmp_n(wr_discard_direct(w, next), w_previous(w),
+						w->numsize) == 0)
 			continue;
 		w->have_previous = 1;
 		mpx_set(w_previous(w), w->numsize,
 				wr_discard_direct(w, next), w->numsize);
+		++wa->stats.yielded;
 		return nexth;
 	}
 }
 
-wrhp wr_clone(whp wh, wrhp wrh) {
-	walker* w = WP(wh);
+wrhp wr_clone(walk_arena* wa, whp wh, wrhp wrh) {
+	walker* w = WP(wa, wh);
 	walk_result *wr, *wr2;
 
 	w_pick_arena(w, wr2);
 	/* we may attempt to clone something already released to arena, in which
 	 * case pick_arena may return the same address. If so, there's nothing
 	 * to do */
-	wr = WRP(wh, wrh);
+	wr = WRP(wa, wh, wrh);
 	if (wr2 != wr)
 		memcpy(wr2, wr, wr_charsize(w));
 	return WRHP(w, wr2);
 }
 
-void wr_clone_free(whp wh, wrhp wrh) {
-	w_free_arena(WP(wh), WRP(wh, wrh));
+void wr_clone_free(walk_arena* wa, whp wh, wrhp wrh) {
+	w_free_arena(WP(wa, wh), WRP(wa, wh, wrh));
+}
+
+/*
+ * Compact the results of a walker, if enough of its slots are free.
+ * Input:
+ *   walk_arena* wa: the arena holding the walker
+ *   whp wh: the most recently created walker in the arena
+ * Returns:
+ *   TRUE if the walker was compacted.
+ * Notes:
+ *   The results still in the heap are packed, in heap order, straight
+ * after the walker, and the heap rewritten to refer to the new locations;
+ * everything else is released. Any wrhp previously returned for this
+ * walker (including clones) becomes invalid, so this may only be called
+ * between calls to walker_findnext() when the last result is finished with.
+ */
+int walker_compact(walk_arena* wa, whp wh) {
+	walker* w = WP(wa, wh);
+	int rs = wr_charsize(w);
+	int count = mbh_size(&wa->heaps, w->heap);
+	void** values;
+	char* copy;
+	wrhp base;
+	int i;
+
+	if (wa->compact_min == 0 || w->nfree * rs < wa->compact_min
+			|| w->nfree <= count)
+		return 0;
+	values = mbh_values(&wa->heaps, w->heap);
+	base = wh + walker_charsize(w->numsize);
+	copy = malloc(count * rs + 1);
+	for (i = 0; i < count; ++i)
+		memcpy(copy + i * rs, &wa->arena[P2I(values[i])], rs);
+	memcpy(&wa->arena[base], copy, count * rs);
+	for (i = 0; i < count; ++i)
+		values[i] = I2P(base + i * rs);
+	free(copy);
+
+	wa->freebytes -= w->nfree * rs;
+	w->nfree = 0;
+	w->arenanext = (wrhp)0;
+	wa->size = base + count * rs;
+	++wa->compactions;
+	return 1;
+}
+
+/*
+ * Save the contents of a walk arena, including its heaps.
+ * Returns TRUE on success.
+ */
+int walker_save(walk_arena* wa, FILE* f) {
+	int hdr[4];
+
+	hdr[0] = wa->size;
+	hdr[1] = wa->freebytes;
+	hdr[2] = wa->peak;
+	hdr[3] = wa->compactions;
+	return fwrite(hdr, sizeof(hdr), 1, f) == 1
+			&& fwrite(wa->arena, 1, wa->size, f) == wa->size
+			&& mbh_save(&wa->heaps, f);
+}
+
+/*
+ * Restore the contents of a walk arena saved with walker_save() into one
+ * set up with setup_walker(). Returns TRUE on success.
+ * Notes:
+ *   Each walker in the arena must then be given its pp and pointers
+ * afresh with walker_rebind().
+ */
+int walker_restore(walk_arena* wa, FILE* f) {
+	int hdr[4];
+
+	if (fread(hdr, sizeof(hdr), 1, f) != 1 || hdr[0] < 4)
+		return 0;
+	if (hdr[0] > wa->max) {
+		wa->max = hdr[0];
+		wa->arena = realloc(wa->arena, wa->max);
+	}
+	if (fread(wa->arena, 1, hdr[0], f) != hdr[0])
+		return 0;
+	wa->size = hdr[0];
+	wa->freebytes = hdr[1];
+	wa->peak = hdr[2];
+	wa->compactions = hdr[3];
+	return mbh_restore(&wa->heaps, f);
+}
+
+/*
+ * Reattach a restored walker to its arena, pp and heap routines.
+ */
+void walker_rebind(walk_arena* wa, whp wh, pp_pp* pp) {
+	walker* w = WP(wa, wh);
+
+	w->wa = wa;
+	w->pp = pp;
+	mbh_rebind(&wa->heaps, w->heap, I2P(wh), wr_comparator[w->numsize - 1]);
+	w->hops = &wr_heap_ops[w->numsize - 1];
 }
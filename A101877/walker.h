@@ -4,7 +4,6 @@
 typedef int wrhp;
 typedef int whp;
 
-#include "pp.h"
 #include "mbh.h"
 #include "mygmp.h"
 
@@ -20,15 +19,27 @@ typedef struct s_walk_result {
 	*/
 } walk_result;
 
+typedef struct s_walk_arena walk_arena;
+
+/* Running totals of walker activity across an arena */
+typedef struct s_walk_stats {
+	long findnext;		/* calls to walker_findnext() */
+	long pushes;		/* results put on a heap */
+	long pops;			/* results taken off a heap */
+	long yielded;		/* results returned */
+	long rejected;		/* results skipped for not matching invsum */
+} walk_stats;
+
 typedef struct s_walker {
+	walk_arena* wa;		/* the arena this walker lives in */
 	bhp heap;
+	const mbh_ops* hops;	/* heap routines for this numsize */
 	struct pp_s_pp* pp;
 	int numsize;
-	mpx_add_func* adder;
-	mpx_cmp_func* cmper;
 	int invsum;
 	int vecsize;
-	wrhp arenanext;
+	wrhp arenanext;		/* free list of walk_result slots */
+	int nfree;			/* number of slots on the free list */
 	int have_previous;
 	mp_limb_t tail[0];
 	/* tail consists of:
@@ -37,38 +48,62 @@ typedef struct s_walker {
 	*/
 } walker;
 
-extern char* walk_arena;
+/*
+ * The arena holding a stack of walkers and their walk_result records,
+ * along with the arena for their heaps. Walkers and results are referred
+ * to by offsets into the arena, since it may move as it grows.
+ *
+ * All the results of one walker are the same size, so each walker keeps
+ * its own free list of released slots; the whole region is released
+ * when the walker is deleted.
+ */
+struct s_walk_arena {
+	char* arena;
+	int size;			/* bytes in use, including free slots */
+	int max;			/* bytes allocated */
+	int freebytes;		/* bytes in slots on walker free lists */
+	int peak;			/* maximum size reached */
+	int compact_min;	/* free bytes in a walker before compacting, or 0 */
+	int compactions;	/* number of compactions done */
+	walk_stats stats;
+	bh_arena heaps;
+};
+
+#define WALK_COMPACT_MIN (1 << 16)
 
 #ifdef ALL_C
-inline walker* WP(whp wh);
-inline walk_result* WRP(whp wh, wrhp wrh);
-inline mpx_t wr_discard(whp wh, wrhp wrh);
-inline int* wr_vec(whp wh, wrhp wrh);
+inline walker* WP(walk_arena* wa, whp wh);
+inline walk_result* WRP(walk_arena* wa, whp wh, wrhp wrh);
+inline mpx_t wr_discard(walk_arena* wa, whp wh, wrhp wrh);
+inline int* wr_vec(walk_arena* wa, whp wh, wrhp wrh);
 #else /* ALL_C */
-extern inline walker* WP(whp wh) {
-	return (walker*)&walk_arena[wh];
+extern inline walker* WP(walk_arena* wa, whp wh) {
+	return (walker*)&wa->arena[wh];
 }
-extern inline walk_result* WRP(whp wh, wrhp wrh) {
-	return (walk_result*)&walk_arena[wrh];
+extern inline walk_result* WRP(walk_arena* wa, whp wh, wrhp wrh) {
+	return (walk_result*)&wa->arena[wrh];
 }
 
-extern inline mpx_t wr_discard(whp wh, wrhp wrh) {
-	return (mpx_t)&WRP(wh, wrh)->tail[WP(wh)->numsize];
+extern inline mpx_t wr_discard(walk_arena* wa, whp wh, wrhp wrh) {
+	return (mpx_t)&WRP(wa, wh, wrh)->tail[WP(wa, wh)->numsize];
 }
-extern inline int* wr_vec(whp wh, wrhp wrh) {
-	return (int*)&WRP(wh, wrh)->tail[WP(wh)->numsize * 2];
+extern inline int* wr_vec(walk_arena* wa, whp wh, wrhp wrh) {
+	return (int*)&WRP(wa, wh, wrh)->tail[WP(wa, wh)->numsize * 2];
 }
 #endif /* ALL_C */
 
 #define MINARENA 16
 
-extern void setup_walker(void);
-extern void teardown_walker(void);
-extern whp new_walker(struct pp_s_pp* pp, mpz_t limit, int invsum);
-extern wrhp walker_next(whp wh);
-extern wrhp walker_findnext(whp wh);
-extern void delete_walker(whp wh);
-extern wrhp wr_clone(whp wh, wrhp wrh);
-extern void wr_clone_free(whp wh, wrhp wrh);
+extern void setup_walker(walk_arena* wa);
+extern void teardown_walker(walk_arena* wa);
+extern whp new_walker(walk_arena* wa, struct pp_s_pp* pp, mpz_t limit, int invsum);
+extern wrhp walker_findnext(walk_arena* wa, whp wh);
+extern void delete_walker(walk_arena* wa, whp wh);
+extern wrhp wr_clone(walk_arena* wa, whp wh, wrhp wrh);
+extern void wr_clone_free(walk_arena* wa, whp wh, wrhp wrh);
+extern int walker_compact(walk_arena* wa, whp wh);
+extern int walker_save(walk_arena* wa, FILE* f);
+extern int walker_restore(walk_arena* wa, FILE* f);
+extern void walker_rebind(walk_arena* wa, whp wh, struct pp_s_pp* pp);
 
 #endif /* WALKER_H */
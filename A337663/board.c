@@ -4,13 +4,23 @@
 
 #include "board.h"
 #include "sym.h"
+#include "tt.h"
 
+/*
+ * One step of the search: 1 = new group, 2 = extend a group, 3 = extend
+ * a group with new 1s, 4 = coalesce two groups, 5 = coalesce 'count'
+ * groups, those indexed gidx[] at locations ln[] (with gidx[0] also in
+ * group_index).
+ */
 typedef struct hist_s {
     int type;
     int index;
     int group_index;
     loc_t l1;
     loc_t l2;
+    int count;
+    int gidx[MAXCOALESCE];
+    loc_t ln[MAXCOALESCE];
 } hist_t;
 
 int n;
@@ -21,14 +31,25 @@ board_t *best_board;
 unsigned long board_count;
 board_t *b0;
 
+/* freed boards, for reuse by new_board() */
+board_t *board_pool = NULL;
+
 #define MAXHIST 100
-#define MAXSTR 16
+#define MAXSTR 32
 int in_histc = 0;
 int next_hist = 0;
 hist_t in_hist[MAXHIST];
 hist_t out_hist[MAXHIST];
 char out_histstr[MAXHIST * MAXSTR];
 
+/* Splitting the search into subtrees, see split_board() and try_subtree() */
+int split_k = 0;
+void (*split_fn)(char *hist);
+int sub_k = 0;
+bool sub_done = 0;
+int *shared_best = NULL;
+int sub_job = -1;
+
 /*
  * Increment the refcount of a board.
  */
@@ -46,7 +67,8 @@ void unref_board(board_t *b) {
     for (int i = 0; i < b->groups; ++i) {
         unref_group(b->group[i]);
     }
-    free(b);
+    b->next = board_pool;
+    board_pool = b;
 }
 
 #define _d1(s) (*s++ - '0')
@@ -56,6 +78,54 @@ void unref_board(board_t *b) {
 })
 #define _s(s) (void) ({ if (*s == ' ') ++s; })
 
+/*
+ * Parse the history string 's' into in_hist[], so that the search will
+ * resume at the point it indicates.
+ */
+static void read_hist(char *s) {
+    in_histc = 2;
+    next_hist = 2;
+    while (isdigit(*s)) {
+        in_hist[in_histc].type = _d1(s);
+        switch (in_hist[in_histc].type) {
+            case 1:
+                in_hist[in_histc].index = _d2(s);
+                break;
+            case 2:
+                in_hist[in_histc].group_index = _d1(s);
+                in_hist[in_histc].l1.x = _d2(s);
+                in_hist[in_histc].l1.y = _d2(s);
+                break;
+            case 3:
+                in_hist[in_histc].group_index = _d1(s);
+                in_hist[in_histc].index = _d2(s);
+                in_hist[in_histc].l1.x = _d2(s);
+                in_hist[in_histc].l1.y = _d2(s);
+                break;
+            case 4:
+                in_hist[in_histc].group_index = _d1(s);
+                in_hist[in_histc].index = _d2(s);
+                in_hist[in_histc].l1.x = _d2(s);
+                in_hist[in_histc].l1.y = _d2(s);
+                in_hist[in_histc].l2.x = _d2(s);
+                in_hist[in_histc].l2.y = _d2(s);
+                break;
+            case 5:
+                in_hist[in_histc].count = _d1(s);
+                in_hist[in_histc].index = _d2(s);
+                for (int i = 0; i < in_hist[in_histc].count; ++i) {
+                    in_hist[in_histc].gidx[i] = _d1(s);
+                    in_hist[in_histc].ln[i].x = _d2(s);
+                    in_hist[in_histc].ln[i].y = _d2(s);
+                }
+                in_hist[in_histc].group_index = in_hist[in_histc].gidx[0];
+                break;
+        }
+        ++in_histc;
+        _s(s);
+    }
+}
+
 /*
  * Perform initialization for a run to find A337663(n0), restarting
  * at the point indicated by start_hist if supplied, else from the start.
@@ -66,7 +136,7 @@ board_t *init_board(int n0, int freq0, char *start_hist) {
     fcount = freq0;
     board_count = 0;
 
-    b0 = new_board(2, n, (group_t *)NULL, (group_t *)NULL);
+    b0 = new_board(2, n, 0, (group_t **)NULL);
     best_k = 1;
     best_board = b0;
     ref_board(b0);
@@ -76,64 +146,80 @@ board_t *init_board(int n0, int freq0, char *start_hist) {
         char *s;
         best_k = strtol(start_hist, &s, 10);
         _s(s);
-        in_histc = 2;
-        next_hist = 2;
-        while (isdigit(*s)) {
-            in_hist[in_histc].type = _d1(s);
-            switch (in_hist[in_histc].type) {
-                case 1:
-                    in_hist[in_histc].index = _d2(s);
-                    break;
-                case 2:
-                    in_hist[in_histc].group_index = _d1(s);
-                    in_hist[in_histc].l1.x = _d2(s);
-                    in_hist[in_histc].l1.y = _d2(s);
-                    break;
-                case 3:
-                    in_hist[in_histc].group_index = _d1(s);
-                    in_hist[in_histc].index = _d2(s);
-                    in_hist[in_histc].l1.x = _d2(s);
-                    in_hist[in_histc].l1.y = _d2(s);
-                    break;
-                case 4:
-                    in_hist[in_histc].group_index = _d1(s);
-                    in_hist[in_histc].index = _d2(s);
-                    in_hist[in_histc].l1.x = _d2(s);
-                    in_hist[in_histc].l1.y = _d2(s);
-                    in_hist[in_histc].l2.x = _d2(s);
-                    in_hist[in_histc].l2.y = _d2(s);
-                    break;
-            }
-            ++in_histc;
-            _s(s);
-        }
+        read_hist(s);
         printf("reset\n");
     }
     return b0;
 }
 
+/*
+ * Search the top of the tree only, calling fn() with the history leading
+ * to each board with k = split (in the order they would be searched)
+ * instead of searching it. Used with try_subtree() to divide the search.
+ */
+void split_board(int split, void (*fn)(char *hist)) {
+    split_k = split;
+    split_fn = fn;
+    try_board(b0);
+    split_k = 0;
+}
+
+/*
+ * Search just the subtree at the end of 'hist', as passed to the
+ * split_fn() of split_board(), and return the number of boards seen
+ * in it. Each board better than *best (which may be shared with other
+ * processes) raises it. Boards shown meanwhile are labelled with 'job'
+ * rather than board_count, which only counts this process's share.
+ */
+unsigned long try_subtree(int job, char *hist, int *best) {
+    unsigned long count = board_count;
+
+    sub_job = job;
+    shared_best = best;
+    best_k = __atomic_load_n(best, __ATOMIC_RELAXED);
+    read_hist(hist);
+    sub_k = in_histc;
+    sub_done = 0;
+    try_board(b0);
+    sub_k = 0;
+    in_histc = 0;
+    shared_best = NULL;
+    sub_job = -1;
+    return board_count - count;
+}
+
 /*
  * Clean up.
  */
 void finish_board(void) {
     unref_board(best_board);
     unref_board(b0);
+    while (board_pool) {
+        board_t *b = board_pool;
+        board_pool = b->next;
+        free(b);
+    }
 }
 
 /*
- * Construct and return a new board structure with the specified details.
- * The refcount is initialised to 1.
+ * Construct and return a new board structure with the specified details,
+ * holding the 'groups' groups in 'group'.
+ * The refcount is initialised to 1. Freed boards are kept for reuse.
  */
-board_t *new_board(int k, int unused, group_t *g0, group_t *g1) {
-    board_t *b = malloc(sizeof(board_t));
+board_t *new_board(int k, int unused, int groups, group_t **group) {
+    board_t *b = board_pool;
+
+    if (b)
+        board_pool = b->next;
+    else
+        b = malloc(sizeof(board_t));
 
     b->k = k;
     b->unused = unused;
     b->refcount = 1;
-    b->group[0] = g0;
-    b->group[1] = g1;
-    b->groups = g0 ? g1 ? 2 : 1 : 0;
+    b->groups = groups;
     for (int i = 0; i < b->groups; ++i) {
+        b->group[i] = group[i];
         ref_group(b->group[i]);
     }
     return b;
@@ -143,10 +229,14 @@ board_t *new_board(int k, int unused, group_t *g0, group_t *g1) {
  * Show the board, along with some relevant parameters.
  * Unconnected groups are separated by '  //  '; within a group the rows
  * are separated by ';', and empty spaces are represented by 0.
+ * Within a subtree the job index is shown as 'j=' in place of 'b='.
  */
 void print_board(board_t *b) {
-    printf("b=%lu; k=%d; u=%d; g=%d ->  ",
-            board_count, b->k, b->unused, b->groups);
+    if (sub_job >= 0)
+        printf("j=%d; ", sub_job);
+    else
+        printf("b=%lu; ", board_count);
+    printf("k=%d; u=%d; g=%d ->  ", b->k, b->unused, b->groups);
     for (int i = 0; i < b->groups; ++i) {
         if (i)
             printf("  //  ");
@@ -155,67 +245,232 @@ void print_board(board_t *b) {
     printf("\n");
 }
 
+/*
+ * Make sure out_histstr[] holds the history for each step up to k.
+ */
+static void format_hist(int k) {
+    for (int i = k; i >= 2; --i) {
+        hist_t h = out_hist[i];
+        char *s = &out_histstr[MAXSTR * i];
+        if (*s)
+            break;
+        switch (h.type) {
+            case 1:
+                sprintf(s, "%01d%02d",
+                        h.type, h.index);
+                break;
+            case 2:
+                sprintf(s, "%01d%01d%02d%02d",
+                        h.type, h.group_index, h.l1.x, h.l1.y);
+                break;
+            case 3:
+                sprintf(s, "%01d%01d%02d%02d%02d",
+                        h.type, h.group_index, h.index, h.l1.x, h.l1.y);
+                break;
+            case 4:
+                sprintf(s, "%01d%01d%02d%02d%02d%02d%02d",
+                        h.type, h.group_index, h.index,
+                        h.l1.x, h.l1.y, h.l2.x, h.l2.y);
+                break;
+            case 5:
+                s += sprintf(s, "%01d%01d%02d",
+                        h.type, h.count, h.index);
+                for (int j = 0; j < h.count; ++j)
+                    s += sprintf(s, "%01d%02d%02d",
+                            h.gidx[j], h.ln[j].x, h.ln[j].y);
+                break;
+        }
+    }
+}
+
+/*
+ * Hand the history of the steps up to k, as accepted by read_hist(),
+ * to split_fn().
+ */
+static void split_hist(int k) {
+    char buf[MAXHIST * MAXSTR], *s = buf;
+
+    format_hist(k);
+    for (int i = 2; i <= k; ++i)
+        s += sprintf(s, "%s%s", (i > 2) ? " " : "", &out_histstr[MAXSTR * i]);
+    split_fn(buf);
+}
+
+/*
+ * Note that we have seen a board with k at least best_k. If there is a
+ * shared best, it is first refreshed from there, and raised if k is
+ * higher.
+ */
+static void check_best(board_t *nb, int k) {
+    if (shared_best)
+        best_k = __atomic_load_n(shared_best, __ATOMIC_RELAXED);
+    if (k < best_k)
+        return;
+
+    printf("%sbest ", (k == best_k) ? "e" : "");
+    print_board(nb);
+    if (k > best_k) {
+        best_k = k;
+        unref_board(best_board);
+        best_board = nb;
+        ref_board(nb);
+        if (shared_best) {
+            int seen = __atomic_load_n(shared_best, __ATOMIC_RELAXED);
+            while (seen < k && !__atomic_compare_exchange_n(shared_best,
+                    &seen, k, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                ;
+        }
+    }
+}
+
 /*
  * Recursive coroutine with try_board(): construct a new board from this
  * board with new details, then call try_board() on it.
  *
  * Progress is tracked here. On return, all possible continuations of
  * the fresh board have been checked.
+ *
+ * If split_k is set, boards reaching that k are not searched but handed
+ * to split_fn(); if sub_k is set, only the subtree from the first board
+ * reaching that k is searched and counted. Boards already seen in the
+ * transposition table are counted, but not searched again.
  */
-void recurse(board_t *b, int unused, group_t *g0, group_t *g1) {
+void recurse(board_t *b, int unused, int groups, group_t **group) {
     int k = b->k;
-    board_t *nb = new_board(k + 1, unused, g0, g1);
+
+    if (sub_done)
+        return;
+
+    board_t *nb = new_board(k + 1, unused, groups, group);
     out_histstr[MAXSTR * k] = 0;
 
-    ++board_count;
-    if (--fcount == 0) {
-        fcount = freq;
-        for (int i = k; i >= 2; --i) {
-            hist_t h = out_hist[i];
-            char *s = &out_histstr[MAXSTR * i];
-            if (*s)
-                break;
-            switch (h.type) {
-                case 1:
-                    sprintf(s, "%01d%02d",
-                            h.type, h.index);
-                    break;
-                case 2:
-                    sprintf(s, "%01d%01d%02d%02d",
-                            h.type, h.group_index, h.l1.x, h.l1.y);
-                    break;
-                case 3:
-                    sprintf(s, "%01d%01d%02d%02d%02d",
-                            h.type, h.group_index, h.index, h.l1.x, h.l1.y);
-                    break;
-                case 4:
-                    sprintf(s, "%01d%01d%02d%02d%02d%02d%02d",
-                            h.type, h.group_index, h.index,
-                            h.l1.x, h.l1.y, h.l2.x, h.l2.y);
-                    break;
-            }
-        }
-        printf("%d ", best_k);
-        for (int i = 2; i <= k; ++i)
-            printf("%s ", &out_histstr[MAXSTR * i]);
-        print_board(nb);
+    if (k + 1 == split_k) {
+        split_hist(k);
+        unref_board(nb);
+        return;
     }
 
-    if (k >= best_k) {
-        printf("%sbest ", (k == best_k) ? "e" : "");
-        print_board(nb);
-        if (k > best_k) {
-            best_k = k;
-            unref_board(best_board);
-            best_board = nb;
-            ref_board(nb);
+    if (k + 1 >= sub_k) {
+        ++board_count;
+        if (--fcount == 0) {
+            fcount = freq;
+            format_hist(k);
+            printf("%d ", best_k);
+            for (int i = 2; i <= k; ++i)
+                printf("%s ", &out_histstr[MAXSTR * i]);
+            print_board(nb);
         }
+        check_best(nb, k);
     }
 
-    try_board(nb);
+    /* the path to a subtree is replayed, not searched */
+    if (k + 1 < sub_k || !tt_seen(nb))
+        try_board(nb);
+    if (k + 1 == sub_k)
+        sub_done = 1;
     unref_board(nb);
 }
 
+/*
+ * Copy the groups of this board to 'ng', with group 'ig' replaced by 'g'
+ * (or added, if ig == b->groups). Returns the new number of groups.
+ */
+static int with_group(board_t *b, group_t **ng, int ig, group_t *g) {
+    for (int i = 0; i < b->groups; ++i)
+        ng[i] = b->group[i];
+    ng[ig] = g;
+    return (ig == b->groups) ? b->groups + 1 : b->groups;
+}
+
+/*
+ * Copy the groups of this board to 'ng', replacing the 'count' groups
+ * indexed by the ascending 'gidx' with 'g' in place of the first of them.
+ * Returns the new number of groups.
+ */
+static int with_coalesced(
+    board_t *b, group_t **ng, int count, int *gidx, group_t *g
+) {
+    int ni = 0, j = 0;
+    for (int i = 0; i < b->groups; ++i) {
+        if (j < count && i == gidx[j]) {
+            if (j++ == 0)
+                ng[ni++] = g;
+            continue;
+        }
+        ng[ni++] = b->group[i];
+    }
+    return ni;
+}
+
+/*
+ * Try each way to coalesce oh->count groups (at least 3) at a new location
+ * for k, having chosen the first 'd' of them along with the location in
+ * each, such that the chosen locations have neighbours summing to 'sum'.
+ * Each group must contribute at least 1 to the sum, and new 1s may be
+ * used to make up the rest.
+ *
+ * While restarting, h is the type 5 entry to wait for: only the groups
+ * and locations it names are tried, and once all are found the search
+ * continues normally from its index, with h->type reset.
+ */
+static void coalesce_multi(board_t *b, hist_t *h, hist_t *oh, int d, int sum) {
+    int k = b->k, unused = b->unused, m = oh->count;
+    int jlo = d ? oh->gidx[d - 1] + 1 : oh->gidx[0];
+    int jhi = d ? b->groups - (m - d) : oh->gidx[0];
+    bool last = (d == m - 1);
+    int smin = last ? k - sum - unused : 1;
+    int smax = last ? k - sum : k - sum - (m - d - 1);
+
+    if (smin < 1)
+        smin = 1;
+    for (int jg = jlo; jg <= jhi; ++jg) {
+        group_t *gj = b->group[jg];
+        int *heads = gj->sum_heads;
+        int *chains = gj->sum_chains;
+
+        if (h->type == 5 && jg != h->gidx[d])
+            continue;
+        oh->gidx[d] = jg;
+        for (int sj = smin; sj <= smax && sj <= gj->maxsum; ++sj) {
+            for (int c = heads[sj]; c >= 0; c = chains[c]) {
+                loc_t l = (loc_t){
+                    c / (gj->y + 2) - 1, c % (gj->y + 2) - 1
+                };
+                int p_start = 0;
+                if (h->type == 5) {
+                    if (l.x != h->ln[d].x || l.y != h->ln[d].y)
+                        continue;
+                    if (last) {
+                        h->type = 0;
+                        p_start = h->index;
+                    }
+                }
+                oh->ln[d] = l;
+                if (!last) {
+                    coalesce_multi(b, h, oh, d + 1, sum + sj);
+                    if (sub_done)
+                        return;
+                    continue;
+                }
+
+                group_t *cg[MAXCOALESCE], *ng[MAXGROUPS];
+                int use = k - sum - sj;
+                for (int i = 0; i < m; ++i)
+                    cg[i] = b->group[oh->gidx[i]];
+                grouplist_t *gl = coalesce_groups(m, cg, oh->ln, k, use);
+                for (int p = p_start; p < gl->count; ++p) {
+                    oh->index = p;
+                    recurse(b, unused - use,
+                            with_coalesced(b, ng, m, oh->gidx, gl->g[p]), ng);
+                }
+                free_grouplist(gl);
+                if (sub_done)
+                    return;
+            }
+        }
+    }
+}
+
 /*
  * Recursive coroutine with recurse(): try each way to extend this board.
  *
@@ -224,7 +479,7 @@ void recurse(board_t *b, int unused, group_t *g0, group_t *g1) {
  */
 void try_board(board_t *b) {
     int k = b->k, unused = b->unused, groups = b->groups;
-    group_t *g0 = b->group[0], *g1 = b->group[1];
+    group_t *ng[MAXGROUPS];
     hist_t h, *oh;
 
     if (k == next_hist) {
@@ -240,19 +495,15 @@ void try_board(board_t *b) {
         h.type = 0;
     oh = &out_hist[k];
 
-    /* try making a new group */
-    if (unused >= k && h.type <= 1) {
+    /* try making a new group; no k > 8 can be surrounded by k 1s */
+    if (unused >= k && k <= 8 && h.type <= 1) {
         int next_unused = unused - k;
         grouplist_t *gl = group_seed(k);
         int start_index = (h.type == 1) ? h.index : 0;
         oh->type = 1;
         for (int i = start_index; i < gl->count; ++i) {
             oh->index = i;
-            if (groups) {
-                recurse(b, next_unused, g0, gl->g[i]);
-            } else {
-                recurse(b, next_unused, gl->g[i], (group_t *)NULL);
-            }
+            recurse(b, next_unused, with_group(b, ng, groups, gl->g[i]), ng);
         }
         /* seed lists are persistent */
         /* free_grouplist(gl); */
@@ -294,11 +545,9 @@ void try_board(board_t *b) {
                         oh->type = 2;
                         oh->l1.x = xi;
                         oh->l1.y = yi;
-                        if (ig) {
-                            recurse(b, unused, g0, gn);
-                        } else {
-                            recurse(b, unused, gn, g1);
-                        }
+                        recurse(b, unused, with_group(b, ng, ig, gn), ng);
+                        if (sub_done)
+                            return;
                     } else {
                         int next_unused = unused - diff;
                         grouplist_t *gl = group_place_with(
@@ -309,20 +558,19 @@ void try_board(board_t *b) {
                         oh->l1.y = yi;
                         for (int p = p_start; p < gl->count; ++p) {
                             oh->index = p;
-                            if (ig) {
-                                recurse(b, next_unused, g0, gl->g[p]);
-                            } else {
-                                recurse(b, next_unused, gl->g[p], g1);
-                            }
+                            recurse(b, next_unused,
+                                    with_group(b, ng, ig, gl->g[p]), ng);
                         }
                         free_grouplist(gl);
+                        if (sub_done)
+                            return;
                     }
                 }
             }
         }
 
         /* try by coalesce */
-        for (int jg = ig + 1; jg < groups; ++jg) {
+        for (int jg = ig + 1; h.type <= 4 && jg < groups; ++jg) {
             group_t *gj = b->group[jg];
             int *headsj = gj->sum_heads;
             int *chainsj = gj->sum_chains;
@@ -363,17 +611,34 @@ void try_board(board_t *b) {
                             grouplist_t *gl = coalesce_group(
                                 gi, li, gj, lj, k, use
                             );
+                            int cidx[2] = { ig, jg };
                             oh->l2.x = lj.x;
                             oh->l2.y = lj.y;
                             for (int p = p_start; p < gl->count; ++p) {
                                 oh->index = p;
-                                recurse(b, next_unused, gl->g[p], (group_t *)NULL);
+                                recurse(b, next_unused,
+                                        with_coalesced(b, ng, 2, cidx, gl->g[p]),
+                                        ng);
                             }
                             free_grouplist(gl);
+                            if (sub_done)
+                                return;
                         }
                     }
                 }
             }
         }
+
+        /* try by coalescing 3 or more groups, with this the first of them */
+        for (int m = 3; m <= MAXCOALESCE && ig + m <= groups; ++m) {
+            if (h.type == 5 && h.count != m)
+                continue;
+            oh->type = 5;
+            oh->count = m;
+            oh->gidx[0] = ig;
+            coalesce_multi(b, &h, oh, 0, 0);
+            if (sub_done)
+                return;
+        }
     }
 }
@@ -3,12 +3,16 @@
 
 #include "group.h"
 
+/* new groups need k 1s around a value k, for distinct k in 2 .. 8 */
+#define MAXGROUPS 7
+
 typedef struct board_s {
     int k;
     int unused;
     int refcount;
     int groups;
-    group_t *group[2];
+    struct board_s *next;   /* when in the free pool */
+    group_t *group[MAXGROUPS];
 } board_t;
 
 extern int best_k;
@@ -17,8 +21,10 @@ extern unsigned long board_count;
 
 extern board_t *init_board(int n, int freq, char *start_hist);
 extern void finish_board(void);
-extern board_t *new_board(int k, int unused, group_t *g0, group_t *g1);
+extern board_t *new_board(int k, int unused, int groups, group_t **group);
 extern void try_board(board_t *b);
+extern void split_board(int split, void (*fn)(char *hist));
+extern unsigned long try_subtree(int job, char *hist, int *best);
 extern void print_board(board_t *b);
 
 #endif
@@ -31,58 +31,202 @@ seed_t seed_base[9] = {
     { 1, { 0777 } }
 };
 
+/*
+ * Each group is held in a single block, with its arrays following the
+ * struct. Blocks are recycled through free lists by size class, in
+ * steps of POOL_STEP bytes, rather than returned to malloc.
+ */
+#define POOL_STEP 64
+typedef struct pool_s {
+    struct pool_s *next;
+} pool_t;
+pool_t **group_pool = NULL;
+int group_pools = 0;
+
+/*
+ * Placement results are hash-consed: intern_group() returns the existing
+ * group if there is one with the same shape, symmetries and vals. They
+ * are held in a chained hash table of group_tsize (a power of 2) buckets.
+ */
+group_t **group_table = NULL;
+int group_tsize = 0;
+int group_tcount = 0;
+unsigned long group_serial = 0;
+
+/*
+ * Recent results of group_place_with(), indexed by a hash of the
+ * arguments; each holds a reference to its grouplist. Since groups are
+ * hash-consed, the placements of a group found again in a sibling board
+ * are found here.
+ */
+#define PLACE_CACHE 4096        /* entries; a power of 2 */
+typedef struct place_s {
+    unsigned long id;           /* of the group placed into, 0 if unused */
+    loc_t loc;
+    int k;
+    int use;
+    grouplist_t *gl;
+} place_t;
+place_t place_cache[PLACE_CACHE];
+
+/* Scratch space for the vals of a group under construction, and
+ * for the sums new_group() works out from them */
+typedef struct scratch_s {
+    int size;
+    int *ints;
+} scratch_t;
+scratch_t scratch_vals = { 0, NULL };
+scratch_t scratch_sums = { 0, NULL };
+
 void init_group(void) {
     return;
 }
 
 void finish_group(void) {
+    for (int i = 0; i < PLACE_CACHE; ++i)
+        if (place_cache[i].id) {
+            free_grouplist(place_cache[i].gl);
+            place_cache[i].id = 0;
+        }
     for (int i = 0; i <= 8; ++i)
-        if (cache_seed[i])
+        if (cache_seed[i]) {
             free_grouplist(cache_seed[i]);
+            cache_seed[i] = NULL;
+        }
+    free(group_table);
+    group_table = NULL;
+    group_tsize = group_tcount = 0;
+    for (int i = 0; i < group_pools; ++i)
+        while (group_pool[i]) {
+            pool_t *p = group_pool[i];
+            group_pool[i] = p->next;
+            free(p);
+        }
+    free(group_pool);
+    group_pool = NULL;
+    group_pools = 0;
+    free(scratch_vals.ints);
+    free(scratch_sums.ints);
+    scratch_vals = scratch_sums = (scratch_t){ 0, NULL };
+}
+
+/*
+ * Return a zeroed scratch array of at least 'size' ints, valid until
+ * the next call for the same scratch space.
+ */
+static int *scratch_ints(scratch_t *sc, int size) {
+    if (size > sc->size) {
+        free(sc->ints);
+        sc->size = size * 2;
+        sc->ints = malloc(sc->size * sizeof(int));
+    }
+    memset(sc->ints, 0, size * sizeof(int));
+    return sc->ints;
+}
+
+/*
+ * Return a block of at least 'size' bytes from the pool, setting *pool
+ * to the size class it should be returned to.
+ */
+static void *pool_get(size_t size, int *pool) {
+    int class = (size + POOL_STEP - 1) / POOL_STEP;
+
+    *pool = class;
+    if (class < group_pools && group_pool[class]) {
+        pool_t *p = group_pool[class];
+        group_pool[class] = p->next;
+        return p;
+    }
+    return malloc(class * POOL_STEP);
+}
+
+static void pool_put(void *block, int class) {
+    pool_t *p = (pool_t *)block;
+
+    if (class >= group_pools) {
+        int size = class * 2;
+        group_pool = realloc(group_pool, size * sizeof(pool_t *));
+        memset(&group_pool[group_pools], 0,
+                (size - group_pools) * sizeof(pool_t *));
+        group_pools = size;
+    }
+    p->next = group_pool[class];
+    group_pool[class] = p;
+}
+
+static unsigned int group_hash(int x, int y, int sym, int *vals) {
+    unsigned int h = 2166136261u;
+
+    h = (h ^ x) * 16777619u;
+    h = (h ^ y) * 16777619u;
+    h = (h ^ sym) * 16777619u;
+    for (int i = 0; i < x * y; ++i)
+        h = (h ^ vals[i]) * 16777619u;
+    return h;
+}
+
+static void group_table_add(group_t *g) {
+    if (group_tcount >= group_tsize) {
+        int size = group_tsize ? group_tsize * 2 : 1024;
+        group_t **table = calloc(size, sizeof(group_t *));
+        for (int i = 0; i < group_tsize; ++i)
+            while (group_table[i]) {
+                group_t *h = group_table[i];
+                group_table[i] = h->hnext;
+                h->hnext = table[h->hash & (size - 1)];
+                table[h->hash & (size - 1)] = h;
+            }
+        free(group_table);
+        group_table = table;
+        group_tsize = size;
+    }
+    g->hnext = group_table[g->hash & (group_tsize - 1)];
+    group_table[g->hash & (group_tsize - 1)] = g;
+    ++group_tcount;
+}
+
+static void group_table_del(group_t *g) {
+    group_t **hp = &group_table[g->hash & (group_tsize - 1)];
+
+    while (*hp != g)
+        hp = &(*hp)->hnext;
+    *hp = g->hnext;
+    --group_tcount;
 }
 
 /*
  * Allocate and initialize a new group struct with the supplied details.
+ * 'vals' is copied, and remains owned by the caller.
  *
  * Initial refcount is zero; caller is expected to give it its initial
- * increment; on decrement to 0 both the group struct and 'vals' will
- * be freed.
+ * increment; on decrement to 0 the group will be freed.
  */
 group_t *new_group(int x, int y, int sym, int* vals) {
-    group_t *g = malloc(sizeof(group_t));
+    int size = (x + 2) * (y + 2);
     int maxsum = 0;
-
-    g->x = x;
-    g->y = y;
-    g->sym = sym;
-    g->vals = vals;
-    g->tvals = (int **)NULL;
-    /* caller will increment; freed on decrement to zero */
-    g->refcount = 0;
-
     /* initialise to AVAIL = 0 */
-    g->avail = calloc((x + 2) * (y + 2), sizeof(avail_t));
-    g->tavail = (avail_t**)NULL;
+    int *sums = scratch_ints(&scratch_sums, size * 2);
+    avail_t *avail = (avail_t *)&sums[size];
+
     for (int i = 0; i < x; ++i)
         for (int j = 0; j < y; ++j)
-            if (g->vals[i * y + j])
-                g->avail[(i + 1) * (y + 2) + (j + 1)] = USED;
+            if (vals[i * y + j])
+                avail[(i + 1) * (y + 2) + (j + 1)] = USED;
 
-    g->sum_chains = calloc((x + 2) * (y + 2), sizeof(int));
     for (int i = 0; i < x; ++i)
         for (int j = 0; j < y; ++j) {
-            int v = g->vals[i * y + j];
+            int v = vals[i * y + j];
             if (v == 0)
                 continue;
             for (int di = 0; di < 3; ++di)
                 for (int dj = 0; dj < 3; ++dj) {
                     int off = (i + di) * (y + 2) + (j + dj);
-                    if (v > 1 && g->avail[off] == AVAIL)
-                        g->avail[off] = RES;
-                    if (g->avail[off] != USED) {
-                        g->sum_chains[off] += v;
-                        if (g->sum_chains[off] > maxsum)
-                            maxsum = g->sum_chains[off];
+                    if (v > 1 && avail[off] == AVAIL)
+                        avail[off] = RES;
+                    if (avail[off] != USED) {
+                        sums[off] += v;
+                        if (sums[off] > maxsum)
+                            maxsum = sums[off];
                     }
                 }
         }
@@ -95,21 +239,43 @@ group_t *new_group(int x, int y, int sym, int* vals) {
                 for (int j = -1; j < y + 1; ++j) {
                     loc_t l = sym_transloc(s, x, y, (loc_t){ i, j });
                     if (l.x * (y + 2) + l.y < i * (y + 2) + j)
-                        g->sum_chains[(i + 1) * (y + 2) + (j + 1)] = 0;
+                        sums[(i + 1) * (y + 2) + (j + 1)] = 0;
                 }
         }
 
+    /* now we know the size, lay out the group and its arrays in one block */
+    int pool;
+    group_t *g = pool_get(sizeof(group_t) + size * sizeof(avail_t)
+            + (x * y + size + maxsum + 1) * sizeof(int), &pool);
+
+    g->x = x;
+    g->y = y;
+    g->sym = sym;
     g->maxsum = maxsum;
-    g->sum_heads = malloc((maxsum + 1) * sizeof(int));
+    g->pool = pool;
+    g->id = ++group_serial;
+    g->hash = 0;
+    g->interned = 0;
+    g->canon = 0;
+    /* caller will increment; freed on decrement to zero */
+    g->refcount = 0;
+    g->vals = (int *)&g[1];
+    g->avail = (avail_t *)&g->vals[x * y];
+    g->sum_chains = (int *)&g->avail[size];
+    g->sum_heads = &g->sum_chains[size];
+    g->tvals = (int **)NULL;
+    g->tavail = (avail_t**)NULL;
+    memcpy(g->vals, vals, x * y * sizeof(int));
+    memcpy(g->avail, avail, size * sizeof(avail_t));
     memset(g->sum_heads, 0xff, (maxsum + 1) * sizeof(int));
 
     /* Walk backwards turning the actual sums into linked lists headed by
      * sum_heads[sum]. We mask out USED and zero locations.
      * FIXME: should also mask out symmetries
      */
-    for (int i = (x + 2) * (y + 2) - 1; i >= 0; --i) {
-        int sum = g->sum_chains[i];
-        if (sum == 0 || g->avail[i] == USED) {
+    for (int i = size - 1; i >= 0; --i) {
+        int sum = sums[i];
+        if (sum == 0 || avail[i] == USED) {
             g->sum_chains[i] = -1;
         } else {
             g->sum_chains[i] = g->sum_heads[sum];
@@ -120,6 +286,100 @@ group_t *new_group(int x, int y, int sym, int* vals) {
     return g;
 }
 
+/*
+ * As new_group(), but return the existing group if there is a live
+ * one with the same details that was also made by intern_group().
+ */
+group_t *intern_group(int x, int y, int sym, int* vals) {
+    unsigned int hash = group_hash(x, y, sym, vals);
+    group_t *g;
+
+    if (group_tsize)
+        for (g = group_table[hash & (group_tsize - 1)]; g; g = g->hnext)
+            if (g->hash == hash && g->x == x && g->y == y && g->sym == sym
+                && !memcmp(g->vals, vals, x * y * sizeof(int))
+            )
+                return g;
+
+    g = new_group(x, y, sym, vals);
+    g->hash = hash;
+    g->interned = 1;
+    group_table_add(g);
+    return g;
+}
+
+static unsigned long canon_mix(long x, long y, long v) {
+    unsigned long h = (x << 42) ^ (y << 21) ^ v;
+
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ul;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebul;
+    h ^= h >> 31;
+    return h;
+}
+
+/*
+ * Return a hash of the group that is the same for all its transforms:
+ * the least over the symmetries of an order-free hash of the shape and
+ * nonzero values. Cached in the group.
+ */
+unsigned long group_canon(group_t *g) {
+    int x = g->x, y = g->y, xm = x - 1, ym = y - 1;
+    unsigned long h[MAXSYM + 1], min;
+
+    if (g->canon)
+        return g->canon;
+    for (sym_t s = 0; s <= MAXSYM; ++s)
+        h[s] = is_transpose(s) ? canon_mix(y, x, -1) : canon_mix(x, y, -1);
+    for (int i = 0; i < x; ++i)
+        for (int j = 0; j < y; ++j) {
+            int v = g->vals[i * y + j];
+            if (!v)
+                continue;
+            /* as sym_transloc() */
+            h[xy] += canon_mix(i, j, v);
+            h[xY] += canon_mix(i, ym - j, v);
+            h[Xy] += canon_mix(xm - i, j, v);
+            h[XY] += canon_mix(xm - i, ym - j, v);
+            h[yx] += canon_mix(j, i, v);
+            h[yX] += canon_mix(j, xm - i, v);
+            h[Yx] += canon_mix(ym - j, i, v);
+            h[YX] += canon_mix(ym - j, xm - i, v);
+        }
+    min = h[0];
+    for (sym_t s = 1; s <= MAXSYM; ++s)
+        if (min > h[s])
+            min = h[s];
+    g->canon = min ? min : 1;
+    return g->canon;
+}
+
+/*
+ * Return TRUE if group 'b' is one of the transforms of group 'a', by
+ * exact comparison of shape and values.
+ */
+int group_same(group_t *a, group_t *b) {
+    if (a == b)
+        return 1;
+    if (group_canon(a) != group_canon(b))
+        return 0;
+    for (sym_t s = 0; s <= MAXSYM; ++s) {
+        int same = 1;
+        if (is_transpose(s) ? (a->y != b->x || a->x != b->y)
+                : (a->x != b->x || a->y != b->y))
+            continue;
+        for (int i = 0; same && i < a->x; ++i)
+            for (int j = 0; same && j < a->y; ++j) {
+                loc_t l = sym_transloc(s, a->x, a->y, (loc_t){ i, j });
+                same = (a->vals[i * a->y + j] == b->vals[l.x * b->y + l.y]);
+            }
+        if (same)
+            return 1;
+    }
+    return 0;
+}
+
 /*
  * Increment the refcount of the group.
  */
@@ -132,38 +392,41 @@ void ref_group(group_t *g) {
  */
 void unref_group(group_t *g) {
     if (--g->refcount == 0) {
-        free(g->vals);
         if (g->tvals) {
             for (int i = 1; i <= MAXSYM; ++i)
                 free(g->tvals[i]);
             free(g->tvals);
         }
-        free(g->avail);
         if (g->tavail) {
             for (int i = 1; i <= MAXSYM; ++i)
                 free(g->tavail[i]);
             free(g->tavail);
         }
-        free(g->sum_heads);
-        free(g->sum_chains);
-        free(g);
+        if (g->interned)
+            group_table_del(g);
+        pool_put(g, g->pool);
     }
 }
 
 /*
  * Allocate a grouplist of the specified size; set the size to 'size'.
+ * The refcount is initialised to 1.
  */
 grouplist_t *new_grouplist(int size) {
     grouplist_t *gl = malloc(sizeof(grouplist_t) + size * sizeof(group_t *));
     gl->count = size;
+    gl->refcount = 1;
     memset(&gl->g[0], 0, size * sizeof(group_t *));
     return gl;
 }
 
 /*
- * Free the grouplist, and dereference any groups within it.
+ * Decrement the refcount of the grouplist; if it hits zero free it, and
+ * dereference any groups within it.
  */
 void free_grouplist(grouplist_t *gl) {
+    if (--gl->refcount > 0)
+        return;
     for (int i = 0; i < gl->count; ++i)
         unref_group(gl->g[i]);
     free(gl);
@@ -241,7 +504,7 @@ avail_t *trans_avail(group_t *g, sym_t s) {
  * which is freed via finish_group().
  */
 group_t *group_seedbits(int k, int bits) {
-    int *vals = malloc(sizeof(int) * 9);
+    int vals[9];
     int x = 3, y = 3, sym = 0, x0 = 0, y0 = 0;
     group_t *g;
 
@@ -326,7 +589,7 @@ group_t *group_place(group_t *g, loc_t loc, int k) {
     if (loc.y >= y)
         ++y;
 
-    vals = calloc(x * y, sizeof(int));
+    vals = scratch_ints(&scratch_vals, x * y);
     for (int i = 0; i < g->x; ++i)
         for (int j = 0; j < g->y; ++j)
             vals[(i + x0) * y + (j + y0)] = g->vals[i * g->y + j];
@@ -344,11 +607,9 @@ int _comb(int n, int d) {
 }
 
 /*
- * Construct and return a grouplist of the new groups formed by adding
- * a new value k at the specified location in this group, along with
- * 'use' 1s in any of the 8 surrounding squares that are available.
+ * Construct the grouplist for group_place_with().
  */
-grouplist_t *group_place_with(group_t *g, loc_t loc, int k, int use) {
+static grouplist_t *place_with(group_t *g, loc_t loc, int k, int use) {
     int maxcount;
     grouplist_t *result;
     int ri = 0;
@@ -408,7 +669,7 @@ grouplist_t *group_place_with(group_t *g, loc_t loc, int k, int use) {
         if (ymax >= g->y)
             y += ymax + 1 - g->y;
 
-        int *vals = calloc(x * y, sizeof(int));
+        int *vals = scratch_ints(&scratch_vals, x * y);
         for (int i = 0; i < g->x; ++i)
             for (int j = 0; j < g->y; ++j)
                 vals[(i + x0) * y + (j + y0)] = g->vals[i * g->y + j];
@@ -430,7 +691,7 @@ grouplist_t *group_place_with(group_t *g, loc_t loc, int k, int use) {
         if (maybe & 0b00000001)
             vals[(loc.x + x0 + 1) * y + (loc.y + y0 + 1)] = 1;
 
-        result->g[ri] = new_group(x, y, 0, vals);
+        result->g[ri] = intern_group(x, y, 0, vals);
         ref_group(result->g[ri++]);
     }
     if (ri < maxcount)
@@ -440,204 +701,372 @@ grouplist_t *group_place_with(group_t *g, loc_t loc, int k, int use) {
 
 /*
  * Construct and return a grouplist of the new groups formed by adding
- * a new value k at a common point connecting two existing groups, such
- * that the location of that point is as specified for each of the two
- * groups, along with 'use' 1s in any of the 8 surrounding squares that
- * are available.
+ * a new value k at the specified location in this group, along with
+ * 'use' 1s in any of the 8 surrounding squares that are available.
  *
- * All relevant symmetries of the two groups are considered, and the
- * results include only those combinations that allowed the two groups
- * to be combined according to location availability checks.
+ * The result may be shared with the placement cache: the caller should
+ * only release it with free_grouplist().
  */
-grouplist_t *coalesce_group(
-    group_t *ga, loc_t la, group_t *gb, loc_t lb, int k, int use
-) {
-    int ax = ga->x, ay = ga->y;
-    int bx = gb->x, by = gb->y;
-    int afree = 0, aneed = 0, bfree = 0, bneed = 0;
-    int maxavail, maxcombs;
+grouplist_t *group_place_with(group_t *g, loc_t loc, int k, int use) {
+    unsigned int h = (g->id * 0x9e3779b97f4a7c15ul) >> 40;
+    place_t *pc;
+
+    h = (h ^ (loc.x + 1)) * 16777619u;
+    h = (h ^ (loc.y + 1)) * 16777619u;
+    h = (h ^ (k << 4 | use)) * 16777619u;
+    pc = &place_cache[h & (PLACE_CACHE - 1)];
+    if (pc->id == g->id && pc->loc.x == loc.x && pc->loc.y == loc.y
+        && pc->k == k && pc->use == use
+    ) {
+        ++pc->gl->refcount;
+        return pc->gl;
+    }
+
+    if (pc->id)
+        free_grouplist(pc->gl);
+    pc->id = g->id;
+    pc->loc = loc;
+    pc->k = k;
+    pc->use = use;
+    pc->gl = place_with(g, loc, k, use);
+    ++pc->gl->refcount;
+    return pc->gl;
+}
+
+/*
+ * State for coalesce_groups() while it tries each combination of
+ * transforms of the groups after the first.
+ */
+typedef struct coalesce_s {
+    int count;
+    group_t **g;
+    loc_t *l;
+    int k;
+    int use;
+    /* rep[j][s] is the least transform placing group j as s does */
+    sym_t rep[MAXCOALESCE][MAXSYM + 1];
+    sym_t stab[MAXSYM];             /* symmetries of g[0] fixing l[0] but xy */
+    int nstab;
+    sym_t same[MAXSYM];             /* those that also fix the chosen s[] */
+    int nsame;
+    int free[MAXCOALESCE];          /* packed 3x3 masks as found */
+    int need[MAXCOALESCE];
+    sym_t s[MAXCOALESCE];           /* transform chosen for each group */
+    int tfree[MAXCOALESCE];         /* masks under the chosen transform */
+    int tneed[MAXCOALESCE];
     grouplist_t *result;
-    int ri = 0;
-    int axmin = -la.x, axmax = ax - la.x, aymin = -la.y, aymax = ay - la.y;
-    sym_t reflect;
+    int ri;
+} coalesce_t;
 
-    /* first look at the 3x3 square around the common location, to see
-     * if the two groups can in principle fit together around there
-     * _and_ leave room for an additional 'use' 1s/
-     */
-    for (int i = 0; i < 3; ++i)
-        for (int j = 0; j < 3; ++j) {
-            if (i == 1 && j == 1)
-                continue;
-            afree <<= 1;
-            aneed <<= 1;
-            bfree <<= 1;
-            bneed <<= 1;
-            if (la.x + i < 0 || la.x + i >= ax + 2
-                || la.y + j < 0 || la.y + j >= ay + 2
-            ) {
-                afree |= 1;
-            } else {
-                avail_t a = ga->avail[(la.x + i) * (ay + 2) + (la.y + j)];
-                if (a == AVAIL)
-                    afree |= 1;
-                else if (a == USED)
-                    aneed |= 1;
-            }
-            if (lb.x + i < 0 || lb.x + i >= bx + 2
-                || lb.y + j < 0 || lb.y + j >= by + 2
-            ) {
-                bfree |= 1;
-            } else {
-                avail_t a = gb->avail[(lb.x + i) * (by + 2) + (lb.y + j)];
-                if (a == AVAIL)
-                    bfree |= 1;
-                else if (a == USED)
-                    bneed |= 1;
+/*
+ * With a transform chosen for every group and their 3x3 squares known
+ * to fit around the common location leaving the spots 'tfree', try the
+ * full superimposition, and add to the results each way of placing k
+ * and 'use' 1s if the groups do not clash.
+ */
+static void coalesce_place(coalesce_t *c, int tfree) {
+    int *tvals[MAXCOALESCE];
+    loc_t lt[MAXCOALESCE];
+    int tx[MAXCOALESCE], ty[MAXCOALESCE];
+    int xmin = 0, xmax = 1, ymin = 0, ymax = 1;
+
+    for (int j = 0; j < c->count; ++j) {
+        group_t *g = c->g[j];
+        bool trans = is_transpose(c->s[j]);
+        tvals[j] = j ? trans_vals(g, c->s[j]) : g->vals;
+        lt[j] = sym_transloc(c->s[j], g->x, g->y, c->l[j]);
+        tx[j] = trans ? g->y : g->x;
+        ty[j] = trans ? g->x : g->y;
+        if (xmin > -lt[j].x)
+            xmin = -lt[j].x;
+        if (xmax < tx[j] - lt[j].x)
+            xmax = tx[j] - lt[j].x;
+        if (ymin > -lt[j].y)
+            ymin = -lt[j].y;
+        if (ymax < ty[j] - lt[j].y)
+            ymax = ty[j] - lt[j].y;
+    }
+
+    int cx = xmax - xmin, cy = ymax - ymin;
+    loc_t lc = (loc_t){ -xmin, -ymin };
+    int *cvals = calloc(cx * cy, sizeof(int));
+    int ok = 1;
+
+    for (int j = 0; ok && j < c->count; ++j) {
+        int dx = -lt[j].x - xmin, dy = -lt[j].y - ymin;
+        for (int i = 0; ok && i < tx[j]; ++i)
+            for (int jj = 0; jj < ty[j]; ++jj) {
+                int v = tvals[j][i * ty[j] + jj];
+                int *cv = &cvals[(i + dx) * cy + (jj + dy)];
+                if (!v)
+                    continue;
+                if (*cv) {
+                    ok = 0;
+                    break;
+                }
+                *cv = v;
             }
-        }
+    }
 
-    if (bitcount[afree] < bitcount[bneed] + use
-        || bitcount[bfree] < bitcount[aneed] + use
-    )
-        return new_grouplist(0);
+    if (ok) {
+        pack_set_t *maybes = &pack_set[c->use];
+        for (int i = 0; i < maybes->count; ++i) {
+            int maybe = maybes->set[i];
+            /* skip if it requires spots we don't have */
+            if (maybe & ~tfree)
+                continue;
+            /* skip if a symmetry of the whole gives one we've already taken */
+            int dup = 0;
+            for (int r = 0; r < c->nsame; ++r)
+                if (sym_lookup(c->same[r])[maybe] < maybe)
+                    dup = 1;
+            if (dup)
+                continue;
 
-    /* prepare a space big enough for the maximum possible number of results */
-    maxavail = (
-        bitcount[afree] - bitcount[bneed] < bitcount[bfree] - bitcount[aneed]
-    )
-        ? bitcount[afree] - bitcount[bneed]
-        : bitcount[bfree] - bitcount[aneed];
-    maxcombs = _comb(maxavail, use);
-    result = new_grouplist((MAXSYM + 1) * maxcombs);
+            int fx = cx, fy = cy;
+            int fx0 = 0, fy0 = 0;
+            int fxmin = (maybe & 0b11100000) ? lc.x - 1 : lc.x;
+            int fxmax = (maybe & 0b00000111) ? lc.x + 1 : lc.x;
+            int fymin = (maybe & 0b10010100) ? lc.y - 1 : lc.y;
+            int fymax = (maybe & 0b00101001) ? lc.y + 1 : lc.y;
+            if (fxmin < 0)
+                fx -= fxmin, fx0 -= fxmin;
+            if (fxmax >= cx)
+                fx += fxmax + 1 - cx;
+            if (fymin < 0)
+                fy -= fymin, fy0 -= fymin;
+            if (fymax >= cy)
+                fy += fymax + 1 - cy;
+            loc_t lf = (loc_t){ lc.x + fx0, lc.y + fy0 };
 
-    /* check if the first group's location is on a line of reflection */
-    reflect = sym_reflect(ga->sym, ax, ay, la);
+            int *fvals = scratch_ints(&scratch_vals, fx * fy);
+            for (int i = 0; i < cx; ++i)
+                for (int j = 0; j < cy; ++j)
+                    fvals[(i + fx0) * fy + (j + fy0)] = cvals[i * cy + j];
+            fvals[lf.x * fy + lf.y] = c->k;
+            if (maybe & 0b10000000)
+                fvals[(lf.x - 1) * fy + (lf.y - 1)] = 1;
+            if (maybe & 0b01000000)
+                fvals[(lf.x - 1) * fy + (lf.y    )] = 1;
+            if (maybe & 0b00100000)
+                fvals[(lf.x - 1) * fy + (lf.y + 1)] = 1;
+            if (maybe & 0b00010000)
+                fvals[(lf.x    ) * fy + (lf.y - 1)] = 1;
+            if (maybe & 0b00001000)
+                fvals[(lf.x    ) * fy + (lf.y + 1)] = 1;
+            if (maybe & 0b00000100)
+                fvals[(lf.x + 1) * fy + (lf.y - 1)] = 1;
+            if (maybe & 0b00000010)
+                fvals[(lf.x + 1) * fy + (lf.y    )] = 1;
+            if (maybe & 0b00000001)
+                fvals[(lf.x + 1) * fy + (lf.y + 1)] = 1;
 
-    /* Now for each transform of gb, check first whether its 3x3 square can
-     * be placed over ga's without conflict, and still leaving enough free
-     * spots for us to add 'use' 1s. If it can, try the full monty.
-     */
-    for (int s = 0; s <= MAXSYM; ++s) {
-        /* if this transform is a symmetry of the group _and_ the location
-         * is invariant under the symmetry, we've already checked it.
-         */
-        if ((gb->sym & (1 << s)) && sym_checkloc(s, bx, by, lb))
-            continue;
+            c->result->g[c->ri] = new_group(fx, fy, 0, fvals);
+            ref_group(c->result->g[c->ri++]);
+        }
+    }
+    free(cvals);
+}
 
-        /* if the shared location is on a line of symmetry of the other group,
-         * check this symmetry on this group only if it is canonical under
-         * that symmetry on the other group.
-         */
-        if (reflect && sym_dup(reflect, s))
-            continue;
+/*
+ * Composing every transform with a symmetry of the first group that
+ * fixes the common location gives the same combination; return true if
+ * any such symmetry maps the transforms chosen for the first n groups to
+ * ones that sort lower. Those mapping them to themselves are recorded
+ * in c->same.
+ */
+static bool coalesce_dup(coalesce_t *c, int n) {
+    c->nsame = 0;
+    for (int r = 0; r < c->nstab; ++r) {
+        int j;
+        for (j = 1; j < n; ++j) {
+            sym_t t = c->rep[j][sym_compose(c->stab[r], c->s[j])];
+            if (t < c->s[j])
+                return 1;
+            if (t > c->s[j])
+                break;
+        }
+        if (j == n)
+            c->same[c->nsame++] = c->stab[r];
+    }
+    return 0;
+}
+
+/*
+ * Try each transform of group j that can be superimposed on the groups
+ * before it around the common location, then recurse for the next group.
+ */
+static void coalesce_fit(coalesce_t *c, int j) {
+    if (j == c->count || j == MAXCOALESCE) {
+        int tfree = 0xff, tneed = 0;
+        for (int i = 0; i < c->count; ++i) {
+            tfree &= c->tfree[i];
+            tneed |= c->tneed[i];
+        }
+        tfree &= ~tneed;
+        /* superimposed, must have 'use' spare spots available */
+        if (bitcount[tfree] >= c->use)
+            coalesce_place(c, tfree);
+        return;
+    }
 
-        /* if the shared location is on the same line of reflection of
-         * both groups, could deduplicate asymmetric placement of 1s using
-         * the same 'if (refset[maybe] < maybe)' logic as group_place_with.
-         * TODO - need something like:
-         *    breflect = sym_reflect(gb->sym, bx, by, lb)
-         *    treflect = sym_combine(breflect, s)
-         *    refset = sym_lookup(areflect == treflect ? areflect : 0)
+    for (sym_t s = 0; s <= MAXSYM; ++s) {
+        /* if this transform composed with a symmetry of the group that
+         * fixes its location gives a lower one, we've already checked it.
          */
+        if (c->rep[j][s] != s)
+            continue;
 
         int *slookup = sym_lookup(s);
-        int btfree = slookup[bfree];
-        int btneed = slookup[bneed];
+        int tfree = slookup[c->free[j]];
+        int tneed = slookup[c->need[j]];
+        int clash = 0;
 
-        /* must be able to superimpose without conflict */
-        if ((aneed & ~btfree) || (btneed & ~afree))
+        /* must be able to superimpose on each earlier group without conflict */
+        for (int i = 0; i < j; ++i)
+            if ((c->tneed[i] & ~tfree) || (tneed & ~c->tfree[i]))
+                clash = 1;
+        if (clash)
             continue;
 
-        int tfree = afree & btfree & ~aneed & ~btneed;
-        /* superimposed, must have 'use' spare spots available */
-        if (bitcount[tfree] < use)
+        c->s[j] = s;
+        if (coalesce_dup(c, j + 1))
             continue;
+        c->tfree[j] = tfree;
+        c->tneed[j] = tneed;
+        coalesce_fit(c, j + 1);
+    }
+}
 
-        int *tvals = trans_vals(gb, s);
-        loc_t lt = sym_transloc(s, bx, by, lb);
-        bool trans = is_transpose(s);
-        int tx = trans ? by : bx, ty = trans ? bx : by;
-        int txmin = -lt.x, txmax = tx - lt.x;
-        int tymin = -lt.y, tymax = ty - lt.y;
-        int xmin = (axmin < txmin) ? axmin : txmin;
-        int xmax = (axmax > txmax) ? axmax : txmax;
-        int ymin = (aymin < tymin) ? aymin : tymin;
-        int ymax = (aymax > tymax) ? aymax : tymax;
-        int dax = axmin - xmin, day = aymin - ymin;
-        int dtx = txmin - xmin, dty = tymin - ymin;
-        int cx = xmax - xmin, cy = ymax - ymin;
-        loc_t lc = (loc_t){ la.x + dax, la.y + day };
-        int *cvals = calloc(cx * cy, sizeof(int));
-        int ok = 1;
-
-        for (int i = 0; ok && i < cx; ++i)
-            for (int j = 0; ok && j < cy; ++j) {
-                bool ba = (i >= dax && i <= dax + ax - 1
-                    && j >= day && j <= day + ay - 1);
-                bool bt = (i >= dtx && i <= dtx + tx - 1
-                    && j >= dty && j <= dty + ty - 1);
-                int va = ba ? ga->vals[(i - dax) * ay + (j - day)] : 0;
-                int vt = bt ? tvals[(i - dtx) * ty + (j - dty)] : 0;
-                if (va && vt) {
-                    ok = 0;
-                    break;
+/*
+ * Construct and return a grouplist of the new groups formed by adding
+ * a new value k at a common point connecting 'count' (2 to MAXCOALESCE)
+ * existing groups, such that the location of that point is l[i] for
+ * group g[i], along with 'use' 1s in any of the 8 surrounding squares
+ * that are available.
+ *
+ * The first group is held fixed, and all relevant symmetries of each of
+ * the others are considered; the results include only those combinations
+ * that allowed all the groups to be combined according to location
+ * availability checks, and each combination only once.
+ */
+grouplist_t *coalesce_groups(int count, group_t **g, loc_t *l, int k, int use) {
+    coalesce_t c;
+    int maxavail = 8, maxcombs, combos = 1;
+
+    if (count < 2 || count > MAXCOALESCE) {
+        fprintf(stderr, "Error: coalesce_groups(%d) called\n", count);
+        exit(1);
+    }
+    c.count = count;
+    c.g = g;
+    c.l = l;
+    c.k = k;
+    c.use = use;
+
+    /* first look at the 3x3 square around the common location, to see
+     * if the groups can in principle fit together around there _and_
+     * leave room for an additional 'use' 1s.
+     */
+    for (int n = 0; n < count; ++n) {
+        group_t *gn = g[n];
+        int free = 0, need = 0;
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 3; ++j) {
+                if (i == 1 && j == 1)
+                    continue;
+                free <<= 1;
+                need <<= 1;
+                if (l[n].x + i < 0 || l[n].x + i >= gn->x + 2
+                    || l[n].y + j < 0 || l[n].y + j >= gn->y + 2
+                ) {
+                    free |= 1;
+                } else {
+                    avail_t a = gn->avail[
+                        (l[n].x + i) * (gn->y + 2) + (l[n].y + j)
+                    ];
+                    if (a == AVAIL)
+                        free |= 1;
+                    else if (a == USED)
+                        need |= 1;
                 }
-                cvals[i * cy + j] = va ? va : vt;
             }
+        c.free[n] = free;
+        c.need[n] = need;
+    }
 
-        if (ok) {
-            pack_set_t *maybes = &pack_set[use];
-            for (int i = 0; i < maybes->count; ++i) {
-                int maybe = maybes->set[i];
-                /* skip if it requires spots we don't have */
-                if (maybe & ~tfree)
-                    continue;
+    /* every other group's needed spots must fit in each group's free ones */
+    for (int n = 0; n < count; ++n) {
+        int others = 0;
+        for (int m = 0; m < count; ++m)
+            if (m != n)
+                others += bitcount[c.need[m]];
+        if (bitcount[c.free[n]] < others + use)
+            return new_grouplist(0);
+        if (maxavail > bitcount[c.free[n]] - others)
+            maxavail = bitcount[c.free[n]] - others;
+    }
 
-                int fx = cx, fy = cy;
-                int fx0 = 0, fy0 = 0;
-                int fxmin = (maybe & 0b11100000) ? lc.x - 1 : lc.x;
-                int fxmax = (maybe & 0b00000111) ? lc.x + 1 : lc.x;
-                int fymin = (maybe & 0b10010100) ? lc.y - 1 : lc.y;
-                int fymax = (maybe & 0b00101001) ? lc.y + 1 : lc.y;
-                if (fxmin < 0)
-                    fx -= fxmin, fx0 -= fxmin;
-                if (fxmax >= cx)
-                    fx += fxmax + 1 - cx;
-                if (fymin < 0)
-                    fy -= fymin, fy0 -= fymin;
-                if (fymax >= cy)
-                    fy += fymax + 1 - cy;
-                loc_t lf = (loc_t){ lc.x + fx0, lc.y + fy0 };
-
-                int *fvals = calloc(fx * fy, sizeof(int));
-                for (int i = 0; i < cx; ++i)
-                    for (int j = 0; j < cy; ++j)
-                        fvals[(i + fx0) * fy + (j + fy0)] = cvals[i * cy + j];
-                fvals[lf.x * fy + lf.y] = k;
-                if (maybe & 0b10000000)
-                    fvals[(lf.x - 1) * fy + (lf.y - 1)] = 1;
-                if (maybe & 0b01000000)
-                    fvals[(lf.x - 1) * fy + (lf.y    )] = 1;
-                if (maybe & 0b00100000)
-                    fvals[(lf.x - 1) * fy + (lf.y + 1)] = 1;
-                if (maybe & 0b00010000)
-                    fvals[(lf.x    ) * fy + (lf.y - 1)] = 1;
-                if (maybe & 0b00001000)
-                    fvals[(lf.x    ) * fy + (lf.y + 1)] = 1;
-                if (maybe & 0b00000100)
-                    fvals[(lf.x + 1) * fy + (lf.y - 1)] = 1;
-                if (maybe & 0b00000010)
-                    fvals[(lf.x + 1) * fy + (lf.y    )] = 1;
-                if (maybe & 0b00000001)
-                    fvals[(lf.x + 1) * fy + (lf.y + 1)] = 1;
-
-                result->g[ri] = new_group(fx, fy, 0, fvals);
-                ref_group(result->g[ri++]);
+    /* prepare a space big enough for the maximum possible number of results */
+    maxcombs = _comb(maxavail, use);
+    for (int n = 1; n < count; ++n)
+        combos *= MAXSYM + 1;
+    c.result = new_grouplist(combos * maxcombs);
+    c.ri = 0;
+
+    /* find the symmetries of each group that fix its location: those
+     * of the first may be applied to the whole combination, those of
+     * the others to that group alone.
+     */
+    c.nstab = 0;
+    for (int n = 0; n < count; ++n) {
+        int stab = 1;
+        for (sym_t s = 1; s <= MAXSYM; ++s) {
+            if (!(g[n]->sym & (1 << s)))
+                continue;
+            loc_t lt = sym_transloc(s, g[n]->x, g[n]->y, l[n]);
+            if (lt.x == l[n].x && lt.y == l[n].y) {
+                stab |= 1 << s;
+                if (n == 0)
+                    c.stab[c.nstab++] = s;
             }
         }
-        free(cvals);
+        for (sym_t s = 0; s <= MAXSYM; ++s) {
+            c.rep[n][s] = s;
+            for (sym_t h = 1; h <= MAXSYM; ++h)
+                if ((stab & (1 << h)) && sym_compose(s, h) < c.rep[n][s])
+                    c.rep[n][s] = sym_compose(s, h);
+        }
     }
-    result->count = ri;
-    return result;
+
+    /* Now for each combination of transforms of the other groups, check
+     * first whether their 3x3 squares can be placed over the first without
+     * conflict, and still leaving enough free spots for us to add 'use' 1s.
+     * If they can, try the full monty.
+     */
+    c.s[0] = xy;
+    c.tfree[0] = c.free[0];
+    c.tneed[0] = c.need[0];
+    coalesce_fit(&c, 1);
+
+    c.result->count = c.ri;
+    return c.result;
+}
+
+/*
+ * Construct and return a grouplist of the new groups formed by adding
+ * a new value k at a common point connecting two existing groups, such
+ * that the location of that point is as specified for each of the two
+ * groups, along with 'use' 1s in any of the 8 surrounding squares that
+ * are available.
+ *
+ * Equivalent to coalesce_groups() with the two groups.
+ */
+grouplist_t *coalesce_group(
+    group_t *ga, loc_t la, group_t *gb, loc_t lb, int k, int use
+) {
+    group_t *g[2] = { ga, gb };
+    loc_t l[2] = { la, lb };
+
+    return coalesce_groups(2, g, l, k, use);
 }
@@ -15,6 +15,12 @@ typedef struct group_s {
     int sym;
     int maxsum;
     int refcount;
+    int pool;           /* size class of the block holding the group */
+    unsigned long id;   /* unique serial number */
+    int interned;       /* if made by intern_group() */
+    unsigned int hash;  /* of shape, sym and vals, if interned */
+    struct group_s *hnext;  /* next in the hash-cons bucket */
+    unsigned long canon;    /* see group_canon(), 0 if not yet known */
     int *vals;
     int **tvals;
     avail_t *avail;
@@ -23,8 +29,13 @@ typedef struct group_s {
     int *sum_chains;
 } group_t;
 
+/* the most groups that can touch one new location without touching
+ * each other, one at each corner */
+#define MAXCOALESCE 4
+
 typedef struct grouplist_t {
     int count;
+    int refcount;
     group_t *g[0];
 } grouplist_t;
 
@@ -35,6 +46,9 @@ extern void ref_group(group_t *g);
 extern void unref_group(group_t *g);
 
 extern group_t *new_group(int x, int y, int sym, int* vals);
+extern group_t *intern_group(int x, int y, int sym, int* vals);
+extern unsigned long group_canon(group_t *g);
+extern int group_same(group_t *a, group_t *b);
 extern group_t *group_place(group_t *g, loc_t loc, int k);
 
 extern grouplist_t *new_grouplist(int size);
@@ -44,5 +58,8 @@ extern grouplist_t *group_place_with(group_t *g, loc_t loc, int k, int use);
 extern grouplist_t *coalesce_group(
     group_t *g1, loc_t loc1, group_t *g2, loc_t loc2, int k, int use
 );
+extern grouplist_t *coalesce_groups(
+    int count, group_t **g, loc_t *l, int k, int use
+);
 
 #endif
@@ -1,9 +1,12 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 
 #include "board.h"
 #include "group.h"
+#include "par.h"
 #include "sym.h"
+#include "tt.h"
 
 board_t *init(int n, int freq, char *start_hist) {
     init_sym();
@@ -12,36 +15,70 @@ board_t *init(int n, int freq, char *start_hist) {
 }
 
 void finish(void) {
+    finish_tt();
     finish_board();
     finish_group();
     finish_sym();
 }
 
+/*
+ * Usage: A337663 [-t mb] [-j workers [-d split]] n [freq [start_hist]]
+ * With -t, a transposition table of up to the given size is used to
+ * avoid searching equivalent boards twice.
+ * With -j, the search below boards with k = split is shared between
+ * the given number of worker processes.
+ */
 int main(int argc, char** argv) {
     board_t *b;
-    int n = 2, freq = 100;
+    int n = 2, freq = 100, workers = 0, split = 6, tt_mb = 0, opt;
+    char *start_hist;
 
     setvbuf(stdout, (char *)NULL, _IOLBF, 0);
 
+    while ((opt = getopt(argc, argv, "t:j:d:")) != -1) {
+        switch (opt) {
+            case 't':
+                tt_mb = atoi(optarg);
+                break;
+            case 'j':
+                workers = atoi(optarg);
+                break;
+            case 'd':
+                split = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-t mb] [-j workers [-d split]]"
+                        " n [freq [start_hist]]\n", argv[0]);
+                exit(1);
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
     if (argc > 1) {
         n = atoi(argv[1]);
-        if (n >= 9) {
-            fprintf(stderr, "Cannot yet calculate n >= 9, need to be able to"
-                    " coalesce more than 2 groups simultaneously\n");
-            exit(1);
-        }
         if (n < 1) {
-            fprintf(stderr, "Error, need 1 <= n <= 8\n");
+            fprintf(stderr, "Error, need n >= 1\n");
             exit(1);
         }
     }
     if (argc > 2) {
         freq = atoi(argv[2]);
     }
+    start_hist = (argc > 3) ? argv[3] : (char*)NULL;
+    if (workers && (start_hist || split < 3)) {
+        fprintf(stderr, "Error, -j needs split >= 3 and no start_hist\n");
+        exit(1);
+    }
 
-    b = init(n, freq, (argc > 3) ? argv[3] : (char*)NULL);
-    try_board(b);
+    init_tt(tt_mb);
+    b = init(n, freq, start_hist);
+    if (workers)
+        par_search(workers, split);
+    else
+        try_board(b);
     printf("a(%d) = %d (%lu)\n", n, best_k, board_count);
+    tt_report();
 
     finish();
     return 0;
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "board.h"
+#include "par.h"
+#include "tt.h"
+
+/*
+ * Parallel search: the top of the tree is searched here up to boards
+ * with k = split, and the history leading to each of those is saved as
+ * a job. Forked workers then take jobs in turn and search the subtree
+ * of each, sharing best_k through anonymous shared memory; the counts
+ * and best results of the jobs are merged here at the end. Each worker
+ * has its own copy of any transposition table, cleared for each job so
+ * that the count of a job does not depend on which worker ran it.
+ */
+
+typedef struct par_shared_s {
+    int best_k;                 /* best seen by anyone, raised atomically */
+    int next_job;               /* index of the next job to take */
+    tt_stats_t tt;              /* totals over the workers */
+    struct {
+        int best_k;
+        unsigned long count;
+    } job[0];
+} par_shared_t;
+
+int par_jobs = 0;
+int par_size = 0;
+char **par_hist = NULL;
+
+static void par_add(char *hist) {
+    if (par_jobs == par_size) {
+        par_size = par_size ? par_size * 2 : 64;
+        par_hist = realloc(par_hist, par_size * sizeof(char *));
+    }
+    par_hist[par_jobs++] = strdup(hist);
+}
+
+static void par_work(par_shared_t *sh) {
+    /* the parent keeps the stats of the top of the tree */
+    tt_stats = (tt_stats_t){ 0, 0, 0 };
+    while (1) {
+        int j = __atomic_fetch_add(&sh->next_job, 1, __ATOMIC_RELAXED);
+        if (j >= par_jobs)
+            break;
+        clear_tt();
+        sh->job[j].count = try_subtree(j, par_hist[j], &sh->best_k);
+        sh->job[j].best_k = best_k;
+    }
+    __atomic_fetch_add(&sh->tt.lookups, tt_stats.lookups, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&sh->tt.hits, tt_stats.hits, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&sh->tt.evictions, tt_stats.evictions,
+            __ATOMIC_RELAXED);
+}
+
+/*
+ * Search the board set up by init_board() using 'workers' processes,
+ * splitting the tree at k = split. On return best_k and board_count
+ * hold the merged results, as if the search had been done in one go.
+ */
+void par_search(int workers, int split) {
+    size_t size;
+    par_shared_t *sh;
+
+    split_board(split, par_add);
+
+    size = sizeof(par_shared_t) + par_jobs * sizeof(sh->job[0]);
+    sh = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sh == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+    }
+    sh->best_k = best_k;
+    sh->next_job = 0;
+    sh->tt = (tt_stats_t){ 0, 0, 0 };
+
+    fflush(stdout);
+    for (int i = 0; i < workers; ++i) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            par_work(sh);
+            fflush(stdout);
+            _exit(0);
+        }
+    }
+    for (int i = 0; i < workers; ++i) {
+        int status;
+        if (wait(&status) < 0 || !WIFEXITED(status)
+            || WEXITSTATUS(status) != 0
+        ) {
+            fprintf(stderr, "Error: worker failed\n");
+            exit(1);
+        }
+    }
+
+    for (int j = 0; j < par_jobs; ++j) {
+        board_count += sh->job[j].count;
+        if (best_k < sh->job[j].best_k)
+            best_k = sh->job[j].best_k;
+        free(par_hist[j]);
+    }
+    free(par_hist);
+    tt_stats.lookups += sh->tt.lookups;
+    tt_stats.hits += sh->tt.hits;
+    tt_stats.evictions += sh->tt.evictions;
+    munmap(sh, size);
+}
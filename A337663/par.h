@@ -0,0 +1,6 @@
+#ifndef PAR_H
+#define PAR_H
+
+extern void par_search(int workers, int split);
+
+#endif
@@ -16,6 +16,10 @@ pack_set_t pack_set[9];
  */
 int lookup[(MAXSYM + 1) * 256];
 
+/* compose[a * 8 + b] is the symmetry equivalent to applying b then a.
+ */
+sym_t compose[(MAXSYM + 1) * (MAXSYM + 1)];
+
 void init_sym(void) {
     for (int i = 0; i < 8; ++i)
         for (int j = 0; j < (1 << i); ++j)
@@ -45,6 +49,23 @@ void init_sym(void) {
         for (int k = 0; k < 8; ++k)
             lookup[k * 256 + i] = t[k];
     }
+
+    /* the symmetries act faithfully on the 8 neighbours, so a composition
+     * is identified by where it sends each of them
+     */
+    for (sym_t a = 0; a <= MAXSYM; ++a)
+        for (sym_t b = 0; b <= MAXSYM; ++b)
+            for (sym_t c = 0; c <= MAXSYM; ++c) {
+                int j;
+                for (j = 0; j < 8; ++j)
+                    if (lookup[c * 256 + (1 << j)]
+                            != lookup[a * 256 + lookup[b * 256 + (1 << j)]])
+                        break;
+                if (j == 8) {
+                    compose[a * (MAXSYM + 1) + b] = c;
+                    break;
+                }
+            }
 }
 
 void finish_sym(void) {
@@ -83,6 +104,13 @@ int *sym_lookup(sym_t s) {
     return &lookup[256 * s];
 }
 
+/*
+    Return the symmetry equivalent to applying t and then s.
+*/
+sym_t sym_compose(sym_t s, sym_t t) {
+    return compose[s * (MAXSYM + 1) + t];
+}
+
 /*
     Return true if t is non-canonical, when copmosed with this symmetry.
 
@@ -18,6 +18,7 @@ int all_sym = (1 << xY) | (1 << Xy) | (1 << XY)
 group_t *_parse_group(pgroup_t pg) {
     int *vals = parse_vals(pg.x, pg.y, pg.str);
     group_t *g = new_group(pg.x, pg.y, pg.syms, vals);
+    free(vals);
     ref_group(g);
     return g;
 }
@@ -218,8 +219,8 @@ void test_coalesce(void) {
         (pgroup_t){ 4, 4, 0, "1 0 0 0; 1 3 0 1; 0 0 4 1; 0 2 0 0" },
         (pgroup_t){ 4, 4, 0, "1 0 0 0; 1 3 0 1; 0 0 4 0; 0 2 0 1" },
         (pgroup_t){ 4, 4, 0, "1 0 0 0; 1 3 0 0; 0 0 4 1; 0 2 0 1" },
-        /* YX */
-        (pgroup_t){ 4, 4, 0, "0 0 1 1; 1 0 3 0; 0 4 0 0; 2 0 1 0" },
+        /* XY */
+        (pgroup_t){ 4, 4, 0, "0 0 0 1; 1 0 3 1; 0 4 0 0; 2 0 1 0" },
     };
 
     grouplist_t *expect = new_grouplist(count);
@@ -231,10 +232,9 @@ void test_coalesce(void) {
     free_grouplist(expect);
 
     /* Should work identically if we swap the groups and associated
-     * locations, but in this case we don't suppress all the symmetries, so
-     * we end up with 2 copies of each result. See TODO in coalesce_group().
+     * locations.
      */
-    expect = new_grouplist(count * 2);
+    expect = new_grouplist(count);
     for (int i = 0; i < count; ++i) {
         group_t *g = _parse_group(pexpect[i]), *gt;
         int x = g->x, y = g->y, *v;
@@ -243,26 +243,125 @@ void test_coalesce(void) {
          */
         sym_t s = (0 <= i && i <= 2) ? xY
             : (3 <= i && i <= 5) ? Xy
-            : yx;
+            : XY;
         v = sym_transform(s, x, y, g->vals);
         if (is_transpose(s))
             gt = new_group(y, x, 0, v);
         else
             gt = new_group(x, y, 0, v);
+        free(v);
         unref_group(g);
         ref_group(gt);
-        expect->g[i * 2] = gt;
-        ref_group(gt);
-        expect->g[i * 2 + 1] = gt;
+        expect->g[i] = gt;
     }
     got = coalesce_group(g2, l2, g1, l1, 4, 2);
-    printf("# (TODO) Should return groups without duplication\n");
     is_grouplist(got, expect, "group_coalesce (b, a) with 2");
     free_grouplist(got);
     free_grouplist(expect);
 
     unref_group(g1);
     unref_group(g2);
+#undef count
+}
+
+/*
+ * Lone 2, 3, 4 (and 5) meeting at a new location diagonally adjacent to
+ * each: the first is held at the bottom right, the others may take any of
+ * the remaining corners. Each distinct combination must appear only once.
+ */
+void test_coalesce_many(void) {
+    group_t *g[4];
+    loc_t l[4];
+    for (int i = 0; i < 4; ++i) {
+        char v[2] = { '2' + i, 0 };
+        g[i] = _parse_group((pgroup_t){ 1, 1, all_sym, v });
+        l[i] = (loc_t){ -1, -1 };
+    }
+
+    pgroup_t pexpect3[3] = {
+        (pgroup_t){ 3, 3, 0, "0 0 4; 0 9 0; 3 0 2" },
+        (pgroup_t){ 3, 3, 0, "4 0 0; 0 9 0; 3 0 2" },
+        (pgroup_t){ 3, 3, 0, "3 0 0; 0 9 0; 4 0 2" },
+    };
+    grouplist_t *expect = new_grouplist(3);
+    for (int i = 0; i < 3; ++i)
+        expect->g[i] = _parse_group(pexpect3[i]);
+    grouplist_t *got = coalesce_groups(3, g, l, 9, 0);
+    is_grouplist(got, expect, "coalesce_groups 3 corners");
+    free_grouplist(got);
+    free_grouplist(expect);
+
+    /* the only spot not next to a group is the remaining corner */
+    pgroup_t pexpect3w[3] = {
+        (pgroup_t){ 3, 3, 0, "1 0 4; 0 10 0; 3 0 2" },
+        (pgroup_t){ 3, 3, 0, "4 0 1; 0 10 0; 3 0 2" },
+        (pgroup_t){ 3, 3, 0, "3 0 1; 0 10 0; 4 0 2" },
+    };
+    expect = new_grouplist(3);
+    for (int i = 0; i < 3; ++i)
+        expect->g[i] = _parse_group(pexpect3w[i]);
+    got = coalesce_groups(3, g, l, 10, 1);
+    is_grouplist(got, expect, "coalesce_groups 3 corners with 1");
+    free_grouplist(got);
+    free_grouplist(expect);
+
+    pgroup_t pexpect4[3] = {
+        (pgroup_t){ 3, 3, 0, "5 0 4; 0 14 0; 3 0 2" },
+        (pgroup_t){ 3, 3, 0, "4 0 5; 0 14 0; 3 0 2" },
+        (pgroup_t){ 3, 3, 0, "3 0 5; 0 14 0; 4 0 2" },
+    };
+    expect = new_grouplist(3);
+    for (int i = 0; i < 3; ++i)
+        expect->g[i] = _parse_group(pexpect4[i]);
+    got = coalesce_groups(4, g, l, 14, 0);
+    is_grouplist(got, expect, "coalesce_groups 4 corners");
+    free_grouplist(got);
+    free_grouplist(expect);
+
+    /* the second group may take either corner next to the first, but
+     * those are mirror images so only one of them is returned
+     */
+    pgroup_t pexpect2[4] = {
+        (pgroup_t){ 3, 3, 0, "0 1 1; 0 5 0; 3 0 2" },
+        (pgroup_t){ 3, 3, 0, "1 0 1; 0 5 0; 3 0 2" },
+        (pgroup_t){ 3, 3, 0, "1 1 0; 0 5 0; 3 0 2" },
+        (pgroup_t){ 3, 3, 0, "3 0 1; 0 5 0; 1 0 2" },
+    };
+    expect = new_grouplist(4);
+    for (int i = 0; i < 4; ++i)
+        expect->g[i] = _parse_group(pexpect2[i]);
+    got = coalesce_groups(2, g, l, 5, 2);
+    is_grouplist(got, expect, "coalesce_groups 2 corners with 2");
+    free_grouplist(got);
+    free_grouplist(expect);
+
+    for (int i = 0; i < 4; ++i)
+        unref_group(g[i]);
+}
+
+void test_canon(void) {
+    group_t *g = _parse_group((pgroup_t){ 2, 3, 0, "1 3 0; 1 0 2" });
+    group_t *h = _parse_group((pgroup_t){ 2, 3, 0, "1 3 0; 0 1 2" });
+    unsigned long canon = group_canon(g);
+
+    for (sym_t s = 1; s <= MAXSYM; ++s) {
+        int *v = sym_transform(s, g->x, g->y, g->vals);
+        group_t *gt = is_transpose(s)
+            ? new_group(g->y, g->x, 0, v) : new_group(g->x, g->y, 0, v);
+        free(v);
+        ref_group(gt);
+        is_bool(group_canon(gt) == canon, true,
+                "group_canon same under transform %d", s);
+        is_bool(group_same(g, gt), true,
+                "group_same under transform %d", s);
+        unref_group(gt);
+    }
+    is_bool(group_canon(h) != canon, true,
+            "group_canon differs for a different group");
+    is_bool(group_same(g, h), false,
+            "group_same false for a different group");
+    unref_group(g);
+    unref_group(h);
 }
 
 int main(void) {
@@ -273,6 +372,8 @@ int main(void) {
     test_place();
     test_place_with();
     test_coalesce();
+    test_coalesce_many();
+    test_canon();
 
     finish_group();
     finish_sym();
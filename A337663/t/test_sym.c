@@ -134,6 +134,30 @@ void test_dup(void) {
     }
 }
 
+void test_compose(void) {
+    int base[6] = { 1, 2, 3, 4, 5, 6 };
+    int bad = 0;
+
+    for (sym_t s = 0; s <= MAXSYM; ++s)
+        for (sym_t t = 0; t <= MAXSYM; ++t) {
+            /* apply t then s to an asymmetric 2x3 grid */
+            int *vt = sym_transform(t, 2, 3, &base[0]);
+            int *vst = is_transpose(t)
+                ? sym_transform(s, 3, 2, vt)
+                : sym_transform(s, 2, 3, vt);
+            int *vc = sym_transform(sym_compose(s, t), 2, 3, &base[0]);
+            for (int i = 0; i < 6; ++i)
+                if (vst[i] != vc[i]) {
+                    ++bad;
+                    break;
+                }
+            free(vt);
+            free(vst);
+            free(vc);
+        }
+    is_int(bad, 0, "sym_compose matches applying each in turn");
+}
+
 int main(void) {
     init_test();
     init_sym();
@@ -143,6 +167,7 @@ int main(void) {
     test_asym();
     test_loc();
     test_dup();
+    test_compose();
 
     finish_sym();
     done_testing();
@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "board.h"
+#include "tt.h"
+
+/*
+ * Transposition table: the boards already searched, so that a board
+ * reached again by a different sequence of moves can be cut off. A
+ * board is identified by a hash of its k, unused and the multiset of
+ * its groups each up to symmetry, since those alone determine what
+ * can follow. A hit cuts off the whole subtree, so the key only finds
+ * a candidate: each entry holds references to the groups of its board,
+ * in canonical order, and those must match exactly up to symmetry.
+ *
+ * The table is set-associative, with TT_WAYS entries in each bucket.
+ * When a bucket is full the entry with the highest k is evicted, since
+ * that is likely to have the smallest subtree.
+ */
+#define TT_WAYS 4
+typedef struct tt_entry_s {
+    unsigned long key;          /* 0 if unused */
+    int k;
+    int unused;
+    int groups;
+    group_t *group[MAXGROUPS];  /* referenced, in canonical order */
+} tt_entry_t;
+
+tt_entry_t *tt_table = NULL;
+unsigned long tt_buckets = 0;   /* a power of 2, or 0 if disabled */
+tt_stats_t tt_stats;
+
+/*
+ * Set up a table using up to 'mb' megabytes; 0 disables it.
+ */
+void init_tt(int mb) {
+    unsigned long want = (unsigned long)mb << 20;
+    size_t bucket = TT_WAYS * sizeof(tt_entry_t);
+
+    tt_buckets = 0;
+    if (want < bucket)
+        return;
+    for (tt_buckets = 1; tt_buckets * 2 * bucket <= want; tt_buckets *= 2)
+        ;
+    tt_table = calloc(tt_buckets * TT_WAYS, sizeof(tt_entry_t));
+    if (!tt_table) {
+        fprintf(stderr, "Error: cannot allocate %d MB for the table\n", mb);
+        exit(1);
+    }
+}
+
+/*
+ * Empty an entry, releasing its groups.
+ */
+static void tt_drop(tt_entry_t *e) {
+    for (int i = 0; i < e->groups; ++i)
+        unref_group(e->group[i]);
+    e->key = 0;
+    e->groups = 0;
+}
+
+/*
+ * Forget all the boards seen so far.
+ */
+void clear_tt(void) {
+    for (unsigned long i = 0; i < tt_buckets * TT_WAYS; ++i)
+        if (tt_table[i].key)
+            tt_drop(&tt_table[i]);
+}
+
+void finish_tt(void) {
+    clear_tt();
+    free(tt_table);
+    tt_table = NULL;
+    tt_buckets = 0;
+}
+
+static unsigned long tt_mix(unsigned long h) {
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ul;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebul;
+    h ^= h >> 31;
+    return h;
+}
+
+/*
+ * Return TRUE if the entry holds the same board as 'b', whose groups
+ * are given in canonical order in 'group'. Groups whose canonical hashes
+ * tie may be ordered differently, which can only lose a hit.
+ */
+static int tt_same(tt_entry_t *e, board_t *b, group_t **group) {
+    if (e->k != b->k || e->unused != b->unused || e->groups != b->groups)
+        return 0;
+    for (int i = 0; i < b->groups; ++i)
+        if (!group_same(e->group[i], group[i]))
+            return 0;
+    return 1;
+}
+
+/*
+ * Return TRUE if a board equivalent to this one has already been seen;
+ * else record it and return FALSE. Always FALSE if there is no table.
+ */
+int tt_seen(board_t *b) {
+    unsigned long canon[MAXGROUPS], key;
+    group_t *group[MAXGROUPS];
+    tt_entry_t *e, *victim;
+
+    if (!tt_buckets)
+        return 0;
+    ++tt_stats.lookups;
+
+    /* sort the canonical hashes, so the order of groups doesn't matter */
+    for (int i = 0; i < b->groups; ++i) {
+        unsigned long c = group_canon(b->group[i]);
+        int j = i;
+        for (; j > 0 && canon[j - 1] > c; --j) {
+            canon[j] = canon[j - 1];
+            group[j] = group[j - 1];
+        }
+        canon[j] = c;
+        group[j] = b->group[i];
+    }
+    key = tt_mix(((unsigned long)b->k << 32) | b->unused);
+    for (int i = 0; i < b->groups; ++i)
+        key = tt_mix(key ^ canon[i]);
+    if (key == 0)
+        key = 1;
+
+    e = &tt_table[(key & (tt_buckets - 1)) * TT_WAYS];
+    victim = NULL;
+    for (int i = 0; i < TT_WAYS; ++i) {
+        if (e[i].key == key && tt_same(&e[i], b, group)) {
+            ++tt_stats.hits;
+            return 1;
+        }
+        if (!victim || (victim->key && (!e[i].key || e[i].k > victim->k)))
+            victim = &e[i];
+    }
+    if (victim->key) {
+        ++tt_stats.evictions;
+        tt_drop(victim);
+    }
+    victim->key = key;
+    victim->k = b->k;
+    victim->unused = b->unused;
+    victim->groups = b->groups;
+    for (int i = 0; i < b->groups; ++i) {
+        victim->group[i] = group[i];
+        ref_group(group[i]);
+    }
+    return 0;
+}
+
+/*
+ * Report how well the table did.
+ */
+void tt_report(void) {
+    if (!tt_buckets)
+        return;
+    printf("tt: %lu entries, %lu lookups, %lu hits (%.2f%%), %lu evictions\n",
+            tt_buckets * TT_WAYS, tt_stats.lookups, tt_stats.hits,
+            tt_stats.lookups ? 100.0 * tt_stats.hits / tt_stats.lookups : 0.0,
+            tt_stats.evictions);
+}
@@ -0,0 +1,20 @@
+#ifndef TT_H
+#define TT_H
+
+#include "board.h"
+
+typedef struct tt_stats_s {
+    unsigned long lookups;
+    unsigned long hits;
+    unsigned long evictions;
+} tt_stats_t;
+
+extern tt_stats_t tt_stats;
+
+extern void init_tt(int mb);
+extern void finish_tt(void);
+extern void clear_tt(void);
+extern int tt_seen(board_t *b);
+extern void tt_report(void);
+
+#endif
@@ -1,4 +1,6 @@
 #include "main.c"
 #include "board.c"
 #include "group.c"
+#include "par.c"
 #include "sym.c"
+#include "tt.c"